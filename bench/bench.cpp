@@ -0,0 +1,365 @@
+// Measures the throughput of the streamed audio packer on a generated corpus and prints the results as JSON.
+#include "synth_corpus.h"
+#include "hash_bench.h"
+#include "hash.h"
+#include "streamed_audio.h"
+#include "pack_report.h"
+#include "archive.h"
+#include "filebox.h"
+#include "memory_budget.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#if defined(_WIN32)
+// filebox.cpp parents its dialogs to the main window. The benchmark never opens one.
+HWND gHwnd = nullptr;
+#endif
+
+typedef struct BenchArgs {
+    const char* outPath = nullptr;
+    const char* corpusDir = nullptr;
+    const char* workDir = nullptr;
+    const char* archiveExt = ".o2r";
+    uint64_t memoryBudget = GetDefaultMemoryBudget();
+    size_t hashSizeMiB = 256;
+    unsigned int iterations = 3;
+    float durationScale = 1.0f;
+    bool transcodeToOpus = true;
+    bool keep = false;
+} BenchArgs;
+
+typedef struct BenchInput {
+    std::string path;
+    std::string name;
+} BenchInput;
+
+// Timings of one pass over a set of files.
+typedef struct BenchRun {
+    PackFileRecord record;
+    double packMs;
+    // libzip does all of its compression and writing here.
+    double closeMs;
+} BenchRun;
+
+typedef struct BenchCase {
+    std::string name;
+    std::vector<BenchRun> runs;
+} BenchCase;
+
+static void PrintUsage() {
+    fprintf(stderr,
+        "Usage: future_bench [options]\n"
+        "  --out <file>          Write the results to <file> instead of stdout.\n"
+        "  --iterations <n>      Times each case is packed. The fastest run is reported. Default 3.\n"
+        "  --scale <f>           Multiply the length of the generated songs by <f>. Default 1.\n"
+        "  --corpus <dir>        Also benchmark the audio files in <dir>. Use this for MP3, which can't be generated.\n"
+        "  --work-dir <dir>      Where the corpus and archives are written. Default is a temporary directory.\n"
+        "  --archive <o2r|otr>   Type of archive to pack into. Default o2r.\n"
+        "  --no-opus             Don't transcode uncompressed files to opus.\n"
+        "  --memory-budget <MiB> Memory the packer's workers can use at once. 0 for no limit. Default is half of RAM.\n"
+        "  --hash-size <MiB>     Amount of data to hash when measuring the hashes. 0 skips them. Default 256.\n"
+        "  --keep                Don't delete the work directory when done.\n");
+}
+
+static bool ParseArgs(int argc, char** argv, BenchArgs* args) {
+    for (int i = 1; i < argc; i++) {
+        const bool hasValue = i + 1 < argc;
+        if (strcmp(argv[i], "--out") == 0 && hasValue) {
+            args->outPath = argv[++i];
+        } else if (strcmp(argv[i], "--iterations") == 0 && hasValue) {
+            args->iterations = std::max(1ul, strtoul(argv[++i], nullptr, 10));
+        } else if (strcmp(argv[i], "--scale") == 0 && hasValue) {
+            args->durationScale = strtof(argv[++i], nullptr);
+        } else if (strcmp(argv[i], "--corpus") == 0 && hasValue) {
+            args->corpusDir = argv[++i];
+        } else if (strcmp(argv[i], "--work-dir") == 0 && hasValue) {
+            args->workDir = argv[++i];
+        } else if (strcmp(argv[i], "--archive") == 0 && hasValue) {
+            i++;
+            if (strcmp(argv[i], "otr") == 0) {
+                args->archiveExt = ".otr";
+            } else if (strcmp(argv[i], "o2r") == 0) {
+                args->archiveExt = ".o2r";
+            } else {
+                fprintf(stderr, "Unknown archive type %s\n", argv[i]);
+                return false;
+            }
+        } else if (strcmp(argv[i], "--memory-budget") == 0 && hasValue) {
+            args->memoryBudget = strtoull(argv[++i], nullptr, 10) * 1024 * 1024;
+        } else if (strcmp(argv[i], "--hash-size") == 0 && hasValue) {
+            args->hashSizeMiB = strtoull(argv[++i], nullptr, 10);
+        } else if (strcmp(argv[i], "--no-opus") == 0) {
+            args->transcodeToOpus = false;
+        } else if (strcmp(argv[i], "--keep") == 0) {
+            args->keep = true;
+        } else {
+            fprintf(stderr, "Unknown option %s\n", argv[i]);
+            return false;
+        }
+    }
+    if (args->durationScale <= 0.0f) {
+        fprintf(stderr, "--scale must be greater than 0\n");
+        return false;
+    }
+    return true;
+}
+
+// `ProcessAudioFile` marks processed paths with the lowest bit so they need 2 byte alignment.
+static char* CopyQueuePath(const std::string& path) {
+    char* out = (char*)operator new[](path.size() + 1, std::align_val_t(2));
+    memcpy(out, path.c_str(), path.size() + 1);
+    return out;
+}
+
+static double MsSince(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Packs `inputs` into a new archive at `archivePath`. The records of every file are added to `records`.
+static bool PackInputs(const std::vector<const BenchInput*>& inputs, const char* archivePath, bool transcodeToOpus, uint64_t memoryBudget,
+                       std::vector<PackFileRecord>& records, BenchRun* run) {
+    std::vector<char*> fileQueue;
+    std::unordered_map<char*, SeqMetaInfo> seqMetaMap;
+    std::atomic<unsigned int> filesProcessed = 0;
+    PackReport report;
+
+    std::filesystem::remove(archivePath);
+    std::unique_ptr<Archive> a = CreateWriteOnlyArchiveOfType(GetArchiveTypeFromExt(archivePath), archivePath);
+    if (a == nullptr || !a->IsArchiveOpen()) {
+        fprintf(stderr, "Failed to create %s\n", archivePath);
+        return false;
+    }
+    for (const auto in : inputs) {
+        fileQueue.push_back(CopyQueuePath(in->path));
+    }
+    FillSeqMetaMap(fileQueue, seqMetaMap);
+
+    auto start = std::chrono::steady_clock::now();
+    const bool packed = PackStreamedAudio(&fileQueue, &seqMetaMap, false, transcodeToOpus, &filesProcessed, memoryBudget, &report, a.get());
+    run->packMs = MsSince(start);
+    start = std::chrono::steady_clock::now();
+    a->CloseArchive();
+    run->closeMs = MsSince(start);
+
+    ClearStreamedFileQueue(&fileQueue);
+    records.insert(records.end(), report.GetRecords().begin(), report.GetRecords().end());
+    return packed;
+}
+
+static void CollectCorpusDir(const char* dir, std::vector<BenchInput>& inputs) {
+    std::error_code ec;
+    std::vector<BenchInput> found;
+    for (const auto& entry : std::filesystem::directory_iterator(dir, ec)) {
+        if (!entry.is_regular_file()) {
+            continue;
+        }
+        std::string path = entry.path().string();
+        if (IsStreamedAudioFile(path.data())) {
+            found.push_back({ path, entry.path().filename().string() });
+        }
+    }
+    if (ec) {
+        fprintf(stderr, "Failed to read %s: %s\n", dir, ec.message().c_str());
+    }
+    std::sort(found.begin(), found.end(), [](const BenchInput& a, const BenchInput& b) {
+        return a.name < b.name;
+    });
+    inputs.insert(inputs.end(), found.begin(), found.end());
+}
+
+static const BenchRun* GetFastestRun(const std::vector<BenchRun>& runs) {
+    const BenchRun* best = &runs[0];
+    for (const auto& r : runs) {
+        if (r.packMs + r.closeMs < best->packMs + best->closeMs) {
+            best = &r;
+        }
+    }
+    return best;
+}
+
+static double GetMedianMs(const std::vector<BenchRun>& runs) {
+    std::vector<double> ms;
+    for (const auto& r : runs) {
+        ms.push_back(r.packMs + r.closeMs);
+    }
+    std::sort(ms.begin(), ms.end());
+    if (ms.size() % 2 == 0) {
+        return (ms[ms.size() / 2 - 1] + ms[ms.size() / 2]) / 2.0;
+    }
+    return ms[ms.size() / 2];
+}
+
+static double FramesPerSecond(uint64_t numFrames, double ms) {
+    if (ms <= 0.0) {
+        return 0.0;
+    }
+    return (double)numFrames * 1000.0 / ms;
+}
+
+static void WriteJsonString(FILE* file, const char* s) {
+    fputc('"', file);
+    for (; *s != 0; s++) {
+        if (*s == '"' || *s == '\\') {
+            fputc('\\', file);
+        }
+        if ((unsigned char)*s < 0x20) {
+            fprintf(file, "\\u%04x", (unsigned char)*s);
+        } else {
+            fputc(*s, file);
+        }
+    }
+    fputc('"', file);
+}
+
+static void WriteCase(FILE* file, const BenchCase* c) {
+    const BenchRun* best = GetFastestRun(c->runs);
+    const PackFileRecord* r = &best->record;
+
+    fprintf(file, "    {\"name\": ");
+    WriteJsonString(file, c->name.c_str());
+    fprintf(file, ", \"input_format\": \"%s\", \"output_format\": \"%s\", \"channels\": %u, \"sample_rate\": %llu, \"frames\": %llu,\n",
+            r->inputFormat, r->outputFormat, r->channels, (unsigned long long)r->sampleRate, (unsigned long long)r->numFrames);
+    fprintf(file, "     \"input_bytes\": %llu, \"output_bytes\": %llu, \"failed\": %s,\n", (unsigned long long)r->inputSize,
+            (unsigned long long)r->outputSize, r->failed ? "true" : "false");
+    fprintf(file, "     \"best_ms\": %.3f, \"median_ms\": %.3f, \"close_ms\": %.3f, \"frames_per_s\": %.0f,\n",
+            best->packMs + best->closeMs, GetMedianMs(c->runs), best->closeMs, FramesPerSecond(r->numFrames, best->packMs + best->closeMs));
+    fprintf(file, "     \"stages\": {");
+    for (size_t s = 0; s < (size_t)PackStage::Max; s++) {
+        // Stages that don't apply to this format are left out instead of reported as infinitely fast.
+        const double ms = r->stageMs[s];
+        fprintf(file, "%s\"%s\": {\"ms\": %.3f, \"frames_per_s\": ", s == 0 ? "" : ", ", PackStageToStr((PackStage)s), ms);
+        if (ms > 0.0) {
+            fprintf(file, "%.0f}", FramesPerSecond(r->numFrames, ms));
+        } else {
+            fprintf(file, "null}");
+        }
+    }
+    fprintf(file, "}}");
+}
+
+int main(int argc, char** argv) {
+    BenchArgs args;
+    std::vector<SynthFile> synthFiles;
+    std::vector<BenchInput> inputs;
+    std::vector<BenchCase> cases;
+    std::vector<BenchRun> batchRuns;
+    uint64_t batchFrames = 0;
+
+    if (!ParseArgs(argc, argv, &args)) {
+        PrintUsage();
+        return 2;
+    }
+    SetHeadless(true);
+    // Timing a CRC that gives the wrong result is pointless, and the mismatch needs to be noticed.
+    if (args.hashSizeMiB != 0 && !CheckCrc64Impls()) {
+        fprintf(stderr, "The CRC64 implementations don't match each other\n");
+        return 1;
+    }
+
+    std::filesystem::path workDir = args.workDir != nullptr ? std::filesystem::path(args.workDir)
+                                                            : std::filesystem::temp_directory_path() / "future_bench";
+    const std::filesystem::path corpusDir = workDir / "corpus";
+    const std::string archivePath = (workDir / (std::string("out") + args.archiveExt)).string();
+    std::filesystem::create_directories(corpusDir);
+
+    fprintf(stderr, "Generating corpus in %s\n", corpusDir.string().c_str());
+    auto start = std::chrono::steady_clock::now();
+    if (!GenerateSynthCorpus(corpusDir.string().c_str(), args.durationScale, synthFiles)) {
+        return 1;
+    }
+    fprintf(stderr, "Generated %zu files in %.0fms\n", synthFiles.size(), MsSince(start));
+    for (const auto& f : synthFiles) {
+        inputs.push_back({ f.path, f.name });
+    }
+    if (args.corpusDir != nullptr) {
+        CollectCorpusDir(args.corpusDir, inputs);
+    }
+
+    // Each file on its own. Only one worker thread gets a file so stage times aren't skewed by contention.
+    for (const auto& in : inputs) {
+        BenchCase c;
+        c.name = in.name;
+        fprintf(stderr, "%s\n", in.name.c_str());
+        for (unsigned int i = 0; i < args.iterations; i++) {
+            std::vector<PackFileRecord> records;
+            BenchRun run;
+            if (!PackInputs({ &in }, archivePath.c_str(), args.transcodeToOpus, args.memoryBudget, records, &run) || records.empty()) {
+                return 1;
+            }
+            run.record = records[0];
+            c.runs.push_back(run);
+        }
+        cases.push_back(std::move(c));
+    }
+
+    // Everything at once on every thread, the way the window packs.
+    std::vector<const BenchInput*> all;
+    for (const auto& in : inputs) {
+        all.push_back(&in);
+    }
+    fprintf(stderr, "All files\n");
+    for (unsigned int i = 0; i < args.iterations; i++) {
+        std::vector<PackFileRecord> records;
+        BenchRun run{};
+        if (!PackInputs(all, archivePath.c_str(), args.transcodeToOpus, args.memoryBudget, records, &run)) {
+            return 1;
+        }
+        batchFrames = 0;
+        for (const auto& r : records) {
+            batchFrames += r.numFrames;
+        }
+        batchRuns.push_back(run);
+    }
+
+    FILE* file = stdout;
+    if (args.outPath != nullptr) {
+        file = fopen(args.outPath, "w");
+        if (file == nullptr) {
+            fprintf(stderr, "Failed to open %s\n", args.outPath);
+            return 1;
+        }
+    }
+
+    const BenchRun* bestBatch = GetFastestRun(batchRuns);
+    fprintf(file, "{\n  \"version\": 1,\n");
+    fprintf(file, "  \"config\": {\"iterations\": %u, \"scale\": %g, \"archive\": \"%s\", \"transcode_to_opus\": %s, \"threads\": %u, \"memory_budget\": %llu},\n",
+            args.iterations, args.durationScale, args.archiveExt + 1, args.transcodeToOpus ? "true" : "false",
+            std::thread::hardware_concurrency(), (unsigned long long)args.memoryBudget);
+    fprintf(file, "  \"files\": [\n");
+    for (size_t i = 0; i < cases.size(); i++) {
+        WriteCase(file, &cases[i]);
+        fprintf(file, "%s\n", i + 1 < cases.size() ? "," : "");
+    }
+    fprintf(file, "  ],\n");
+    fprintf(file, "  \"batch\": {\"files\": %zu, \"frames\": %llu, \"best_ms\": %.3f, \"median_ms\": %.3f, \"close_ms\": %.3f, \"frames_per_s\": %.0f}",
+            inputs.size(), (unsigned long long)batchFrames, bestBatch->packMs + bestBatch->closeMs, GetMedianMs(batchRuns), bestBatch->closeMs,
+            FramesPerSecond(batchFrames, bestBatch->packMs + bestBatch->closeMs));
+    if (args.hashSizeMiB != 0) {
+        fprintf(stderr, "Hashes\n");
+        fprintf(file, ",\n  \"hash\": ");
+        WriteHashBench(file, args.hashSizeMiB, args.iterations);
+    }
+    fprintf(file, "\n}\n");
+    if (file != stdout) {
+        fclose(file);
+    }
+
+    if (!args.keep) {
+        // Only remove what was created here in case --work-dir points somewhere that has other files.
+        std::error_code ec;
+        std::filesystem::remove_all(corpusDir, ec);
+        std::filesystem::remove(archivePath, ec);
+        std::filesystem::remove(workDir, ec);
+    }
+    return 0;
+}
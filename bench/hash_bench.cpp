@@ -0,0 +1,66 @@
+#include "hash_bench.h"
+#include "hash.h"
+#include <chrono>
+#include <cstdint>
+#include <vector>
+
+typedef struct HashBenchCase {
+    const char* name;
+    uint64_t (*fn)(const uint8_t* data, size_t size);
+} HashBenchCase;
+
+static uint64_t RunCrc64Table(const uint8_t* data, size_t size) {
+    return Crc64UpdateTable(INITIAL_CRC64, data, size);
+}
+
+static uint64_t RunCrc64Clmul(const uint8_t* data, size_t size) {
+    return Crc64UpdateClmul(INITIAL_CRC64, data, size);
+}
+
+static uint64_t RunContentHash64(const uint8_t* data, size_t size) {
+    return ContentHash64(data, size, 0);
+}
+
+static uint64_t RunContentHash128(const uint8_t* data, size_t size) {
+    const Hash128 h = ContentHash128(data, size, 0);
+    return h.lo ^ h.hi;
+}
+
+static const HashBenchCase sCases[] = {
+    { "crc64_table", RunCrc64Table },
+    { "crc64_clmul", RunCrc64Clmul },
+    { "content_hash64", RunContentHash64 },
+    { "content_hash128", RunContentHash128 },
+};
+
+void WriteHashBench(FILE* file, size_t sizeMiB, unsigned int iterations) {
+    const size_t size = sizeMiB * 1024 * 1024;
+    std::vector<uint8_t> data(size);
+    uint64_t state = 0x9E3779B97F4A7C15;
+
+    // xorshift so the data isn't trivially compressible or all the same byte
+    for (size_t i = 0; i < size; i++) {
+        state ^= state << 13;
+        state ^= state >> 7;
+        state ^= state << 17;
+        data[i] = (uint8_t)state;
+    }
+
+    fprintf(file, "{\"size_mib\": %zu, \"crc64_impl\": \"%s\"", sizeMiB, GetCrc64ImplName());
+    for (const auto& c : sCases) {
+        double bestMs = 0.0;
+        // Printed so the call can't be optimized out.
+        uint64_t result = 0;
+        for (unsigned int i = 0; i < iterations; i++) {
+            const auto start = std::chrono::steady_clock::now();
+            result = c.fn(data.data(), size);
+            const double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+            if (i == 0 || ms < bestMs) {
+                bestMs = ms;
+            }
+        }
+        fprintf(file, ", \"%s\": {\"best_ms\": %.3f, \"mib_per_s\": %.0f, \"result\": \"%016llx\"}", c.name, bestMs,
+                bestMs > 0.0 ? (double)sizeMiB / (bestMs / 1000.0) : 0.0, (unsigned long long)result);
+    }
+    fprintf(file, "}");
+}
@@ -0,0 +1,11 @@
+#ifndef HASH_BENCH_H
+#define HASH_BENCH_H
+
+#include <cstddef>
+#include <cstdio>
+
+// Hashes `sizeMiB` MiB of generated data with every hash in hash.h and writes their throughput to `file` as the
+// members of a JSON object. The fastest of `iterations` runs is reported.
+void WriteHashBench(FILE* file, size_t sizeMiB, unsigned int iterations);
+
+#endif
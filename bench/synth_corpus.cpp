@@ -0,0 +1,439 @@
+#include "synth_corpus.h"
+#include "filebox.h"
+#include "dr_wav.h"
+
+#include <ogg/ogg.h>
+#include <vorbis/vorbisenc.h>
+#include <opus/opusenc.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+
+static constexpr const char* sFormatNames[(size_t)SynthFormat::Max] = {
+    "wav_s16",
+    "wav_s24",
+    "wav_f32",
+    "flac",
+    "vorbis",
+    "opus",
+};
+
+static constexpr const char* sFormatExts[(size_t)SynthFormat::Max] = {
+    ".wav",
+    ".wav",
+    ".wav",
+    ".flac",
+    ".ogg",
+    ".ogg",
+};
+
+typedef struct SynthDuration {
+    float seconds;
+    uint32_t sampleRate;
+} SynthDuration;
+
+// Each duration also uses a different sample rate so rate dependent paths get covered.
+static constexpr SynthDuration sDurations[] = {
+    { 2.0f, 32000 },
+    { 10.0f, 44100 },
+    { 30.0f, 48000 },
+};
+
+static constexpr uint32_t FLAC_BLOCK_SIZE = 4096;
+// Fixed so repeated runs produce identical files.
+static constexpr int OGG_SERIAL = 0x46555455;
+
+const char* SynthFormatToStr(SynthFormat format) {
+    return sFormatNames[(size_t)format];
+}
+
+// A few detuned partials with a slow tremolo and some noise. Pure tones compress unrealistically well.
+static void GenerateSignal(float* out, uint64_t numFrames, uint32_t channels, uint32_t sampleRate, uint32_t seed) {
+    static constexpr double partials[] = { 110.0, 220.5, 331.0, 662.5, 1325.0, 2650.0 };
+    const double twoPi = 6.283185307179586;
+    uint32_t lcg = seed;
+
+    for (uint64_t i = 0; i < numFrames; i++) {
+        const double t = (double)i / sampleRate;
+        const double tremolo = 0.75 + 0.25 * sin(twoPi * 0.5 * t);
+        for (uint32_t c = 0; c < channels; c++) {
+            double s = 0.0;
+            for (size_t p = 0; p < sizeof(partials) / sizeof(partials[0]); p++) {
+                s += sin(twoPi * partials[p] * (1.0 + 0.003 * c) * t) / (double)(p + 2);
+            }
+            lcg = lcg * 1664525u + 1013904223u;
+            const double noise = ((double)(lcg >> 8) / (double)(1 << 24)) - 0.5;
+            out[i * channels + c] = (float)((s * tremolo + noise * 0.05) * 0.6);
+        }
+    }
+}
+
+static int16_t FloatToS16(float f) {
+    return (int16_t)lrintf(std::fmax(-1.0f, std::fmin(1.0f, f)) * 32767.0f);
+}
+
+static bool WriteWav(const char* path, SynthFormat format, const float* pcm, uint64_t numFrames, uint32_t channels, uint32_t sampleRate) {
+    drwav wav;
+    drwav_data_format fmt;
+    const uint64_t numSamples = numFrames * channels;
+    std::unique_ptr<uint8_t[]> converted;
+    const void* data = pcm;
+
+    fmt.container = drwav_container_riff;
+    fmt.channels = channels;
+    fmt.sampleRate = sampleRate;
+    switch (format) {
+        case SynthFormat::WavS16: {
+            fmt.format = DR_WAVE_FORMAT_PCM;
+            fmt.bitsPerSample = 16;
+            converted = std::make_unique<uint8_t[]>(numSamples * 2);
+            int16_t* out = (int16_t*)converted.get();
+            for (uint64_t i = 0; i < numSamples; i++) {
+                out[i] = FloatToS16(pcm[i]);
+            }
+            data = converted.get();
+            break;
+        }
+        case SynthFormat::WavS24: {
+            fmt.format = DR_WAVE_FORMAT_PCM;
+            fmt.bitsPerSample = 24;
+            converted = std::make_unique<uint8_t[]>(numSamples * 3);
+            for (uint64_t i = 0; i < numSamples; i++) {
+                const float f = std::fmax(-1.0f, std::fmin(1.0f, pcm[i]));
+                const int32_t s = (int32_t)lrintf(f * 8388607.0f);
+                converted[i * 3 + 0] = (uint8_t)s;
+                converted[i * 3 + 1] = (uint8_t)(s >> 8);
+                converted[i * 3 + 2] = (uint8_t)(s >> 16);
+            }
+            data = converted.get();
+            break;
+        }
+        default:
+            fmt.format = DR_WAVE_FORMAT_IEEE_FLOAT;
+            fmt.bitsPerSample = 32;
+            break;
+    }
+
+    if (!drwav_init_file_write(&wav, path, &fmt, nullptr)) {
+        return false;
+    }
+    const uint64_t written = drwav_write_pcm_frames(&wav, numFrames, data);
+    drwav_uninit(&wav);
+    return written == numFrames;
+}
+
+// There is no FLAC encoder in the build so this writes the subset of the format that is needed: fixed block size,
+// independent channels, 16 bit samples, and order 2 fixed prediction with a single rice partition.
+typedef struct BitWriter {
+    std::vector<uint8_t> bytes;
+    uint64_t acc;
+    uint32_t numBits;
+} BitWriter;
+
+static void PutBits(BitWriter* bw, uint32_t value, uint32_t numBits) {
+    const uint64_t mask = (numBits == 32) ? 0xFFFFFFFFull : ((1ull << numBits) - 1);
+    bw->acc = (bw->acc << numBits) | (value & mask);
+    bw->numBits += numBits;
+    while (bw->numBits >= 8) {
+        bw->numBits -= 8;
+        bw->bytes.push_back((uint8_t)(bw->acc >> bw->numBits));
+    }
+}
+
+static void ByteAlign(BitWriter* bw) {
+    if (bw->numBits != 0) {
+        PutBits(bw, 0, 8 - bw->numBits);
+    }
+}
+
+static void PutUtf8(BitWriter* bw, uint32_t v) {
+    if (v < 0x80) {
+        PutBits(bw, v, 8);
+        return;
+    }
+    uint32_t n = 2;
+    while (n < 6 && v >= (1u << (5 * n + 1))) {
+        n++;
+    }
+    PutBits(bw, ((0xFF00 >> n) & 0xFF) | (v >> (6 * (n - 1))), 8);
+    for (uint32_t i = n - 1; i > 0; i--) {
+        PutBits(bw, 0x80 | ((v >> (6 * (i - 1))) & 0x3F), 8);
+    }
+}
+
+static uint8_t FlacCrc8(const uint8_t* data, size_t len) {
+    uint8_t crc = 0;
+    for (size_t i = 0; i < len; i++) {
+        crc ^= data[i];
+        for (int b = 0; b < 8; b++) {
+            crc = (crc & 0x80) ? (uint8_t)((crc << 1) ^ 0x07) : (uint8_t)(crc << 1);
+        }
+    }
+    return crc;
+}
+
+static uint16_t FlacCrc16(const uint8_t* data, size_t len) {
+    uint16_t crc = 0;
+    for (size_t i = 0; i < len; i++) {
+        crc ^= (uint16_t)(data[i] << 8);
+        for (int b = 0; b < 8; b++) {
+            crc = (crc & 0x8000) ? (uint16_t)((crc << 1) ^ 0x8005) : (uint16_t)(crc << 1);
+        }
+    }
+    return crc;
+}
+
+static void PutFlacSubframe(BitWriter* bw, const int16_t* s, uint32_t stride, uint32_t n) {
+    // Not enough samples to predict from. Store them as is.
+    if (n <= 2) {
+        PutBits(bw, 0x02, 8);
+        for (uint32_t i = 0; i < n; i++) {
+            PutBits(bw, (uint16_t)s[i * stride], 16);
+        }
+        return;
+    }
+
+    auto residuals = std::make_unique<uint32_t[]>(n - 2);
+    uint64_t sum = 0;
+    for (uint32_t i = 2; i < n; i++) {
+        const int32_t r = (int32_t)s[i * stride] - 2 * (int32_t)s[(i - 1) * stride] + (int32_t)s[(i - 2) * stride];
+        const uint32_t u = r >= 0 ? (uint32_t)r << 1 : (((uint32_t)-r) << 1) - 1;
+        residuals[i - 2] = u;
+        sum += u;
+    }
+    const uint64_t mean = sum / (n - 2);
+    uint32_t k = 0;
+    while (k < 14 && (2ull << k) <= mean) {
+        k++;
+    }
+
+    // Fixed predictor, order 2, no wasted bits
+    PutBits(bw, 0x14, 8);
+    PutBits(bw, (uint16_t)s[0], 16);
+    PutBits(bw, (uint16_t)s[stride], 16);
+    // 4 bit rice parameters, partition order 0
+    PutBits(bw, 0, 2);
+    PutBits(bw, 0, 4);
+    PutBits(bw, k, 4);
+    for (uint32_t i = 0; i < n - 2; i++) {
+        uint32_t q = residuals[i] >> k;
+        while (q >= 32) {
+            PutBits(bw, 0, 32);
+            q -= 32;
+        }
+        PutBits(bw, 1, q + 1);
+        PutBits(bw, residuals[i], k);
+    }
+}
+
+static bool WriteFlac(const char* path, const float* pcm, uint64_t numFrames, uint32_t channels, uint32_t sampleRate) {
+    const uint64_t numSamples = numFrames * channels;
+    auto s16 = std::make_unique<int16_t[]>(numSamples);
+    BitWriter bw{};
+
+    for (uint64_t i = 0; i < numSamples; i++) {
+        s16[i] = FloatToS16(pcm[i]);
+    }
+
+    PutBits(&bw, 'f', 8);
+    PutBits(&bw, 'L', 8);
+    PutBits(&bw, 'a', 8);
+    PutBits(&bw, 'C', 8);
+    // Last metadata block, STREAMINFO, 34 bytes
+    PutBits(&bw, 0x80, 8);
+    PutBits(&bw, 34, 24);
+    PutBits(&bw, FLAC_BLOCK_SIZE, 16);
+    PutBits(&bw, FLAC_BLOCK_SIZE, 16);
+    PutBits(&bw, 0, 24);
+    PutBits(&bw, 0, 24);
+    PutBits(&bw, sampleRate, 20);
+    PutBits(&bw, channels - 1, 3);
+    PutBits(&bw, 15, 5);
+    PutBits(&bw, (uint32_t)(numFrames >> 32), 4);
+    PutBits(&bw, (uint32_t)numFrames, 32);
+    for (int i = 0; i < 4; i++) {
+        // MD5 is optional
+        PutBits(&bw, 0, 32);
+    }
+
+    uint32_t frameNum = 0;
+    for (uint64_t pos = 0; pos < numFrames; pos += FLAC_BLOCK_SIZE, frameNum++) {
+        const uint32_t blockSize = (uint32_t)std::min<uint64_t>(FLAC_BLOCK_SIZE, numFrames - pos);
+        const size_t start = bw.bytes.size();
+
+        PutBits(&bw, 0xFFF8, 16);
+        // Block size is stored at the end of the header, sample rate comes from STREAMINFO
+        PutBits(&bw, 0x70, 8);
+        // Independent channels, 16 bits per sample
+        PutBits(&bw, ((channels - 1) << 4) | 0x08, 8);
+        PutUtf8(&bw, frameNum);
+        PutBits(&bw, blockSize - 1, 16);
+        PutBits(&bw, FlacCrc8(&bw.bytes[start], bw.bytes.size() - start), 8);
+        for (uint32_t c = 0; c < channels; c++) {
+            PutFlacSubframe(&bw, &s16[pos * channels + c], channels, blockSize);
+        }
+        ByteAlign(&bw);
+        PutBits(&bw, FlacCrc16(&bw.bytes[start], bw.bytes.size() - start), 16);
+    }
+
+    FILE* file = fopen(path, "wb");
+    if (file == nullptr) {
+        return false;
+    }
+    const size_t written = fwrite(bw.bytes.data(), 1, bw.bytes.size(), file);
+    fclose(file);
+    return written == bw.bytes.size();
+}
+
+static void WriteOggPage(FILE* file, const ogg_page* og) {
+    fwrite(og->header, 1, og->header_len, file);
+    fwrite(og->body, 1, og->body_len, file);
+}
+
+static bool WriteVorbis(const char* path, const float* pcm, uint64_t numFrames, uint32_t channels, uint32_t sampleRate) {
+    vorbis_info vi;
+    vorbis_comment vc;
+    vorbis_dsp_state vd;
+    vorbis_block vb;
+    ogg_stream_state os;
+    ogg_page og;
+    ogg_packet op;
+    ogg_packet header;
+    ogg_packet headerComm;
+    ogg_packet headerCode;
+
+    FILE* file = fopen(path, "wb");
+    if (file == nullptr) {
+        return false;
+    }
+
+    vorbis_info_init(&vi);
+    if (vorbis_encode_init_vbr(&vi, channels, sampleRate, 0.4f) != 0) {
+        vorbis_info_clear(&vi);
+        fclose(file);
+        return false;
+    }
+    vorbis_comment_init(&vc);
+    vorbis_comment_add_tag(&vc, "ENCODER", "future_bench");
+    vorbis_analysis_init(&vd, &vi);
+    vorbis_block_init(&vd, &vb);
+    ogg_stream_init(&os, OGG_SERIAL);
+
+    vorbis_analysis_headerout(&vd, &vc, &header, &headerComm, &headerCode);
+    ogg_stream_packetin(&os, &header);
+    ogg_stream_packetin(&os, &headerComm);
+    ogg_stream_packetin(&os, &headerCode);
+    while (ogg_stream_flush(&os, &og) != 0) {
+        WriteOggPage(file, &og);
+    }
+
+    uint64_t pos = 0;
+    bool eos = false;
+    while (!eos) {
+        const uint64_t toWrite = std::min<uint64_t>(1024, numFrames - pos);
+        if (toWrite == 0) {
+            vorbis_analysis_wrote(&vd, 0);
+        } else {
+            float** buffer = vorbis_analysis_buffer(&vd, (int)toWrite);
+            for (uint64_t i = 0; i < toWrite; i++) {
+                for (uint32_t c = 0; c < channels; c++) {
+                    buffer[c][i] = pcm[(pos + i) * channels + c];
+                }
+            }
+            vorbis_analysis_wrote(&vd, (int)toWrite);
+            pos += toWrite;
+        }
+
+        while (vorbis_analysis_blockout(&vd, &vb) == 1) {
+            vorbis_analysis(&vb, nullptr);
+            vorbis_bitrate_addblock(&vb);
+            while (vorbis_bitrate_flushpacket(&vd, &op)) {
+                ogg_stream_packetin(&os, &op);
+                while (ogg_stream_pageout(&os, &og) != 0) {
+                    WriteOggPage(file, &og);
+                    if (ogg_page_eos(&og)) {
+                        eos = true;
+                    }
+                }
+            }
+        }
+    }
+
+    ogg_stream_clear(&os);
+    vorbis_block_clear(&vb);
+    vorbis_dsp_clear(&vd);
+    vorbis_comment_clear(&vc);
+    vorbis_info_clear(&vi);
+    fclose(file);
+    return true;
+}
+
+static bool WriteOpus(const char* path, const float* pcm, uint64_t numFrames, uint32_t channels, uint32_t sampleRate) {
+    int err = 0;
+    OggOpusComments* comments = ope_comments_create();
+    ope_comments_add(comments, "ENCODER", "future_bench");
+    OggOpusEnc* enc = ope_encoder_create_file(path, comments, sampleRate, channels, 0, &err);
+    ope_comments_destroy(comments);
+    if (enc == nullptr) {
+        return false;
+    }
+    ope_encoder_ctl(enc, OPE_SET_SERIALNO(OGG_SERIAL));
+    err = ope_encoder_write_float(enc, pcm, (int)numFrames);
+    if (err == 0) {
+        err = ope_encoder_drain(enc);
+    }
+    ope_encoder_destroy(enc);
+    return err == 0;
+}
+
+bool GenerateSynthCorpus(const char* dir, float durationScale, std::vector<SynthFile>& files) {
+    uint32_t seed = 1;
+
+    for (const auto& d : sDurations) {
+        for (uint32_t channels = 1; channels <= 2; channels++) {
+            const uint64_t numFrames = std::max<uint64_t>(1024, (uint64_t)(d.seconds * durationScale * d.sampleRate));
+            auto pcm = std::make_unique<float[]>(numFrames * channels);
+            GenerateSignal(pcm.get(), numFrames, channels, d.sampleRate, seed++);
+
+            for (size_t f = 0; f < (size_t)SynthFormat::Max; f++) {
+                const SynthFormat format = (SynthFormat)f;
+                SynthFile file;
+                char name[64];
+                snprintf(name, sizeof(name), "%s_%uch_%gs%s", sFormatNames[f], channels, d.seconds * durationScale, sFormatExts[f]);
+                file.name = name;
+                file.path = std::string(dir) + PATH_SEPARATOR + name;
+                file.format = format;
+                file.channels = channels;
+                file.sampleRate = d.sampleRate;
+                file.numFrames = numFrames;
+
+                bool written;
+                switch (format) {
+                    case SynthFormat::WavS16:
+                    case SynthFormat::WavS24:
+                    case SynthFormat::WavF32:
+                        written = WriteWav(file.path.c_str(), format, pcm.get(), numFrames, channels, d.sampleRate);
+                        break;
+                    case SynthFormat::Flac:
+                        written = WriteFlac(file.path.c_str(), pcm.get(), numFrames, channels, d.sampleRate);
+                        break;
+                    case SynthFormat::OggVorbis:
+                        written = WriteVorbis(file.path.c_str(), pcm.get(), numFrames, channels, d.sampleRate);
+                        break;
+                    default:
+                        written = WriteOpus(file.path.c_str(), pcm.get(), numFrames, channels, d.sampleRate);
+                        break;
+                }
+                if (!written) {
+                    fprintf(stderr, "Failed to write %s\n", file.path.c_str());
+                    return false;
+                }
+                files.push_back(std::move(file));
+            }
+        }
+    }
+    return true;
+}
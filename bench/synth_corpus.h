@@ -0,0 +1,35 @@
+#ifndef SYNTH_CORPUS_H
+#define SYNTH_CORPUS_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+enum class SynthFormat : uint8_t {
+    WavS16,
+    WavS24,
+    WavF32,
+    Flac,
+    OggVorbis,
+    OggOpus,
+    Max,
+};
+
+typedef struct SynthFile {
+    std::string path;
+    // Name of the file without the directory. Used as the name of the benchmark case.
+    std::string name;
+    SynthFormat format;
+    uint32_t channels;
+    uint32_t sampleRate;
+    uint64_t numFrames;
+} SynthFile;
+
+const char* SynthFormatToStr(SynthFormat format);
+
+// Writes one file for every combination of format, channel count, and duration into `dir`.
+// Durations are multiplied by `durationScale`. The same arguments always produce the same audio.
+// Returns false if any file couldn't be written.
+bool GenerateSynthCorpus(const char* dir, float durationScale, std::vector<SynthFile>& files);
+
+#endif
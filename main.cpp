@@ -16,6 +16,9 @@
 #include "zip.h"
 #include "font.h"
 #include "style.h"
+#include "cli.h"
+#include "images.h"
+#include "audio_preview.h"
 
 
 
@@ -47,8 +50,13 @@ static SDL_GLContext gl_context;
 WindowMgr gWindowMgr;
 
 // Main code
-int main(int, char**)
+int main(int argc, char** argv)
 {
+    // Any arguments means we are running from the command line. Don't create a window.
+    if (argc > 1) {
+        return RunCli(argc, argv);
+    }
+
     // Initialize Direct3D
     if (InitState()) {
         return 1;
@@ -82,6 +90,7 @@ int main(int, char**)
         StartFrame();
 
         gWindowMgr.DisplayCurWindow();
+        UpdateTextureCache();
 
         // Rendering
         Render(clear_color);
@@ -246,6 +255,8 @@ static void Render(const ImVec4& clear_color) {
 
 
 static void Shutdown() {
+    ShutdownAudioPreview();
+    ClearTextureCache();
 #if defined(_WIN32)
     ImGui_ImplDX11_Shutdown();
     ImGui_ImplWin32_Shutdown();
@@ -1,4 +1,11 @@
 #include "archive.h"
+#include "zip_archive.h"
+#include "mpq_archive.h"
+#include "o2r_stream_archive.h"
+#include <cctype>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
 
 Archive::Archive()
 {
@@ -6,4 +13,92 @@ Archive::Archive()
 
 Archive::~Archive()
 {
-}
\ No newline at end of file
+}
+
+ArchiveType GetArchiveTypeFromFile(const char* path) {
+    uint8_t header[4];
+    FILE* file = fopen(path, "rb");
+
+    if (file == nullptr) {
+        return ArchiveType::Unchecked;
+    }
+    size_t read = fread(header, 1, sizeof(header), file);
+    fclose(file);
+    if (read != sizeof(header)) {
+        return ArchiveType::Unchecked;
+    }
+
+    if (header[0] == 'P' && header[1] == 'K' && header[2] == 3 && header[3] == 4) {
+        return ArchiveType::O2R;
+    } else if (header[0] == 'M' && header[1] == 'P' && header[2] == 'Q' && header[3] == 0x1A) {
+        return ArchiveType::OTR;
+    }
+    return ArchiveType::Unchecked;
+}
+
+ArchiveType GetArchiveTypeFromExt(const char* path) {
+    const char* ext = strrchr(path, '.');
+    if (ext == nullptr) {
+        return ArchiveType::Unchecked;
+    }
+    char newStr[8]{};
+    for (size_t i = 0; ext[i] != 0 && i < sizeof(newStr) - 1; i++) {
+        newStr[i] = (char)tolower(ext[i]);
+    }
+    if (strcmp(newStr, ".o2r") == 0 || strcmp(newStr, ".zip") == 0) {
+        return ArchiveType::O2R;
+    } else if (strcmp(newStr, ".otr") == 0 || strcmp(newStr, ".mpq") == 0) {
+        return ArchiveType::OTR;
+    }
+    return ArchiveType::Unchecked;
+}
+
+std::unique_ptr<Archive> CreateArchiveOfType(ArchiveType type, const char* path) {
+    switch (type) {
+        case ArchiveType::O2R:
+            return std::make_unique<ZipArchive>(path);
+        case ArchiveType::OTR:
+            return std::make_unique<MpqArchive>(path);
+        default:
+            return nullptr;
+    }
+}
+
+std::unique_ptr<Archive> CreateWriteOnlyArchiveOfType(ArchiveType type, const char* path) {
+    switch (type) {
+        case ArchiveType::O2R:
+            return std::make_unique<O2rStreamArchive>(path);
+        case ArchiveType::OTR:
+            // StormLib already writes each file when it is added.
+            return std::make_unique<MpqArchive>(path);
+        default:
+            return nullptr;
+    }
+}
+
+std::unique_ptr<Archive> OpenOrCreateArchiveOfType(ArchiveType type, const char* path) {
+    // The O2R write only archive replaces the file, so it is only used for a new one
+    std::error_code ec;
+    if (std::filesystem::exists(path, ec)) {
+        return CreateArchiveOfType(type, path);
+    }
+    return CreateWriteOnlyArchiveOfType(type, path);
+}
+
+bool ExtractArchiveFile(Archive* a, const char* archiveFilePath, const char* outPath) {
+    size_t uncompressedSize;
+    void* data = a->ReadFile(archiveFilePath, &uncompressedSize);
+    if (data == nullptr) {
+        return false;
+    }
+
+    FILE* outFile = fopen(outPath, "wb+");
+    if (outFile == nullptr) {
+        free(data);
+        return false;
+    }
+    fwrite(data, uncompressedSize, 1, outFile);
+    fclose(outFile);
+    free(data);
+    return true;
+}
@@ -11,6 +11,14 @@
 enum DataHandleMode : uint8_t {
     MMappedFile,
     DataCopy,
+    // The archive takes ownership of the data and frees it once it is written. Must be allocated with `malloc`.
+    DataOwned,
+};
+
+enum class ArchiveType : uint8_t {
+    Unchecked,
+    O2R,
+    OTR,
 };
 
 typedef struct ArchiveDataInfo {
@@ -19,6 +27,15 @@ typedef struct ArchiveDataInfo {
     DataHandleMode mode;
 } ArchiveDataInfo;
 
+// Reads parts of one file in an archive without reading the whole file. Made by `Archive::OpenFileReader`.
+class ArchiveFileReader {
+    public:
+    virtual ~ArchiveFileReader() = default;
+    // Reads up to `size` bytes starting at `offset` into `out`. Returns the number of bytes read.
+    virtual size_t Read(uint64_t offset, void* out, size_t size) = 0;
+    virtual uint64_t GetSize() const = 0;
+};
+
 class Archive {
     public:
     Archive();
@@ -33,6 +50,9 @@ class Archive {
     virtual void* ReadFile(const char* filePath, size_t* bytesRead) = 0;
     //virtual void ReadFile(const char* filePath, void** outBuffer);
     virtual size_t GetFileSize(const char* path) const = 0;
+    // Opens `filePath` to be read a part at a time. Returns null if the file can't be opened. The reader must be
+    // destroyed before the archive is closed. Readers can be used on any thread, reads from the same archive take turns.
+    virtual std::unique_ptr<ArchiveFileReader> OpenFileReader(const char* filePath) = 0;
     virtual void GenFileList() = 0;
 
     virtual void CreateArchiveFromList(std::vector<char*>& list, char* basePath) = 0;
@@ -41,13 +61,42 @@ class Archive {
     virtual void WriteFile(char* path, const ArchiveDataInfo* data) = 0;
     // Same as `WriteFile` but not thread safe
     virtual void WriteFileUnlocked(char* path, const ArchiveDataInfo* data) = 0;
+    // Write the `numSegments` buffers in `segments` back to back as one file at `path`. Used for files made of a header
+    // and a payload so they don't have to be concatenated first. Each segment is handled according to its own mode,
+    // the same as `WriteFile`. Threadsafe.
+    virtual void WriteFileSegments(char* path, const ArchiveDataInfo* segments, size_t numSegments) = 0;
+    // Same as `WriteFileSegments` but not thread safe
+    virtual void WriteFileSegmentsUnlocked(char* path, const ArchiveDataInfo* segments, size_t numSegments) = 0;
+    // Removes `path` from the archive. Returns false if it isn't in the archive. Threadsafe.
+    virtual bool RemoveFile(const char* path) = 0;
+    // Writes out everything added so far so the file on disk is a complete archive, while this one stays open to add
+    // more. Returns false if it couldn't be written. Threadsafe.
+    virtual bool FlushArchive() = 0;
     // ZIP will keep the file names valid until the archive is closed so we don't need to free them.
     // MPQ will not so we need to allocate and free the strings.
     std::vector<const char*> files;
+    // Uncompressed size of each file in `files`. Filled by `GenFileList`.
+    std::vector<uint64_t> fileSizes;
+    // Size each file in `files` takes up in the archive, after compression. Filled by `GenFileList`.
+    std::vector<uint64_t> fileStoredSizes;
 
     std::mutex m;
     std::condition_variable c;
 };
 
+// Returns the type of the archive at `path` from its magic bytes, or `Unchecked` if it isn't an archive.
+ArchiveType GetArchiveTypeFromFile(const char* path);
+// Returns the type of archive to create for `path` from its extension, or `Unchecked` if it isn't known.
+ArchiveType GetArchiveTypeFromExt(const char* path);
+// Opens or creates an archive of type `type` at `path`. Returns null for `Unchecked`.
+std::unique_ptr<Archive> CreateArchiveOfType(ArchiveType type, const char* path);
+// Creates a new archive of type `type` at `path` that is only written to. O2R archives write each file as it is added
+// instead of keeping everything in memory until they are closed. Replaces any O2R archive already at `path`.
+std::unique_ptr<Archive> CreateWriteOnlyArchiveOfType(ArchiveType type, const char* path);
+// Adds to the archive already at `path`, or creates it as a write only archive if there isn't one. Everything that
+// writes songs or patches into an archive uses this so they all treat an existing archive the same way.
+std::unique_ptr<Archive> OpenOrCreateArchiveOfType(ArchiveType type, const char* path);
+// Reads `archiveFilePath` from `a` and writes it to `outPath` on disk.
+bool ExtractArchiveFile(Archive* a, const char* archiveFilePath, const char* outPath);
 
 #endif
@@ -0,0 +1,142 @@
+#include "archive_stats.h"
+
+#include <algorithm>
+#include <string_view>
+#include <unordered_map>
+
+static constexpr char ROOT_NAME[] = "(root)";
+static constexpr char NO_EXTENSION_NAME[] = "(none)";
+
+ArchiveStats::~ArchiveStats() {
+    Clear();
+}
+
+void ArchiveStats::BuildAsync(const std::vector<const char*>* paths, const std::vector<uint64_t>* sizes,
+                              const std::vector<uint64_t>* storedSizes) {
+    Clear();
+    mPaths = paths;
+    mSizes = sizes;
+    mStoredSizes = storedSizes;
+    mThread = std::thread(&ArchiveStats::Build, this);
+}
+
+void ArchiveStats::Clear() {
+    mCancel = true;
+    if (mThread.joinable()) {
+        mThread.join();
+    }
+    mCancel = false;
+    mReady = false;
+    mPaths = nullptr;
+    mSizes = nullptr;
+    mStoredSizes = nullptr;
+    mTotal = {};
+    mDirectories = {};
+    mExtensions = {};
+    mLargestFiles = {};
+}
+
+bool ArchiveStats::IsReady() const {
+    return mReady.load(std::memory_order_acquire);
+}
+
+const ArchiveStatGroup& ArchiveStats::GetTotal() const {
+    return mTotal;
+}
+
+const std::vector<ArchiveStatGroup>& ArchiveStats::GetDirectories() const {
+    return mDirectories;
+}
+
+const std::vector<ArchiveStatGroup>& ArchiveStats::GetExtensions() const {
+    return mExtensions;
+}
+
+const std::vector<uint32_t>& ArchiveStats::GetLargestFiles() const {
+    return mLargestFiles;
+}
+
+static void AddToGroup(ArchiveStatGroup* group, uint64_t size, uint64_t storedSize) {
+    group->numFiles++;
+    group->size += size;
+    group->storedSize += storedSize;
+}
+
+// Finds or adds the group for `key`. Keys point into the paths so they are only copied once per group.
+static ArchiveStatGroup* GetGroup(std::unordered_map<std::string_view, size_t>* indices, std::vector<ArchiveStatGroup>* groups,
+                                  std::string_view key, const char* emptyName) {
+    auto [it, inserted] = indices->try_emplace(key, groups->size());
+    if (inserted) {
+        groups->push_back({ key.empty() ? std::string(emptyName) : std::string(key), 0, 0, 0 });
+    }
+    return &(*groups)[it->second];
+}
+
+static void SortByName(std::vector<ArchiveStatGroup>* groups) {
+    std::sort(groups->begin(), groups->end(), [](const ArchiveStatGroup& a, const ArchiveStatGroup& b) {
+        return a.name < b.name;
+    });
+}
+
+void ArchiveStats::Build() {
+    const std::vector<const char*>& paths = *mPaths;
+    const uint32_t numPaths = (uint32_t)paths.size();
+    std::unordered_map<std::string_view, size_t> dirIndices;
+    std::unordered_map<std::string, size_t> extIndices;
+    // Lowercased so "PNG" and "png" are counted together
+    std::string ext;
+
+    for (uint32_t i = 0; i < numPaths; i++) {
+        const char* path = paths[i] != nullptr ? paths[i] : "";
+        const uint64_t size = i < mSizes->size() ? (*mSizes)[i] : 0;
+        const uint64_t storedSize = i < mStoredSizes->size() ? (*mStoredSizes)[i] : 0;
+        AddToGroup(&mTotal, size, storedSize);
+
+        const std::string_view p(path);
+        const size_t sep = p.find_last_of("/\\");
+        const std::string_view dir = sep != std::string_view::npos ? p.substr(0, sep) : std::string_view();
+        AddToGroup(GetGroup(&dirIndices, &mDirectories, dir, ROOT_NAME), size, storedSize);
+
+        const std::string_view name = sep != std::string_view::npos ? p.substr(sep + 1) : p;
+        const size_t dot = name.find_last_of('.');
+        // A leading dot is a hidden file, not an extension
+        ext.clear();
+        if (dot != std::string_view::npos && dot != 0) {
+            for (char c : name.substr(dot + 1)) {
+                ext.push_back((c >= 'A' && c <= 'Z') ? (char)(c + ('a' - 'A')) : c);
+            }
+        }
+        auto it = extIndices.find(ext);
+        if (it == extIndices.end()) {
+            it = extIndices.emplace(ext, mExtensions.size()).first;
+            mExtensions.push_back({ ext.empty() ? std::string(NO_EXTENSION_NAME) : ext, 0, 0, 0 });
+        }
+        AddToGroup(&mExtensions[it->second], size, storedSize);
+
+        if ((i & 0xFFF) == 0 && mCancel) {
+            return;
+        }
+    }
+
+    mLargestFiles.resize(numPaths);
+    for (uint32_t i = 0; i < numPaths; i++) {
+        mLargestFiles[i] = i;
+    }
+    const size_t numLargest = std::min<size_t>(numPaths, MAX_LARGEST_FILES);
+    auto storedSizeOf = [this](uint32_t i) {
+        return i < mStoredSizes->size() ? (*mStoredSizes)[i] : 0;
+    };
+    std::partial_sort(mLargestFiles.begin(), mLargestFiles.begin() + numLargest, mLargestFiles.end(), [&](uint32_t a, uint32_t b) {
+        return storedSizeOf(a) > storedSizeOf(b);
+    });
+    mLargestFiles.resize(numLargest);
+    mLargestFiles.shrink_to_fit();
+
+    SortByName(&mDirectories);
+    SortByName(&mExtensions);
+    mReady.store(true, std::memory_order_release);
+}
+
+double GetStoredPercent(const ArchiveStatGroup* group) {
+    return group->size != 0 ? 100.0 * group->storedSize / group->size : 100.0;
+}
@@ -0,0 +1,60 @@
+#ifndef ARCHIVE_STATS_H
+#define ARCHIVE_STATS_H
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <thread>
+#include <vector>
+
+typedef struct ArchiveStatGroup {
+    // Directory or extension the files have in common
+    std::string name;
+    uint64_t numFiles;
+    uint64_t size;
+    // Size after compression
+    uint64_t storedSize;
+} ArchiveStatGroup;
+
+// What an archive is made of, by directory and by extension, and its largest files. Only the sizes from the archive's
+// index are used so nothing is decompressed. Computed on a background thread since archives can have hundreds of
+// thousands of files.
+class ArchiveStats {
+public:
+    static constexpr size_t MAX_LARGEST_FILES = 100;
+
+    ~ArchiveStats();
+    // Starts computing the stats of `paths`. `sizes[i]` and `storedSizes[i]` are the sizes of `paths[i]`, missing sizes
+    // are 0. The vectors must not change until the stats are cleared.
+    void BuildAsync(const std::vector<const char*>* paths, const std::vector<uint64_t>* sizes, const std::vector<uint64_t>* storedSizes);
+    // Stops building and frees the stats.
+    void Clear();
+    bool IsReady() const;
+
+    // The rest can only be called once `IsReady` returns true.
+    const ArchiveStatGroup& GetTotal() const;
+    // Groups files by the directory they are directly in. Sorted by name.
+    const std::vector<ArchiveStatGroup>& GetDirectories() const;
+    // Groups files by their extension, ignoring case. Sorted by name.
+    const std::vector<ArchiveStatGroup>& GetExtensions() const;
+    // Indices of the files that take the most space in the archive, largest first.
+    const std::vector<uint32_t>& GetLargestFiles() const;
+private:
+    void Build();
+
+    const std::vector<const char*>* mPaths = nullptr;
+    const std::vector<uint64_t>* mSizes = nullptr;
+    const std::vector<uint64_t>* mStoredSizes = nullptr;
+    ArchiveStatGroup mTotal = {};
+    std::vector<ArchiveStatGroup> mDirectories;
+    std::vector<ArchiveStatGroup> mExtensions;
+    std::vector<uint32_t> mLargestFiles;
+    std::thread mThread;
+    std::atomic<bool> mCancel = false;
+    std::atomic<bool> mReady = false;
+};
+
+// Stored size as a percentage of the uncompressed size, or 100 for empty files.
+double GetStoredPercent(const ArchiveStatGroup* group);
+
+#endif
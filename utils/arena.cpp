@@ -0,0 +1,78 @@
+#include "arena.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <new>
+
+Arena::Arena() : Arena(64 * 1024) {
+}
+
+Arena::Arena(size_t blockSize) : mBlockSize(blockSize) {
+}
+
+Arena::~Arena() {
+    Release();
+}
+
+void Arena::NewBlock(size_t minSize) {
+    // Room for the block header and for aligning the first allocation
+    size_t size = minSize + sizeof(Block) + alignof(std::max_align_t);
+    if (size < mBlockSize) {
+        size = mBlockSize;
+    }
+    Block* block = static_cast<Block*>(malloc(size));
+    if (block == nullptr) {
+        throw std::bad_alloc();
+    }
+    block->next = mHead;
+    block->size = size;
+    mHead = block;
+    mCur = reinterpret_cast<uint8_t*>(block + 1);
+    mEnd = reinterpret_cast<uint8_t*>(block) + size;
+    mCapacity += size;
+}
+
+void Arena::Reserve(size_t size) {
+    if (mCur == nullptr || (size_t)(mEnd - mCur) < size + alignof(std::max_align_t)) {
+        NewBlock(size);
+    }
+}
+
+void* Arena::Alloc(size_t size, size_t align) {
+    uintptr_t p = ((uintptr_t)mCur + (align - 1)) & ~(uintptr_t)(align - 1);
+    if (mCur == nullptr || p + size > (uintptr_t)mEnd) {
+        NewBlock(size + align);
+        p = ((uintptr_t)mCur + (align - 1)) & ~(uintptr_t)(align - 1);
+    }
+    mCur = reinterpret_cast<uint8_t*>(p + size);
+    return reinterpret_cast<void*>(p);
+}
+
+char* Arena::StrDup(const char* str, size_t len) {
+    char* copy = static_cast<char*>(Alloc(len + 1, 1));
+    memcpy(copy, str, len);
+    copy[len] = 0;
+    return copy;
+}
+
+char* Arena::StrDup(const char* str) {
+    if (str == nullptr) {
+        return nullptr;
+    }
+    return StrDup(str, strlen(str));
+}
+
+void Arena::Release() {
+    while (mHead != nullptr) {
+        Block* next = mHead->next;
+        free(mHead);
+        mHead = next;
+    }
+    mCur = nullptr;
+    mEnd = nullptr;
+    mCapacity = 0;
+}
+
+size_t Arena::GetCapacity() const {
+    return mCapacity;
+}
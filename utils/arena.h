@@ -0,0 +1,55 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <type_traits>
+
+// Bump allocator. Memory is taken from large blocks and everything is freed at once with `Release`, there is no way to
+// free a single allocation. Only use it for trivially destructible types, destructors are never run.
+class Arena {
+public:
+    Arena();
+    explicit Arena(size_t blockSize);
+    ~Arena();
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
+
+    // Makes sure the next `size` bytes can be allocated without allocating a new block. Useful when the total size is
+    // roughly known up front.
+    void Reserve(size_t size);
+    void* Alloc(size_t size, size_t align = alignof(std::max_align_t));
+    // Copies `len` bytes of `str` and null terminates the copy.
+    char* StrDup(const char* str, size_t len);
+    char* StrDup(const char* str);
+    // Frees every block. Pointers returned before this are invalid afterwards.
+    void Release();
+    // Bytes allocated from the system, including what hasn't been handed out yet.
+    size_t GetCapacity() const;
+
+    // `count` value initialized `T`s.
+    template <typename T>
+    T* AllocArray(size_t count) {
+        static_assert(std::is_trivially_destructible_v<T>, "The arena never runs destructors");
+        if (count == 0) {
+            return nullptr;
+        }
+        T* arr = static_cast<T*>(Alloc(sizeof(T) * count, alignof(T)));
+        std::uninitialized_value_construct_n(arr, count);
+        return arr;
+    }
+private:
+    struct Block {
+        Block* next;
+        size_t size;
+    };
+    void NewBlock(size_t minSize);
+    Block* mHead = nullptr;
+    uint8_t* mCur = nullptr;
+    uint8_t* mEnd = nullptr;
+    size_t mBlockSize;
+    size_t mCapacity = 0;
+};
+
+#endif
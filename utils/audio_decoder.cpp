@@ -0,0 +1,363 @@
+#include "audio_decoder.h"
+
+#include "dr_mp3.h"
+#include "dr_wav.h"
+#include "dr_flac.h"
+
+#include <ogg/ogg.h>
+#include <vorbis/vorbisfile.h>
+#include <opus/opus.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+static constexpr uint32_t MAX_CHANNELS = 8;
+// Largest Opus packet: 120 ms at 48KHz
+static constexpr int OPUS_MAX_FRAMES = 5760;
+
+// Reads a file on disk for files that aren't in an archive
+class DiskFileReader : public ArchiveFileReader {
+    public:
+    DiskFileReader(FILE* file, uint64_t size) {
+        mFile = file;
+        mSize = size;
+    }
+
+    ~DiskFileReader() override {
+        fclose(mFile);
+    }
+
+    size_t Read(uint64_t offset, void* out, size_t size) override {
+        if (offset >= mSize) {
+            return 0;
+        }
+        if (offset != mPos) {
+            if (fseek(mFile, (long)offset, SEEK_SET) != 0) {
+                return 0;
+            }
+            mPos = offset;
+        }
+        const size_t bytesRead = fread(out, 1, size, mFile);
+        mPos += bytesRead;
+        return bytesRead;
+    }
+
+    uint64_t GetSize() const override {
+        return mSize;
+    }
+
+    private:
+    FILE* mFile;
+    uint64_t mSize;
+    uint64_t mPos = 0;
+};
+
+std::unique_ptr<ArchiveFileReader> OpenDiskFileReader(const char* path) {
+    FILE* file = fopen(path, "rb");
+    if (file == nullptr) {
+        return nullptr;
+    }
+    fseek(file, 0, SEEK_END);
+    const long size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    return std::make_unique<DiskFileReader>(file, size > 0 ? (uint64_t)size : 0);
+}
+
+// Read position in the file being decoded, shared by the decoder library callbacks
+typedef struct DecodeSource {
+    ArchiveFileReader* reader;
+    uint64_t pos;
+} DecodeSource;
+
+static size_t SourceRead(void* userData, void* out, size_t size) {
+    DecodeSource* src = (DecodeSource*)userData;
+    const size_t bytesRead = src->reader->Read(src->pos, out, size);
+    src->pos += bytesRead;
+    return bytesRead;
+}
+
+static bool SourceSeek(void* userData, int64_t offset, bool fromStart) {
+    DecodeSource* src = (DecodeSource*)userData;
+    const int64_t newPos = fromStart ? offset : (int64_t)src->pos + offset;
+    if (newPos < 0 || (uint64_t)newPos > src->reader->GetSize()) {
+        return false;
+    }
+    src->pos = (uint64_t)newPos;
+    return true;
+}
+
+class StreamDecoder : public AudioDecoder {
+    public:
+    // Reads the file's header. Returns false if it isn't valid.
+    virtual bool Open(DecodeSource* src) = 0;
+
+    DecodeSource source;
+};
+
+class WavDecoder : public StreamDecoder {
+    public:
+    ~WavDecoder() override {
+        if (mOpen) {
+            drwav_uninit(&mWav);
+        }
+    }
+
+    bool Open(DecodeSource* src) override {
+        mOpen = drwav_init(&mWav, SourceRead, Seek, src, nullptr);
+        if (!mOpen) {
+            return false;
+        }
+        numChannels = mWav.channels;
+        sampleRate = mWav.sampleRate;
+        numFrames = mWav.totalPCMFrameCount;
+        return true;
+    }
+
+    size_t Decode(float* out, size_t maxFrames) override {
+        return (size_t)drwav_read_pcm_frames_f32(&mWav, maxFrames, out);
+    }
+
+    private:
+    static drwav_bool32 Seek(void* userData, int offset, drwav_seek_origin origin) {
+        return SourceSeek(userData, offset, origin == drwav_seek_origin_start);
+    }
+
+    drwav mWav;
+    bool mOpen = false;
+};
+
+class Mp3Decoder : public StreamDecoder {
+    public:
+    ~Mp3Decoder() override {
+        if (mOpen) {
+            drmp3_uninit(&mMp3);
+        }
+    }
+
+    bool Open(DecodeSource* src) override {
+        mOpen = drmp3_init(&mMp3, SourceRead, Seek, src, nullptr);
+        if (!mOpen) {
+            return false;
+        }
+        // Counting the frames means decoding the whole file
+        numChannels = mMp3.channels;
+        sampleRate = mMp3.sampleRate;
+        return true;
+    }
+
+    size_t Decode(float* out, size_t maxFrames) override {
+        return (size_t)drmp3_read_pcm_frames_f32(&mMp3, maxFrames, out);
+    }
+
+    private:
+    static drmp3_bool32 Seek(void* userData, int offset, drmp3_seek_origin origin) {
+        return SourceSeek(userData, offset, origin == drmp3_seek_origin_start);
+    }
+
+    drmp3 mMp3;
+    bool mOpen = false;
+};
+
+class FlacDecoder : public StreamDecoder {
+    public:
+    ~FlacDecoder() override {
+        if (mFlac != nullptr) {
+            drflac_close(mFlac);
+        }
+    }
+
+    bool Open(DecodeSource* src) override {
+        mFlac = drflac_open(SourceRead, Seek, src, nullptr);
+        if (mFlac == nullptr) {
+            return false;
+        }
+        numChannels = mFlac->channels;
+        sampleRate = mFlac->sampleRate;
+        numFrames = mFlac->totalPCMFrameCount;
+        return true;
+    }
+
+    size_t Decode(float* out, size_t maxFrames) override {
+        return (size_t)drflac_read_pcm_frames_f32(mFlac, maxFrames, out);
+    }
+
+    private:
+    static drflac_bool32 Seek(void* userData, int offset, drflac_seek_origin origin) {
+        return SourceSeek(userData, offset, origin == drflac_seek_origin_start);
+    }
+
+    drflac* mFlac = nullptr;
+};
+
+class VorbisDecoder : public StreamDecoder {
+    public:
+    ~VorbisDecoder() override {
+        if (mOpen) {
+            ov_clear(&mVorbis);
+        }
+    }
+
+    bool Open(DecodeSource* src) override {
+        // No seek callback: vorbisfile would read to the end of the file to find its length before playing anything
+        const ov_callbacks callbacks = { Read, nullptr, nullptr, nullptr };
+        mOpen = ov_open_callbacks(src, &mVorbis, nullptr, 0, callbacks) == 0;
+        if (!mOpen) {
+            return false;
+        }
+        const vorbis_info* info = ov_info(&mVorbis, -1);
+        numChannels = info->channels;
+        sampleRate = info->rate;
+        return true;
+    }
+
+    size_t Decode(float* out, size_t maxFrames) override {
+        while (true) {
+            float** pcm;
+            int section;
+            const long framesRead = ov_read_float(&mVorbis, &pcm, (int)maxFrames, &section);
+            // A hole is a gap in the stream that decoding can continue after. Anything else is an error.
+            if (framesRead == OV_HOLE) {
+                continue;
+            }
+            if (framesRead < 0) {
+                return 0;
+            }
+            for (long i = 0; i < framesRead; i++) {
+                for (uint32_t c = 0; c < numChannels; c++) {
+                    *out++ = pcm[c][i];
+                }
+            }
+            return (size_t)framesRead;
+        }
+    }
+
+    private:
+    static size_t Read(void* out, size_t size, size_t count, void* userData) {
+        return SourceRead(userData, out, size * count) / size;
+    }
+
+    OggVorbis_File mVorbis;
+    bool mOpen = false;
+};
+
+class OggOpusDecoder : public StreamDecoder {
+    public:
+    ~OggOpusDecoder() override {
+        if (mDecoder != nullptr) {
+            opus_decoder_destroy(mDecoder);
+        }
+        if (mStreamInit) {
+            ogg_stream_clear(&mStream);
+        }
+        ogg_sync_clear(&mSync);
+    }
+
+    bool Open(DecodeSource* src) override {
+        mSrc = src;
+        ogg_sync_init(&mSync);
+        ogg_packet packet;
+        if (!ReadPacket(&packet) || packet.bytes < 19 || memcmp(packet.packet, "OpusHead", 8) != 0) {
+            return false;
+        }
+        numChannels = packet.packet[9];
+        mPreSkip = packet.packet[10] | (packet.packet[11] << 8);
+        // Opus always decodes to 48KHz. The rate in the header is only the rate of the original file.
+        sampleRate = 48000;
+        // Skip the comment header
+        if (numChannels == 0 || numChannels > 2 || !ReadPacket(&packet)) {
+            return false;
+        }
+        mDecoder = opus_decoder_create(48000, numChannels, nullptr);
+        return mDecoder != nullptr;
+    }
+
+    size_t Decode(float* out, size_t maxFrames) override {
+        while (mPcmPos == mPcmFrames) {
+            ogg_packet packet;
+            if (!ReadPacket(&packet)) {
+                return 0;
+            }
+            const int framesDecoded = opus_decode_float(mDecoder, packet.packet, (int32_t)packet.bytes, mPcm, OPUS_MAX_FRAMES, 0);
+            mPcmFrames = std::max(framesDecoded, 0);
+            mPcmPos = std::min(mPreSkip, mPcmFrames);
+            mPreSkip -= mPcmPos;
+        }
+        const size_t frames = std::min(maxFrames, (size_t)(mPcmFrames - mPcmPos));
+        memcpy(out, mPcm + mPcmPos * numChannels, frames * numChannels * sizeof(float));
+        mPcmPos += (int)frames;
+        return frames;
+    }
+
+    private:
+    bool ReadPacket(ogg_packet* packet) {
+        while (!mStreamInit || ogg_stream_packetout(&mStream, packet) != 1) {
+            ogg_page page;
+            while (ogg_sync_pageout(&mSync, &page) != 1) {
+                char* buffer = ogg_sync_buffer(&mSync, 4096);
+                const size_t bytesRead = SourceRead(mSrc, buffer, 4096);
+                if (bytesRead == 0) {
+                    return false;
+                }
+                ogg_sync_wrote(&mSync, (long)bytesRead);
+            }
+            if (!mStreamInit) {
+                ogg_stream_init(&mStream, ogg_page_serialno(&page));
+                mStreamInit = true;
+            }
+            ogg_stream_pagein(&mStream, &page);
+        }
+        return true;
+    }
+
+    DecodeSource* mSrc = nullptr;
+    ogg_sync_state mSync;
+    ogg_stream_state mStream;
+    bool mStreamInit = false;
+    ::OpusDecoder* mDecoder = nullptr;
+    // Samples at the start of the stream that are only there to prime the decoder
+    int mPreSkip = 0;
+    float mPcm[OPUS_MAX_FRAMES * 2];
+    int mPcmFrames = 0;
+    int mPcmPos = 0;
+};
+
+// Picks a decoder from the first bytes of the file. Ogg files have to look at the first packet to tell Vorbis and
+// Opus apart.
+static std::unique_ptr<StreamDecoder> CreateDecoder(ArchiveFileReader* reader) {
+    uint8_t d[64] = {};
+    reader->Read(0, d, sizeof(d));
+    if (memcmp(d, "RIFF", 4) == 0) {
+        return std::make_unique<WavDecoder>();
+    }
+    if (memcmp(d, "fLaC", 4) == 0) {
+        return std::make_unique<FlacDecoder>();
+    }
+    if (memcmp(d, "OggS", 4) == 0) {
+        // The first packet starts after the page header and its segment table
+        const size_t packetStart = 27 + d[26];
+        if (packetStart + 8 <= sizeof(d) && memcmp(d + packetStart, "OpusHead", 8) == 0) {
+            return std::make_unique<OggOpusDecoder>();
+        }
+        return std::make_unique<VorbisDecoder>();
+    }
+    if ((d[0] == 'I' && d[1] == 'D' && d[2] == '3') || (d[0] == 0xFF && (d[1] & 0xE0) == 0xE0)) {
+        return std::make_unique<Mp3Decoder>();
+    }
+    return nullptr;
+}
+
+std::unique_ptr<AudioDecoder> OpenAudioDecoder(ArchiveFileReader* reader) {
+    std::unique_ptr<StreamDecoder> decoder = CreateDecoder(reader);
+    if (decoder == nullptr) {
+        return nullptr;
+    }
+    decoder->source = { reader, 0 };
+    if (!decoder->Open(&decoder->source)) {
+        return nullptr;
+    }
+    if (decoder->numChannels == 0 || decoder->numChannels > MAX_CHANNELS || decoder->sampleRate == 0) {
+        return nullptr;
+    }
+    return decoder;
+}
@@ -0,0 +1,29 @@
+#ifndef AUDIO_DECODER_H
+#define AUDIO_DECODER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include "archive.h"
+
+// Decodes an audio file a block at a time instead of all at once. WAV, MP3, FLAC, Ogg Vorbis and Ogg Opus are
+// supported, the format is detected from the file's contents.
+class AudioDecoder {
+    public:
+    virtual ~AudioDecoder() = default;
+    // Decodes up to `maxFrames` interleaved frames into `out`. Returns 0 at the end of the file.
+    virtual size_t Decode(float* out, size_t maxFrames) = 0;
+
+    uint32_t numChannels = 0;
+    uint32_t sampleRate = 0;
+    // 0 if the format doesn't store it
+    uint64_t numFrames = 0;
+};
+
+// Opens a decoder for the file `reader` reads. `reader` must outlive the decoder. Returns null if the file isn't
+// audio in a supported format.
+std::unique_ptr<AudioDecoder> OpenAudioDecoder(ArchiveFileReader* reader);
+// Opens a file on disk to be read the same way as a file in an archive. Returns null if it can't be opened.
+std::unique_ptr<ArchiveFileReader> OpenDiskFileReader(const char* path);
+
+#endif
@@ -0,0 +1,213 @@
+#include "audio_preview.h"
+#include "audio_decoder.h"
+#include "font_awesome.h"
+#include "imgui.h"
+
+#define SDL_MAIN_HANDLED
+#include <SDL2/SDL.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Frames decoded at a time. Small enough that the first block is ready almost immediately.
+static constexpr size_t BLOCK_FRAMES = 1024;
+// Samples in the ring buffer between the decoder and the audio callback. A power of two so indices can be masked.
+static constexpr size_t RING_SIZE = 1 << 16;
+
+// Decoded samples waiting to be played. The decode thread only moves `sRingWrite` and the audio callback only moves
+// `sRingRead`, so neither has to lock.
+static float sRing[RING_SIZE];
+static std::atomic<uint64_t> sRingWrite = 0;
+static std::atomic<uint64_t> sRingRead = 0;
+
+static std::thread sDecodeThread;
+static std::atomic<bool> sStop = false;
+static std::atomic<bool> sDecodeDone = false;
+// Set by the audio callback once everything decoded has been played
+static std::atomic<bool> sFinished = false;
+static std::atomic<bool> sFailed = false;
+static std::atomic<uint64_t> sFramesPlayed = 0;
+// Only written by the decode thread before the device is started or by the UI thread while it isn't running
+static char sError[256];
+static uint32_t sNumChannels = 0;
+static std::atomic<uint32_t> sSampleRate = 0;
+static std::atomic<uint64_t> sNumFrames = 0;
+static SDL_AudioDeviceID sDevice = 0;
+static bool sAudioInit = false;
+
+static const Archive* sArchive = nullptr;
+static std::string sPath;
+static bool sActive = false;
+
+static void AudioCallback(void* userData, Uint8* stream, int len) {
+    float* out = (float*)stream;
+    const size_t numSamples = len / sizeof(float);
+    const uint64_t read = sRingRead.load(std::memory_order_relaxed);
+    const uint64_t write = sRingWrite.load(std::memory_order_acquire);
+    const size_t available = (size_t)std::min<uint64_t>(numSamples, write - read);
+
+    for (size_t i = 0; i < available; i++) {
+        out[i] = sRing[(read + i) & (RING_SIZE - 1)];
+    }
+    memset(out + available, 0, (numSamples - available) * sizeof(float));
+    sRingRead.store(read + available, std::memory_order_release);
+    sFramesPlayed.fetch_add(available / sNumChannels, std::memory_order_relaxed);
+    if (available < numSamples && sDecodeDone.load(std::memory_order_acquire)) {
+        sFinished.store(true, std::memory_order_release);
+    }
+}
+
+static void FailPreview(const char* fmt, const char* arg) {
+    snprintf(sError, sizeof(sError), fmt, arg);
+    sFailed.store(true, std::memory_order_release);
+}
+
+static void WriteRing(const float* samples, size_t numSamples) {
+    const uint64_t write = sRingWrite.load(std::memory_order_relaxed);
+    for (size_t i = 0; i < numSamples; i++) {
+        sRing[(write + i) & (RING_SIZE - 1)] = samples[i];
+    }
+    sRingWrite.store(write + numSamples, std::memory_order_release);
+}
+
+static void PreviewWorker(Archive* a, std::string path) {
+    std::unique_ptr<ArchiveFileReader> reader = a != nullptr ? a->OpenFileReader(path.c_str()) : OpenDiskFileReader(path.c_str());
+    if (reader == nullptr) {
+        FailPreview("Failed to open %s", path.c_str());
+        return;
+    }
+    std::unique_ptr<AudioDecoder> decoder = OpenAudioDecoder(reader.get());
+    if (decoder == nullptr) {
+        FailPreview("%s isn't a supported audio file", path.c_str());
+        return;
+    }
+    // SDL takes the channel count as a byte
+    if (decoder->numChannels == 0 || decoder->numChannels > UINT8_MAX) {
+        FailPreview("%s has an unsupported number of channels", path.c_str());
+        return;
+    }
+    sNumChannels = decoder->numChannels;
+    sSampleRate = decoder->sampleRate;
+    sNumFrames = decoder->numFrames;
+
+    // A block has to fit in the ring or there would never be room to write it
+    const size_t blockFrames = std::min(BLOCK_FRAMES, RING_SIZE / sNumChannels);
+    // Fill the first block before opening the device so it doesn't start on silence
+    std::vector<float> block(blockFrames * sNumChannels);
+    size_t framesDecoded = decoder->Decode(block.data(), blockFrames);
+    WriteRing(block.data(), framesDecoded * sNumChannels);
+
+    if (!sAudioInit) {
+        if (SDL_InitSubSystem(SDL_INIT_AUDIO) != 0) {
+            FailPreview("Failed to start audio: %s", SDL_GetError());
+            return;
+        }
+        sAudioInit = true;
+    }
+    // SDL converts to whatever the device wants
+    SDL_AudioSpec want = {};
+    want.freq = (int)decoder->sampleRate;
+    want.format = AUDIO_F32SYS;
+    want.channels = (Uint8)sNumChannels;
+    want.samples = 512;
+    want.callback = AudioCallback;
+    sDevice = SDL_OpenAudioDevice(nullptr, 0, &want, nullptr, 0);
+    if (sDevice == 0) {
+        FailPreview("Failed to open audio device: %s", SDL_GetError());
+        return;
+    }
+    SDL_PauseAudioDevice(sDevice, 0);
+
+    while (framesDecoded != 0 && !sStop.load(std::memory_order_relaxed)) {
+        const uint64_t used = sRingWrite.load(std::memory_order_relaxed) - sRingRead.load(std::memory_order_acquire);
+        if (RING_SIZE - used < block.size()) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(5));
+            continue;
+        }
+        framesDecoded = decoder->Decode(block.data(), blockFrames);
+        WriteRing(block.data(), framesDecoded * sNumChannels);
+    }
+    sDecodeDone.store(true, std::memory_order_release);
+}
+
+void StartAudioPreview(Archive* a, const char* path) {
+    StopAudioPreview();
+    sArchive = a;
+    sPath = path;
+    sActive = true;
+    sStop = false;
+    sDecodeDone = false;
+    sFinished = false;
+    sFailed = false;
+    sFramesPlayed = 0;
+    sSampleRate = 0;
+    sNumFrames = 0;
+    sRingWrite = 0;
+    sRingRead = 0;
+    sError[0] = 0;
+    sDecodeThread = std::thread(PreviewWorker, a, sPath);
+}
+
+void StopAudioPreview() {
+    sStop = true;
+    if (sDecodeThread.joinable()) {
+        sDecodeThread.join();
+    }
+    if (sDevice != 0) {
+        SDL_CloseAudioDevice(sDevice);
+        sDevice = 0;
+    }
+    sActive = false;
+    sArchive = nullptr;
+    sPath.clear();
+}
+
+bool IsAudioPreviewPlaying(const Archive* a, const char* path) {
+    return sActive && sArchive == a && sPath == path && !sFinished.load(std::memory_order_acquire) &&
+           !sFailed.load(std::memory_order_acquire);
+}
+
+bool GetAudioPreviewProgress(float* played, float* length) {
+    if (!sActive || sFinished.load(std::memory_order_acquire) || sFailed.load(std::memory_order_acquire) || sSampleRate == 0) {
+        return false;
+    }
+    const uint32_t sampleRate = sSampleRate.load(std::memory_order_relaxed);
+    *played = (float)sFramesPlayed.load(std::memory_order_relaxed) / sampleRate;
+    *length = (float)sNumFrames.load(std::memory_order_relaxed) / sampleRate;
+    return true;
+}
+
+const char* GetAudioPreviewError() {
+    return sFailed.load(std::memory_order_acquire) ? sError : nullptr;
+}
+
+void DrawAudioPreviewStatus() {
+    float played;
+    float length;
+    const char* error = GetAudioPreviewError();
+    if (GetAudioPreviewProgress(&played, &length)) {
+        ImGui::SameLine();
+        if (length > 0.0f) {
+            ImGui::Text(ICON_FA_PLAY " %.1f / %.1f s", played, length);
+        } else {
+            ImGui::Text(ICON_FA_PLAY " %.1f s", played);
+        }
+    } else if (error != nullptr) {
+        ImGui::SameLine();
+        ImGui::TextUnformatted(error);
+    }
+}
+
+void ShutdownAudioPreview() {
+    StopAudioPreview();
+    if (sAudioInit) {
+        SDL_QuitSubSystem(SDL_INIT_AUDIO);
+        sAudioInit = false;
+    }
+}
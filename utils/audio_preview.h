@@ -0,0 +1,27 @@
+#ifndef AUDIO_PREVIEW_H
+#define AUDIO_PREVIEW_H
+
+#include "archive.h"
+
+// Plays one audio file at a time so it can be listened to before it is packed or extracted. The file is decoded a
+// block at a time on a background thread while it plays, so playback starts as soon as the first block is decoded no
+// matter how long the file is. WAV, MP3, FLAC, Ogg Vorbis and Ogg Opus are supported. The format is detected from the
+// file's contents.
+
+// Starts playing `path` from `a`, or from disk if `a` is null. Stops whatever was already playing. `a` must stay open
+// until the preview is stopped.
+void StartAudioPreview(Archive* a, const char* path);
+void StopAudioPreview();
+// Returns true while `path` from `a` is playing.
+bool IsAudioPreviewPlaying(const Archive* a, const char* path);
+// Gets how many seconds have been played and the length of the file in seconds, or 0 if the format doesn't store it.
+// Returns false if nothing is playing.
+bool GetAudioPreviewProgress(float* played, float* length);
+// Returns why the last preview couldn't be played, or null if it didn't fail.
+const char* GetAudioPreviewError();
+// Shows how far the preview has played, or why it failed, on the same line as the last item.
+void DrawAudioPreviewStatus();
+// Stops playback and closes the audio device. Called at shutdown.
+void ShutdownAudioPreview();
+
+#endif
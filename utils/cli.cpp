@@ -0,0 +1,595 @@
+#include "cli.h"
+#include "archive.h"
+#include "zip_archive.h"
+#include "filebox.h"
+#include "streamed_audio.h"
+#include "sequenced_audio.h"
+#include "pack_report.h"
+#include "memory_budget.h"
+#include "dir_scanner.h"
+#include "dir_packer.h"
+#include "dir_watcher.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <climits>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <thread>
+
+typedef struct CliArgs {
+    std::vector<char*> positional;
+    const char* metaPath = nullptr;
+    const char* reportPath = nullptr;
+    uint64_t memoryBudget = GetDefaultMemoryBudget();
+    bool noOpus = false;
+    bool loopSamples = false;
+    bool watch = false;
+} CliArgs;
+
+static void PrintUsage() {
+    printf(
+        "Usage: future [command] [options]\n"
+        "Without a command the GUI is started.\n"
+        "\n"
+        "Commands:\n"
+        "  pack-streamed <dir> <out>     Pack the audio files in <dir> as streamed songs. They are added to an existing <out>.\n"
+        "      --no-opus                 Don't transcode uncompressed files to opus.\n"
+        "      --loop-samples            Loop times in the meta file are in samples instead of seconds.\n"
+        "      --meta <file>             Loop points and fanfares. One song per line with tab separated fields:\n"
+        "                                file name, loop start, loop end, and optionally \"fanfare\".\n"
+        "      --memory-budget <MiB>     Memory the workers can use for decoding at once. 0 for no limit. Default is half of RAM.\n"
+        "      --report <file>           Write the timings and sizes of every file. JSON if <file> ends in .json, otherwise CSV.\n"
+        "      --watch                   Keep running and pack songs again as they change. Linux only.\n"
+        "  pack-sequenced <dir> <out>    Pack the .meta/.seq pairs and .mmrs files in <dir>. They are added to an existing <out>.\n"
+        "  create <dir> <out>            Create an archive with the same structure and files as <dir>. An existing <out> is replaced.\n"
+        "      --watch                   Keep running and update files in <out> as they change in <dir>. Linux only.\n"
+        "  list <archive>                Print the path of every file in <archive>.\n"
+        "  extract <archive> <dir> [files...]\n"
+        "                                Extract the given files, or every file, from <archive> into <dir>.\n"
+        "\n"
+        "The type of archive to create is picked from the extension of <out>: .otr/.mpq or .o2r/.zip\n");
+}
+
+static bool ParseArgs(int argc, char** argv, CliArgs* args) {
+    for (int i = 0; i < argc; i++) {
+        if (strcmp(argv[i], "--no-opus") == 0) {
+            args->noOpus = true;
+        } else if (strcmp(argv[i], "--loop-samples") == 0) {
+            args->loopSamples = true;
+        } else if (strcmp(argv[i], "--watch") == 0) {
+            args->watch = true;
+        } else if (strcmp(argv[i], "--meta") == 0 && i + 1 < argc) {
+            args->metaPath = argv[++i];
+        } else if (strcmp(argv[i], "--memory-budget") == 0 && i + 1 < argc) {
+            args->memoryBudget = strtoull(argv[++i], nullptr, 10) * 1024 * 1024;
+        } else if (strcmp(argv[i], "--report") == 0 && i + 1 < argc) {
+            args->reportPath = argv[++i];
+        } else if (argv[i][0] == '-' && argv[i][1] == '-') {
+            fprintf(stderr, "Unknown option %s\n", argv[i]);
+            return false;
+        } else {
+            args->positional.push_back(argv[i]);
+        }
+    }
+    return true;
+}
+
+// Runs `work` on another thread and prints the value of `counter` whenever it changes.
+template <class F>
+static void RunWithProgress(F work, std::atomic<unsigned int>* counter, size_t total, const char* label) {
+    std::atomic<bool> done = false;
+    std::thread worker([&]() {
+        work();
+        done = true;
+    });
+
+    unsigned int lastCount = UINT_MAX;
+    while (!done) {
+        const unsigned int count = std::min<unsigned int>(counter->load(), (unsigned int)total);
+        if (count != lastCount) {
+            printf("%s: %u/%zu\n", label, count, total);
+            fflush(stdout);
+            lastCount = count;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    }
+    worker.join();
+    printf("%s: %zu/%zu done\n", label, total, total);
+}
+
+// Copies `dir` without any trailing separators. `FillFileQueue` expects the path to end in a separator on
+// Linux and macOS, and `CreateArchiveFromList` expects it not to.
+static std::unique_ptr<char[]> CopyDirPath(const char* dir, bool withSeparator) {
+    size_t len = strlen(dir);
+    while (len > 1 && (dir[len - 1] == '/' || dir[len - 1] == PATH_SEPARATOR)) {
+        len--;
+    }
+    auto out = std::make_unique<char[]>(len + 2);
+    memcpy(out.get(), dir, len);
+    if (withSeparator) {
+        out[len++] = PATH_SEPARATOR;
+    }
+    out[len] = 0;
+    return out;
+}
+
+static std::unique_ptr<char[]> CopyQueueDirPath(const char* dir) {
+#if defined(_WIN32)
+    return CopyDirPath(dir, false);
+#else
+    return CopyDirPath(dir, true);
+#endif
+}
+
+static void FreeAlignedQueue(std::vector<char*>& queue) {
+    for (auto p : queue) {
+        operator delete[](p, std::align_val_t(2));
+    }
+    queue.clear();
+}
+
+// `replace` replaces the archive at `path` instead of adding to it, the same as the window for the command does.
+static std::unique_ptr<Archive> OpenOutputArchive(const char* path, bool replace) {
+    const ArchiveType type = GetArchiveTypeFromExt(path);
+    if (type == ArchiveType::Unchecked) {
+        fprintf(stderr, "Can't tell which type of archive to create from %s. Use .otr or .o2r\n", path);
+        return nullptr;
+    }
+    std::unique_ptr<Archive> a = replace ? CreateWriteOnlyArchiveOfType(type, path) : OpenOrCreateArchiveOfType(type, path);
+    if (!a->IsArchiveOpen()) {
+        fprintf(stderr, "Failed to open %s\n", path);
+        return nullptr;
+    }
+    return a;
+}
+
+static void ZipProgressCallback(zip_t*, double progress, void* data) {
+    int* lastPercent = (int*)data;
+    const int percent = (int)(progress * 100.0);
+    // libzip calls this every 1%. Only print every 10% so build logs stay readable.
+    if (percent / 10 != *lastPercent / 10) {
+        printf("Writing archive: %d%%\n", percent);
+        fflush(stdout);
+        *lastPercent = percent;
+    }
+}
+
+// ZIP archives do most of their work when they are closed so report the progress of that.
+static void CloseOutputArchive(Archive* a, const char* path) {
+    int lastPercent = 0;
+    printf("Writing %s\n", path);
+    fflush(stdout);
+    ZipArchive* za = dynamic_cast<ZipArchive*>(a);
+    if (za != nullptr) {
+        za->RegisterProgressCallback(ZipProgressCallback, &lastPercent);
+    }
+    a->CloseArchive();
+}
+
+// Starts `watcher` on `dir` for `--watch`. Returns false if it can't be watched.
+static bool StartWatching(DirWatcher* watcher, const char* dir, bool recursive) {
+    if (!DIR_WATCH_SUPPORTED) {
+        fprintf(stderr, "--watch is only supported on Linux\n");
+        return false;
+    }
+    if (!watcher->Start(dir, {}, recursive)) {
+        fprintf(stderr, "Failed to watch %s\n", dir);
+        return false;
+    }
+    return true;
+}
+
+// Writes out `a` and calls `apply` with each batch of changes from `watcher`. The archive is complete on disk after
+// every batch so this runs until the program is stopped.
+template <class F>
+static void WatchForChanges(DirWatcher* watcher, const char* dir, Archive* a, const char* path, F apply) {
+    std::vector<DirChange> changes;
+    if (!a->FlushArchive()) {
+        fprintf(stderr, "Failed to write %s\n", path);
+    }
+    printf("Watching %s for changes. Press Ctrl+C to stop.\n", dir);
+    fflush(stdout);
+    while (watcher->WaitForChanges(&changes)) {
+        const auto start = std::chrono::steady_clock::now();
+        const bool ok = apply(changes);
+        const double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        printf("Applied %zu changes in %.0f ms%s\n", changes.size(), ms,
+               ok ? "" : ". Some files couldn't be read or the archive couldn't be written");
+        fflush(stdout);
+        changes.clear();
+    }
+}
+
+static bool IsDir(const char* path) {
+    std::error_code ec;
+    if (!std::filesystem::is_directory(path, ec)) {
+        fprintf(stderr, "%s is not a directory\n", path);
+        return false;
+    }
+    return true;
+}
+
+static void LoadMetaFile(const char* path, std::unordered_map<char*, SeqMetaInfo>& seqMetaMap, bool loopTimeInSamples) {
+    FILE* file = fopen(path, "r");
+    char line[1024];
+    unsigned int lineNum = 0;
+
+    if (file == nullptr) {
+        fprintf(stderr, "Failed to open meta file %s. Using the default loop points.\n", path);
+        return;
+    }
+
+    while (fgets(line, sizeof(line), file) != nullptr) {
+        char* fields[4] = {};
+        size_t numFields = 0;
+        char* cur = line;
+
+        lineNum++;
+        line[strcspn(line, "\r\n")] = 0;
+        if (line[0] == 0 || line[0] == '#') {
+            continue;
+        }
+        while (numFields < 4) {
+            fields[numFields++] = cur;
+            char* tab = strchr(cur, '\t');
+            if (tab == nullptr) {
+                break;
+            }
+            *tab = 0;
+            cur = tab + 1;
+        }
+        if (numFields < 3) {
+            fprintf(stderr, "%s:%u: Expected at least 3 tab separated fields\n", path, lineNum);
+            continue;
+        }
+
+        // The map is keyed by pointers into the file queue so it has to be searched by name.
+        SeqMetaInfo* info = nullptr;
+        for (auto& e : seqMetaMap) {
+            if (strcmp(e.first, fields[0]) == 0) {
+                info = &e.second;
+                break;
+            }
+        }
+        if (info == nullptr) {
+            fprintf(stderr, "%s:%u: %s is not in the input directory\n", path, lineNum, fields[0]);
+            continue;
+        }
+        if (loopTimeInSamples) {
+            info->loopStart.i = (uint32_t)strtoul(fields[1], nullptr, 10);
+            info->loopEnd.i = (uint32_t)strtoul(fields[2], nullptr, 10);
+        } else {
+            info->loopStart.f = strtof(fields[1], nullptr);
+            info->loopEnd.f = strtof(fields[2], nullptr);
+        }
+        info->fanfare = numFields > 3 && strcmp(fields[3], "fanfare") == 0;
+    }
+    fclose(file);
+}
+
+static int PackStreamedCmd(const CliArgs* args) {
+    std::vector<char*> fileQueue;
+    std::unordered_map<char*, SeqMetaInfo> seqMetaMap;
+    std::atomic<unsigned int> filesProcessed = 0;
+    PackReport report;
+    PackReportSummary summary;
+    bool success = false;
+
+    if (args->positional.size() != 2) {
+        PrintUsage();
+        return 2;
+    }
+    if (!IsDir(args->positional[0])) {
+        return 1;
+    }
+
+    auto dir = CopyQueueDirPath(args->positional[0]);
+    FillFileQueue(fileQueue, dir.get(), IsStreamedAudioFile);
+    if (fileQueue.empty()) {
+        fprintf(stderr, "No audio files found in %s\n", args->positional[0]);
+        return 1;
+    }
+    std::sort(fileQueue.begin(), fileQueue.end(), [](char* a, char* b) {
+        return strcmp(a, b) < 0;
+    });
+    FillSeqMetaMap(fileQueue, seqMetaMap);
+    if (args->metaPath != nullptr) {
+        LoadMetaFile(args->metaPath, seqMetaMap, args->loopSamples);
+    }
+    // The map is keyed by pointers into the queue, which is freed once the songs are packed
+    std::unordered_map<std::string, SeqMetaInfo> metaByName;
+    for (const auto& e : seqMetaMap) {
+        metaByName.emplace(e.first, e.second);
+    }
+
+    // Started before packing so songs that change while packing aren't missed
+    DirWatcher watcher;
+    if (args->watch && !StartWatching(&watcher, dir.get(), false)) {
+        ClearStreamedFileQueue(&fileQueue);
+        return 1;
+    }
+
+    std::unique_ptr<Archive> a = OpenOutputArchive(args->positional[1], false);
+    if (a == nullptr) {
+        ClearStreamedFileQueue(&fileQueue);
+        return 1;
+    }
+
+    RunWithProgress([&]() {
+        success = PackStreamedAudio(&fileQueue, &seqMetaMap, args->loopSamples, !args->noOpus, &filesProcessed, args->memoryBudget, &report, a.get());
+    }, &filesProcessed, fileQueue.size(), "Packing");
+
+    ClearStreamedFileQueue(&fileQueue);
+
+    report.Summarize(&summary);
+    printf("Packed %zu files (%zu failed), %.1fs of audio in %.1fs. %.2f MiB -> %.2f MiB\n", summary.numFiles, summary.numFailed,
+           summary.audioSeconds, summary.wallMs / 1000.0, summary.inputSize / (1024.0 * 1024.0), summary.outputSize / (1024.0 * 1024.0));
+    if (args->reportPath != nullptr && !report.Write(args->reportPath)) {
+        fprintf(stderr, "Failed to write report %s\n", args->reportPath);
+        success = false;
+    }
+
+    if (args->watch) {
+        std::set<std::string> names;
+        for (const auto& e : metaByName) {
+            names.insert(e.first);
+        }
+        WatchForChanges(&watcher, args->positional[0], a.get(), args->positional[1], [&](const std::vector<DirChange>& changes) {
+            return ApplyStreamedAudioChanges(changes, dir.get(), metaByName, args->loopSamples, !args->noOpus, args->memoryBudget, &names, a.get());
+        });
+    }
+    CloseOutputArchive(a.get(), args->positional[1]);
+    return success ? 0 : 1;
+}
+
+static int PackSequencedCmd(const CliArgs* args) {
+    std::vector<char*> fileQueue;
+    std::vector<char*> mmrsFiles;
+    std::vector<std::pair<char*, char*>> filePairs;
+    std::atomic<unsigned int> filesProcessed = 0;
+
+    if (args->positional.size() != 2) {
+        PrintUsage();
+        return 2;
+    }
+    if (!IsDir(args->positional[0])) {
+        return 1;
+    }
+
+    auto dir = CopyQueueDirPath(args->positional[0]);
+    FillFileQueue(fileQueue, dir.get(), IsSequenceFile);
+    FillFileQueue(mmrsFiles, dir.get(), IsMMRSFile);
+    if (fileQueue.empty() && mmrsFiles.empty()) {
+        fprintf(stderr, "No sequences found in %s\n", args->positional[0]);
+        return 1;
+    }
+    if (!fileQueue.empty() && CreateSeqFilePairs(fileQueue, filePairs) != CheckState::Good) {
+        fprintf(stderr, "Every .meta file needs a sequence with the same name and every sequence needs a .meta file\n");
+        FreeAlignedQueue(fileQueue);
+        FreeAlignedQueue(mmrsFiles);
+        return 1;
+    }
+
+    std::unique_ptr<Archive> a = OpenOutputArchive(args->positional[1], false);
+    if (a == nullptr) {
+        FreeAlignedQueue(fileQueue);
+        FreeAlignedQueue(mmrsFiles);
+        return 1;
+    }
+
+    unsigned int numFailed = 0;
+    RunWithProgress([&]() {
+        numFailed += PackSequenceFiles(&filePairs, &filesProcessed, a.get());
+        numFailed += PackMMRSFiles(&mmrsFiles, &filesProcessed, a.get());
+    }, &filesProcessed, filePairs.size() + mmrsFiles.size(), "Packing");
+    if (numFailed != 0) {
+        fprintf(stderr, "%u sequences couldn't be packed and were skipped\n", numFailed);
+    }
+
+    CloseOutputArchive(a.get(), args->positional[1]);
+    FreeAlignedQueue(fileQueue);
+    FreeAlignedQueue(mmrsFiles);
+    return numFailed == 0 ? 0 : 1;
+}
+
+static int CreateFromDirCmd(const CliArgs* args) {
+    std::vector<char*> files;
+
+    if (args->positional.size() != 2) {
+        PrintUsage();
+        return 2;
+    }
+    if (!IsDir(args->positional[0])) {
+        return 1;
+    }
+
+    auto dir = CopyDirPath(args->positional[0], false);
+    // Started before scanning so files that change while packing aren't missed
+    DirWatcher watcher;
+    if (args->watch && !StartWatching(&watcher, dir.get(), true)) {
+        return 1;
+    }
+    DirScanner scanner;
+    scanner.Start(dir.get());
+    scanner.Wait();
+    scanner.TakeFiles(&files);
+    if (scanner.GetNumErrors() != 0) {
+        fprintf(stderr, "Failed to read %zu directories under %s. Their files are skipped.\n", scanner.GetNumErrors(), dir.get());
+    }
+
+    std::unique_ptr<Archive> a = OpenOutputArchive(args->positional[1], true);
+    if (a == nullptr) {
+        for (auto f : files) {
+            delete[] f;
+        }
+        return 1;
+    }
+
+    printf("Adding %zu files from %s\n", files.size(), dir.get());
+    std::set<std::string> names;
+    if (args->watch) {
+        names = GetDirPackNames(files, dir.get());
+    }
+    DirPackProgress progress = {};
+    std::atomic<bool> done = false;
+    bool success = false;
+    std::thread worker([&]() {
+        // Frees the paths in `files`
+        success = PackDirectory(&files, dir.get(), a.get(), DIR_PACK_READ_AHEAD, DIR_PACK_MAX_OPEN_FILES, &progress);
+        done = true;
+    });
+    int lastPercent = -1;
+    while (!done) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        double fraction;
+        double secondsLeft;
+        GetDirPackEstimate(&progress, &fraction, &secondsLeft);
+        const int percent = (int)(fraction * 100.0);
+        // Only print every 10% so build logs stay readable
+        if (percent / 10 == lastPercent / 10 || done) {
+            continue;
+        }
+        lastPercent = percent;
+        printf("Packing: %d%% (%.1f MiB)", percent, progress.bytesWritten.load() / (1024.0 * 1024.0));
+        if (secondsLeft >= 0.0) {
+            printf(", %.0fs left", secondsLeft);
+        }
+        printf("\n");
+        fflush(stdout);
+    }
+    worker.join();
+    if (!success) {
+        fprintf(stderr, "%u files couldn't be read and were skipped\n", progress.numFailed.load());
+    }
+    if (args->watch) {
+        WatchForChanges(&watcher, args->positional[0], a.get(), args->positional[1], [&](const std::vector<DirChange>& changes) {
+            return ApplyDirChanges(changes, dir.get(), {}, a.get(), &names, &progress);
+        });
+    }
+    CloseOutputArchive(a.get(), args->positional[1]);
+    return success ? 0 : 1;
+}
+
+static std::unique_ptr<Archive> OpenInputArchive(const char* path) {
+    const ArchiveType type = GetArchiveTypeFromFile(path);
+    if (type == ArchiveType::Unchecked) {
+        fprintf(stderr, "%s is not an OTR or O2R archive\n", path);
+        return nullptr;
+    }
+    std::unique_ptr<Archive> a = CreateArchiveOfType(type, path);
+    if (!a->IsArchiveOpen()) {
+        fprintf(stderr, "Failed to open %s\n", path);
+        return nullptr;
+    }
+    return a;
+}
+
+static int ListCmd(const CliArgs* args) {
+    if (args->positional.size() != 1) {
+        PrintUsage();
+        return 2;
+    }
+
+    std::unique_ptr<Archive> a = OpenInputArchive(args->positional[0]);
+    if (a == nullptr) {
+        return 1;
+    }
+    a->GenFileList();
+    for (const auto f : a->files) {
+        printf("%s\n", f);
+    }
+    a->CloseArchive();
+    return 0;
+}
+
+static int ExtractCmd(const CliArgs* args) {
+    std::vector<const char*> toExtract;
+    size_t numFailed = 0;
+    int lastPercent = -1;
+
+    if (args->positional.size() < 2) {
+        PrintUsage();
+        return 2;
+    }
+
+    std::unique_ptr<Archive> a = OpenInputArchive(args->positional[0]);
+    if (a == nullptr) {
+        return 1;
+    }
+    if (args->positional.size() > 2) {
+        toExtract.assign(args->positional.begin() + 2, args->positional.end());
+    } else {
+        a->GenFileList();
+        toExtract = a->files;
+    }
+
+    const std::filesystem::path outDir(args->positional[1]);
+    for (size_t i = 0; i < toExtract.size(); i++) {
+        // MPQ paths use '\' as the separator.
+        std::string relPath = toExtract[i];
+        std::replace(relPath.begin(), relPath.end(), '\\', '/');
+        const std::filesystem::path rel = std::filesystem::path(relPath).relative_path();
+        if (std::find(rel.begin(), rel.end(), "..") != rel.end()) {
+            fprintf(stderr, "Skipping %s. It would be written outside of %s\n", toExtract[i], args->positional[1]);
+            numFailed++;
+            continue;
+        }
+        const std::filesystem::path outPath = outDir / rel;
+        std::error_code ec;
+        std::filesystem::create_directories(outPath.parent_path(), ec);
+        if (!ExtractArchiveFile(a.get(), toExtract[i], outPath.string().c_str())) {
+            fprintf(stderr, "Failed to extract %s\n", toExtract[i]);
+            numFailed++;
+        }
+
+        const int percent = (int)(((i + 1) * 100) / toExtract.size());
+        if (percent / 10 != lastPercent / 10) {
+            printf("Extracting: %zu/%zu\n", i + 1, toExtract.size());
+            fflush(stdout);
+            lastPercent = percent;
+        }
+    }
+    a->CloseArchive();
+
+    if (numFailed != 0) {
+        fprintf(stderr, "%zu of %zu files could not be extracted\n", numFailed, toExtract.size());
+        return 1;
+    }
+    return 0;
+}
+
+int RunCli(int argc, char** argv) {
+    CliArgs args;
+    const char* cmd = argv[1];
+
+    // There is no window to show message boxes on.
+    SetHeadless(true);
+
+    if (strcmp(cmd, "help") == 0 || strcmp(cmd, "-h") == 0 || strcmp(cmd, "--help") == 0) {
+        PrintUsage();
+        return 0;
+    }
+    if (!ParseArgs(argc - 2, argv + 2, &args)) {
+        PrintUsage();
+        return 2;
+    }
+
+    if (strcmp(cmd, "pack-streamed") == 0) {
+        return PackStreamedCmd(&args);
+    } else if (strcmp(cmd, "pack-sequenced") == 0) {
+        return PackSequencedCmd(&args);
+    } else if (strcmp(cmd, "create") == 0) {
+        return CreateFromDirCmd(&args);
+    } else if (strcmp(cmd, "list") == 0) {
+        return ListCmd(&args);
+    } else if (strcmp(cmd, "extract") == 0) {
+        return ExtractCmd(&args);
+    }
+
+    fprintf(stderr, "Unknown command %s\n", cmd);
+    PrintUsage();
+    return 2;
+}
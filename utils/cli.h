@@ -0,0 +1,8 @@
+#ifndef CLI_H
+#define CLI_H
+
+// Runs one command from the command line without creating a window or initializing SDL/OpenGL.
+// Returns the exit code for the process.
+int RunCli(int argc, char** argv);
+
+#endif
@@ -0,0 +1,399 @@
+#include "dir_packer.h"
+#include "archive.h"
+#include "dir_scanner.h"
+#include "filebox.h"
+#include "memory_budget.h"
+#include "mio.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <mutex>
+#include <thread>
+
+// Files at least this big are mapped instead of read so one file can't take up the whole read ahead
+static constexpr uint64_t MAP_THRESHOLD = 16ull * 1024 * 1024;
+
+typedef struct PendingFile {
+    char* path;
+    ArchiveDataInfo info;
+    // Bytes reserved from the read ahead budget
+    uint64_t reserved;
+} PendingFile;
+
+typedef struct PackState {
+    std::vector<char*>* list;
+    size_t nameOffset;
+    MemoryBudget* budget;
+    DirPackProgress* progress;
+    std::atomic<size_t> next;
+
+    std::mutex lock;
+    std::condition_variable cond;
+    std::vector<PendingFile> done;
+    // Files that have been read or failed. The writer is done once this reaches the size of the list.
+    size_t numFinished;
+} PackState;
+
+// Names start after the base path and the separator following it, if the base path doesn't already end in one
+static size_t GetNameOffset(const char* basePath) {
+    size_t nameOffset = strlen(basePath);
+    if (nameOffset != 0 && basePath[nameOffset - 1] != '/' && basePath[nameOffset - 1] != PATH_SEPARATOR) {
+        nameOffset++;
+    }
+    return nameOffset;
+}
+
+static int64_t NowMs() {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Opens `path` and gets its size in one go so every file is only `stat`ed once.
+// Returns false if the file couldn't be opened.
+#if defined(_WIN32)
+static bool OpenDiskFile(const char* path, HANDLE* handle, uint64_t* size) {
+    *handle = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (*handle == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+    LARGE_INTEGER li;
+    if (!GetFileSizeEx(*handle, &li)) {
+        CloseHandle(*handle);
+        return false;
+    }
+    *size = (uint64_t)li.QuadPart;
+    return true;
+}
+
+static bool ReadDiskFile(HANDLE handle, void* out, uint64_t size) {
+    uint8_t* p = (uint8_t*)out;
+    while (size != 0) {
+        DWORD numRead;
+        const DWORD chunk = (DWORD)std::min<uint64_t>(size, 1u << 30);
+        if (!::ReadFile(handle, p, chunk, &numRead, nullptr) || numRead == 0) {
+            return false;
+        }
+        p += numRead;
+        size -= numRead;
+    }
+    return true;
+}
+
+static void CloseDiskFile(HANDLE handle) {
+    CloseHandle(handle);
+}
+#else
+static bool OpenDiskFile(const char* path, int* fd, uint64_t* size) {
+    *fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (*fd < 0) {
+        return false;
+    }
+    struct stat st;
+    if (fstat(*fd, &st) != 0) {
+        close(*fd);
+        return false;
+    }
+    *size = (uint64_t)st.st_size;
+    return true;
+}
+
+static bool ReadDiskFile(int fd, void* out, uint64_t size) {
+    uint8_t* p = (uint8_t*)out;
+    while (size != 0) {
+        const ssize_t numRead = read(fd, p, std::min<uint64_t>(size, 1u << 30));
+        if (numRead < 0 && errno == EINTR) {
+            continue;
+        }
+        if (numRead <= 0) {
+            return false;
+        }
+        p += numRead;
+        size -= numRead;
+    }
+    return true;
+}
+
+static void CloseDiskFile(int fd) {
+    close(fd);
+}
+#endif
+
+// Reads one file into `out`. The read ahead is reserved while the file is open so at most one file per reader waits on
+// the budget.
+static bool ReadOneFile(PackState* state, char* path, PendingFile* out) {
+#if defined(_WIN32)
+    HANDLE file;
+#else
+    int file;
+#endif
+    uint64_t size;
+    if (!OpenDiskFile(path, &file, &size)) {
+        return false;
+    }
+    state->progress->bytesOpened.fetch_add(size, std::memory_order_relaxed);
+    state->progress->filesOpened.fetch_add(1, std::memory_order_relaxed);
+
+    out->path = path;
+    out->reserved = 0;
+    if (size == 0) {
+        CloseDiskFile(file);
+        out->info = { .data = nullptr, .size = 0, .mode = DataCopy };
+        return true;
+    }
+    if (size >= MAP_THRESHOLD) {
+        CloseDiskFile(file);
+        std::error_code ec;
+        mio::mmap_source map;
+        map.map(path, ec);
+        if (ec) {
+            return false;
+        }
+        map.release();
+        out->info = { .data = (void*)map.data(), .size = map.size(), .mode = MMappedFile };
+        return true;
+    }
+
+    state->budget->Acquire(size);
+    void* data = malloc(size);
+    if (data == nullptr || !ReadDiskFile(file, data, size)) {
+        free(data);
+        CloseDiskFile(file);
+        state->budget->Release(size);
+        return false;
+    }
+    CloseDiskFile(file);
+    out->info = { .data = data, .size = size, .mode = DataOwned };
+    out->reserved = size;
+    return true;
+}
+
+static void ReaderThread(PackState* state) {
+    std::vector<char*>& list = *state->list;
+    while (true) {
+        const size_t i = state->next.fetch_add(1, std::memory_order_relaxed);
+        if (i >= list.size()) {
+            return;
+        }
+        PendingFile file;
+        const bool ok = ReadOneFile(state, list[i], &file);
+        {
+            std::lock_guard<std::mutex> lock(state->lock);
+            if (ok) {
+                state->done.push_back(file);
+            } else {
+                printf("Failed to read %s\n", list[i]);
+                state->progress->numFailed.fetch_add(1, std::memory_order_relaxed);
+            }
+            state->numFinished++;
+        }
+        state->cond.notify_one();
+    }
+}
+
+bool PackDirectory(std::vector<char*>* list, const char* basePath, Archive* a, uint64_t readAhead, unsigned int maxOpenFiles,
+                   DirPackProgress* progress) {
+    progress->bytesWritten = 0;
+    progress->bytesOpened = 0;
+    progress->filesOpened = 0;
+    progress->filesWritten = 0;
+    progress->numFailed = 0;
+    progress->numFiles = (uint32_t)list->size();
+    progress->startTimeMs = NowMs();
+
+    MemoryBudget budget(readAhead);
+    PackState state;
+    state.list = list;
+    state.nameOffset = GetNameOffset(basePath);
+    state.budget = &budget;
+    state.progress = progress;
+    state.next = 0;
+    state.numFinished = 0;
+
+    // Each reader has at most one file open. Reads mostly wait on the disk so there can be more readers than cores.
+    const unsigned int numReaders = (unsigned int)std::clamp<size_t>(list->size(), 1, std::max(maxOpenFiles, 1u));
+    std::vector<std::thread> readers;
+    for (unsigned int i = 0; i < numReaders; i++) {
+        readers.emplace_back(ReaderThread, &state);
+    }
+
+    // Files are written as soon as they are read instead of in list order. Waiting on a slow file would leave the read
+    // ahead full of files that can't be written and stop every reader.
+    std::vector<PendingFile> batch;
+    size_t numHandled = 0;
+    while (numHandled < list->size()) {
+        {
+            std::unique_lock<std::mutex> lock(state.lock);
+            state.cond.wait(lock, [&state, numHandled]() {
+                return !state.done.empty() || state.numFinished > numHandled;
+            });
+            batch.swap(state.done);
+            numHandled = state.numFinished;
+        }
+        for (PendingFile& f : batch) {
+            const size_t size = f.info.size;
+            // The archive frees or unmaps the data once it is written
+            a->WriteFile(&f.path[state.nameOffset], &f.info);
+            budget.Release(f.reserved);
+            progress->bytesWritten.fetch_add(size, std::memory_order_relaxed);
+            progress->filesWritten.fetch_add(1, std::memory_order_relaxed);
+        }
+        batch.clear();
+    }
+
+    for (std::thread& t : readers) {
+        t.join();
+    }
+    for (char* p : *list) {
+        delete[] p;
+    }
+    list->clear();
+    return progress->numFailed == 0;
+}
+
+std::set<std::string> GetDirPackNames(const std::vector<char*>& list, const char* basePath) {
+    const size_t nameOffset = GetNameOffset(basePath);
+    std::set<std::string> names;
+    for (const char* path : list) {
+        names.emplace(&path[nameOffset]);
+    }
+    return names;
+}
+
+// Returns true if `name` is in the directory `dir`, or one under it. Everything is under the root, which is empty.
+static bool IsUnderDir(const std::string& name, const std::string& dir) {
+    return dir.empty() || (name.size() > dir.size() && name.compare(0, dir.size(), dir) == 0 && name[dir.size()] == PATH_SEPARATOR);
+}
+
+static bool IsUnderAnyDir(const std::string& name, const std::vector<std::string>& dirs) {
+    return std::any_of(dirs.begin(), dirs.end(), [&name](const std::string& dir) {
+        return IsUnderDir(name, dir);
+    });
+}
+
+// Allocates the path on disk of the file named `name` in the archive, the way `DirScanner` allocates them
+static char* MakeDiskPath(const char* basePath, size_t nameOffset, const std::string& name) {
+    const size_t baseLen = strlen(basePath);
+    char* path = new char[nameOffset + name.size() + 1];
+    memcpy(path, basePath, baseLen);
+    if (nameOffset != baseLen) {
+        path[baseLen] = PATH_SEPARATOR;
+    }
+    memcpy(&path[nameOffset], name.c_str(), name.size() + 1);
+    return path;
+}
+
+bool ApplyDirChanges(const std::vector<DirChange>& changes, const char* basePath, const std::vector<std::string>& ignorePatterns,
+                     Archive* a, std::set<std::string>* names, DirPackProgress* progress) {
+    const size_t nameOffset = GetNameOffset(basePath);
+    std::vector<std::string> rescanDirs;
+    std::vector<char*> toPack;
+
+    for (const DirChange& change : changes) {
+        if (change.type == DirChangeType::Modified) {
+            if (change.isDir) {
+                rescanDirs.push_back(change.path);
+            } else {
+                toPack.push_back(MakeDiskPath(basePath, nameOffset, change.path));
+            }
+            continue;
+        }
+        if (!change.isDir) {
+            a->RemoveFile(change.path.c_str());
+            names->erase(change.path);
+            continue;
+        }
+        for (auto it = names->lower_bound(change.path); it != names->end() && it->compare(0, change.path.size(), change.path) == 0;) {
+            if (IsUnderDir(*it, change.path)) {
+                a->RemoveFile(it->c_str());
+                it = names->erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
+
+    if (!rescanDirs.empty()) {
+        // The whole tree is scanned so ignore patterns with separators match the same way they did for the first pack
+        std::vector<char*> found;
+        DirScanner scanner;
+        scanner.Start(basePath, ignorePatterns);
+        scanner.Wait();
+        scanner.TakeFiles(&found);
+        const std::set<std::string> foundNames = GetDirPackNames(found, basePath);
+        for (auto it = names->begin(); it != names->end();) {
+            if (IsUnderAnyDir(*it, rescanDirs) && !foundNames.contains(*it)) {
+                a->RemoveFile(it->c_str());
+                it = names->erase(it);
+            } else {
+                ++it;
+            }
+        }
+        for (char* path : found) {
+            if (IsUnderAnyDir(&path[nameOffset], rescanDirs)) {
+                toPack.push_back(path);
+            } else {
+                delete[] path;
+            }
+        }
+    }
+
+    // A file can be changed on its own and be in a directory that is scanned again
+    std::sort(toPack.begin(), toPack.end(), [](const char* l, const char* r) {
+        return strcmp(l, r) < 0;
+    });
+    size_t numUnique = 0;
+    for (char* path : toPack) {
+        if (numUnique != 0 && strcmp(toPack[numUnique - 1], path) == 0) {
+            delete[] path;
+        } else {
+            toPack[numUnique++] = path;
+        }
+    }
+    toPack.resize(numUnique);
+
+    bool ret = true;
+    if (!toPack.empty()) {
+        for (const char* path : toPack) {
+            names->emplace(&path[nameOffset]);
+        }
+        // Frees the paths in `toPack`
+        ret = PackDirectory(&toPack, basePath, a, DIR_PACK_READ_AHEAD, DIR_PACK_MAX_OPEN_FILES, progress);
+    }
+    return a->FlushArchive() && ret;
+}
+
+void GetDirPackEstimate(const DirPackProgress* progress, double* fraction, double* secondsLeft) {
+    const uint32_t numFiles = progress->numFiles.load(std::memory_order_relaxed);
+    const uint32_t filesOpened = progress->filesOpened.load(std::memory_order_relaxed);
+    const uint32_t numFailed = progress->numFailed.load(std::memory_order_relaxed);
+    const uint64_t bytesOpened = progress->bytesOpened.load(std::memory_order_relaxed);
+    const uint64_t bytesWritten = progress->bytesWritten.load(std::memory_order_relaxed);
+
+    *fraction = 0.0;
+    *secondsLeft = -1.0;
+    if (numFiles == 0) {
+        *fraction = 1.0;
+        *secondsLeft = 0.0;
+        return;
+    }
+    if (filesOpened == 0) {
+        return;
+    }
+    double total = (double)bytesOpened;
+    const uint32_t numLeft = numFiles - std::min(numFiles, filesOpened + numFailed);
+    if (numLeft != 0) {
+        total += (double)bytesOpened / filesOpened * numLeft;
+    }
+    if (total <= 0.0) {
+        // Only empty files so far. Go by the number of files instead.
+        *fraction = (double)progress->filesWritten.load(std::memory_order_relaxed) / numFiles;
+        return;
+    }
+    *fraction = std::min((double)bytesWritten / total, 1.0);
+
+    const double elapsed = (NowMs() - progress->startTimeMs.load(std::memory_order_relaxed)) / 1000.0;
+    // The rate is too noisy to go on for the first moment
+    if (bytesWritten != 0 && elapsed >= 0.5) {
+        *secondsLeft = (total - (double)bytesWritten) / ((double)bytesWritten / elapsed);
+    }
+}
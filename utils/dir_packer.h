@@ -0,0 +1,59 @@
+#ifndef DIR_PACKER_H
+#define DIR_PACKER_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <set>
+#include <string>
+#include <vector>
+#include "dir_watcher.h"
+
+class Archive;
+
+// How much file data is read ahead of the archive writer by default
+static constexpr uint64_t DIR_PACK_READ_AHEAD = 256ull * 1024 * 1024;
+// How many files are open at once by default
+static constexpr unsigned int DIR_PACK_MAX_OPEN_FILES = 16;
+
+// Updated by `PackDirectory` as it runs so it can be polled from another thread.
+typedef struct DirPackProgress {
+    std::atomic<uint64_t> bytesWritten;
+    // Total size of the files that have been opened. Once every file is open this is the size of all of them.
+    std::atomic<uint64_t> bytesOpened;
+    std::atomic<uint32_t> filesOpened;
+    std::atomic<uint32_t> filesWritten;
+    std::atomic<uint32_t> numFailed;
+    std::atomic<uint32_t> numFiles;
+    std::atomic<int64_t> startTimeMs;
+} DirPackProgress;
+
+// Adds every file in `list` to `a`. Files are named by their path after `basePath` and a separator, the same as
+// `CreateArchiveFromList`. The paths are freed with `delete[]` and `list` is emptied.
+// Files are read by up to `maxOpenFiles` threads, each with one file open at a time, while this thread writes the ones
+// that have been read. Readers wait once `readAhead` bytes are waiting to be written. Large files are memory mapped
+// instead, so they don't count against `readAhead` and are read as they are written.
+// Files are written in the order they finish being read. `a` should be write only, see `CreateWriteOnlyArchiveOfType`,
+// or it may keep everything in memory until it is closed anyway.
+// Returns false if any file couldn't be read.
+bool PackDirectory(std::vector<char*>* list, const char* basePath, Archive* a, uint64_t readAhead, unsigned int maxOpenFiles,
+                   DirPackProgress* progress);
+
+// Names in the archive of the files in `list`, the same way `PackDirectory` names them. Used to start `ApplyDirChanges`
+// with the files of the first pack.
+std::set<std::string> GetDirPackNames(const std::vector<char*>& list, const char* basePath);
+
+// Brings `a` up to date with the changes a `DirWatcher` reported for the directory at `basePath`. Only the files that
+// changed are read and written. Directories that are added, or that have to be scanned again, are scanned with
+// `ignorePatterns` and replace everything that was under them. `names` has the name of every file in the archive and is
+// kept up to date. The archive is flushed before returning so the file on disk is complete.
+// Returns false if a file couldn't be read or the archive couldn't be written.
+bool ApplyDirChanges(const std::vector<DirChange>& changes, const char* basePath, const std::vector<std::string>& ignorePatterns,
+                     Archive* a, std::set<std::string>* names, DirPackProgress* progress);
+
+// Gets how much of the data has been written from 0 to 1 and an estimate of the seconds left. Until every file has been
+// opened the total size is estimated from the average size of the files opened so far. `secondsLeft` is negative if
+// there isn't enough to go on yet.
+void GetDirPackEstimate(const DirPackProgress* progress, double* fraction, double* secondsLeft);
+
+#endif
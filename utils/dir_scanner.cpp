@@ -0,0 +1,259 @@
+#include "dir_scanner.h"
+#include "filebox.h"
+#include "path_search.h"
+
+#include <algorithm>
+#include <cstring>
+
+// Files a thread collects before handing them out, so huge directories show up while they are still being read
+static constexpr size_t BATCH_SIZE = 4096;
+static constexpr unsigned int MAX_THREADS = 8;
+
+DirScanner::~DirScanner() {
+    Cancel();
+}
+
+void DirScanner::Start(const char* root, std::vector<std::string> ignorePatterns) {
+    Cancel();
+    mRoot = root;
+    // Joined paths look the same as `std::filesystem` joins them: no separator is added if the root already ends in one
+    if (!mRoot.empty() && mRoot.back() != '/' && mRoot.back() != PATH_SEPARATOR) {
+        mRoot.push_back(PATH_SEPARATOR);
+    }
+    mIgnorePatterns = std::move(ignorePatterns);
+    mNumFound = 0;
+    mNumErrors = 0;
+#if !defined(_WIN32)
+    mRootFd = open(root, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (mRootFd < 0) {
+        mNumErrors = 1;
+        return;
+    }
+#endif
+    mQueue.push_back({});
+    mNumPending = 1;
+    mDone = false;
+
+    const unsigned int numThreads = std::clamp(std::thread::hardware_concurrency(), 1u, MAX_THREADS);
+    for (unsigned int i = 0; i < numThreads; i++) {
+        mThreads.emplace_back(&DirScanner::Worker, this);
+    }
+}
+
+void DirScanner::Cancel() {
+    {
+        std::lock_guard<std::mutex> lock(mLock);
+        mCancel = true;
+    }
+    mQueueCond.notify_all();
+    for (std::thread& t : mThreads) {
+        t.join();
+    }
+    mThreads.clear();
+    for (char* f : mFound) {
+        delete[] f;
+    }
+    mFound.clear();
+    mQueue.clear();
+    mNumPending = 0;
+#if !defined(_WIN32)
+    if (mRootFd >= 0) {
+        close(mRootFd);
+        mRootFd = -1;
+    }
+#endif
+    mCancel = false;
+    mDone = true;
+}
+
+void DirScanner::Wait() {
+    std::unique_lock<std::mutex> lock(mLock);
+    mDoneCond.wait(lock, [this]() {
+        return mNumPending == 0;
+    });
+}
+
+bool DirScanner::IsDone() const {
+    return mDone.load(std::memory_order_acquire);
+}
+
+void DirScanner::TakeFiles(std::vector<char*>* out) {
+    std::lock_guard<std::mutex> lock(mLock);
+    out->insert(out->end(), mFound.begin(), mFound.end());
+    mFound.clear();
+}
+
+size_t DirScanner::GetNumFound() const {
+    return mNumFound.load(std::memory_order_relaxed);
+}
+
+size_t DirScanner::GetNumErrors() const {
+    return mNumErrors.load(std::memory_order_relaxed);
+}
+
+void DirScanner::Worker() {
+    std::vector<std::string> subdirs;
+    std::vector<char*> files;
+    while (true) {
+        std::string dir;
+        {
+            std::unique_lock<std::mutex> lock(mLock);
+            mQueueCond.wait(lock, [this]() {
+                return !mQueue.empty() || mNumPending == 0 || mCancel;
+            });
+            if (mCancel || mQueue.empty()) {
+                return;
+            }
+            dir = std::move(mQueue.back());
+            mQueue.pop_back();
+        }
+
+        subdirs.clear();
+        ScanDir(dir, &subdirs, &files);
+
+        std::unique_lock<std::mutex> lock(mLock);
+        mFound.insert(mFound.end(), files.begin(), files.end());
+        files.clear();
+        for (std::string& s : subdirs) {
+            mQueue.push_back(std::move(s));
+        }
+        mNumPending += subdirs.size();
+        mNumPending--;
+        if (mNumPending == 0) {
+#if !defined(_WIN32)
+            close(mRootFd);
+            mRootFd = -1;
+#endif
+            mDone.store(true, std::memory_order_release);
+            lock.unlock();
+            mQueueCond.notify_all();
+            mDoneCond.notify_all();
+        } else if (!subdirs.empty()) {
+            lock.unlock();
+            mQueueCond.notify_all();
+        }
+    }
+}
+
+void DirScanner::FlushFiles(std::vector<char*>* files) {
+    std::lock_guard<std::mutex> lock(mLock);
+    mFound.insert(mFound.end(), files->begin(), files->end());
+    files->clear();
+}
+
+static bool HasSeparator(const std::string& s) {
+    return s.find('/') != std::string::npos || s.find(PATH_SEPARATOR) != std::string::npos;
+}
+
+bool IsPathIgnored(const std::vector<std::string>& patterns, const std::string& relPath, const char* name) {
+    for (const std::string& pattern : patterns) {
+        if (!HasSeparator(pattern)) {
+            if (GlobMatch(pattern.c_str(), name)) {
+                return true;
+            }
+            continue;
+        }
+        const std::string path = relPath.empty() ? std::string(name) : relPath + PATH_SEPARATOR + name;
+        if (GlobMatch(pattern.c_str(), path.c_str())) {
+            return true;
+        }
+    }
+    return false;
+}
+
+char* DirScanner::MakeFullPath(const std::string& relPath, const char* name) const {
+    const size_t nameLen = strlen(name);
+    const size_t len = mRoot.size() + relPath.size() + (relPath.empty() ? 0 : 1) + nameLen;
+    char* path = new char[len + 1];
+    char* out = path;
+    memcpy(out, mRoot.data(), mRoot.size());
+    out += mRoot.size();
+    if (!relPath.empty()) {
+        memcpy(out, relPath.data(), relPath.size());
+        out += relPath.size();
+        *out++ = PATH_SEPARATOR;
+    }
+    memcpy(out, name, nameLen + 1);
+    return path;
+}
+
+static bool IsDotDir(const char* name) {
+    return name[0] == '.' && (name[1] == 0 || (name[1] == '.' && name[2] == 0));
+}
+
+// Adds one entry of the directory at `relPath`. Returns false if the scan was cancelled.
+bool DirScanner::AddEntry(const std::string& relPath, const char* name, bool isDir, std::vector<std::string>* subdirs,
+                          std::vector<char*>* files) {
+    if (IsPathIgnored(mIgnorePatterns, relPath, name)) {
+        return true;
+    }
+    if (isDir) {
+        subdirs->push_back(relPath.empty() ? std::string(name) : relPath + PATH_SEPARATOR + name);
+        return true;
+    }
+    files->push_back(MakeFullPath(relPath, name));
+    mNumFound.fetch_add(1, std::memory_order_relaxed);
+    if (files->size() >= BATCH_SIZE) {
+        FlushFiles(files);
+        return !mCancel;
+    }
+    return true;
+}
+
+void DirScanner::ScanDir(const std::string& relPath, std::vector<std::string>* subdirs, std::vector<char*>* files) {
+#if defined(_WIN32)
+    const std::string pattern = mRoot + relPath + (relPath.empty() ? "*" : "\\*");
+    WIN32_FIND_DATAA ffd;
+    HANDLE h = FindFirstFileExA(pattern.c_str(), FindExInfoBasic, &ffd, FindExSearchNameMatch, nullptr, FIND_FIRST_EX_LARGE_FETCH);
+    if (h == INVALID_HANDLE_VALUE) {
+        mNumErrors++;
+        return;
+    }
+    do {
+        if (IsDotDir(ffd.cFileName)) {
+            continue;
+        }
+        const bool isDir = (ffd.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) != 0;
+        // Junctions and directory links aren't followed so they can't make the scan loop
+        if (isDir && (ffd.dwFileAttributes & FILE_ATTRIBUTE_REPARSE_POINT) != 0) {
+            continue;
+        }
+        if (!AddEntry(relPath, ffd.cFileName, isDir, subdirs, files)) {
+            break;
+        }
+    } while (FindNextFileA(h, &ffd) != 0);
+    FindClose(h);
+#else
+    const int fd = openat(mRootFd, relPath.empty() ? "." : relPath.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    DIR* d = fd >= 0 ? fdopendir(fd) : nullptr;
+    if (d == nullptr) {
+        if (fd >= 0) {
+            close(fd);
+        }
+        mNumErrors++;
+        return;
+    }
+    struct dirent* entry;
+    while ((entry = readdir(d)) != nullptr) {
+        if (IsDotDir(entry->d_name)) {
+            continue;
+        }
+        bool isDir = entry->d_type == DT_DIR;
+        bool isFile = entry->d_type == DT_REG;
+        // Some file systems don't fill in the type, and links have to be followed to know what they point to
+        if (entry->d_type == DT_UNKNOWN || entry->d_type == DT_LNK) {
+            struct stat st;
+            if (fstatat(dirfd(d), entry->d_name, &st, 0) != 0) {
+                continue;
+            }
+            // Linked directories aren't followed so they can't make the scan loop
+            isDir = entry->d_type == DT_UNKNOWN && S_ISDIR(st.st_mode);
+            isFile = S_ISREG(st.st_mode);
+        }
+        if ((isDir || isFile) && !AddEntry(relPath, entry->d_name, isDir, subdirs, files)) {
+            break;
+        }
+    }
+    closedir(d);
+#endif
+}
@@ -0,0 +1,67 @@
+#ifndef DIR_SCANNER_H
+#define DIR_SCANNER_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Finds every file under a directory, including subdirectories, on background threads. Each thread takes a directory
+// off a shared queue, adds its files to the results and queues its subdirectories, so wide trees are read in parallel.
+// Files are handed out in batches while the scan is running so a list can fill in as they are found.
+// Paths are the root, a separator, then the path relative to the root, the same as `CreateArchiveFromList` expects.
+// On Linux and macOS directories are opened relative to the root with `openat` and the file type comes from the
+// directory entry, so most files are never `stat`ed and the working directory is never changed.
+// Returns true if `name`, in the directory at `relPath` relative to the root, matches one of `patterns`. Patterns can
+// use `*` and `?`, and ones with a separator are matched against the path relative to the root instead of the name.
+bool IsPathIgnored(const std::vector<std::string>& patterns, const std::string& relPath, const char* name);
+
+class DirScanner {
+public:
+    ~DirScanner();
+    // Starts scanning `root`. Files and directories that match one of `ignorePatterns` are skipped, see `IsPathIgnored`.
+    void Start(const char* root, std::vector<std::string> ignorePatterns = {});
+    // Stops the scan and frees the files that haven't been taken.
+    void Cancel();
+    // Blocks until the scan is done.
+    void Wait();
+    bool IsDone() const;
+    // Moves the files found since the last call to the end of `out`. The paths are allocated with `new[]` and are
+    // owned by the caller.
+    void TakeFiles(std::vector<char*>* out);
+    size_t GetNumFound() const;
+    // Number of directories that couldn't be opened
+    size_t GetNumErrors() const;
+private:
+    void Worker();
+    void ScanDir(const std::string& relPath, std::vector<std::string>* subdirs, std::vector<char*>* files);
+    bool AddEntry(const std::string& relPath, const char* name, bool isDir, std::vector<std::string>* subdirs, std::vector<char*>* files);
+    char* MakeFullPath(const std::string& relPath, const char* name) const;
+    void FlushFiles(std::vector<char*>* files);
+
+    std::string mRoot;
+    std::vector<std::string> mIgnorePatterns;
+#if !defined(_WIN32)
+    int mRootFd = -1;
+#endif
+    std::vector<std::thread> mThreads;
+
+    // Guards the queue and the results
+    std::mutex mLock;
+    std::condition_variable mQueueCond;
+    std::condition_variable mDoneCond;
+    // Directories left to scan, relative to the root
+    std::vector<std::string> mQueue;
+    // Directories queued or being scanned. The scan is done when this reaches 0.
+    size_t mNumPending = 0;
+    std::vector<char*> mFound;
+    std::atomic<size_t> mNumFound = 0;
+    std::atomic<size_t> mNumErrors = 0;
+    std::atomic<bool> mCancel = false;
+    std::atomic<bool> mDone = true;
+};
+
+#endif
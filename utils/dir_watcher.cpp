@@ -0,0 +1,267 @@
+#include "dir_watcher.h"
+#include "dir_scanner.h"
+#include "filebox.h"
+
+#include <algorithm>
+#include <cerrno>
+
+#if defined(__linux__)
+#include <poll.h>
+#include <sys/inotify.h>
+
+static constexpr uint32_t DIR_WATCH_MASK = IN_CLOSE_WRITE | IN_MOVED_TO | IN_MOVED_FROM | IN_CREATE | IN_DELETE | IN_ONLYDIR;
+#endif
+
+DirWatcher::~DirWatcher() {
+    Stop();
+}
+
+bool DirWatcher::Start(const char* root, std::vector<std::string> ignorePatterns, bool recursive, unsigned int debounceMs) {
+    Stop();
+#if defined(__linux__)
+    mRoot = root;
+    if (!mRoot.empty() && mRoot.back() != '/') {
+        mRoot.push_back('/');
+    }
+    mIgnorePatterns = std::move(ignorePatterns);
+    mRecursive = recursive;
+    mDebounce = std::chrono::milliseconds(debounceMs);
+    mFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (mFd < 0) {
+        return false;
+    }
+    if (pipe2(mWakeFds, O_NONBLOCK | O_CLOEXEC) != 0) {
+        close(mFd);
+        mFd = -1;
+        return false;
+    }
+    AddWatches({});
+    if (mWatches.empty()) {
+        Stop();
+        return false;
+    }
+    mPending.clear();
+    mReady.clear();
+    mWatching = true;
+    mThread = std::thread(&DirWatcher::Worker, this);
+    return true;
+#else
+    return false;
+#endif
+}
+
+void DirWatcher::Stop() {
+#if defined(__linux__)
+    std::lock_guard<std::mutex> stopLock(mStopLock);
+    {
+        std::lock_guard<std::mutex> lock(mLock);
+        mWatching = false;
+    }
+    mCond.notify_all();
+    if (mThread.joinable()) {
+        const char c = 0;
+        (void)!write(mWakeFds[1], &c, 1);
+        mThread.join();
+    }
+    int* fds[] = { &mFd, &mWakeFds[0], &mWakeFds[1] };
+    for (int* fd : fds) {
+        if (*fd >= 0) {
+            close(*fd);
+            *fd = -1;
+        }
+    }
+    mWatches.clear();
+#endif
+}
+
+bool DirWatcher::IsWatching() const {
+    std::lock_guard<std::mutex> lock(mLock);
+    return mWatching;
+}
+
+bool DirWatcher::WaitForChanges(std::vector<DirChange>* out) {
+    std::unique_lock<std::mutex> lock(mLock);
+    mCond.wait(lock, [this]() {
+        return !mReady.empty() || !mWatching;
+    });
+    if (!mWatching) {
+        return false;
+    }
+    out->insert(out->end(), std::make_move_iterator(mReady.begin()), std::make_move_iterator(mReady.end()));
+    mReady.clear();
+    return true;
+}
+
+// Watches the directory at `relPath` and, if the watch is recursive, every directory under it.
+void DirWatcher::AddWatches(const std::string& relPath) {
+#if defined(__linux__)
+    const std::string path = mRoot + relPath;
+    const int wd = inotify_add_watch(mFd, path.c_str(), DIR_WATCH_MASK);
+    if (wd < 0) {
+        return;
+    }
+    mWatches[wd] = relPath;
+    if (!mRecursive) {
+        return;
+    }
+    DIR* d = opendir(path.c_str());
+    if (d == nullptr) {
+        return;
+    }
+    struct dirent* entry;
+    while ((entry = readdir(d)) != nullptr) {
+        const char* name = entry->d_name;
+        if (name[0] == '.' && (name[1] == 0 || (name[1] == '.' && name[2] == 0))) {
+            continue;
+        }
+        bool isDir = entry->d_type == DT_DIR;
+        if (entry->d_type == DT_UNKNOWN) {
+            struct stat st;
+            isDir = fstatat(dirfd(d), name, &st, AT_SYMLINK_NOFOLLOW) == 0 && S_ISDIR(st.st_mode);
+        }
+        if (isDir && !IsPathIgnored(mIgnorePatterns, relPath, name)) {
+            AddWatches(relPath.empty() ? std::string(name) : relPath + '/' + name);
+        }
+    }
+    closedir(d);
+#endif
+}
+
+// Stops watching the directory at `relPath` and everything under it. Used when a directory is moved away, since its
+// watches would keep reporting changes under the old path.
+void DirWatcher::RemoveWatches(const std::string& relPath) {
+#if defined(__linux__)
+    for (auto it = mWatches.begin(); it != mWatches.end();) {
+        const std::string& p = it->second;
+        if (p == relPath || (p.size() > relPath.size() && p.compare(0, relPath.size(), relPath) == 0 && p[relPath.size()] == '/')) {
+            inotify_rm_watch(mFd, it->first);
+            it = mWatches.erase(it);
+        } else {
+            ++it;
+        }
+    }
+#endif
+}
+
+void DirWatcher::AddChange(std::string relPath, DirChangeType type, bool isDir) {
+    std::lock_guard<std::mutex> lock(mLock);
+    const auto now = std::chrono::steady_clock::now();
+    if (mPending.empty()) {
+        mFirstPending = now;
+    }
+    mLastPending = now;
+    // Anything pending under a directory that is gone or will be added again as a whole is covered by this change
+    if (isDir) {
+        const std::string prefix = relPath.empty() ? relPath : relPath + '/';
+        std::erase_if(mPending, [&prefix](const auto& e) {
+            return e.first.compare(0, prefix.size(), prefix) == 0;
+        });
+    }
+    DirChange& change = mPending[relPath];
+    change.path = std::move(relPath);
+    change.type = type;
+    change.isDir = isDir;
+}
+
+// Moves the pending changes to the ready list once they have settled. Removals go first so a path that was removed and
+// then added again in the same batch isn't removed after being added.
+void DirWatcher::FlushPending() {
+    std::unique_lock<std::mutex> lock(mLock);
+    if (mPending.empty()) {
+        return;
+    }
+    const auto now = std::chrono::steady_clock::now();
+    if (now - mLastPending < mDebounce && now - mFirstPending < mDebounce * 10) {
+        return;
+    }
+    for (auto& e : mPending) {
+        mReady.push_back(std::move(e.second));
+    }
+    mPending.clear();
+    std::stable_partition(mReady.begin(), mReady.end(), [](const DirChange& c) {
+        return c.type == DirChangeType::Removed;
+    });
+    lock.unlock();
+    mCond.notify_all();
+}
+
+void DirWatcher::ReadEvents() {
+#if defined(__linux__)
+    alignas(struct inotify_event) char buf[64 * 1024];
+    while (true) {
+        const ssize_t len = read(mFd, buf, sizeof(buf));
+        if (len <= 0) {
+            return;
+        }
+        for (ssize_t pos = 0; pos < len;) {
+            const struct inotify_event* ev = (const struct inotify_event*)&buf[pos];
+            pos += sizeof(struct inotify_event) + ev->len;
+
+            if (ev->mask & IN_Q_OVERFLOW) {
+                // Events were lost so nothing is known about what changed
+                AddChange({}, DirChangeType::Modified, true);
+                continue;
+            }
+            const auto it = mWatches.find(ev->wd);
+            if (it == mWatches.end()) {
+                continue;
+            }
+            if (ev->mask & IN_IGNORED) {
+                mWatches.erase(it);
+                continue;
+            }
+            if (ev->len == 0 || IsPathIgnored(mIgnorePatterns, it->second, ev->name)) {
+                continue;
+            }
+            const std::string relPath = it->second.empty() ? std::string(ev->name) : it->second + '/' + ev->name;
+            const bool isDir = (ev->mask & IN_ISDIR) != 0;
+
+            if (ev->mask & (IN_DELETE | IN_MOVED_FROM)) {
+                if (isDir) {
+                    RemoveWatches(relPath);
+                }
+                AddChange(relPath, DirChangeType::Removed, isDir);
+            } else if (isDir) {
+                if (mRecursive && (ev->mask & (IN_CREATE | IN_MOVED_TO))) {
+                    // Files can be added before the watch is, so the whole directory is scanned once things settle
+                    AddWatches(relPath);
+                    AddChange(relPath, DirChangeType::Modified, true);
+                }
+            } else if (ev->mask & (IN_CLOSE_WRITE | IN_MOVED_TO)) {
+                // Files are only reported once they are closed, not while they are still being written
+                AddChange(relPath, DirChangeType::Modified, false);
+            }
+        }
+    }
+#endif
+}
+
+void DirWatcher::Worker() {
+#if defined(__linux__)
+    while (true) {
+        int timeout = -1;
+        {
+            std::lock_guard<std::mutex> lock(mLock);
+            if (!mWatching) {
+                return;
+            }
+            if (!mPending.empty()) {
+                const auto deadline = std::min(mLastPending + mDebounce, mFirstPending + mDebounce * 10);
+                const auto left = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now());
+                timeout = (int)std::max<int64_t>(left.count() + 1, 0);
+            }
+        }
+        struct pollfd fds[2] = { { mFd, POLLIN, 0 }, { mWakeFds[0], POLLIN, 0 } };
+        if (poll(fds, 2, timeout) < 0 && errno != EINTR) {
+            return;
+        }
+        if (fds[1].revents != 0) {
+            return;
+        }
+        if (fds[0].revents & POLLIN) {
+            ReadEvents();
+        }
+        FlushPending();
+    }
+#endif
+}
@@ -0,0 +1,88 @@
+#ifndef DIR_WATCHER_H
+#define DIR_WATCHER_H
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+// Changes are reported once nothing has changed for this long, so a save that touches several files is one update
+static constexpr unsigned int DIR_WATCH_DEBOUNCE_MS = 100;
+
+// Watching uses inotify so it is only available on Linux
+#if defined(__linux__)
+static constexpr bool DIR_WATCH_SUPPORTED = true;
+#else
+static constexpr bool DIR_WATCH_SUPPORTED = false;
+#endif
+
+enum class DirChangeType : uint8_t {
+    // The file was written, or the directory was created or moved in and everything in it should be added again
+    Modified,
+    // The file or directory, and everything in it, is gone
+    Removed,
+};
+
+typedef struct DirChange {
+    // Relative to the watched directory. Empty for the watched directory itself, which is reported as modified if
+    // changes were lost and it has to be scanned again.
+    std::string path;
+    DirChangeType type;
+    bool isDir;
+} DirChange;
+
+// Reports files that change under a directory. Changes to the same path are merged and handed out in a batch once the
+// directory has been quiet for the debounce time, or once changes have been pending for 10 times that, so a constant
+// stream of writes can't hold everything back.
+class DirWatcher {
+public:
+    ~DirWatcher();
+    // Starts watching `root`, and its subdirectories if `recursive` is set. Files and directories that match one of
+    // `ignorePatterns` are skipped, see `IsPathIgnored`. Returns false if the directory can't be watched or watching
+    // isn't supported.
+    bool Start(const char* root, std::vector<std::string> ignorePatterns = {}, bool recursive = true,
+               unsigned int debounceMs = DIR_WATCH_DEBOUNCE_MS);
+    // Stops watching and wakes up `WaitForChanges`. Can be called from any thread, and from several at once.
+    void Stop();
+    bool IsWatching() const;
+    // Blocks until there is a batch of changes and moves it to the end of `out`. Removals come before everything else
+    // in a batch. Returns false once the watcher is stopped.
+    bool WaitForChanges(std::vector<DirChange>* out);
+private:
+    void Worker();
+    void AddWatches(const std::string& relPath);
+    void RemoveWatches(const std::string& relPath);
+    void AddChange(std::string relPath, DirChangeType type, bool isDir);
+    void ReadEvents();
+    void FlushPending();
+
+    std::string mRoot;
+    std::vector<std::string> mIgnorePatterns;
+    bool mRecursive = true;
+    std::chrono::milliseconds mDebounce{ DIR_WATCH_DEBOUNCE_MS };
+    std::thread mThread;
+    // Held by `Stop` so two threads can't join the worker and close the descriptors at the same time
+    std::mutex mStopLock;
+#if defined(__linux__)
+    int mFd = -1;
+    // Written to by `Stop` to wake up the worker
+    int mWakeFds[2] = { -1, -1 };
+    // Watch descriptor of each watched directory to its path relative to the root
+    std::unordered_map<int, std::string> mWatches;
+#endif
+
+    // Guards everything below
+    mutable std::mutex mLock;
+    std::condition_variable mCond;
+    std::unordered_map<std::string, DirChange> mPending;
+    std::chrono::steady_clock::time_point mFirstPending;
+    std::chrono::steady_clock::time_point mLastPending;
+    std::vector<DirChange> mReady;
+    bool mWatching = false;
+};
+
+#endif
@@ -18,7 +18,15 @@ extern HWND gHwnd;
 #endif
 #include <cstring>
 
+static bool sHeadless = false;
 
+void SetHeadless(bool headless) {
+    sHeadless = headless;
+}
+
+bool IsHeadless() {
+    return sHeadless;
+}
 
 bool GetOpenDirPath(char** inputBuffer) {
 #if defined(_WIN32)
@@ -205,6 +213,10 @@ bool GetSaveFilePath(char** inputBuffer) {
 
 int ShowYesNoBox(const char* title, const char* box) {
     int ret;
+    if (sHeadless) {
+        fprintf(stderr, "%s: %s Answering yes.\n", title, box);
+        return IDYES;
+    }
 #ifdef _WIN32
     ret = MessageBoxA(nullptr, box, title, MB_YESNO | MB_ICONQUESTION);
 #else
@@ -228,6 +240,10 @@ int ShowYesNoBox(const char* title, const char* box) {
 }
 
 void ShowErrorBox(const char* title, const char* text) {
+    if (sHeadless) {
+        fprintf(stderr, "%s: %s\n", title, text);
+        return;
+    }
 #ifdef _WIN32
     MessageBoxA(nullptr, text, title, MB_OK | MB_ICONERROR);
 #else
@@ -281,4 +297,4 @@ void UnmapFile(void* data, [[maybe_unused]] size_t size) {
 #elif defined(__linux__) || defined(__APPLE__)
     munmap(data, size);
 #endif
-}
\ No newline at end of file
+}
@@ -5,6 +5,7 @@
 #include <stdio.h>
 #include <cstring>
 #include <filesystem>
+#include <vector>
 
 #if defined (_WIN32)
 #define WIN32_LEAN_AND_MEAN
@@ -34,6 +35,10 @@ enum class FileBoxType {
 #define IDNO 7
 #endif
 
+// When set, message boxes are printed to stderr instead of being shown. Yes/no boxes are answered with yes.
+// Used by the command line mode where SDL isn't initialized.
+void SetHeadless(bool headless);
+bool IsHeadless();
 bool GetOpenDirPath(char** inputBuffer);
 bool GetOpenFilePath(char** inputBuffer, FileBoxType type);
 bool GetSaveFilePath(char** inputBuffer);
@@ -53,21 +58,23 @@ typedef bool (*ExtCheckCallback)(char*);
 template <class T>
 static void FillFileQueue(T& dest, char* mBasePath, ExtCheckCallback cb) {
 #ifdef _WIN32
-    char oldWorkingDir[MAX_PATH];
-    char oldWorkingDir2[MAX_PATH];
-    GetCurrentDirectoryA(MAX_PATH, oldWorkingDir);
-    bool ret = SetCurrentDirectoryA(mBasePath);
-    GetCurrentDirectoryA(MAX_PATH, oldWorkingDir2);
+    // Search the directory by its path instead of changing the working directory, which other threads may be using
+    size_t baseLen = strlen(mBasePath);
+    char* pattern = new char[baseLen + 3];
+    snprintf(pattern, baseLen + 3, "%s\\*", mBasePath);
     WIN32_FIND_DATAA ffd;
-    HANDLE h = FindFirstFileA("*", &ffd);
+    HANDLE h = FindFirstFileExA(pattern, FindExInfoBasic, &ffd, FindExSearchNameMatch, nullptr, FIND_FIRST_EX_LARGE_FETCH);
+    delete[] pattern;
+    if (h == INVALID_HANDLE_VALUE) {
+        return;
+    }
 
     do {
         if (!(ffd.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)) {
             // Check for any standard N64 rom file extensions.
             if (cb(ffd.cFileName)) {
                 size_t s1 = strlen(ffd.cFileName);
-                size_t s2 = strlen(mBasePath);
-                size_t sizeToAlloc = s1 + s2 + 2;
+                size_t sizeToAlloc = s1 + baseLen + 2;
 
                 char* fullPath = (char*)operator new[](sizeToAlloc, std::align_val_t(2));
                 snprintf(fullPath, sizeToAlloc, "%s\\%s", mBasePath, ffd.cFileName);
@@ -76,24 +83,21 @@ static void FillFileQueue(T& dest, char* mBasePath, ExtCheckCallback cb) {
         }
     } while (FindNextFileA(h, &ffd) != 0);
     FindClose(h);
-    SetCurrentDirectoryA(oldWorkingDir);
 #elif defined(__linux__) || defined(__APPLE__)
-    // Change the current working directory to the path selected.
-    char oldWorkingDir[PATH_MAX];
-    getcwd(oldWorkingDir, PATH_MAX);
-    chdir(mBasePath);
-    DIR* d = opendir(".");
-
+    // Open the directory by its path instead of changing the working directory, which other threads may be using
+    DIR* d = opendir(mBasePath);
     struct dirent* dir;
 
     if (d != nullptr) {
         // Go through each file in the directory
         while ((dir = readdir(d)) != nullptr) {
-            struct stat path;
-
-            // Check if current entry is not folder
-            stat(dir->d_name, &path);
-            if (S_ISREG(path.st_mode)) {
+            // The entry has the type on most file systems. Only stat the ones that don't, or are links.
+            bool isFile = dir->d_type == DT_REG;
+            if (dir->d_type == DT_UNKNOWN || dir->d_type == DT_LNK) {
+                struct stat path;
+                isFile = fstatat(dirfd(d), dir->d_name, &path, 0) == 0 && S_ISREG(path.st_mode);
+            }
+            if (isFile) {
                 if (cb(dir->d_name)) {
                     size_t s1 = strlen(dir->d_name);
                     size_t s2 = strlen(mBasePath);
@@ -106,9 +110,8 @@ static void FillFileQueue(T& dest, char* mBasePath, ExtCheckCallback cb) {
                 }
             }
         }
+        closedir(d);
     }
-    closedir(d);
-    chdir(oldWorkingDir);
 #else
     for (const auto& file : std::filesystem::directory_iterator("./")) {
         if (file.is_directory())
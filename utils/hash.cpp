@@ -0,0 +1,371 @@
+#include "hash.h"
+#include <array>
+#include <cstdio>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define HASH_X86 1
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#define CLMUL_TARGET
+#else
+#define CLMUL_TARGET __attribute__((target("pclmul,ssse3")))
+#endif
+#endif
+
+#if defined(_MSC_VER) && defined(_M_X64)
+#include <intrin.h>
+#endif
+
+// Same polynomial as the table in CRC64.cpp, without the x^64 term
+static constexpr uint64_t CRC64_POLY = 0x42F0E1EBA9EA3693;
+
+// x^n mod P
+static constexpr uint64_t XPowModP(unsigned int n) {
+    uint64_t r = 1;
+    for (unsigned int i = 0; i < n; i++) {
+        const bool carry = (r >> 63) != 0;
+        r <<= 1;
+        if (carry) {
+            r ^= CRC64_POLY;
+        }
+    }
+    return r;
+}
+
+// Slicing-by-8 tables. sCrcTables[k][i] = i * x^(64 + 8 * k) mod P. sCrcTables[0] is the same as the table in CRC64.cpp.
+static constexpr std::array<std::array<uint64_t, 256>, 8> sCrcTables = []() {
+    std::array<std::array<uint64_t, 256>, 8> t{};
+    for (uint64_t i = 0; i < 256; i++) {
+        uint64_t c = i << 56;
+        for (int k = 0; k < 8; k++) {
+            c = (c & (1ull << 63)) ? (c << 1) ^ CRC64_POLY : c << 1;
+        }
+        t[0][i] = c;
+    }
+    for (size_t i = 0; i < 256; i++) {
+        for (size_t s = 1; s < 8; s++) {
+            t[s][i] = (t[s - 1][i] << 8) ^ t[0][t[s - 1][i] >> 56];
+        }
+    }
+    return t;
+}();
+
+static inline uint64_t ReadBE64(const uint8_t* p) {
+    return (uint64_t)p[0] << 56 | (uint64_t)p[1] << 48 | (uint64_t)p[2] << 40 | (uint64_t)p[3] << 32 | (uint64_t)p[4] << 24 |
+           (uint64_t)p[5] << 16 | (uint64_t)p[6] << 8 | (uint64_t)p[7];
+}
+
+static inline uint64_t ReadLE64(const uint8_t* p) {
+    uint64_t v;
+    memcpy(&v, p, sizeof(v));
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    v = __builtin_bswap64(v);
+#endif
+    return v;
+}
+
+static inline uint64_t ReadLE32(const uint8_t* p) {
+    return (uint64_t)p[0] | (uint64_t)p[1] << 8 | (uint64_t)p[2] << 16 | (uint64_t)p[3] << 24;
+}
+
+uint64_t Crc64UpdateTable(uint64_t crc, const void* data, size_t size) {
+    const uint8_t* p = (const uint8_t*)data;
+    while (size >= 8) {
+        crc ^= ReadBE64(p);
+        crc = sCrcTables[7][crc >> 56] ^ sCrcTables[6][(crc >> 48) & 0xFF] ^ sCrcTables[5][(crc >> 40) & 0xFF] ^
+              sCrcTables[4][(crc >> 32) & 0xFF] ^ sCrcTables[3][(crc >> 24) & 0xFF] ^ sCrcTables[2][(crc >> 16) & 0xFF] ^
+              sCrcTables[1][(crc >> 8) & 0xFF] ^ sCrcTables[0][crc & 0xFF];
+        p += 8;
+        size -= 8;
+    }
+    while (size-- != 0) {
+        crc = sCrcTables[0][(crc >> 56) ^ *p++] ^ (crc << 8);
+    }
+    return crc;
+}
+
+#if defined(HASH_X86)
+// Folds the 128 bit polynomial `x` forward by the distance `k` was built for and adds `next`.
+// The high half of `k` is x^(d + 64) mod P and the low half is x^d mod P.
+CLMUL_TARGET static inline __m128i Fold(__m128i x, __m128i k, __m128i next) {
+    const __m128i hi = _mm_clmulepi64_si128(x, k, 0x11);
+    const __m128i lo = _mm_clmulepi64_si128(x, k, 0x00);
+    return _mm_xor_si128(_mm_xor_si128(hi, lo), next);
+}
+
+// Loads 16 bytes so the first bit of the message is the highest coefficient.
+CLMUL_TARGET static inline __m128i LoadBE128(const uint8_t* p, __m128i swap) {
+    return _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)p), swap);
+}
+
+// Folds 64 bytes at a time in 4 independent lanes, then folds the lanes into one and finishes the last 16 bytes
+// and any tail with the tables.
+CLMUL_TARGET static uint64_t Crc64UpdateClmulImpl(uint64_t crc, const uint8_t* p, size_t size) {
+    if (size < 64) {
+        return Crc64UpdateTable(crc, p, size);
+    }
+    const __m128i swap = _mm_set_epi8(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+    const __m128i k512 = _mm_set_epi64x((long long)XPowModP(512 + 64), (long long)XPowModP(512));
+    const __m128i k384 = _mm_set_epi64x((long long)XPowModP(384 + 64), (long long)XPowModP(384));
+    const __m128i k256 = _mm_set_epi64x((long long)XPowModP(256 + 64), (long long)XPowModP(256));
+    const __m128i k128 = _mm_set_epi64x((long long)XPowModP(128 + 64), (long long)XPowModP(128));
+
+    __m128i x0 = LoadBE128(p, swap);
+    __m128i x1 = LoadBE128(p + 16, swap);
+    __m128i x2 = LoadBE128(p + 32, swap);
+    __m128i x3 = LoadBE128(p + 48, swap);
+    // The starting CRC is added to the first 64 bits of the message.
+    x0 = _mm_xor_si128(x0, _mm_set_epi64x((long long)crc, 0));
+    p += 64;
+    size -= 64;
+
+    while (size >= 64) {
+        x0 = Fold(x0, k512, LoadBE128(p, swap));
+        x1 = Fold(x1, k512, LoadBE128(p + 16, swap));
+        x2 = Fold(x2, k512, LoadBE128(p + 32, swap));
+        x3 = Fold(x3, k512, LoadBE128(p + 48, swap));
+        p += 64;
+        size -= 64;
+    }
+
+    __m128i x = Fold(x0, k384, Fold(x1, k256, Fold(x2, k128, x3)));
+    while (size >= 16) {
+        x = Fold(x, k128, LoadBE128(p, swap));
+        p += 16;
+        size -= 16;
+    }
+
+    // What is left is the CRC of these 16 bytes starting from 0.
+    alignas(16) uint8_t rest[16];
+    _mm_store_si128((__m128i*)rest, _mm_shuffle_epi8(x, swap));
+    crc = Crc64UpdateTable(0, rest, sizeof(rest));
+    return Crc64UpdateTable(crc, p, size);
+}
+#endif
+
+static bool DetectClmul() {
+#if defined(HASH_X86)
+#if defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 1);
+    // ECX bit 1 is PCLMULQDQ, bit 9 is SSSE3
+    return (info[2] & (1 << 1)) != 0 && (info[2] & (1 << 9)) != 0;
+#else
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("pclmul") && __builtin_cpu_supports("ssse3");
+#endif
+#else
+    return false;
+#endif
+}
+
+// Compares the implementations with each other and with `CRC64` over every length up to 300 bytes, a few longer ones
+// and every start offset in a 16 byte block. The CLMUL path is also checked continuing from a CRC that isn't the
+// initial value. A wrong folding constant would otherwise silently change every stored CRC and cache key.
+static bool Crc64ImplsMatch(bool withClmul) {
+    static constexpr size_t MAX_OFFSET = 16;
+    static constexpr size_t MAX_SHORT = 300;
+    static constexpr size_t sLongSizes[] = { 511, 512, 513, 1000, 4099 };
+    static char sBuf[MAX_OFFSET + 4099 + 1];
+    uint64_t state = 0x9E3779B97F4A7C15;
+
+    // No zero bytes since `CRC64` stops at the first one.
+    for (size_t i = 0; i < sizeof(sBuf); i++) {
+        state ^= state << 13;
+        state ^= state >> 7;
+        state ^= state << 17;
+        sBuf[i] = (char)((state % 255) + 1);
+    }
+
+    auto check = [withClmul](size_t offset, size_t size) {
+        char* p = sBuf + offset;
+        const char saved = p[size];
+        p[size] = '\0';
+        const uint64_t expected = CRC64(p);
+        p[size] = saved;
+        if (Crc64UpdateTable(INITIAL_CRC64, p, size) != expected) {
+            return false;
+        }
+#if defined(HASH_X86)
+        if (withClmul) {
+            const size_t split = size / 3;
+            const uint64_t partial = Crc64UpdateTable(INITIAL_CRC64, p, split);
+            if (Crc64UpdateClmulImpl(INITIAL_CRC64, (const uint8_t*)p, size) != expected ||
+                Crc64UpdateClmulImpl(partial, (const uint8_t*)p + split, size - split) != expected) {
+                return false;
+            }
+        }
+#endif
+        return true;
+    };
+
+    for (size_t offset = 0; offset < MAX_OFFSET; offset++) {
+        for (size_t size = 0; size <= MAX_SHORT; size++) {
+            if (!check(offset, size)) {
+                return false;
+            }
+        }
+        for (size_t size : sLongSizes) {
+            if (!check(offset, size)) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+static bool SelectClmul() {
+    if (!DetectClmul()) {
+        return false;
+    }
+    if (!Crc64ImplsMatch(true)) {
+        fprintf(stderr, "The CLMUL CRC64 doesn't match the table. Using the table instead.\n");
+        return false;
+    }
+    return true;
+}
+
+static const bool sHasClmul = SelectClmul();
+
+bool CheckCrc64Impls() {
+    return Crc64ImplsMatch(DetectClmul());
+}
+
+bool HasCrc64Clmul() {
+    return sHasClmul;
+}
+
+uint64_t Crc64UpdateClmul(uint64_t crc, const void* data, size_t size) {
+#if defined(HASH_X86)
+    if (sHasClmul) {
+        return Crc64UpdateClmulImpl(crc, (const uint8_t*)data, size);
+    }
+#endif
+    return Crc64UpdateTable(crc, data, size);
+}
+
+uint64_t Crc64Update(uint64_t crc, const void* data, size_t size) {
+    return Crc64UpdateClmul(crc, data, size);
+}
+
+uint64_t Crc64(const void* data, size_t size) {
+    return Crc64Update(INITIAL_CRC64, data, size);
+}
+
+const char* GetCrc64ImplName() {
+    return sHasClmul ? "clmul" : "table";
+}
+
+// Content hashes. The mixing is the same as wyhash: multiply two 64 bit values and fold the 128 bit product.
+static constexpr uint64_t sHashSecret[4] = { 0xA0761D6478BD642F, 0xE7037ED1A0B428DB, 0x8EBC6AF09C88C6E3, 0x589965CC75374CC3 };
+
+static inline void Mum(uint64_t* a, uint64_t* b) {
+#if defined(__SIZEOF_INT128__)
+    const __uint128_t r = (__uint128_t)*a * *b;
+    *a = (uint64_t)r;
+    *b = (uint64_t)(r >> 64);
+#elif defined(_MSC_VER) && defined(_M_X64)
+    *a = _umul128(*a, *b, b);
+#else
+    const uint64_t ha = *a >> 32, hb = *b >> 32, la = (uint32_t)*a, lb = (uint32_t)*b;
+    const uint64_t rh = ha * hb, rm0 = ha * lb, rm1 = hb * la, rl = la * lb;
+    const uint64_t t = rl + (rm0 << 32);
+    uint64_t c = t < rl;
+    const uint64_t lo = t + (rm1 << 32);
+    c += lo < t;
+    *a = lo;
+    *b = rh + (rm0 >> 32) + (rm1 >> 32) + c;
+#endif
+}
+
+static inline uint64_t Mix(uint64_t a, uint64_t b) {
+    Mum(&a, &b);
+    return a ^ b;
+}
+
+// Hashes `data` once for each of the `N` seeds. Every block is read once and mixed into every lane.
+template <size_t N>
+static void ContentHashLanes(const uint8_t* p, size_t size, const uint64_t (&seeds)[N], uint64_t (&out)[N]) {
+    uint64_t s[N];
+    uint64_t a;
+    uint64_t b;
+
+    for (size_t n = 0; n < N; n++) {
+        s[n] = seeds[n] ^ Mix(seeds[n] ^ sHashSecret[0], sHashSecret[1]);
+    }
+    if (size <= 16) {
+        if (size >= 4) {
+            a = (ReadLE32(p) << 32) | ReadLE32(p + ((size >> 3) << 2));
+            b = (ReadLE32(p + size - 4) << 32) | ReadLE32(p + size - 4 - ((size >> 3) << 2));
+        } else if (size > 0) {
+            a = ((uint64_t)p[0] << 16) | ((uint64_t)p[size >> 1] << 8) | p[size - 1];
+            b = 0;
+        } else {
+            a = 0;
+            b = 0;
+        }
+    } else {
+        size_t i = size;
+        if (i >= 48) {
+            uint64_t see1[N];
+            uint64_t see2[N];
+            for (size_t n = 0; n < N; n++) {
+                see1[n] = s[n];
+                see2[n] = s[n];
+            }
+            do {
+                const uint64_t w0 = ReadLE64(p);
+                const uint64_t w1 = ReadLE64(p + 8);
+                const uint64_t w2 = ReadLE64(p + 16);
+                const uint64_t w3 = ReadLE64(p + 24);
+                const uint64_t w4 = ReadLE64(p + 32);
+                const uint64_t w5 = ReadLE64(p + 40);
+                for (size_t n = 0; n < N; n++) {
+                    s[n] = Mix(w0 ^ sHashSecret[1], w1 ^ s[n]);
+                    see1[n] = Mix(w2 ^ sHashSecret[2], w3 ^ see1[n]);
+                    see2[n] = Mix(w4 ^ sHashSecret[3], w5 ^ see2[n]);
+                }
+                p += 48;
+                i -= 48;
+            } while (i >= 48);
+            for (size_t n = 0; n < N; n++) {
+                s[n] ^= see1[n] ^ see2[n];
+            }
+        }
+        while (i > 16) {
+            const uint64_t w0 = ReadLE64(p);
+            const uint64_t w1 = ReadLE64(p + 8);
+            for (size_t n = 0; n < N; n++) {
+                s[n] = Mix(w0 ^ sHashSecret[1], w1 ^ s[n]);
+            }
+            i -= 16;
+            p += 16;
+        }
+        a = ReadLE64(p + i - 16);
+        b = ReadLE64(p + i - 8);
+    }
+
+    for (size_t n = 0; n < N; n++) {
+        uint64_t la = a ^ sHashSecret[1];
+        uint64_t lb = b ^ s[n];
+        Mum(&la, &lb);
+        out[n] = Mix(la ^ sHashSecret[0] ^ size, lb ^ sHashSecret[1]);
+    }
+}
+
+uint64_t ContentHash64(const void* data, size_t size, uint64_t seed) {
+    const uint64_t seeds[1] = { seed };
+    uint64_t out[1];
+    ContentHashLanes((const uint8_t*)data, size, seeds, out);
+    return out[0];
+}
+
+Hash128 ContentHash128(const void* data, size_t size, uint64_t seed) {
+    // The second lane's seed only has to be different from the first.
+    const uint64_t seeds[2] = { seed, seed ^ sHashSecret[2] };
+    uint64_t out[2];
+    ContentHashLanes((const uint8_t*)data, size, seeds, out);
+    return { out[0], out[1] };
+}
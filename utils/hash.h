@@ -0,0 +1,36 @@
+#ifndef HASH_H
+#define HASH_H
+
+#include <cstddef>
+#include <cstdint>
+#include "CRC64.h"
+
+// CRC64 of `size` bytes at `data`, continued from `crc`. Gives the same results as `CRC64` when started from
+// `INITIAL_CRC64`, so values can be compared with the ones already stored in the XML files.
+// Uses carry-less multiplication when the CPU supports it.
+uint64_t Crc64Update(uint64_t crc, const void* data, size_t size);
+uint64_t Crc64(const void* data, size_t size);
+
+// The individual CRC64 implementations, for checking them against each other.
+uint64_t Crc64UpdateTable(uint64_t crc, const void* data, size_t size);
+// Falls back to `Crc64UpdateTable` if `HasCrc64Clmul` is false.
+uint64_t Crc64UpdateClmul(uint64_t crc, const void* data, size_t size);
+bool HasCrc64Clmul();
+// Name of the implementation `Crc64Update` uses.
+const char* GetCrc64ImplName();
+// Checks every implementation the CPU supports against `CRC64` over odd lengths and unaligned starts. `Crc64Update`
+// already runs this once and falls back to the table if CLMUL gets a different result.
+bool CheckCrc64Impls();
+
+typedef struct Hash128 {
+    uint64_t lo;
+    uint64_t hi;
+} Hash128;
+
+// Fast non-cryptographic hashes for comparing file contents. Much faster than CRC64 but the values are only meant to
+// be compared with other values from the same function and seed.
+uint64_t ContentHash64(const void* data, size_t size, uint64_t seed);
+// Two independent 64 bit lanes computed in one pass. Use this when collisions between a lot of files matter, like dedup.
+Hash128 ContentHash128(const void* data, size_t size, uint64_t seed);
+
+#endif
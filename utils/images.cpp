@@ -15,10 +15,16 @@
 #endif
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb_image.h"
-#include <unordered_map>
+#include "images.h"
+#include <algorithm>
+#include <condition_variable>
+#include <list>
+#include <memory>
+#include <mutex>
 #include <string>
-
-static std::unordered_map<std::string, void*> sImageCache;
+#include <thread>
+#include <unordered_map>
+#include <vector>
 
 #if defined(_WIN32)
 static inline ID3D11ShaderResourceView* LoadTextureDX11(void* data, int width, int height) {
@@ -55,6 +61,10 @@ static inline ID3D11ShaderResourceView* LoadTextureDX11(void* data, int width, i
     pTexture->Release();
     return view;
 }
+
+static inline void FreeTextureDX11(void* texId) {
+    ((ID3D11ShaderResourceView*)texId)->Release();
+}
 #elif defined(__linux__) || defined(__APPLE__)
 static inline GLuint LoadTextureGL(void* data, int width, int height) {
     GLuint image_texture;
@@ -75,17 +85,37 @@ static inline GLuint LoadTextureGL(void* data, int width, int height) {
     
     return image_texture;
 }
+
+static inline void FreeTextureGL(void* texId) {
+    GLuint image_texture = (GLuint)(uintptr_t)texId;
+    glDeleteTextures(1, &image_texture);
+}
 #endif
 
-void* LoadTextureByName(const char* path, int* width, int* height) {
-    if (sImageCache.contains(path)) {
-        return sImageCache.at(path);
-    }
+static void* UploadTexture(void* data, int width, int height) {
+#if defined(_WIN32)
+    return (void*)(uintptr_t)LoadTextureDX11(data, width, height);
+#elif defined(__linux__) || defined(__APPLE__)
+    return (void*)(uintptr_t)LoadTextureGL(data, width, height);
+#endif
+}
+
+static void FreeTexture(void* texId) {
+#if defined(_WIN32)
+    FreeTextureDX11(texId);
+#elif defined(__linux__) || defined(__APPLE__)
+    FreeTextureGL(texId);
+#endif
+}
+
+// Decodes the image file at `path` to RGBA8. Returns null if it can't be read or decoded.
+static stbi_uc* DecodeImageFile(const char* path, int* width, int* height) {
     void* imageData;
+    stbi_uc* image;
     off_t fileSize;
     #if defined(_WIN32)
     HANDLE hFile = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, 0, nullptr);
-    if (hFile == nullptr) {
+    if (hFile == INVALID_HANDLE_VALUE) {
         return nullptr;
     }
     LARGE_INTEGER sizeW;
@@ -97,9 +127,7 @@ void* LoadTextureByName(const char* path, int* width, int* height) {
         return nullptr;
     }
     imageData = MapViewOfFile(mappingObj, FILE_MAP_READ, 0, 0, 0);
-    
-    stbi_uc* image = stbi_load_from_memory((stbi_uc*)imageData, (int)fileSize, width, height, nullptr, 4);
-    void* texId = (void*)(uintptr_t)LoadTextureDX11(image, *width, *height);
+    image = stbi_load_from_memory((stbi_uc*)imageData, (int)fileSize, width, height, nullptr, 4);
 
     UnmapViewOfFile(imageData);
     CloseHandle(mappingObj);
@@ -116,13 +144,212 @@ void* LoadTextureByName(const char* path, int* width, int* height) {
     fileSize = s.st_size;
     imageData = mmap(nullptr, fileSize, PROT_READ, MAP_SHARED, fd, 0);
     close(fd);
-    stbi_uc* image = stbi_load_from_memory((stbi_uc*)imageData, (int)fileSize, width, height, nullptr, 4);
-    void* texId = (void*)(uintptr_t)LoadTextureGL(image, *width, *height);
+    if (imageData == MAP_FAILED) {
+        return nullptr;
+    }
+    image = stbi_load_from_memory((stbi_uc*)imageData, (int)fileSize, width, height, nullptr, 4);
     munmap(imageData, fileSize);
     #endif
-    stbi_image_free(image);
-    sImageCache[path] = texId;
-    
-    return texId;
+    return image;
+}
+
+enum class TextureState : uint8_t {
+    Decoding,
+    Ready,
+    Failed,
+};
+
+typedef struct CachedTexture {
+    void* texId;
+    size_t bytes;
+    uint64_t lastUsedFrame;
+    // Position in `sLru`. Only valid once the texture is ready.
+    std::list<std::string>::iterator lruPos;
+    int width;
+    int height;
+    TextureState state;
+} CachedTexture;
+
+typedef struct DecodedImage {
+    std::string path;
+    stbi_uc* pixels;
+    int width;
+    int height;
+    // `sGeneration` when the image was requested. Images requested before the cache was cleared are thrown away.
+    uint64_t generation;
+} DecodedImage;
+
+// Only touched on the render thread
+static std::unordered_map<std::string, CachedTexture> sTextures;
+// Ready textures, most recently used first
+static std::list<std::string> sLru;
+static size_t sTextureBytes = 0;
+static size_t sTextureBudget = 256 * 1024 * 1024;
+static uint64_t sFrame = 0;
+static void* sPlaceholder = nullptr;
+
+// Shared with the decode threads
+static std::mutex sDecodeMutex;
+static std::condition_variable sDecodeCond;
+static std::vector<std::string> sDecodeJobs;
+static std::vector<DecodedImage> sDecoded;
+static uint64_t sGeneration = 0;
+static bool sStopDecoding = false;
+static std::vector<std::thread> sDecodeThreads;
+
+// Most images decoded each frame. Uploading is the only part that blocks the render thread so it is spread out.
+static constexpr size_t MAX_UPLOADS_PER_FRAME = 8;
+
+static void DecodeWorker() {
+    std::unique_lock<std::mutex> lock(sDecodeMutex);
+    while (true) {
+        sDecodeCond.wait(lock, [] { return sStopDecoding || !sDecodeJobs.empty(); });
+        if (sStopDecoding) {
+            return;
+        }
+        // The newest request first, it is most likely still on screen
+        DecodedImage image;
+        image.path = std::move(sDecodeJobs.back());
+        image.generation = sGeneration;
+        sDecodeJobs.pop_back();
+        lock.unlock();
+
+        image.pixels = DecodeImageFile(image.path.c_str(), &image.width, &image.height);
 
-}
\ No newline at end of file
+        lock.lock();
+        sDecoded.push_back(std::move(image));
+    }
+}
+
+static void StartDecodeThreads() {
+    const unsigned int numThreads = std::max(1u, std::min(4u, std::thread::hardware_concurrency() - 1));
+    sStopDecoding = false;
+    for (unsigned int i = 0; i < numThreads; i++) {
+        sDecodeThreads.emplace_back(DecodeWorker);
+    }
+}
+
+static void* GetPlaceholderTexture() {
+    if (sPlaceholder == nullptr) {
+        const uint32_t grey = 0xFF808080;
+        sPlaceholder = UploadTexture((void*)&grey, 1, 1);
+    }
+    return sPlaceholder;
+}
+
+void* LoadTextureByName(const char* path, int* width, int* height) {
+    auto [it, inserted] = sTextures.try_emplace(path);
+    CachedTexture& tex = it->second;
+    if (inserted) {
+        tex.texId = nullptr;
+        tex.bytes = 0;
+        tex.width = 0;
+        tex.height = 0;
+        tex.state = TextureState::Decoding;
+        if (sDecodeThreads.empty()) {
+            StartDecodeThreads();
+        }
+        {
+            std::lock_guard<std::mutex> lock(sDecodeMutex);
+            sDecodeJobs.push_back(path);
+        }
+        sDecodeCond.notify_one();
+    }
+    tex.lastUsedFrame = sFrame;
+
+    switch (tex.state) {
+        case TextureState::Decoding:
+            *width = 0;
+            *height = 0;
+            return GetPlaceholderTexture();
+        case TextureState::Ready:
+            sLru.splice(sLru.begin(), sLru, tex.lruPos);
+            *width = tex.width;
+            *height = tex.height;
+            return tex.texId;
+        case TextureState::Failed:
+        default:
+            *width = 0;
+            *height = 0;
+            return nullptr;
+    }
+}
+
+void UpdateTextureCache() {
+    std::vector<DecodedImage> decoded;
+    {
+        std::lock_guard<std::mutex> lock(sDecodeMutex);
+        const size_t numDecoded = std::min(sDecoded.size(), MAX_UPLOADS_PER_FRAME);
+        decoded.assign(std::make_move_iterator(sDecoded.end() - numDecoded), std::make_move_iterator(sDecoded.end()));
+        sDecoded.resize(sDecoded.size() - numDecoded);
+    }
+
+    for (DecodedImage& image : decoded) {
+        const auto it = sTextures.find(image.path);
+        if (image.generation != sGeneration || it == sTextures.end()) {
+            stbi_image_free(image.pixels);
+            continue;
+        }
+        CachedTexture& tex = it->second;
+        if (image.pixels == nullptr) {
+            tex.state = TextureState::Failed;
+            continue;
+        }
+        tex.texId = UploadTexture(image.pixels, image.width, image.height);
+        stbi_image_free(image.pixels);
+        tex.width = image.width;
+        tex.height = image.height;
+        tex.bytes = (size_t)image.width * image.height * 4;
+        tex.state = TextureState::Ready;
+        tex.lruPos = sLru.insert(sLru.begin(), it->first);
+        sTextureBytes += tex.bytes;
+    }
+
+    // Textures drawn this frame are kept even if they don't fit, freeing them would only reload them next frame
+    while (sTextureBytes > sTextureBudget && !sLru.empty()) {
+        const auto it = sTextures.find(sLru.back());
+        if (it->second.lastUsedFrame == sFrame) {
+            break;
+        }
+        FreeTexture(it->second.texId);
+        sTextureBytes -= it->second.bytes;
+        sLru.pop_back();
+        sTextures.erase(it);
+    }
+    sFrame++;
+}
+
+void SetTextureCacheBudget(size_t budget) {
+    sTextureBudget = budget;
+}
+
+void ClearTextureCache() {
+    {
+        std::lock_guard<std::mutex> lock(sDecodeMutex);
+        sStopDecoding = true;
+        sGeneration++;
+        sDecodeJobs.clear();
+    }
+    sDecodeCond.notify_all();
+    for (std::thread& t : sDecodeThreads) {
+        t.join();
+    }
+    sDecodeThreads.clear();
+    for (DecodedImage& image : sDecoded) {
+        stbi_image_free(image.pixels);
+    }
+    sDecoded.clear();
+
+    for (auto& [path, tex] : sTextures) {
+        if (tex.state == TextureState::Ready) {
+            FreeTexture(tex.texId);
+        }
+    }
+    sTextures.clear();
+    sLru.clear();
+    sTextureBytes = 0;
+    if (sPlaceholder != nullptr) {
+        FreeTexture(sPlaceholder);
+        sPlaceholder = nullptr;
+    }
+}
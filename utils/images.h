@@ -1,6 +1,18 @@
 #ifndef IMAGES_H
 #define IMAGES_H
 
+#include <cstddef>
+
+// Returns the texture of the image file at `path`. The first call starts decoding the image on a worker thread and
+// returns a grey placeholder texture with a size of 0 until it is uploaded. Returns null if the image couldn't be
+// decoded. Must be called on the render thread.
 void* LoadTextureByName(const char* path, int* width, int* height);
+// Uploads some of the images that finished decoding and frees the least recently used textures while the cache is
+// over budget. Called once per frame on the render thread.
+void UpdateTextureCache();
+// Sets how many bytes of textures can be kept. Textures used in the current frame are never freed. Defaults to 256 MiB.
+void SetTextureCacheBudget(size_t budget);
+// Stops decoding and frees every texture. Must be called before the graphics device is destroyed.
+void ClearTextureCache();
 
 #endif
@@ -0,0 +1,70 @@
+#include "memory_budget.h"
+
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#include <Windows.h>
+#else
+#include <unistd.h>
+#endif
+
+MemoryBudget::MemoryBudget(uint64_t limit) : mLimit(limit) {
+}
+
+void MemoryBudget::Acquire(uint64_t bytes) {
+    std::unique_lock<std::mutex> lock(mMutex);
+    if (mLimit != 0) {
+        mCond.wait(lock, [this, bytes] { return mInUse == 0 || mInUse + bytes <= mLimit; });
+    }
+    mInUse += bytes;
+}
+
+void MemoryBudget::Release(uint64_t bytes) {
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mInUse -= bytes;
+    }
+    // Waiters need different amounts so any of them might fit now.
+    mCond.notify_all();
+}
+
+MemoryReservation::MemoryReservation(MemoryBudget* budget) : mBudget(budget) {
+}
+
+MemoryReservation::~MemoryReservation() {
+    if (mBudget != nullptr && mBytes != 0) {
+        mBudget->Release(mBytes);
+    }
+}
+
+void MemoryReservation::Reserve(uint64_t bytes) {
+    if (mBudget == nullptr) {
+        return;
+    }
+    if (mBytes != 0) {
+        mBudget->Release(mBytes);
+    }
+    mBudget->Acquire(bytes);
+    mBytes = bytes;
+}
+
+uint64_t GetPhysicalMemorySize() {
+#if defined(_WIN32)
+    MEMORYSTATUSEX status;
+    status.dwLength = sizeof(status);
+    if (!GlobalMemoryStatusEx(&status)) {
+        return 0;
+    }
+    return status.ullTotalPhys;
+#else
+    const long pages = sysconf(_SC_PHYS_PAGES);
+    const long pageSize = sysconf(_SC_PAGE_SIZE);
+    if (pages <= 0 || pageSize <= 0) {
+        return 0;
+    }
+    return (uint64_t)pages * (uint64_t)pageSize;
+#endif
+}
+
+uint64_t GetDefaultMemoryBudget() {
+    return GetPhysicalMemorySize() / 2;
+}
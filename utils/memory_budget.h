@@ -0,0 +1,43 @@
+#ifndef MEMORY_BUDGET_H
+#define MEMORY_BUDGET_H
+
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+
+// Limits how many bytes worker threads can have allocated at once. Workers reserve an estimate of what a job
+// needs before starting it and wait if it doesn't fit.
+class MemoryBudget {
+public:
+    // A `limit` of 0 means there is no limit.
+    explicit MemoryBudget(uint64_t limit);
+    // Blocks until `bytes` fit in the budget. A request is always granted when nothing else is reserved so a job
+    // larger than the whole budget still runs, just on its own.
+    void Acquire(uint64_t bytes);
+    void Release(uint64_t bytes);
+private:
+    std::mutex mMutex;
+    std::condition_variable mCond;
+    uint64_t mLimit;
+    uint64_t mInUse = 0;
+};
+
+// Releases its reservation when it goes out of scope. `budget` can be null, in which case nothing is reserved.
+class MemoryReservation {
+public:
+    explicit MemoryReservation(MemoryBudget* budget);
+    ~MemoryReservation();
+    // Replaces the current reservation. A worker must only hold one reservation at a time or two workers
+    // could wait on each other.
+    void Reserve(uint64_t bytes);
+private:
+    MemoryBudget* mBudget;
+    uint64_t mBytes = 0;
+};
+
+// Total RAM in the system. 0 if it couldn't be determined.
+uint64_t GetPhysicalMemorySize();
+// Half of the system's RAM, or no limit if the size of RAM is unknown.
+uint64_t GetDefaultMemoryBudget();
+
+#endif
@@ -1,5 +1,6 @@
 #include "mpq_archive.h"
 #include "filebox.h"
+#include <algorithm>
 #include <cstring>
 #include <filesystem>
 
@@ -67,6 +68,8 @@ int64_t MpqArchive::GetNumFiles()
 }
 
 void* MpqArchive::ReadFile(const char *filePath, size_t* bytesRead) {
+    // File readers can be reading on other threads
+    std::lock_guard<std::mutex> lock(m);
     HANDLE mpqFile;
     DWORD bytesRead1;
     bool res1 = SFileOpenFileEx(mArchive, filePath, 0, &mpqFile);
@@ -93,17 +96,74 @@ size_t MpqArchive::GetFileSize(HANDLE fileHandle) const {
     return static_cast<size_t>(size);
 }
 
+// StormLib decompresses only the sectors that are read, so any offset can be read directly. Reads hold the archive's
+// lock so files can be read from more than one thread.
+class MpqFileReader : public ArchiveFileReader {
+    public:
+    MpqFileReader(HANDLE file, std::mutex* lock, uint64_t size) {
+        mFile = file;
+        mLock = lock;
+        mSize = size;
+    }
+
+    ~MpqFileReader() override {
+        std::lock_guard<std::mutex> lock(*mLock);
+        SFileCloseFile(mFile);
+    }
+
+    size_t Read(uint64_t offset, void* out, size_t size) override {
+        if (offset >= mSize) {
+            return 0;
+        }
+        std::lock_guard<std::mutex> lock(*mLock);
+        LONG offsetHigh = (LONG)(offset >> 32);
+        SFileSetFilePointer(mFile, (LONG)(offset & 0xFFFFFFFF), &offsetHigh, FILE_BEGIN);
+        DWORD bytesRead = 0;
+        SFileReadFile(mFile, out, (DWORD)std::min<uint64_t>(size, mSize - offset), &bytesRead, nullptr);
+        return bytesRead;
+    }
+
+    uint64_t GetSize() const override {
+        return mSize;
+    }
+
+    private:
+    HANDLE mFile;
+    std::mutex* mLock;
+    uint64_t mSize;
+};
+
+std::unique_ptr<ArchiveFileReader> MpqArchive::OpenFileReader(const char* filePath) {
+    std::lock_guard<std::mutex> lock(m);
+    HANDLE file;
+    if (!SFileOpenFileEx(mArchive, filePath, 0, &file)) {
+        return nullptr;
+    }
+    return std::make_unique<MpqFileReader>(file, &m, GetFileSize(file));
+}
+
 void MpqArchive::GenFileList() {
     size_t size = GetNumFiles();
     SFILE_FIND_DATA data;
-    HANDLE file = SListFileFindFirstFile(mArchive, nullptr, "*", &data);
+    // Searching the archive instead of just its list file fills in the sizes from the block table
+    HANDLE file = SFileFindFirstFile(mArchive, "*", &data, nullptr);
+    if (file == nullptr) {
+        return;
+    }
     files.reserve(size);
+    fileSizes.reserve(size);
+    fileStoredSizes.reserve(size);
 
-    files.push_back(_strdup(data.cFileName));
-    while (SListFileFindNextFile(file, &data)) {
+    do {
+        // StormLib's own files, like (listfile) and (attributes), aren't part of the archive's contents
+        if (data.cFileName[0] == '(') {
+            continue;
+        }
         files.push_back(_strdup(data.cFileName));
-    }
-    SListFileFindClose(file);
+        fileSizes.push_back(data.dwFileSize);
+        fileStoredSizes.push_back(data.dwCompSize);
+    } while (SFileFindNextFile(file, &data));
+    SFileFindClose(file);
 }
 
 void MpqArchive::CreateArchiveFromList(std::vector<char*>& list, char* pathBase) {
@@ -125,13 +185,43 @@ void MpqArchive::WriteFile(char* path, const ArchiveDataInfo* data) {
 }
 
 void MpqArchive::WriteFileUnlocked(char* path, const ArchiveDataInfo* data) {
+    WriteFileSegmentsUnlocked(path, data, 1);
+}
+
+void MpqArchive::WriteFileSegments(char* path, const ArchiveDataInfo* segments, size_t numSegments) {
+    std::lock_guard<std::mutex> lock(m);
+    WriteFileSegmentsUnlocked(path, segments, numSegments);
+    c.notify_one();
+}
+
+void MpqArchive::WriteFileSegmentsUnlocked(char* path, const ArchiveDataInfo* segments, size_t numSegments) {
     HANDLE hFile;
+    size_t size = 0;
 
-    SFileCreateFile(mArchive, path, 0, data->size, 0, 0, &hFile);
-    SFileWriteFile(hFile, data->data, data->size, 0);
-    if (data->mode == MMappedFile) {
-        // MPQs write the data when the write function is calle, not when the archive is closed.
-        // so we don't need to copy the data
-        UnmapFile(data->data, data->size);
+    for (size_t i = 0; i < numSegments; i++) {
+        size += segments[i].size;
     }
+    // Writing a path again replaces it, the same as the O2R archives
+    SFileCreateFile(mArchive, path, 0, size, 0, MPQ_FILE_REPLACEEXISTING, &hFile);
+    for (size_t i = 0; i < numSegments; i++) {
+        SFileWriteFile(hFile, segments[i].data, segments[i].size, 0);
+        if (segments[i].mode == MMappedFile) {
+            // MPQs write the data when the write function is calle, not when the archive is closed.
+            // so we don't need to copy the data
+            UnmapFile(segments[i].data, segments[i].size);
+        } else if (segments[i].mode == DataOwned) {
+            free(segments[i].data);
+        }
+    }
+    SFileFinishFile(hFile);
+}
+
+bool MpqArchive::RemoveFile(const char* path) {
+    std::lock_guard<std::mutex> lock(m);
+    return SFileRemoveFile(mArchive, path, 0);
+}
+
+bool MpqArchive::FlushArchive() {
+    std::lock_guard<std::mutex> lock(m);
+    return SFileFlushArchive(mArchive);
 }
@@ -23,11 +23,16 @@ public:
     //void ReadFile(const char* filePath, void** outBuffer) override;
 
     size_t GetFileSize(const char* path) const override;
+    std::unique_ptr<ArchiveFileReader> OpenFileReader(const char* filePath) override;
     void GenFileList() override;
     void CreateArchiveFromList(std::vector<char*>& list, char* basePath) override;
     
     void WriteFile(char* path, const ArchiveDataInfo* data) override;
     void WriteFileUnlocked(char* path, const ArchiveDataInfo* data) override;
+    void WriteFileSegments(char* path, const ArchiveDataInfo* segments, size_t numSegments) override;
+    void WriteFileSegmentsUnlocked(char* path, const ArchiveDataInfo* segments, size_t numSegments) override;
+    bool RemoveFile(const char* path) override;
+    bool FlushArchive() override;
 private:
     size_t GetFileSize(HANDLE fileHandle) const;
     HANDLE mArchive = nullptr;
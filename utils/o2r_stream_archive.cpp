@@ -0,0 +1,495 @@
+#include "o2r_stream_archive.h"
+#include "filebox.h"
+#include "mio.hpp"
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <ctime>
+#if defined(_WIN32)
+#include <io.h>
+#endif
+
+static constexpr uint32_t LOCAL_HEADER_SIG = 0x04034B50;
+static constexpr uint32_t CENTRAL_HEADER_SIG = 0x02014B50;
+static constexpr uint32_t EOCD_SIG = 0x06054B50;
+static constexpr uint32_t EOCD64_SIG = 0x06064B50;
+static constexpr uint32_t EOCD64_LOCATOR_SIG = 0x07064B50;
+static constexpr uint16_t ZIP64_EXTRA_ID = 0x0001;
+// The file name is UTF-8
+static constexpr uint16_t FLAG_UTF8 = 1 << 11;
+static constexpr uint16_t VERSION_DEFAULT = 20;
+static constexpr uint16_t VERSION_ZIP64 = 45;
+// Sizes and offsets at or above these don't fit in the regular headers and are moved to the ZIP64 extra field.
+static constexpr uint64_t ZIP64_LIMIT_32 = 0xFFFFFFFF;
+static constexpr uint64_t ZIP64_LIMIT_16 = 0xFFFF;
+
+// Slicing-by-8 tables for the reflected ZIP polynomial
+static constexpr std::array<std::array<uint32_t, 256>, 8> sCrcTables = []() {
+    std::array<std::array<uint32_t, 256>, 8> t{};
+    for (uint32_t i = 0; i < 256; i++) {
+        uint32_t c = i;
+        for (int k = 0; k < 8; k++) {
+            c = (c & 1) ? (c >> 1) ^ 0xEDB88320 : c >> 1;
+        }
+        t[0][i] = c;
+    }
+    for (uint32_t i = 0; i < 256; i++) {
+        for (size_t s = 1; s < 8; s++) {
+            t[s][i] = (t[s - 1][i] >> 8) ^ t[0][t[s - 1][i] & 0xFF];
+        }
+    }
+    return t;
+}();
+
+uint32_t ZipCrc32(uint32_t crc, const void* data, size_t size) {
+    const uint8_t* p = (const uint8_t*)data;
+    crc = ~crc;
+    while (size >= 8) {
+        const uint32_t lo = crc ^ ((uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24);
+        crc = sCrcTables[7][lo & 0xFF] ^ sCrcTables[6][(lo >> 8) & 0xFF] ^ sCrcTables[5][(lo >> 16) & 0xFF] ^ sCrcTables[4][lo >> 24] ^
+              sCrcTables[3][p[4]] ^ sCrcTables[2][p[5]] ^ sCrcTables[1][p[6]] ^ sCrcTables[0][p[7]];
+        p += 8;
+        size -= 8;
+    }
+    while (size-- != 0) {
+        crc = (crc >> 8) ^ sCrcTables[0][(crc ^ *p++) & 0xFF];
+    }
+    return ~crc;
+}
+
+static uint32_t SegmentsCrc32(const ArchiveDataInfo* segments, size_t numSegments) {
+    uint32_t crc = 0;
+    for (size_t i = 0; i < numSegments; i++) {
+        crc = ZipCrc32(crc, segments[i].data, segments[i].size);
+    }
+    return crc;
+}
+
+// Little endian writer for building headers on the stack
+typedef struct HeaderWriter {
+    uint8_t buf[128];
+    size_t pos;
+} HeaderWriter;
+
+static void Put16(HeaderWriter* w, uint16_t v) {
+    w->buf[w->pos++] = (uint8_t)v;
+    w->buf[w->pos++] = (uint8_t)(v >> 8);
+}
+
+static void Put32(HeaderWriter* w, uint32_t v) {
+    Put16(w, (uint16_t)v);
+    Put16(w, (uint16_t)(v >> 16));
+}
+
+static void Put64(HeaderWriter* w, uint64_t v) {
+    Put32(w, (uint32_t)v);
+    Put32(w, (uint32_t)(v >> 32));
+}
+
+static uint32_t Clamp32(uint64_t v) {
+    return v >= ZIP64_LIMIT_32 ? (uint32_t)ZIP64_LIMIT_32 : (uint32_t)v;
+}
+
+// Size of the local header and data of `e`, see `WriteEntry`
+static uint64_t GetEntryRecordSize(const O2rStreamEntry* e) {
+    return 30 + e->name.size() + (e->size >= ZIP64_LIMIT_32 ? 20 : 0) + e->size;
+}
+
+static bool SeekFile(FILE* file, uint64_t offset) {
+#if defined(_WIN32)
+    return _fseeki64(file, (__int64)offset, SEEK_SET) == 0;
+#else
+    return fseeko(file, (off_t)offset, SEEK_SET) == 0;
+#endif
+}
+
+// Cuts the file off at `size`. Anything buffered has to be flushed first.
+static bool TruncateFile(FILE* file, uint64_t size) {
+#if defined(_WIN32)
+    return _chsize_s(_fileno(file), (__int64)size) == 0;
+#else
+    return ftruncate(fileno(file), (off_t)size) == 0;
+#endif
+}
+
+O2rStreamArchive::O2rStreamArchive() {
+
+}
+
+O2rStreamArchive::O2rStreamArchive(const char* path) {
+    OpenArchive(path);
+}
+
+O2rStreamArchive::~O2rStreamArchive() {
+    CloseArchive();
+    files.clear();
+}
+
+bool O2rStreamArchive::OpenArchive(const char* path) {
+    // Opened for reading too so `Compact` can move entries that are already written
+    mFile = fopen(path, "wb+");
+    if (mFile == nullptr) {
+        ShowErrorBox("ZIP Error", "Failed to create the archive");
+        return true;
+    }
+    // Entries are written with a few large writes each, a bigger buffer cuts down on the number of syscalls for the headers.
+    setvbuf(mFile, nullptr, _IOFBF, 1024 * 1024);
+    mOffset = 0;
+    mDeadBytes = 0;
+    mFailed = false;
+    mEntries.clear();
+    mEntryIndices.clear();
+
+    // Every entry gets the time the archive was created
+    const time_t now = time(nullptr);
+    const tm* t = localtime(&now);
+    mDosTime = (uint16_t)((t->tm_hour << 11) | (t->tm_min << 5) | (t->tm_sec / 2));
+    mDosDate = (uint16_t)(((t->tm_year - 80) << 9) | ((t->tm_mon + 1) << 5) | t->tm_mday);
+    return false;
+}
+
+bool O2rStreamArchive::IsArchiveOpen() const {
+    return mFile != nullptr;
+}
+
+bool O2rStreamArchive::CloseArchive() {
+    if (!IsArchiveOpen()) {
+        return false;
+    }
+    if (mDeadBytes != 0) {
+        Compact();
+    }
+    bool ret = WriteCentralDirectory();
+    // The file is longer than the archive if it was flushed or compacted
+    if (fflush(mFile) != 0 || !TruncateFile(mFile, mOffset)) {
+        ret = false;
+    }
+    if (fclose(mFile) != 0) {
+        ret = false;
+    }
+    mFile = nullptr;
+    return ret;
+}
+
+int64_t O2rStreamArchive::GetNumFiles() {
+    return mEntries.size();
+}
+
+void* O2rStreamArchive::ReadFile(const char* filePath, size_t* bytesRead) {
+    *bytesRead = 0;
+    return nullptr;
+}
+
+size_t O2rStreamArchive::GetFileSize(const char* path) const {
+    const auto it = mEntryIndices.find(path);
+    if (it == mEntryIndices.end()) {
+        return 0;
+    }
+    return mEntries[it->second].size;
+}
+
+std::unique_ptr<ArchiveFileReader> O2rStreamArchive::OpenFileReader(const char* filePath) {
+    return nullptr;
+}
+
+void O2rStreamArchive::GenFileList() {
+    files.clear();
+    fileSizes.clear();
+    fileStoredSizes.clear();
+    files.reserve(mEntries.size());
+    fileSizes.reserve(mEntries.size());
+    fileStoredSizes.reserve(mEntries.size());
+    for (const auto& e : mEntries) {
+        files.push_back(e.name.c_str());
+        fileSizes.push_back(e.size);
+        // Always stored uncompressed
+        fileStoredSizes.push_back(e.size);
+    }
+}
+
+void O2rStreamArchive::CreateArchiveFromList(std::vector<char*>& list, char* pathBase) {
+    size_t baseStrEnd = strlen(pathBase);
+    while (!list.empty()) {
+        char* newPath = &list.back()[baseStrEnd + 1];
+        std::error_code ec;
+        mio::mmap_source file;
+        file.map(list.back(), ec);
+
+        if (!ec) {
+            file.release();
+            const ArchiveDataInfo info = {
+                .data = (void*)file.data(), .size = file.size(), .mode = MMappedFile
+            };
+            WriteFileUnlocked(newPath, &info);
+        } else if (GetDiskFileSize(list.back()) == 0) {
+            // Empty files can't be mapped
+            const ArchiveDataInfo info = {
+                .data = nullptr, .size = 0, .mode = DataCopy
+            };
+            WriteFileUnlocked(newPath, &info);
+        } else {
+            printf("Failed to open %s\n", list.back());
+            mFailed = true;
+        }
+        delete[] list.back();
+        list.pop_back();
+    }
+}
+
+// The CRC is calculated before taking the lock so other threads can keep writing while it runs.
+void O2rStreamArchive::WriteFile(char* path, const ArchiveDataInfo* data) {
+    const uint32_t crc = SegmentsCrc32(data, 1);
+    std::lock_guard<std::mutex> lock(m);
+    WriteEntry(path, data, 1, crc);
+    c.notify_one();
+}
+
+void O2rStreamArchive::WriteFileUnlocked(char* path, const ArchiveDataInfo* data) {
+    WriteEntry(path, data, 1, SegmentsCrc32(data, 1));
+}
+
+void O2rStreamArchive::WriteFileSegments(char* path, const ArchiveDataInfo* segments, size_t numSegments) {
+    const uint32_t crc = SegmentsCrc32(segments, numSegments);
+    std::lock_guard<std::mutex> lock(m);
+    WriteEntry(path, segments, numSegments, crc);
+    c.notify_one();
+}
+
+void O2rStreamArchive::WriteFileSegmentsUnlocked(char* path, const ArchiveDataInfo* segments, size_t numSegments) {
+    WriteEntry(path, segments, numSegments, SegmentsCrc32(segments, numSegments));
+}
+
+bool O2rStreamArchive::RemoveFile(const char* path) {
+    std::lock_guard<std::mutex> lock(m);
+    const auto it = mEntryIndices.find(path);
+    if (it == mEntryIndices.end()) {
+        return false;
+    }
+    const size_t index = it->second;
+    mDeadBytes += GetEntryRecordSize(&mEntries[index]);
+    mEntryIndices.erase(it);
+    if (index != mEntries.size() - 1) {
+        mEntries[index] = std::move(mEntries.back());
+        mEntryIndices[mEntries[index].name] = index;
+    }
+    mEntries.pop_back();
+    return true;
+}
+
+bool O2rStreamArchive::FlushArchive() {
+    std::lock_guard<std::mutex> lock(m);
+    if (!IsArchiveOpen()) {
+        return false;
+    }
+    // Keeps a long watch from growing the file without end. Compacting copies everything after the first hole, so
+    // waiting until half the file is dead space keeps the copying in proportion to what was written.
+    if (mDeadBytes > mOffset - mDeadBytes) {
+        Compact();
+    }
+    const uint64_t cdOffset = mOffset;
+    bool ret = WriteCentralDirectory();
+    if (fflush(mFile) != 0) {
+        ret = false;
+    }
+    // A shorter central directory than last time would leave the end of the old one after it, and readers look for the
+    // end of the central directory at the end of the file.
+    const bool truncated = TruncateFile(mFile, mOffset);
+    const bool seeked = SeekFile(mFile, cdOffset);
+    if (!truncated || !seeked) {
+        mFailed = true;
+        ret = false;
+    }
+    mOffset = cdOffset;
+    return ret;
+}
+
+void O2rStreamArchive::WriteBytes(const void* data, size_t size) {
+    if (size != 0 && fwrite(data, size, 1, mFile) != 1) {
+        mFailed = true;
+    }
+    mOffset += size;
+}
+
+void O2rStreamArchive::WriteEntry(const char* path, const ArchiveDataInfo* segments, size_t numSegments, uint32_t crc) {
+    HeaderWriter w;
+    O2rStreamEntry entry;
+    const size_t nameLen = strlen(path);
+
+    entry.name = path;
+    entry.crc = crc;
+    entry.size = 0;
+    entry.offset = mOffset;
+    for (size_t i = 0; i < numSegments; i++) {
+        entry.size += segments[i].size;
+    }
+    const bool zip64 = entry.size >= ZIP64_LIMIT_32;
+
+    w.pos = 0;
+    Put32(&w, LOCAL_HEADER_SIG);
+    Put16(&w, zip64 ? VERSION_ZIP64 : VERSION_DEFAULT);
+    Put16(&w, FLAG_UTF8);
+    Put16(&w, 0); // Stored
+    Put16(&w, mDosTime);
+    Put16(&w, mDosDate);
+    Put32(&w, crc);
+    Put32(&w, Clamp32(entry.size));
+    Put32(&w, Clamp32(entry.size));
+    Put16(&w, (uint16_t)nameLen);
+    Put16(&w, zip64 ? 20 : 0);
+    WriteBytes(w.buf, w.pos);
+    WriteBytes(path, nameLen);
+    if (zip64) {
+        w.pos = 0;
+        Put16(&w, ZIP64_EXTRA_ID);
+        Put16(&w, 16);
+        Put64(&w, entry.size);
+        Put64(&w, entry.size);
+        WriteBytes(w.buf, w.pos);
+    }
+
+    for (size_t i = 0; i < numSegments; i++) {
+        WriteBytes(segments[i].data, segments[i].size);
+        // The data is on disk now, there is no reason to hold on to it.
+        if (segments[i].mode == MMappedFile) {
+            UnmapFile(segments[i].data, segments[i].size);
+        } else if (segments[i].mode == DataOwned) {
+            free(segments[i].data);
+        }
+    }
+
+    const auto it = mEntryIndices.find(entry.name);
+    if (it != mEntryIndices.end()) {
+        // The old data stays in the file but nothing points to it anymore.
+        mDeadBytes += GetEntryRecordSize(&mEntries[it->second]);
+        mEntries[it->second] = std::move(entry);
+    } else {
+        mEntryIndices.emplace(entry.name, mEntries.size());
+        mEntries.push_back(std::move(entry));
+    }
+}
+
+// Moves every entry down over the data of files that were removed or replaced. Entries only ever move toward the start
+// of the file, so each one can be copied front to back in place.
+bool O2rStreamArchive::Compact() {
+    std::vector<O2rStreamEntry*> order;
+    order.reserve(mEntries.size());
+    for (auto& e : mEntries) {
+        order.push_back(&e);
+    }
+    std::sort(order.begin(), order.end(), [](const O2rStreamEntry* a, const O2rStreamEntry* b) {
+        return a->offset < b->offset;
+    });
+
+    static constexpr size_t COPY_BUF_SIZE = 1024 * 1024;
+    auto buf = std::make_unique<uint8_t[]>(COPY_BUF_SIZE);
+    // Anything buffered has to be on disk before it is read back
+    if (fflush(mFile) != 0) {
+        mFailed = true;
+    }
+    uint64_t dst = 0;
+    for (O2rStreamEntry* e : order) {
+        const uint64_t size = GetEntryRecordSize(e);
+        for (uint64_t done = 0; e->offset != dst && done < size && !mFailed;) {
+            const size_t toCopy = (size_t)std::min<uint64_t>(COPY_BUF_SIZE, size - done);
+            // Switching between reading and writing needs a seek in between
+            if (!SeekFile(mFile, e->offset + done) || fread(buf.get(), toCopy, 1, mFile) != 1 ||
+                !SeekFile(mFile, dst + done) || fwrite(buf.get(), toCopy, 1, mFile) != 1) {
+                mFailed = true;
+            }
+            done += toCopy;
+        }
+        e->offset = dst;
+        dst += size;
+    }
+    if (!SeekFile(mFile, dst)) {
+        mFailed = true;
+    }
+    mOffset = dst;
+    mDeadBytes = 0;
+    return !mFailed;
+}
+
+bool O2rStreamArchive::WriteCentralDirectory() {
+    HeaderWriter w;
+    const uint64_t cdOffset = mOffset;
+
+    for (const auto& e : mEntries) {
+        const bool sizeZip64 = e.size >= ZIP64_LIMIT_32;
+        const bool offsetZip64 = e.offset >= ZIP64_LIMIT_32;
+        const uint16_t extraLen = (sizeZip64 ? 16 : 0) + (offsetZip64 ? 8 : 0);
+
+        w.pos = 0;
+        Put32(&w, CENTRAL_HEADER_SIG);
+        Put16(&w, VERSION_ZIP64); // Made by
+        Put16(&w, extraLen != 0 ? VERSION_ZIP64 : VERSION_DEFAULT);
+        Put16(&w, FLAG_UTF8);
+        Put16(&w, 0); // Stored
+        Put16(&w, mDosTime);
+        Put16(&w, mDosDate);
+        Put32(&w, e.crc);
+        Put32(&w, Clamp32(e.size));
+        Put32(&w, Clamp32(e.size));
+        Put16(&w, (uint16_t)e.name.size());
+        Put16(&w, extraLen != 0 ? extraLen + 4 : 0);
+        Put16(&w, 0); // Comment length
+        Put16(&w, 0); // Disk number
+        Put16(&w, 0); // Internal attributes
+        Put32(&w, 0); // External attributes
+        Put32(&w, Clamp32(e.offset));
+        WriteBytes(w.buf, w.pos);
+        WriteBytes(e.name.data(), e.name.size());
+        if (extraLen != 0) {
+            w.pos = 0;
+            Put16(&w, ZIP64_EXTRA_ID);
+            Put16(&w, extraLen);
+            if (sizeZip64) {
+                Put64(&w, e.size);
+                Put64(&w, e.size);
+            }
+            if (offsetZip64) {
+                Put64(&w, e.offset);
+            }
+            WriteBytes(w.buf, w.pos);
+        }
+    }
+
+    const uint64_t cdSize = mOffset - cdOffset;
+    const uint64_t numEntries = mEntries.size();
+    if (numEntries >= ZIP64_LIMIT_16 || cdSize >= ZIP64_LIMIT_32 || cdOffset >= ZIP64_LIMIT_32) {
+        const uint64_t eocd64Offset = mOffset;
+
+        w.pos = 0;
+        Put32(&w, EOCD64_SIG);
+        Put64(&w, 44); // Size of the rest of the record
+        Put16(&w, VERSION_ZIP64);
+        Put16(&w, VERSION_ZIP64);
+        Put32(&w, 0); // This disk
+        Put32(&w, 0); // Disk with the central directory
+        Put64(&w, numEntries);
+        Put64(&w, numEntries);
+        Put64(&w, cdSize);
+        Put64(&w, cdOffset);
+
+        Put32(&w, EOCD64_LOCATOR_SIG);
+        Put32(&w, 0); // Disk with the ZIP64 end of central directory
+        Put64(&w, eocd64Offset);
+        Put32(&w, 1); // Number of disks
+        WriteBytes(w.buf, w.pos);
+    }
+
+    w.pos = 0;
+    Put32(&w, EOCD_SIG);
+    Put16(&w, 0); // This disk
+    Put16(&w, 0); // Disk with the central directory
+    Put16(&w, numEntries >= ZIP64_LIMIT_16 ? (uint16_t)ZIP64_LIMIT_16 : (uint16_t)numEntries);
+    Put16(&w, numEntries >= ZIP64_LIMIT_16 ? (uint16_t)ZIP64_LIMIT_16 : (uint16_t)numEntries);
+    Put32(&w, Clamp32(cdSize));
+    Put32(&w, Clamp32(cdOffset));
+    Put16(&w, 0); // Comment length
+    WriteBytes(w.buf, w.pos);
+
+    if (mFailed) {
+        printf("Failed to write the archive\n");
+    }
+    return !mFailed;
+}
@@ -0,0 +1,73 @@
+#ifndef O2R_STREAM_ARCHIVE_H
+#define O2R_STREAM_ARCHIVE_H
+
+#include "archive.h"
+#include <cstdio>
+#include <string>
+#include <unordered_map>
+
+typedef struct O2rStreamEntry {
+    std::string name;
+    uint32_t crc;
+    uint64_t size;
+    // Offset of the local file header
+    uint64_t offset;
+} O2rStreamEntry;
+
+// Write only O2R archive. Unlike `ZipArchive`, which has libzip write everything when the archive is closed, each file
+// is written to disk as soon as it is added and its data is released right away. Only the central directory is kept
+// until the archive is closed. Files are always stored uncompressed, the same as `ZipArchive`.
+// Opening an archive replaces the file at that path. Nothing can be read back from it. `FlushArchive` makes the file a
+// complete archive without closing it, so it can be kept up to date by replacing only the files that changed.
+// Removed and replaced files leave their old data behind until the archive is compacted. That happens when it is
+// closed, or when it is flushed with more dead space than files.
+class O2rStreamArchive : public Archive {
+public:
+    O2rStreamArchive();
+    O2rStreamArchive(const char* path);
+    ~O2rStreamArchive();
+
+    bool OpenArchive(const char* path) override;
+    bool IsArchiveOpen() const override;
+    // Compacts the archive if anything was removed or replaced and writes the central directory. Returns false if
+    // anything failed to be written.
+    bool CloseArchive() override;
+    int64_t GetNumFiles() override;
+
+    // Always returns null. The archive is write only.
+    void* ReadFile(const char* filePath, size_t* bytesRead) override;
+    // Returns the size of a file that has already been written.
+    size_t GetFileSize(const char* path) const override;
+    std::unique_ptr<ArchiveFileReader> OpenFileReader(const char* filePath) override;
+    void GenFileList() override;
+    void CreateArchiveFromList(std::vector<char*>& list, char* basePath) override;
+
+    void WriteFile(char* path, const ArchiveDataInfo* data) override;
+    void WriteFileUnlocked(char* path, const ArchiveDataInfo* data) override;
+    void WriteFileSegments(char* path, const ArchiveDataInfo* segments, size_t numSegments) override;
+    void WriteFileSegmentsUnlocked(char* path, const ArchiveDataInfo* segments, size_t numSegments) override;
+    // The data of a removed file stays in the archive, with nothing pointing to it, until it is compacted.
+    bool RemoveFile(const char* path) override;
+    // Writes the central directory after the files written so far. The next file written overwrites it.
+    bool FlushArchive() override;
+private:
+    void WriteEntry(const char* path, const ArchiveDataInfo* segments, size_t numSegments, uint32_t crc);
+    void WriteBytes(const void* data, size_t size);
+    bool WriteCentralDirectory();
+    bool Compact();
+    FILE* mFile = nullptr;
+    uint64_t mOffset = 0;
+    // Bytes of files that were removed or replaced since the archive was last compacted
+    uint64_t mDeadBytes = 0;
+    uint16_t mDosTime = 0;
+    uint16_t mDosDate = 0;
+    bool mFailed = false;
+    std::vector<O2rStreamEntry> mEntries;
+    // Index into `mEntries` of each path. Writing a path twice replaces the first entry in the central directory.
+    std::unordered_map<std::string, size_t> mEntryIndices;
+};
+
+// CRC-32 used by ZIP. Pass the result of the previous call as `crc` to continue a checksum, or 0 to start a new one.
+uint32_t ZipCrc32(uint32_t crc, const void* data, size_t size);
+
+#endif
@@ -0,0 +1,221 @@
+#include "pack_report.h"
+#include <cstdio>
+#include <cstring>
+
+static constexpr const char* sStageNames[(size_t)PackStage::Max] = {
+    "decode",
+    "deinterleave",
+    "convert",
+    "encode",
+    "memory_wait",
+    "write_wait",
+    "write",
+};
+
+void StartStageTimer(StageTimer* t) {
+    t->last = std::chrono::steady_clock::now();
+}
+
+void EndStage(PackFileRecord* record, PackStage stage, StageTimer* t) {
+    const auto now = std::chrono::steady_clock::now();
+    record->stageMs[(size_t)stage] += std::chrono::duration<double, std::milli>(now - t->last).count();
+    t->last = now;
+}
+
+const char* PackStageToStr(PackStage stage) {
+    return sStageNames[(size_t)stage];
+}
+
+double GetRecordDuration(const PackFileRecord* record) {
+    if (record->sampleRate == 0) {
+        return 0.0;
+    }
+    return (double)record->numFrames / (double)record->sampleRate;
+}
+
+double GetRecordTotalMs(const PackFileRecord* record) {
+    double total = 0.0;
+    for (size_t i = 0; i < (size_t)PackStage::Max; i++) {
+        total += record->stageMs[i];
+    }
+    return total;
+}
+
+static double GetRecordRatio(const PackFileRecord* record) {
+    if (record->inputSize == 0) {
+        return 0.0;
+    }
+    return (double)record->outputSize / (double)record->inputSize;
+}
+
+void PackReport::Start(size_t numFiles) {
+    mRecords.clear();
+    mRecords.resize(numFiles);
+    mWallMs = 0.0;
+    mStart = std::chrono::steady_clock::now();
+}
+
+void PackReport::Finish() {
+    mWallMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - mStart).count();
+}
+
+PackFileRecord* PackReport::GetRecord(size_t index) {
+    if (index >= mRecords.size()) {
+        return nullptr;
+    }
+    return &mRecords[index];
+}
+
+const std::vector<PackFileRecord>& PackReport::GetRecords() const {
+    return mRecords;
+}
+
+void PackReport::Summarize(PackReportSummary* summary) const {
+    double slowestMs = -1.0;
+    double worstRatio = -1.0;
+
+    memset(summary, 0, sizeof(*summary));
+    summary->wallMs = mWallMs;
+    summary->slowest = SIZE_MAX;
+    summary->worstRatio = SIZE_MAX;
+    for (size_t i = 0; i < mRecords.size(); i++) {
+        const PackFileRecord* r = &mRecords[i];
+        if (!r->processed) {
+            continue;
+        }
+        summary->numFiles++;
+        if (r->failed) {
+            summary->numFailed++;
+            continue;
+        }
+        summary->audioSeconds += GetRecordDuration(r);
+        summary->inputSize += r->inputSize;
+        summary->outputSize += r->outputSize;
+        for (size_t s = 0; s < (size_t)PackStage::Max; s++) {
+            summary->stageMs[s] += r->stageMs[s];
+        }
+        const double totalMs = GetRecordTotalMs(r);
+        if (totalMs > slowestMs) {
+            slowestMs = totalMs;
+            summary->slowest = i;
+        }
+        const double ratio = GetRecordRatio(r);
+        if (ratio > worstRatio) {
+            worstRatio = ratio;
+            summary->worstRatio = i;
+        }
+    }
+}
+
+// Quotes `s` if it contains anything that would break the row.
+static void WriteCsvString(FILE* file, const char* s) {
+    if (strpbrk(s, ",\"\r\n") == nullptr) {
+        fputs(s, file);
+        return;
+    }
+    fputc('"', file);
+    for (; *s != 0; s++) {
+        if (*s == '"') {
+            fputc('"', file);
+        }
+        fputc(*s, file);
+    }
+    fputc('"', file);
+}
+
+bool PackReport::WriteCsv(const char* path) const {
+    FILE* file = fopen(path, "w");
+    if (file == nullptr) {
+        return false;
+    }
+
+    fputs("file,input_format,output_format,channels,sample_rate,frames,duration_s", file);
+    for (size_t s = 0; s < (size_t)PackStage::Max; s++) {
+        fprintf(file, ",%s_ms", sStageNames[s]);
+    }
+    fputs(",input_bytes,output_bytes,ratio,failed\n", file);
+
+    for (const auto& r : mRecords) {
+        if (!r.processed) {
+            continue;
+        }
+        WriteCsvString(file, r.name.c_str());
+        fprintf(file, ",%s,%s,%u,%llu,%llu,%.3f", r.inputFormat, r.outputFormat, r.channels, (unsigned long long)r.sampleRate,
+                (unsigned long long)r.numFrames, GetRecordDuration(&r));
+        for (size_t s = 0; s < (size_t)PackStage::Max; s++) {
+            fprintf(file, ",%.3f", r.stageMs[s]);
+        }
+        fprintf(file, ",%llu,%llu,%.4f,%d\n", (unsigned long long)r.inputSize, (unsigned long long)r.outputSize, GetRecordRatio(&r), r.failed);
+    }
+    fclose(file);
+    return true;
+}
+
+static void WriteJsonString(FILE* file, const char* s) {
+    fputc('"', file);
+    for (; *s != 0; s++) {
+        switch (*s) {
+            case '"':
+                fputs("\\\"", file);
+                break;
+            case '\\':
+                fputs("\\\\", file);
+                break;
+            default:
+                if ((unsigned char)*s < 0x20) {
+                    fprintf(file, "\\u%04x", (unsigned char)*s);
+                } else {
+                    fputc(*s, file);
+                }
+                break;
+        }
+    }
+    fputc('"', file);
+}
+
+bool PackReport::WriteJson(const char* path) const {
+    PackReportSummary summary;
+    FILE* file = fopen(path, "w");
+    if (file == nullptr) {
+        return false;
+    }
+
+    Summarize(&summary);
+    fprintf(file, "{\n  \"summary\": {\n");
+    fprintf(file, "    \"files\": %zu,\n    \"failed\": %zu,\n    \"audio_s\": %.3f,\n    \"wall_ms\": %.3f,\n", summary.numFiles,
+            summary.numFailed, summary.audioSeconds, summary.wallMs);
+    for (size_t s = 0; s < (size_t)PackStage::Max; s++) {
+        fprintf(file, "    \"%s_ms\": %.3f,\n", sStageNames[s], summary.stageMs[s]);
+    }
+    fprintf(file, "    \"input_bytes\": %llu,\n    \"output_bytes\": %llu\n  },\n", (unsigned long long)summary.inputSize,
+            (unsigned long long)summary.outputSize);
+
+    fprintf(file, "  \"files\": [");
+    bool first = true;
+    for (const auto& r : mRecords) {
+        if (!r.processed) {
+            continue;
+        }
+        fprintf(file, "%s\n    {\"file\": ", first ? "" : ",");
+        first = false;
+        WriteJsonString(file, r.name.c_str());
+        fprintf(file, ", \"input_format\": \"%s\", \"output_format\": \"%s\", \"channels\": %u, \"sample_rate\": %llu, \"frames\": %llu, \"duration_s\": %.3f",
+                r.inputFormat, r.outputFormat, r.channels, (unsigned long long)r.sampleRate, (unsigned long long)r.numFrames, GetRecordDuration(&r));
+        for (size_t s = 0; s < (size_t)PackStage::Max; s++) {
+            fprintf(file, ", \"%s_ms\": %.3f", sStageNames[s], r.stageMs[s]);
+        }
+        fprintf(file, ", \"input_bytes\": %llu, \"output_bytes\": %llu, \"ratio\": %.4f, \"failed\": %s}", (unsigned long long)r.inputSize,
+                (unsigned long long)r.outputSize, GetRecordRatio(&r), r.failed ? "true" : "false");
+    }
+    fprintf(file, "\n  ]\n}\n");
+    fclose(file);
+    return true;
+}
+
+bool PackReport::Write(const char* path) const {
+    const char* ext = strrchr(path, '.');
+    if (ext != nullptr && strcmp(ext, ".json") == 0) {
+        return WriteJson(path);
+    }
+    return WriteCsv(path);
+}
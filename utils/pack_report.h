@@ -0,0 +1,89 @@
+#ifndef PACK_REPORT_H
+#define PACK_REPORT_H
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+enum class PackStage : uint8_t {
+    Decode,
+    // Splitting interleaved stereo into one buffer per channel.
+    Deinterleave,
+    // Converting between sample formats.
+    Convert,
+    Encode,
+    // Time spent waiting for the memory budget to have room for the file.
+    MemoryWait,
+    // Time spent waiting for another thread to finish writing to the archive.
+    WriteWait,
+    Write,
+    Max,
+};
+
+// Everything recorded about one input file while it is packed.
+typedef struct PackFileRecord {
+    std::string name;
+    const char* inputFormat = "";
+    const char* outputFormat = "";
+    uint32_t channels = 0;
+    uint64_t sampleRate = 0;
+    uint64_t numFrames = 0;
+    double stageMs[(size_t)PackStage::Max] = {};
+    uint64_t inputSize = 0;
+    // Size of the sample data written. Metadata isn't included.
+    uint64_t outputSize = 0;
+    bool processed = false;
+    bool failed = false;
+} PackFileRecord;
+
+typedef struct PackReportSummary {
+    size_t numFiles;
+    size_t numFailed;
+    double audioSeconds;
+    double wallMs;
+    double stageMs[(size_t)PackStage::Max];
+    uint64_t inputSize;
+    uint64_t outputSize;
+    // Index of the file that took the longest. SIZE_MAX if no file was packed.
+    size_t slowest;
+    // Index of the file with the largest output compared to its input. SIZE_MAX if no file was packed.
+    size_t worstRatio;
+} PackReportSummary;
+
+// Accumulates the time since the last call to `EndStage` into a stage of a record.
+typedef struct StageTimer {
+    std::chrono::steady_clock::time_point last;
+} StageTimer;
+
+void StartStageTimer(StageTimer* t);
+void EndStage(PackFileRecord* record, PackStage stage, StageTimer* t);
+const char* PackStageToStr(PackStage stage);
+double GetRecordDuration(const PackFileRecord* record);
+double GetRecordTotalMs(const PackFileRecord* record);
+
+// Per-file records of a pack job. Each file is written by only one worker, picked by its index in the
+// file queue, so the records don't need to be locked.
+class PackReport {
+public:
+    // Clears the records and starts the wall clock.
+    void Start(size_t numFiles);
+    // Stops the wall clock.
+    void Finish();
+    // Null if `index` is past the end of the file queue the report was started with.
+    PackFileRecord* GetRecord(size_t index);
+    const std::vector<PackFileRecord>& GetRecords() const;
+    // Only valid once `Finish` has been called.
+    void Summarize(PackReportSummary* summary) const;
+    bool WriteCsv(const char* path) const;
+    bool WriteJson(const char* path) const;
+    // Writes JSON if `path` ends in .json, otherwise CSV.
+    bool Write(const char* path) const;
+private:
+    std::vector<PackFileRecord> mRecords;
+    std::chrono::steady_clock::time_point mStart;
+    double mWallMs = 0.0;
+};
+
+#endif
@@ -0,0 +1,54 @@
+#include "paged_file.h"
+
+#include <cstring>
+
+PagedFile::PagedFile(std::unique_ptr<ArchiveFileReader> reader) {
+    mReader = std::move(reader);
+    mSize = mReader->GetSize();
+    mPages.reserve(MAX_PAGES);
+}
+
+uint64_t PagedFile::GetSize() const {
+    return mSize;
+}
+
+uint8_t PagedFile::ReadByte(uint64_t offset) {
+    if (offset >= mSize) {
+        return 0;
+    }
+    const uint64_t index = offset / PAGE_SIZE;
+    // Bytes are read one at a time and almost always from the same page as the last one
+    if (mCurPage == nullptr || mCurPage->index != index) {
+        mCurPage = GetPage(index);
+    }
+    return mCurPage->data[offset % PAGE_SIZE];
+}
+
+PagedFile::Page* PagedFile::GetPage(uint64_t index) {
+    mUseCounter++;
+    Page* oldest = nullptr;
+    for (Page& page : mPages) {
+        if (page.index == index) {
+            page.lastUse = mUseCounter;
+            return &page;
+        }
+        if (oldest == nullptr || page.lastUse < oldest->lastUse) {
+            oldest = &page;
+        }
+    }
+
+    Page* page;
+    if (mPages.size() < MAX_PAGES) {
+        page = &mPages.emplace_back();
+        page->data = std::make_unique<uint8_t[]>(PAGE_SIZE);
+    } else {
+        page = oldest;
+    }
+    page->index = index;
+    page->lastUse = mUseCounter;
+
+    const uint64_t offset = index * PAGE_SIZE;
+    const size_t bytesRead = mReader->Read(offset, page->data.get(), PAGE_SIZE);
+    memset(page->data.get() + bytesRead, 0, PAGE_SIZE - bytesRead);
+    return page;
+}
@@ -0,0 +1,41 @@
+#ifndef PAGED_FILE_H
+#define PAGED_FILE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include "archive.h"
+
+// A file in an archive read in fixed size pages as they are needed. Only the most recently used pages are kept, so
+// viewing any part of a large file only costs reading that part.
+class PagedFile {
+public:
+    static constexpr size_t PAGE_SIZE = 64 * 1024;
+    static constexpr size_t MAX_PAGES = 64;
+
+    explicit PagedFile(std::unique_ptr<ArchiveFileReader> reader);
+    PagedFile(const PagedFile&) = delete;
+    PagedFile& operator=(const PagedFile&) = delete;
+
+    uint64_t GetSize() const;
+    // Returns the byte at `offset`, reading its page first if it isn't cached. Bytes that couldn't be read are 0.
+    uint8_t ReadByte(uint64_t offset);
+private:
+    typedef struct Page {
+        std::unique_ptr<uint8_t[]> data;
+        uint64_t index;
+        uint64_t lastUse;
+    } Page;
+
+    Page* GetPage(uint64_t index);
+
+    std::unique_ptr<ArchiveFileReader> mReader;
+    uint64_t mSize;
+    // Never grows past `MAX_PAGES` so pointers to pages stay valid
+    std::vector<Page> mPages;
+    Page* mCurPage = nullptr;
+    uint64_t mUseCounter = 0;
+};
+
+#endif
@@ -0,0 +1,223 @@
+#include "path_search.h"
+
+#include <algorithm>
+#include <cstring>
+
+// Trigrams are hashed into a fixed number of buckets. Collisions only add candidates, every candidate is checked
+// against the query anyway.
+static constexpr uint32_t NUM_BUCKETS_LOG2 = 16;
+static constexpr uint32_t NUM_BUCKETS = 1 << NUM_BUCKETS_LOG2;
+
+static uint32_t GetTrigramBucket(const char* s) {
+    const uint32_t key = (uint8_t)s[0] | ((uint8_t)s[1] << 8) | ((uint8_t)s[2] << 16);
+    return (key * 2654435761u) >> (32 - NUM_BUCKETS_LOG2);
+}
+
+static char ToLower(char c) {
+    return (c >= 'A' && c <= 'Z') ? (char)(c + ('a' - 'A')) : c;
+}
+
+static bool IsGlobChar(char c) {
+    return c == '*' || c == '?';
+}
+
+bool GlobMatch(const char* pattern, const char* str) {
+    // Position to go back to when the rest of the pattern doesn't match: the last `*` and where it started matching
+    const char* starPattern = nullptr;
+    const char* starStr = nullptr;
+    while (*str != 0) {
+        if (*pattern == '*') {
+            starPattern = ++pattern;
+            starStr = str;
+        } else if (*pattern == '?' || *pattern == *str) {
+            pattern++;
+            str++;
+        } else if (starPattern != nullptr) {
+            // Let the `*` take one more character
+            pattern = starPattern;
+            str = ++starStr;
+        } else {
+            return false;
+        }
+    }
+    while (*pattern == '*') {
+        pattern++;
+    }
+    return *pattern == 0;
+}
+
+PathSearchIndex::~PathSearchIndex() {
+    Clear();
+}
+
+void PathSearchIndex::BuildAsync(const std::vector<const char*>* paths) {
+    Clear();
+    mPaths = paths;
+    mThread = std::thread(&PathSearchIndex::Build, this);
+}
+
+void PathSearchIndex::Clear() {
+    mCancel = true;
+    if (mThread.joinable()) {
+        mThread.join();
+    }
+    mCancel = false;
+    mReady = false;
+    mPaths = nullptr;
+    mLowerPaths = {};
+    mOffsets = {};
+    mBucketStart = {};
+    mPostings = {};
+    mLastQuery.clear();
+    mLastResults.clear();
+}
+
+bool PathSearchIndex::IsReady() const {
+    return mReady.load(std::memory_order_acquire);
+}
+
+const char* PathSearchIndex::GetLowerPath(uint32_t i) const {
+    return mLowerPaths.data() + mOffsets[i];
+}
+
+void PathSearchIndex::Build() {
+    const std::vector<const char*>& paths = *mPaths;
+    const uint32_t numPaths = (uint32_t)paths.size();
+
+    size_t totalSize = 0;
+    for (const char* p : paths) {
+        totalSize += (p != nullptr ? strlen(p) : 0) + 1;
+    }
+    mLowerPaths.resize(totalSize);
+    mOffsets.resize(numPaths);
+    char* out = mLowerPaths.data();
+    for (uint32_t i = 0; i < numPaths; i++) {
+        mOffsets[i] = (uint32_t)(out - mLowerPaths.data());
+        for (const char* p = paths[i]; p != nullptr && *p != 0; p++) {
+            *out++ = ToLower(*p);
+        }
+        *out++ = 0;
+    }
+    if (mCancel) {
+        return;
+    }
+
+    // Count each bucket once per path, then fill the postings in a second pass. Paths are visited in order so every
+    // bucket's list ends up sorted.
+    std::vector<uint32_t> lastPath(NUM_BUCKETS, UINT32_MAX);
+    mBucketStart.assign(NUM_BUCKETS + 1, 0);
+    for (uint32_t i = 0; i < numPaths; i++) {
+        const char* p = GetLowerPath(i);
+        for (size_t j = 0; p[j] != 0 && p[j + 1] != 0 && p[j + 2] != 0; j++) {
+            const uint32_t b = GetTrigramBucket(p + j);
+            if (lastPath[b] != i) {
+                lastPath[b] = i;
+                mBucketStart[b + 1]++;
+            }
+        }
+        if ((i & 0xFFF) == 0 && mCancel) {
+            return;
+        }
+    }
+    for (uint32_t b = 0; b < NUM_BUCKETS; b++) {
+        mBucketStart[b + 1] += mBucketStart[b];
+    }
+
+    mPostings.resize(mBucketStart[NUM_BUCKETS]);
+    std::vector<uint32_t> fill(mBucketStart.begin(), mBucketStart.end() - 1);
+    std::fill(lastPath.begin(), lastPath.end(), UINT32_MAX);
+    for (uint32_t i = 0; i < numPaths; i++) {
+        const char* p = GetLowerPath(i);
+        for (size_t j = 0; p[j] != 0 && p[j + 1] != 0 && p[j + 2] != 0; j++) {
+            const uint32_t b = GetTrigramBucket(p + j);
+            if (lastPath[b] != i) {
+                lastPath[b] = i;
+                mPostings[fill[b]++] = i;
+            }
+        }
+        if ((i & 0xFFF) == 0 && mCancel) {
+            return;
+        }
+    }
+    mReady.store(true, std::memory_order_release);
+}
+
+// Paths that could match `pattern`: the ones containing every trigram of its literal parts. If the pattern doesn't
+// have any trigrams every path is a candidate.
+void PathSearchIndex::GetCandidates(const std::string& pattern, bool isGlob, std::vector<uint32_t>* out) const {
+    std::vector<uint32_t> buckets;
+    size_t start = 0;
+    while (start < pattern.size()) {
+        size_t end = start;
+        while (end < pattern.size() && !(isGlob && IsGlobChar(pattern[end]))) {
+            end++;
+        }
+        for (size_t j = start; j + 3 <= end; j++) {
+            buckets.push_back(GetTrigramBucket(pattern.data() + j));
+        }
+        start = end + 1;
+    }
+    std::sort(buckets.begin(), buckets.end());
+    buckets.erase(std::unique(buckets.begin(), buckets.end()), buckets.end());
+
+    out->clear();
+    if (buckets.empty()) {
+        out->resize(mOffsets.size());
+        for (uint32_t i = 0; i < out->size(); i++) {
+            (*out)[i] = i;
+        }
+        return;
+    }
+
+    // Start from the shortest list and look each candidate up in the others
+    std::sort(buckets.begin(), buckets.end(), [this](uint32_t a, uint32_t b) {
+        return mBucketStart[a + 1] - mBucketStart[a] < mBucketStart[b + 1] - mBucketStart[b];
+    });
+    const uint32_t* first = mPostings.data() + mBucketStart[buckets[0]];
+    const uint32_t* firstEnd = mPostings.data() + mBucketStart[buckets[0] + 1];
+    for (const uint32_t* c = first; c < firstEnd; c++) {
+        bool inAll = true;
+        for (size_t b = 1; b < buckets.size() && inAll; b++) {
+            inAll = std::binary_search(mPostings.data() + mBucketStart[buckets[b]], mPostings.data() + mBucketStart[buckets[b] + 1], *c);
+        }
+        if (inAll) {
+            out->push_back(*c);
+        }
+    }
+}
+
+bool PathSearchIndex::Search(const char* query, std::vector<uint32_t>* results) {
+    results->clear();
+    if (!IsReady()) {
+        return false;
+    }
+    std::string pattern(query);
+    for (char& c : pattern) {
+        c = ToLower(c);
+    }
+    const bool isGlob = std::any_of(pattern.begin(), pattern.end(), IsGlobChar);
+
+    std::vector<uint32_t> candidates;
+    // A substring query that contains the last one can only match paths the last one matched
+    if (!isGlob && !mLastQuery.empty() && pattern.find(mLastQuery) != std::string::npos) {
+        candidates.swap(mLastResults);
+    } else {
+        GetCandidates(pattern, isGlob, &candidates);
+    }
+
+    for (uint32_t i : candidates) {
+        const char* path = GetLowerPath(i);
+        if (isGlob ? GlobMatch(pattern.c_str(), path) : strstr(path, pattern.c_str()) != nullptr) {
+            results->push_back(i);
+        }
+    }
+
+    if (isGlob) {
+        mLastQuery.clear();
+        mLastResults.clear();
+    } else {
+        mLastQuery = pattern;
+        mLastResults = *results;
+    }
+    return true;
+}
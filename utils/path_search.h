@@ -0,0 +1,55 @@
+#ifndef PATH_SEARCH_H
+#define PATH_SEARCH_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Case insensitive search over the paths in an archive. The index is built on a background thread and keeps a lower
+// case copy of every path in one buffer, plus a trigram index over it. A query only has to check the paths that
+// contain every trigram of the query instead of every path.
+class PathSearchIndex {
+public:
+    PathSearchIndex() = default;
+    ~PathSearchIndex();
+    PathSearchIndex(const PathSearchIndex&) = delete;
+    PathSearchIndex& operator=(const PathSearchIndex&) = delete;
+
+    // Starts indexing `paths`. The paths must stay valid and unchanged until `Clear` is called.
+    void BuildAsync(const std::vector<const char*>* paths);
+    // Stops indexing if it is still running and frees the index.
+    void Clear();
+    bool IsReady() const;
+
+    // Fills `results` with the indices of the paths that match `query`, in the order of the paths.
+    // A query containing `*` or `?` is a glob that has to match the whole path, anything else matches anywhere in the
+    // path. Returns false if the index isn't ready yet.
+    bool Search(const char* query, std::vector<uint32_t>* results);
+private:
+    void Build();
+    void GetCandidates(const std::string& pattern, bool isGlob, std::vector<uint32_t>* out) const;
+    const char* GetLowerPath(uint32_t i) const;
+
+    std::thread mThread;
+    std::atomic<bool> mReady = false;
+    std::atomic<bool> mCancel = false;
+    const std::vector<const char*>* mPaths = nullptr;
+    // Every path lower cased and null terminated, one after the other
+    std::vector<char> mLowerPaths;
+    std::vector<uint32_t> mOffsets;
+    // Paths containing each trigram bucket. Bucket `b` is `mPostings[mBucketStart[b]]` to `mPostings[mBucketStart[b + 1]]`.
+    std::vector<uint32_t> mBucketStart;
+    std::vector<uint32_t> mPostings;
+    // Results of the last substring query. Typing more of the same query only has to check these.
+    std::string mLastQuery;
+    std::vector<uint32_t> mLastResults;
+};
+
+// Case sensitive glob match of the whole of `str`. `*` matches any run of characters, including separators, and `?`
+// matches one character.
+bool GlobMatch(const char* pattern, const char* str);
+
+#endif
@@ -0,0 +1,161 @@
+#include "path_tree.h"
+
+#include <algorithm>
+#include <cstring>
+#include <string_view>
+#include <unordered_map>
+
+static bool IsPathSeparator(char c) {
+    return c == '/' || c == '\\';
+}
+
+void PathTree::Build(const std::vector<const char*>& paths, const std::vector<uint64_t>& sizes) {
+    Clear();
+    mNodes.reserve(paths.size() + paths.size() / 4 + 1);
+    mNodes.push_back({ .name = "", .nameLen = 0, .parent = PATH_TREE_NONE, .firstChild = 0, .numChildren = 0,
+                       .fileIndex = PATH_TREE_NONE, .numFiles = 0, .size = 0 });
+
+    // Directories are keyed by their full path including the trailing separator. The key points into the first path
+    // that had the directory so nothing is copied.
+    std::unordered_map<std::string_view, uint32_t> dirs;
+    for (size_t i = 0; i < paths.size(); i++) {
+        const char* path = paths[i];
+        if (path == nullptr) {
+            continue;
+        }
+        const size_t len = strlen(path);
+        const uint64_t size = i < sizes.size() ? sizes[i] : 0;
+        uint32_t parent = ROOT;
+        size_t start = 0;
+        for (size_t pos = 0; pos < len; pos++) {
+            if (!IsPathSeparator(path[pos])) {
+                continue;
+            }
+            if (pos > start) {
+                auto [it, inserted] = dirs.try_emplace(std::string_view(path, pos + 1), (uint32_t)mNodes.size());
+                if (inserted) {
+                    mNodes.push_back({ .name = path + start, .nameLen = (uint32_t)(pos - start), .parent = parent, .firstChild = 0,
+                                       .numChildren = 0, .fileIndex = PATH_TREE_NONE, .numFiles = 0, .size = 0 });
+                }
+                parent = it->second;
+            }
+            start = pos + 1;
+        }
+        // ZIP files can have entries for directories. They end with a separator and are already in the tree.
+        if (start == len) {
+            continue;
+        }
+        mNodes.push_back({ .name = path + start, .nameLen = (uint32_t)(len - start), .parent = parent, .firstChild = 0,
+                           .numChildren = 0, .fileIndex = (uint32_t)i, .numFiles = 1, .size = size });
+        for (uint32_t n = parent; n != PATH_TREE_NONE; n = mNodes[n].parent) {
+            mNodes[n].numFiles++;
+            mNodes[n].size += size;
+        }
+    }
+
+    // Group the children of each node together. Every node is added after its parent so counting them in order and
+    // filling in the same order keeps it a single pass each.
+    for (uint32_t n = 1; n < mNodes.size(); n++) {
+        mNodes[mNodes[n].parent].numChildren++;
+    }
+    uint32_t offset = 0;
+    for (auto& node : mNodes) {
+        node.firstChild = offset;
+        offset += node.numChildren;
+        node.numChildren = 0;
+    }
+    mChildren.resize(offset);
+    for (uint32_t n = 1; n < mNodes.size(); n++) {
+        PathTreeNode& parent = mNodes[mNodes[n].parent];
+        mChildren[parent.firstChild + parent.numChildren++] = n;
+    }
+
+    for (const auto& node : mNodes) {
+        uint32_t* children = mChildren.data() + node.firstChild;
+        std::sort(children, children + node.numChildren, [this](uint32_t a, uint32_t b) {
+            const PathTreeNode& na = mNodes[a];
+            const PathTreeNode& nb = mNodes[b];
+            const bool aIsDir = na.fileIndex == PATH_TREE_NONE;
+            const bool bIsDir = nb.fileIndex == PATH_TREE_NONE;
+            if (aIsDir != bIsDir) {
+                return aIsDir;
+            }
+            return std::string_view(na.name, na.nameLen) < std::string_view(nb.name, nb.nameLen);
+        });
+    }
+}
+
+void PathTree::Clear() {
+    mNodes.clear();
+    mChildren.clear();
+}
+
+bool PathTree::IsEmpty() const {
+    return mNodes.empty();
+}
+
+const PathTreeNode& PathTree::GetNode(uint32_t node) const {
+    return mNodes[node];
+}
+
+const uint32_t* PathTree::GetChildren(uint32_t node) const {
+    return mChildren.data() + mNodes[node].firstChild;
+}
+
+bool PathTree::IsDir(uint32_t node) const {
+    return mNodes[node].fileIndex == PATH_TREE_NONE;
+}
+
+void PathTreeView::Reset(const PathTree* tree) {
+    mTree = tree;
+    mRows.clear();
+    mExpanded.clear();
+    if (tree == nullptr || tree->IsEmpty()) {
+        return;
+    }
+    AddRows(PathTree::ROOT, 0, &mRows);
+}
+
+void PathTreeView::AddRows(uint32_t node, uint32_t depth, std::vector<PathTreeRow>* out) const {
+    const uint32_t* children = mTree->GetChildren(node);
+    const uint32_t numChildren = mTree->GetNode(node).numChildren;
+    for (uint32_t i = 0; i < numChildren; i++) {
+        out->push_back({ children[i], depth });
+        if (IsExpanded(children[i])) {
+            AddRows(children[i], depth + 1, out);
+        }
+    }
+}
+
+void PathTreeView::Toggle(size_t row) {
+    if (row >= mRows.size() || !mTree->IsDir(mRows[row].node)) {
+        return;
+    }
+    const PathTreeRow toggled = mRows[row];
+    // The expanded state is only stored for directories that have been toggled
+    if (mExpanded.size() <= toggled.node) {
+        mExpanded.resize(toggled.node + 1, 0);
+    }
+
+    if (mExpanded[toggled.node]) {
+        mExpanded[toggled.node] = 0;
+        size_t end = row + 1;
+        while (end < mRows.size() && mRows[end].depth > toggled.depth) {
+            end++;
+        }
+        mRows.erase(mRows.begin() + row + 1, mRows.begin() + end);
+    } else {
+        mExpanded[toggled.node] = 1;
+        std::vector<PathTreeRow> newRows;
+        AddRows(toggled.node, toggled.depth + 1, &newRows);
+        mRows.insert(mRows.begin() + row + 1, newRows.begin(), newRows.end());
+    }
+}
+
+bool PathTreeView::IsExpanded(uint32_t node) const {
+    return node < mExpanded.size() && mExpanded[node] != 0;
+}
+
+const std::vector<PathTreeRow>& PathTreeView::GetRows() const {
+    return mRows;
+}
@@ -0,0 +1,69 @@
+#ifndef PATH_TREE_H
+#define PATH_TREE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+static constexpr uint32_t PATH_TREE_NONE = UINT32_MAX;
+
+typedef struct PathTreeNode {
+    // Last component of the path. Points into the path the tree was built from so it isn't null terminated.
+    const char* name;
+    uint32_t nameLen;
+    uint32_t parent;
+    // Start of this node's children in `PathTree::GetChildren`
+    uint32_t firstChild;
+    uint32_t numChildren;
+    // Index of the path the file came from. `PATH_TREE_NONE` for directories.
+    uint32_t fileIndex;
+    // Files in this directory and all of its subdirectories. 1 for files.
+    uint32_t numFiles;
+    // Total size of those files
+    uint64_t size;
+} PathTreeNode;
+
+// Directory tree of the files in an archive, built once from the flat list of paths. Both '/' and '\' separate
+// directories. Children are sorted with directories first, then by name.
+// The paths must stay valid for as long as the tree is used.
+class PathTree {
+public:
+    static constexpr uint32_t ROOT = 0;
+
+    // `sizes[i]` is the size of `paths[i]`. It can be shorter than `paths`, missing sizes are 0.
+    void Build(const std::vector<const char*>& paths, const std::vector<uint64_t>& sizes);
+    void Clear();
+    bool IsEmpty() const;
+    const PathTreeNode& GetNode(uint32_t node) const;
+    // Returns the `GetNode(node).numChildren` children of `node`.
+    const uint32_t* GetChildren(uint32_t node) const;
+    bool IsDir(uint32_t node) const;
+private:
+    std::vector<PathTreeNode> mNodes;
+    std::vector<uint32_t> mChildren;
+};
+
+typedef struct PathTreeRow {
+    uint32_t node;
+    uint32_t depth;
+} PathTreeRow;
+
+// The rows of a `PathTree` that are shown with the directories that are currently expanded. Only expanded directories
+// have their children added, so expanding or collapsing costs as much as the rows that appear or disappear no matter
+// how large the tree is.
+class PathTreeView {
+public:
+    // Shows the top level of `tree` with everything collapsed.
+    void Reset(const PathTree* tree);
+    // Expands or collapses the directory at `row`. Directories inside it keep their state.
+    void Toggle(size_t row);
+    bool IsExpanded(uint32_t node) const;
+    const std::vector<PathTreeRow>& GetRows() const;
+private:
+    void AddRows(uint32_t node, uint32_t depth, std::vector<PathTreeRow>* out) const;
+    const PathTree* mTree = nullptr;
+    std::vector<PathTreeRow> mRows;
+    std::vector<uint8_t> mExpanded;
+};
+
+#endif
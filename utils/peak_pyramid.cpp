@@ -0,0 +1,354 @@
+#include "peak_pyramid.h"
+#include "audio_decoder.h"
+#include "hash.h"
+#include "mio.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define PEAK_SSE2 1
+#include <emmintrin.h>
+#endif
+
+static_assert(PeakPyramid::BASE_FRAMES == 16, "Buckets are summarized 16 floats at a time");
+
+static constexpr char PEAK_CACHE_MAGIC[4] = { 'F', 'P', 'K', 'S' };
+static constexpr uint32_t PEAK_CACHE_VERSION = 1;
+
+typedef struct PeakCacheHeader {
+    char magic[4];
+    uint32_t version;
+    uint32_t baseFrames;
+    uint32_t sampleRate;
+    uint32_t numChannels;
+    uint32_t reserved;
+    uint64_t numFrames;
+    uint64_t numBuckets;
+} PeakCacheHeader;
+
+static int16_t ToPeak(float v) {
+    v = std::clamp(v, -1.0f, 1.0f);
+    return (int16_t)(v * 32767.0f);
+}
+
+void PeakPyramid::Begin(uint32_t sampleRate, uint32_t numChannels) {
+    Clear();
+    mSampleRate = sampleRate;
+    mNumChannels = numChannels;
+    mLevels.emplace_back();
+}
+
+void PeakPyramid::AddFrames(const float* frames, size_t numFrames) {
+    const size_t start = mMono.size();
+    const float scale = 1.0f / mNumChannels;
+    mMono.resize(start + numFrames);
+    for (size_t i = 0; i < numFrames; i++) {
+        float sum = 0.0f;
+        for (uint32_t c = 0; c < mNumChannels; c++) {
+            sum += frames[i * mNumChannels + c];
+        }
+        mMono[start + i] = sum * scale;
+    }
+    mNumFrames += numFrames;
+
+    const size_t numBuckets = mMono.size() / BASE_FRAMES;
+    AddBuckets(mMono.data(), numBuckets);
+    mMono.erase(mMono.begin(), mMono.begin() + numBuckets * BASE_FRAMES);
+}
+
+// Finds the min, max and sign changes of each bucket in one pass over the samples.
+void PeakPyramid::AddBuckets(const float* mono, size_t numBuckets) {
+    std::vector<PeakPair>& level0 = mLevels[0];
+    level0.reserve(level0.size() + numBuckets);
+    mCrossings.reserve(mCrossings.size() + numBuckets);
+    for (size_t b = 0; b < numBuckets; b++) {
+        const float* s = mono + b * BASE_FRAMES;
+        float lo;
+        float hi;
+        uint32_t signs;
+#if PEAK_SSE2
+        const __m128 v0 = _mm_loadu_ps(s);
+        const __m128 v1 = _mm_loadu_ps(s + 4);
+        const __m128 v2 = _mm_loadu_ps(s + 8);
+        const __m128 v3 = _mm_loadu_ps(s + 12);
+        __m128 mn = _mm_min_ps(_mm_min_ps(v0, v1), _mm_min_ps(v2, v3));
+        __m128 mx = _mm_max_ps(_mm_max_ps(v0, v1), _mm_max_ps(v2, v3));
+        mn = _mm_min_ps(mn, _mm_shuffle_ps(mn, mn, _MM_SHUFFLE(1, 0, 3, 2)));
+        mx = _mm_max_ps(mx, _mm_shuffle_ps(mx, mx, _MM_SHUFFLE(1, 0, 3, 2)));
+        mn = _mm_min_ps(mn, _mm_shuffle_ps(mn, mn, _MM_SHUFFLE(2, 3, 0, 1)));
+        mx = _mm_max_ps(mx, _mm_shuffle_ps(mx, mx, _MM_SHUFFLE(2, 3, 0, 1)));
+        lo = _mm_cvtss_f32(mn);
+        hi = _mm_cvtss_f32(mx);
+        signs = (uint32_t)_mm_movemask_ps(v0) | ((uint32_t)_mm_movemask_ps(v1) << 4) |
+                ((uint32_t)_mm_movemask_ps(v2) << 8) | ((uint32_t)_mm_movemask_ps(v3) << 12);
+#else
+        lo = s[0];
+        hi = s[0];
+        signs = 0;
+        for (uint32_t i = 0; i < BASE_FRAMES; i++) {
+            lo = std::min(lo, s[i]);
+            hi = std::max(hi, s[i]);
+            signs |= (uint32_t)std::signbit(s[i]) << i;
+        }
+#endif
+        // A sample crosses zero if its sign is different from the one before it
+        const uint32_t prevSigns = (signs << 1) | (mLastNegative ? 1 : 0);
+        mCrossings.push_back((uint16_t)(signs ^ prevSigns));
+        mLastNegative = (signs >> (BASE_FRAMES - 1)) != 0;
+        level0.push_back({ ToPeak(lo), ToPeak(hi) });
+    }
+}
+
+void PeakPyramid::Finish() {
+    // Pad the last bucket with its last sample so it doesn't add a new peak or crossing
+    if (!mMono.empty()) {
+        mMono.resize(BASE_FRAMES, mMono.back());
+        AddBuckets(mMono.data(), 1);
+    }
+    mMono.clear();
+    mMono.shrink_to_fit();
+
+    mLevels.resize(1);
+    while (mLevels.back().size() > 1) {
+        const std::vector<PeakPair>& below = mLevels.back();
+        std::vector<PeakPair> level((below.size() + 1) / 2);
+        for (size_t i = 0; i < level.size(); i++) {
+            const PeakPair& a = below[i * 2];
+            const PeakPair& b = i * 2 + 1 < below.size() ? below[i * 2 + 1] : a;
+            level[i] = { std::min(a.min, b.min), std::max(a.max, b.max) };
+        }
+        mLevels.push_back(std::move(level));
+    }
+}
+
+void PeakPyramid::Clear() {
+    mLevels.clear();
+    mCrossings.clear();
+    mMono.clear();
+    mNumFrames = 0;
+    mSampleRate = 0;
+    mNumChannels = 0;
+    mLastNegative = false;
+}
+
+uint64_t PeakPyramid::GetNumFrames() const {
+    return mNumFrames;
+}
+
+uint32_t PeakPyramid::GetSampleRate() const {
+    return mSampleRate;
+}
+
+uint32_t PeakPyramid::GetNumChannels() const {
+    return mNumChannels;
+}
+
+void PeakPyramid::GetRange(uint64_t start, uint64_t end, float* min, float* max) const {
+    *min = 0.0f;
+    *max = 0.0f;
+    if (mLevels.empty() || mLevels[0].empty() || start >= mNumFrames) {
+        return;
+    }
+    end = std::clamp<uint64_t>(end, start + 1, mNumFrames);
+
+    // The coarsest level whose pairs aren't bigger than the range, so only a few pairs are read
+    const uint64_t span = end - start;
+    size_t level = 0;
+    while (level + 1 < mLevels.size() && ((uint64_t)BASE_FRAMES << (level + 1)) <= span) {
+        level++;
+    }
+    const std::vector<PeakPair>& pairs = mLevels[level];
+    const uint64_t pairFrames = (uint64_t)BASE_FRAMES << level;
+    const uint64_t last = std::min<uint64_t>((end - 1) / pairFrames, pairs.size() - 1);
+    int16_t lo = INT16_MAX;
+    int16_t hi = INT16_MIN;
+    for (uint64_t i = start / pairFrames; i <= last; i++) {
+        lo = std::min(lo, pairs[i].min);
+        hi = std::max(hi, pairs[i].max);
+    }
+    *min = lo / 32767.0f;
+    *max = hi / 32767.0f;
+}
+
+bool PeakPyramid::IsCrossing(uint64_t frame) const {
+    return (mCrossings[frame / BASE_FRAMES] >> (frame % BASE_FRAMES)) & 1;
+}
+
+uint64_t PeakPyramid::FindZeroCrossing(uint64_t frame, uint64_t maxDistance) const {
+    if (mCrossings.empty()) {
+        return frame;
+    }
+    const uint64_t lastFrame = mCrossings.size() * BASE_FRAMES - 1;
+    frame = std::min(frame, lastFrame);
+
+    // Search both ways a bucket at a time, skipping buckets without any crossings
+    uint64_t after = UINT64_MAX;
+    const uint64_t afterLimit = std::min(lastFrame, frame + maxDistance);
+    for (uint64_t f = frame; f <= afterLimit;) {
+        const uint32_t bits = mCrossings[f / BASE_FRAMES] >> (f % BASE_FRAMES);
+        if (bits == 0) {
+            f = (f / BASE_FRAMES + 1) * BASE_FRAMES;
+            continue;
+        }
+        f += std::countr_zero(bits);
+        if (f <= afterLimit) {
+            after = f;
+        }
+        break;
+    }
+
+    uint64_t before = UINT64_MAX;
+    const uint64_t beforeLimit = frame > maxDistance ? frame - maxDistance : 0;
+    for (uint64_t f = frame; f >= beforeLimit;) {
+        const uint32_t shift = (uint32_t)(BASE_FRAMES - 1 - f % BASE_FRAMES);
+        const uint16_t bits = (uint16_t)(mCrossings[f / BASE_FRAMES] << shift);
+        if (bits == 0) {
+            const uint64_t bucketStart = f / BASE_FRAMES * BASE_FRAMES;
+            if (bucketStart == 0) {
+                break;
+            }
+            f = bucketStart - 1;
+            continue;
+        }
+        f -= std::countl_zero(bits);
+        if (f >= beforeLimit) {
+            before = f;
+        }
+        break;
+    }
+
+    if (after == UINT64_MAX && before == UINT64_MAX) {
+        return frame;
+    }
+    if (after == UINT64_MAX) {
+        return before;
+    }
+    if (before == UINT64_MAX) {
+        return after;
+    }
+    return (after - frame) < (frame - before) ? after : before;
+}
+
+bool PeakPyramid::Save(const char* path) const {
+    if (mLevels.empty()) {
+        return false;
+    }
+    FILE* file = fopen(path, "wb");
+    if (file == nullptr) {
+        return false;
+    }
+    PeakCacheHeader header;
+    memcpy(header.magic, PEAK_CACHE_MAGIC, sizeof(header.magic));
+    header.version = PEAK_CACHE_VERSION;
+    header.baseFrames = BASE_FRAMES;
+    header.sampleRate = mSampleRate;
+    header.numChannels = mNumChannels;
+    header.reserved = 0;
+    header.numFrames = mNumFrames;
+    header.numBuckets = mLevels[0].size();
+    bool written = fwrite(&header, sizeof(header), 1, file) == 1;
+    written = written && fwrite(mLevels[0].data(), sizeof(PeakPair), mLevels[0].size(), file) == mLevels[0].size();
+    written = written && fwrite(mCrossings.data(), sizeof(uint16_t), mCrossings.size(), file) == mCrossings.size();
+    fclose(file);
+    if (!written) {
+        remove(path);
+    }
+    return written;
+}
+
+bool PeakPyramid::Load(const char* path) {
+    // The cache is in a shared temp directory so the header can't be trusted to size anything until it matches the file
+    std::error_code ec;
+    const uint64_t fileSize = std::filesystem::file_size(path, ec);
+    if (ec || fileSize < sizeof(PeakCacheHeader)) {
+        return false;
+    }
+    constexpr uint64_t bucketSize = sizeof(PeakPair) + sizeof(uint16_t);
+    FILE* file = fopen(path, "rb");
+    if (file == nullptr) {
+        return false;
+    }
+    PeakCacheHeader header;
+    bool valid = fread(&header, sizeof(header), 1, file) == 1 && memcmp(header.magic, PEAK_CACHE_MAGIC, sizeof(header.magic)) == 0 &&
+                 header.version == PEAK_CACHE_VERSION && header.baseFrames == BASE_FRAMES && header.sampleRate != 0 &&
+                 header.numChannels != 0 && header.numBuckets == (fileSize - sizeof(header)) / bucketSize &&
+                 header.numBuckets * bucketSize == fileSize - sizeof(header) &&
+                 header.numBuckets == header.numFrames / BASE_FRAMES + (header.numFrames % BASE_FRAMES != 0);
+    if (valid) {
+        Begin(header.sampleRate, header.numChannels);
+        mNumFrames = header.numFrames;
+        mLevels[0].resize(header.numBuckets);
+        mCrossings.resize(header.numBuckets);
+        valid = fread(mLevels[0].data(), sizeof(PeakPair), mLevels[0].size(), file) == mLevels[0].size() &&
+                fread(mCrossings.data(), sizeof(uint16_t), mCrossings.size(), file) == mCrossings.size();
+    }
+    fclose(file);
+    if (!valid) {
+        Clear();
+        return false;
+    }
+    Finish();
+    return true;
+}
+
+static std::filesystem::path GetPeakCachePath(const Hash128& hash) {
+    std::error_code ec;
+    std::filesystem::path dir = std::filesystem::temp_directory_path(ec);
+    if (ec) {
+        return {};
+    }
+    dir /= "future_peaks";
+    std::filesystem::create_directories(dir, ec);
+    if (ec) {
+        return {};
+    }
+    char name[48];
+    snprintf(name, sizeof(name), "%016llx%016llx.peaks", (unsigned long long)hash.hi, (unsigned long long)hash.lo);
+    return dir / name;
+}
+
+bool LoadPeakPyramid(const char* path, PeakPyramid* out, const std::atomic<bool>* cancel) {
+    std::filesystem::path cachePath;
+    {
+        mio::mmap_source file;
+        std::error_code ec;
+        file.map(path, ec);
+        if (!ec && file.size() != 0) {
+            cachePath = GetPeakCachePath(ContentHash128(file.data(), file.size(), 0));
+        }
+    }
+    if (!cachePath.empty() && out->Load(cachePath.string().c_str())) {
+        return true;
+    }
+
+    std::unique_ptr<ArchiveFileReader> reader = OpenDiskFileReader(path);
+    if (reader == nullptr) {
+        return false;
+    }
+    std::unique_ptr<AudioDecoder> decoder = OpenAudioDecoder(reader.get());
+    if (decoder == nullptr) {
+        return false;
+    }
+    static constexpr size_t BLOCK_FRAMES = 4096;
+    std::vector<float> block(BLOCK_FRAMES * decoder->numChannels);
+    out->Begin(decoder->sampleRate, decoder->numChannels);
+    size_t framesDecoded;
+    while ((framesDecoded = decoder->Decode(block.data(), BLOCK_FRAMES)) != 0) {
+        if (cancel->load(std::memory_order_relaxed)) {
+            out->Clear();
+            return false;
+        }
+        out->AddFrames(block.data(), framesDecoded);
+    }
+    out->Finish();
+
+    if (!cachePath.empty()) {
+        out->Save(cachePath.string().c_str());
+    }
+    return true;
+}
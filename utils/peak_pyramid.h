@@ -0,0 +1,60 @@
+#ifndef PEAK_PYRAMID_H
+#define PEAK_PYRAMID_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+typedef struct PeakPair {
+    int16_t min;
+    int16_t max;
+} PeakPair;
+
+// Min/max summaries of an audio file for drawing its waveform at any zoom. Level 0 has a pair for every `BASE_FRAMES`
+// frames and each level above it merges two pairs of the one below, so any range of frames is covered by a few pairs
+// from one level and drawing costs the same per pixel at every zoom. The channels are mixed down to one.
+// Also keeps where the mixed signal crosses zero so loop points can be snapped to them.
+class PeakPyramid {
+public:
+    static constexpr uint32_t BASE_FRAMES = 16;
+
+    // Starts a new pyramid for `numChannels` channels. Frames are added with `AddFrames` and `Finish` builds the
+    // levels above the first.
+    void Begin(uint32_t sampleRate, uint32_t numChannels);
+    // Adds `numFrames` interleaved frames.
+    void AddFrames(const float* frames, size_t numFrames);
+    void Finish();
+    void Clear();
+
+    uint64_t GetNumFrames() const;
+    uint32_t GetSampleRate() const;
+    uint32_t GetNumChannels() const;
+    // Gets the lowest and highest value in frames `start` to `end`, from -1 to 1.
+    void GetRange(uint64_t start, uint64_t end, float* min, float* max) const;
+    // Returns the zero crossing closest to `frame` that is at most `maxDistance` frames away, or `frame` if there isn't one.
+    uint64_t FindZeroCrossing(uint64_t frame, uint64_t maxDistance) const;
+
+    // The cache is only meant to be read back on the same machine so it is written in native byte order.
+    bool Save(const char* path) const;
+    bool Load(const char* path);
+private:
+    void AddBuckets(const float* mono, size_t numBuckets);
+    bool IsCrossing(uint64_t frame) const;
+
+    std::vector<std::vector<PeakPair>> mLevels;
+    // Bit `i` of entry `b` is set if frame `b * BASE_FRAMES + i` has a different sign than the frame before it
+    std::vector<uint16_t> mCrossings;
+    uint64_t mNumFrames = 0;
+    uint32_t mSampleRate = 0;
+    uint32_t mNumChannels = 0;
+    // Mixed frames that don't fill a whole bucket yet
+    std::vector<float> mMono;
+    bool mLastNegative = false;
+};
+
+// Builds the pyramid of the audio file at `path`, or loads it from the cache if the file has been seen before. The
+// cache is keyed by the file's contents. Stops early and returns false if `cancel` is set.
+bool LoadPeakPyramid(const char* path, PeakPyramid* out, const std::atomic<bool>* cancel);
+
+#endif
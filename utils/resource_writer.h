@@ -0,0 +1,102 @@
+#ifndef RESOURCE_WRITER_H
+#define RESOURCE_WRITER_H
+
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+#include "archive.h"
+
+// Writer for the binary OTR/O2R resource format. Every resource is a 64 byte header followed by fields that are
+// described at compile time with `ResourceLayout`, so sizes are known up front and the fields are written straight
+// into the caller's buffer. All values are little endian.
+//
+// Usage:
+// using MyHead = ResourceLayout<uint32_t, float>;
+// uint8_t buf[RESOURCE_HEADER_SIZE + MyHead::SIZE];
+// MyHead::Write(WriteResourceHeader(buf, ResourceType::X, 0), 123, 1.0f);
+//
+// Resources with a large payload, like sequences, should write the fields before and after it into small buffers and
+// hand all three to `Archive::WriteFileSegments`. See `ResourceSegments`.
+
+enum class ResourceType : uint32_t {
+    Sequence = 0x4F534551, // OSEQ
+};
+
+static constexpr size_t RESOURCE_HEADER_SIZE = 0x40;
+
+template <typename T>
+using ResourceFieldBits = std::conditional_t<sizeof(T) == 1, uint8_t,
+                          std::conditional_t<sizeof(T) == 2, uint16_t,
+                          std::conditional_t<sizeof(T) == 4, uint32_t, uint64_t>>>;
+
+// Writes `value` to `out` and returns the position after it. Works with integers, enums, and floats.
+template <typename T>
+constexpr uint8_t* PutResourceField(uint8_t* out, T value) {
+    static_assert(sizeof(T) == 1 || sizeof(T) == 2 || sizeof(T) == 4 || sizeof(T) == 8, "Fields must be 1, 2, 4, or 8 bytes");
+    const ResourceFieldBits<T> bits = std::bit_cast<ResourceFieldBits<T>>(value);
+    for (size_t i = 0; i < sizeof(T); i++) {
+        out[i] = (uint8_t)(bits >> (8 * i));
+    }
+    return out + sizeof(T);
+}
+
+// A fixed run of fields, written in the order they are listed with no padding between them.
+template <typename... Fields>
+struct ResourceLayout {
+    static constexpr size_t SIZE = (sizeof(Fields) + ... + 0);
+
+    // Returns the position after the last field.
+    static constexpr uint8_t* Write(uint8_t* out, Fields... values) {
+        ((out = PutResourceField(out, values)), ...);
+        return out;
+    }
+};
+
+// Writes the header of a resource to `out` and returns the position of the first field after it.
+constexpr uint8_t* WriteResourceHeader(uint8_t* out, ResourceType type, uint32_t version) {
+    // This is technically against the OTR spec, but there is no good way to get a real id for custom files
+    constexpr uint32_t CUSTOM_ID = 0x07151129;
+    uint8_t* p = ResourceLayout<uint8_t, uint8_t, uint8_t, uint8_t, ResourceType, uint32_t, uint32_t, uint32_t>::Write(
+        out, 0 /* little endian */, 0, 0, 0, type, version, CUSTOM_ID, CUSTOM_ID);
+    // ROM CRC and enum are 0 for custom files. The rest is padding.
+    while (p < out + RESOURCE_HEADER_SIZE) {
+        *p++ = 0;
+    }
+    return p;
+}
+
+// The parts of a resource whose payload is written from wherever it already is: `Head` fields after the header,
+// the payload, then `Tail` fields.
+template <typename Head, typename Tail>
+struct ResourceSegments {
+    uint8_t head[RESOURCE_HEADER_SIZE + Head::SIZE];
+    uint8_t tail[Tail::SIZE == 0 ? 1 : Tail::SIZE];
+
+    static constexpr size_t GetSize(size_t payloadSize) {
+        return RESOURCE_HEADER_SIZE + Head::SIZE + payloadSize + Tail::SIZE;
+    }
+
+    // Returns the position of `Head`'s fields.
+    constexpr uint8_t* WriteHeader(ResourceType type, uint32_t version) {
+        return WriteResourceHeader(head, type, version);
+    }
+
+    // Fills `out` with the segments to pass to `Archive::WriteFileSegments`. `head` and `tail` are copied by the
+    // archive so this object only has to live until the write returns.
+    void GetSegments(void* payload, size_t payloadSize, DataHandleMode payloadMode, ArchiveDataInfo out[3]) {
+        out[0] = { .data = head, .size = sizeof(head), .mode = DataCopy };
+        out[1] = { .data = payload, .size = payloadSize, .mode = payloadMode };
+        out[2] = { .data = tail, .size = Tail::SIZE, .mode = DataCopy };
+    }
+};
+
+// OSEQ version 2. The payload is the raw sequence.
+using SequenceHead = ResourceLayout<uint32_t /* sequence size */>;
+using SequenceTail = ResourceLayout<uint8_t /* sequence number */, uint8_t /* medium */, uint8_t /* cache policy */,
+                                    uint32_t /* number of fonts */, uint8_t /* font index */>;
+using SequenceResource = ResourceSegments<SequenceHead, SequenceTail>;
+static constexpr uint32_t SEQUENCE_RESOURCE_VERSION = 2;
+static_assert(SequenceTail::SIZE == 8);
+
+#endif
@@ -0,0 +1,403 @@
+#include "sequenced_audio.h"
+#include "filebox.h"
+#include "resource_writer.h"
+#include "zip.h"
+#include "mio.hpp"
+#include "tinyxml2.h"
+#include <algorithm>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <thread>
+
+// Copies `ext` to `out` in lower case. Returns false if it doesn't fit, since it can't be any of the extensions we look for.
+static bool LowerExt(const char* ext, char* out, size_t outSize) {
+    size_t i = 0;
+    for (; ext[i] != 0; i++) {
+        if (i == outSize - 1) {
+            return false;
+        }
+        out[i] = (char)tolower(ext[i]);
+    }
+    out[i] = 0;
+    return true;
+}
+
+bool IsSequenceFile(char* path) {
+    char* ext = strrchr(path, '.');
+    if (ext != nullptr) {
+        char newStr[8];
+        if (!LowerExt(ext, newStr, sizeof(newStr))) {
+            return false;
+        }
+        if ((strcmp(newStr, ".seq") == 0 || strcmp(newStr, ".aseq") == 0 || strcmp(newStr, ".meta") == 0)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool IsMMRSFile(char* path) {
+    char* ext = strrchr(path, '.');
+    if (ext != nullptr) {
+        char newStr[8];
+        if (!LowerExt(ext, newStr, sizeof(newStr))) {
+            return false;
+        }
+        return strcmp(newStr, ".mmrs") == 0;
+    }
+    return false;
+}
+
+static bool IsSeqExt(const char* ext) {
+    char newStr[8];
+    if (!LowerExt(ext, newStr, sizeof(newStr))) {
+        return false;
+    }
+    return strcmp(newStr, ".zseq") == 0 || strcmp(newStr, ".aseq") == 0 || strcmp(newStr, ".seq") == 0;
+}
+
+static bool IsFontExt(const char* ext) {
+    char newStr[8];
+    if (!LowerExt(ext, newStr, sizeof(newStr))) {
+        return false;
+    }
+    return strcmp(newStr, ".zbank") == 0;
+}
+
+static bool IsNoteExt(const char* ext) {
+    char newStr[8];
+    if (!LowerExt(ext, newStr, sizeof(newStr))) {
+        return false;
+    }
+    return strcmp(newStr, ".zsound") == 0;
+}
+
+CheckState CreateSeqFilePairs(std::vector<char*>& files, std::vector<std::pair<char*, char*>>& pairs) {
+    // There must be a pair of files for each song. If there is an odd number of files there must be an issue.
+    if (files.size() % 2 != 0) {
+        return CheckState::Bad;
+    }
+    std::sort(files.begin(), files.end(), [](char* a, char* b) {return strcmp(a, b) < 0; });
+    for (size_t i = 0; i < files.size(); i += 2) {
+        // First make sure the extensions are not the same. If they are, then there are either two meta or two sequences, meaning the other is missing.
+        // IE the folder contains the files song1.meta and song2.meta but song1 doesn't have a .seq file to go with it.
+        char* aExt = strrchr(files[i], '.');
+        char* bExt = strrchr(files[i + 1], '.');
+        if (strcmp(aExt, bExt) != 0) {
+            // Next, make sure the file names before the extension are the same. If so they are 'pairs'
+            if (std::equal(files[i], aExt, files[i + 1], bExt)) {
+                // first is the meta file, second is the sequence. There are two possible extensions for sequences so check against meta
+                if (strcmp(aExt, ".meta") == 0) {
+                    pairs.push_back({ files[i], files[i + 1] });
+                }
+                else {
+                    pairs.push_back({ files[i + 1], files[i] });
+                }
+            }
+            else {
+                pairs.clear();
+                return CheckState::Bad;
+            }
+        }
+        else {
+            pairs.clear();
+            return CheckState::Bad;
+        }
+    }
+    return CheckState::Good;
+}
+
+// Write `data` to either the archive, or if the archive is null, a file on disk
+static void WriteFileData(char* path, void* data, size_t size, Archive* a) {
+    if (a == nullptr) {
+        FILE* file = fopen(path, "wb+");
+        fwrite(data, size, 1, file);
+        fclose(file);
+    }
+    else {
+        const ArchiveDataInfo info = {
+            .data = data, .size = size, .mode = DataCopy
+        };
+        a->WriteFile(path, &info);
+    }
+}
+
+// Same as `WriteFileData` but the file is made of the `numSegments` buffers in `segments` back to back.
+static void WriteFileSegmentsData(char* path, const ArchiveDataInfo* segments, size_t numSegments, Archive* a) {
+    if (a == nullptr) {
+        FILE* file = fopen(path, "wb+");
+        for (size_t i = 0; i < numSegments; i++) {
+            fwrite(segments[i].data, segments[i].size, 1, file);
+            if (segments[i].mode == MMappedFile) {
+                UnmapFile(segments[i].data, segments[i].size);
+            } else if (segments[i].mode == DataOwned) {
+                free(segments[i].data);
+            }
+        }
+        fclose(file);
+    }
+    else {
+        a->WriteFileSegments(path, segments, numSegments);
+    }
+}
+
+static constexpr const char sSeqPathBase[] = "custom/music";
+
+// Packs one .meta/.seq pair as an OSEQ resource. Returns false if either file couldn't be read.
+static bool PackSequenceFile(const std::pair<char*, char*>* p, Archive* a) {
+    bool isFanfare = false;
+    // TODO get rid of this once both games support XML sequences
+    char buffer[260];
+    char name[260];
+    FILE* metaFile = fopen(p->first, "r");
+    if (metaFile == nullptr) {
+        printf("Failed to open %s\n", p->first);
+        return false;
+    }
+
+    std::error_code ec;
+    mio::mmap_source seqFile;
+    seqFile.map(p->second, ec);
+    if (ec) {
+        printf("Failed to open %s\n", p->second);
+        fclose(metaFile);
+        return false;
+    }
+    const uint32_t seqSize = (uint32_t)seqFile.size();
+
+    // The .meta file always follows a structure of:
+    // line 1: Friendly name
+    // line 2: SoundFont Index
+    // line 3: bgm/fanfare (defaults to bgm if not specified)
+    fgets(name, sizeof(name), metaFile);
+    fgets(buffer, sizeof(buffer), metaFile);
+    int font = strtol(buffer, nullptr, 16);
+    if (fgets(buffer, sizeof(buffer), metaFile) != nullptr) {
+        if (strcmp(buffer, "fanfare") == 0) {
+            isFanfare = true;
+        }
+    }
+    fclose(metaFile);
+
+    size_t outFileNameLen = strlen(name);
+    name[outFileNameLen - 1] = 0;
+    auto newName = std::make_unique<char[]>(outFileNameLen + sizeof(sSeqPathBase));
+    snprintf(newName.get(), outFileNameLen + sizeof(sSeqPathBase), "%s/%s", sSeqPathBase, name);
+
+    // The sequence data is written straight from the mapped file. Only the fields around it are built here.
+    SequenceResource res;
+    ArchiveDataInfo segments[3];
+    SequenceHead::Write(res.WriteHeader(ResourceType::Sequence, SEQUENCE_RESOURCE_VERSION), seqSize);
+    // Sequence number 0, medium 2 (disk), cache policy 2, and one font
+    SequenceTail::Write(res.tail, 0, 2, 2, 1, (uint8_t)font);
+
+    // The archive or `WriteFileSegmentsData` unmaps the file.
+    seqFile.release();
+    res.GetSegments((void*)seqFile.data(), seqFile.size(), MMappedFile, segments);
+    WriteFileSegmentsData(newName.get(), segments, 3, a);
+    return true;
+}
+
+// Each thread takes the next pair from `nextPair` until there are none left.
+static void PackSequenceFilesWorker(std::vector<std::pair<char*, char*>>* fileQueue, std::atomic<size_t>* nextPair,
+                                    std::atomic<unsigned int>* filesProcessed, std::atomic<unsigned int>* numFailed, Archive* a) {
+    size_t i;
+    while ((i = nextPair->fetch_add(1, std::memory_order_relaxed)) < fileQueue->size()) {
+        if (!PackSequenceFile(&(*fileQueue)[i], a)) {
+            numFailed->fetch_add(1, std::memory_order_relaxed);
+        }
+        filesProcessed->fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+unsigned int PackSequenceFiles(std::vector<std::pair<char*, char*>>* fileQueue, std::atomic<unsigned int>* filesProcessed, Archive* a) {
+    std::atomic<size_t> nextPair = 0;
+    std::atomic<unsigned int> numFailed = 0;
+    // No archive means the files are written into folders instead
+    if (a == nullptr) {
+        CreateDir(sSeqPathBase);
+    }
+
+    // Sequences are small so most of the time is spent opening files. Work on several at once to hide that latency.
+    const unsigned int numThreads = std::min<size_t>(std::max(1u, std::thread::hardware_concurrency()), fileQueue->size());
+    auto packThreads = std::make_unique<std::thread[]>(numThreads);
+    for (unsigned int i = 0; i < numThreads; i++) {
+        packThreads[i] = std::thread(PackSequenceFilesWorker, fileQueue, &nextPair, filesProcessed, &numFailed, a);
+    }
+    for (unsigned int i = 0; i < numThreads; i++) {
+        packThreads[i].join();
+    }
+    return numFailed;
+}
+
+static constexpr const char sMMRSMetaBase[] = "custom/music/";
+static constexpr const char sMMRSSeqDataBase[] = "custom/sequenceData/";
+
+static bool IsBankMetaExt(const char* ext) {
+    char newStr[16];
+    if (!LowerExt(ext, newStr, sizeof(newStr))) {
+        return false;
+    }
+    return strcmp(newStr, ".bankmeta") == 0;
+}
+
+// Reads entry `index` of `z` into a buffer allocated with `malloc`. Returns null if it can't be read.
+static void* ReadMMRSEntry(zip_t* z, zip_uint64_t index, zip_uint64_t size) {
+    // malloc(0) may return null
+    void* data = malloc(size != 0 ? size : 1);
+    zip_file_t* zf = zip_fopen_index(z, index, 0);
+    if (zf == nullptr) {
+        free(data);
+        return nullptr;
+    }
+    const zip_int64_t read = zip_fread(zf, data, size);
+    zip_fclose(zf);
+    if (read < 0 || (zip_uint64_t)read != size) {
+        free(data);
+        return nullptr;
+    }
+    return data;
+}
+
+// Reads entry `index` of `z` and writes it to `path`. The buffer is handed to the archive so it is never copied again.
+static bool CopyMMRSEntry(zip_t* z, zip_uint64_t index, zip_uint64_t size, char* path, Archive* a) {
+    void* data = ReadMMRSEntry(z, index, size);
+    if (data == nullptr) {
+        return false;
+    }
+    const ArchiveDataInfo info = {
+        .data = data, .size = size, .mode = DataOwned
+    };
+    WriteFileSegmentsData(path, &info, 1, a);
+    return true;
+}
+
+static std::unique_ptr<char[]> CreateMMRSPath(const char* base, const char* name, const char* part, const char* suffix) {
+    const size_t len = strlen(base) + strlen(name) + strlen(part) + strlen(suffix) + 2;
+    auto path = std::make_unique<char[]>(len);
+    snprintf(path.get(), len, "%s%s%s%s", base, name, part, suffix);
+    return path;
+}
+
+// Packs one .mmrs file. The sequence is copied over as is and the META XML points to it. Returns false if the file
+// couldn't be read or was skipped.
+static bool PackMMRSFile(char* f, const tinyxml2::XMLDocument* seqBase, Archive* a) {
+    int err;
+    zip_t* mmrsFile = zip_open(f, ZIP_RDONLY, &err);
+    if (mmrsFile == nullptr) {
+        printf("Failed to open %s\n", f);
+        return false;
+    }
+    const zip_int64_t numFiles = zip_get_num_entries(mmrsFile, 0);
+    zip_stat_t seqStat;
+    bool hasSeq = false;
+    bool hasBankOrSamples = false;
+
+    // One pass over the central directory picks out everything. The stat has the index and size needed to read
+    // each entry without looking it up by name again.
+    for (zip_int64_t i = 0; i < numFiles; i++) {
+        zip_stat_t stat;
+        if (zip_stat_index(mmrsFile, i, ZIP_FL_ENC_RAW, &stat) != 0 || stat.name == nullptr) {
+            continue;
+        }
+        const char* ext = strrchr(stat.name, '.');
+        if (ext == nullptr) {
+            continue;
+        }
+        if (IsSeqExt(ext)) {
+            seqStat = stat;
+            hasSeq = true;
+        } else if (IsFontExt(ext) || IsBankMetaExt(ext) || IsNoteExt(ext)) {
+            hasBankOrSamples = true;
+        }
+    }
+    if (!hasSeq) {
+        printf("No sequence found in archive %s. Skipping...\n", f);
+        zip_close(mmrsFile);
+        return false;
+    }
+    // Banks and samples are in the N64 format, which would have to be converted to soundfont and sample XML first.
+    // A sequence packed without them would play with the wrong instruments.
+    if (hasBankOrSamples) {
+        printf("%s has a custom bank or samples. Only sequences are supported right now. Skipping...\n", f);
+        zip_close(mmrsFile);
+        return false;
+    }
+    // The sequence is named after the index of the font it uses, in hex.
+    int fontIdx = strtol(seqStat.name, nullptr, 16);
+
+    // We don't need the extension anymore so remove it.
+    char* mmrsExt = strrchr(f, '.');
+    *mmrsExt = 0;
+    // Remote the beginning of the path which may include the disk and \ from the FS.
+    // We don't want to replace `f` because the pointer needs to stay the same so we can delete it later.
+    char* name = strrchr(f, PATH_SEPARATOR);
+    name++;
+
+    tinyxml2::XMLPrinter p;
+    tinyxml2::XMLDocument seqDoc;
+    seqBase->DeepCopy(&seqDoc);
+
+    tinyxml2::XMLElement* root = seqDoc.FirstChildElement();
+    root->SetAttribute("Size", (uint64_t)seqStat.size);
+    root->SetAttribute("Streamed", false);
+    // Write the font index
+    tinyxml2::XMLElement* fontIndiciesElement = root->FirstChildElement("FontIndicies");
+    tinyxml2::XMLElement* fontIdxElement = fontIndiciesElement->InsertNewChildElement("FontIndex");
+    fontIdxElement->SetAttribute("FontIdx", fontIdx);
+    fontIndiciesElement->InsertEndChild(fontIdxElement);
+
+    // Write the raw sequence data.
+    auto seqDataZipPath = CreateMMRSPath(sMMRSSeqDataBase, name, "", "_RAW");
+    if (!CopyMMRSEntry(mmrsFile, seqStat.index, seqStat.size, seqDataZipPath.get(), a)) {
+        printf("Failed to read the sequence in %s\n", f);
+        zip_close(mmrsFile);
+        return false;
+    }
+    root->SetAttribute("Path", seqDataZipPath.get());
+
+    zip_close(mmrsFile);
+
+    seqDoc.Accept(&p);
+    // Write the META xml file.
+    auto seqXMLZipPath = CreateMMRSPath(sMMRSMetaBase, name, "", "_META");
+    WriteFileData(seqXMLZipPath.get(), (void*)p.CStr(), p.CStrSize(), a);
+    return true;
+}
+
+// Each thread opens its own .mmrs files since a `zip_t` can't be shared between threads.
+static void PackMMRSFilesWorker(std::vector<char*>* fileQueue, std::atomic<size_t>* nextFile, std::atomic<unsigned int>* filesProcessed,
+                                std::atomic<unsigned int>* numFailed, Archive* a) {
+    // Parsed once per thread and copied for each file.
+    tinyxml2::XMLDocument seqBase;
+    const bool loaded = seqBase.LoadFile("assets/seq-base.xml") == tinyxml2::XML_SUCCESS;
+    size_t i;
+
+    while ((i = nextFile->fetch_add(1, std::memory_order_relaxed)) < fileQueue->size()) {
+        if (!loaded || !PackMMRSFile((*fileQueue)[i], &seqBase, a)) {
+            numFailed->fetch_add(1, std::memory_order_relaxed);
+        }
+        filesProcessed->fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+unsigned int PackMMRSFiles(std::vector<char*>* fileQueue, std::atomic<unsigned int>* filesProcessed, Archive* a) {
+    std::atomic<size_t> nextFile = 0;
+    std::atomic<unsigned int> numFailed = 0;
+    // No archive means the files are written into folders instead
+    if (a == nullptr) {
+        CreateDir(sMMRSMetaBase);
+        CreateDir(sMMRSSeqDataBase);
+    }
+
+    const unsigned int numThreads = std::min<size_t>(std::max(1u, std::thread::hardware_concurrency()), fileQueue->size());
+    auto packThreads = std::make_unique<std::thread[]>(numThreads);
+    for (unsigned int i = 0; i < numThreads; i++) {
+        packThreads[i] = std::thread(PackMMRSFilesWorker, fileQueue, &nextFile, filesProcessed, &numFailed, a);
+    }
+    for (unsigned int i = 0; i < numThreads; i++) {
+        packThreads[i].join();
+    }
+    return numFailed;
+}
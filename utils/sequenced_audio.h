@@ -0,0 +1,30 @@
+#ifndef SEQUENCED_AUDIO_H
+#define SEQUENCED_AUDIO_H
+
+#include "archive.h"
+#include <atomic>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+typedef enum CheckState : uint8_t {
+    Unchecked,
+    Good,
+    Bad,
+} CheckState;
+
+// Extension filters for `FillFileQueue`.
+bool IsSequenceFile(char* path);
+bool IsMMRSFile(char* path);
+
+// Sorts `files` and pairs each .meta file with its sequence. first is the meta file, second is the sequence.
+// Returns `Bad` and clears `pairs` if a file is missing its pair.
+CheckState CreateSeqFilePairs(std::vector<char*>& files, std::vector<std::pair<char*, char*>>& pairs);
+
+// Both functions write to `a`, or into folders in the working directory if `a` is null.
+// `filesProcessed` is incremented after each file so it can be polled from another thread.
+// Both return the number of files that couldn't be read or were skipped.
+unsigned int PackSequenceFiles(std::vector<std::pair<char*, char*>>* fileQueue, std::atomic<unsigned int>* filesProcessed, Archive* a);
+unsigned int PackMMRSFiles(std::vector<char*>* fileQueue, std::atomic<unsigned int>* filesProcessed, Archive* a);
+
+#endif
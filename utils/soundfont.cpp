@@ -0,0 +1,779 @@
+#include "soundfont.h"
+
+#include <array>
+#include <charconv>
+#include <cstdio>
+#include <cstring>
+#include <string_view>
+#include <system_error>
+#include "mio.hpp"
+
+// Soundfont XML is read with a small pull parser straight from the file's memory. Elements and attributes are
+// dispatched with a switch on a hash of their name instead of comparing strings one at a time. Only what soundfonts use
+// is supported: elements, attributes, comments, CDATA, and the prolog are skipped. Text content is ignored.
+
+// FNV-1a
+static constexpr uint64_t NAME_HASH_BASIS = 0xCBF29CE484222325;
+
+static constexpr uint64_t NameHashStep(uint64_t hash, char c) {
+    return (hash ^ (uint8_t)c) * 0x100000001B3;
+}
+
+static constexpr uint64_t NameHash(std::string_view name) {
+    uint64_t hash = NAME_HASH_BASIS;
+    for (char c : name) {
+        hash = NameHashStep(hash, c);
+    }
+    return hash;
+}
+
+typedef struct XmlTag {
+    std::string_view name;
+    uint64_t nameHash;
+    // Text between the name and the closing `>` or `/>`
+    const char* attrs;
+    const char* attrsEnd;
+    bool isEnd;
+    bool selfClosing;
+} XmlTag;
+
+typedef struct XmlAttr {
+    std::string_view name;
+    uint64_t nameHash;
+    std::string_view value;
+} XmlAttr;
+
+typedef struct XmlReader {
+    const char* start;
+    const char* p;
+    const char* end;
+    // Set on the first error
+    const char* error;
+    const char* errorPos;
+} XmlReader;
+
+static bool Fail(XmlReader* r, const char* pos, const char* msg) {
+    if (r->error == nullptr) {
+        r->error = msg;
+        r->errorPos = pos;
+    }
+    return false;
+}
+
+enum CharClass : uint8_t {
+    CHAR_SPACE = 1 << 0,
+    CHAR_NAME = 1 << 1,
+};
+
+static constexpr std::array<uint8_t, 256> MakeCharClasses() {
+    std::array<uint8_t, 256> classes = {};
+    for (size_t i = 0; i < classes.size(); i++) {
+        const char c = (char)i;
+        if (c == ' ' || c == '\t' || c == '\n' || c == '\r') {
+            classes[i] = CHAR_SPACE;
+        } else if (c != '/' && c != '>' && c != '=' && c != '<' && c != '"' && c != '\'') {
+            classes[i] = CHAR_NAME;
+        }
+    }
+    return classes;
+}
+
+static constexpr std::array<uint8_t, 256> sCharClasses = MakeCharClasses();
+
+static bool IsSpace(char c) {
+    return sCharClasses[(uint8_t)c] & CHAR_SPACE;
+}
+
+static bool IsNameChar(char c) {
+    return sCharClasses[(uint8_t)c] & CHAR_NAME;
+}
+
+// Reads a name starting at `p` and hashes it at the same time. Returns the position after it.
+static const char* ReadName(const char* p, const char* end, uint64_t* hash) {
+    uint64_t h = NAME_HASH_BASIS;
+    while (p < end && IsNameChar(*p)) {
+        h = NameHashStep(h, *p);
+        p++;
+    }
+    *hash = h;
+    return p;
+}
+
+static bool StartsWith(const char* p, const char* end, std::string_view prefix) {
+    return (size_t)(end - p) >= prefix.size() && memcmp(p, prefix.data(), prefix.size()) == 0;
+}
+
+// Returns the position after `terminator`, or null if it isn't found.
+static const char* SkipPast(const char* p, const char* end, std::string_view terminator) {
+    size_t pos = std::string_view(p, end - p).find(terminator);
+    if (pos == std::string_view::npos) {
+        return nullptr;
+    }
+    return p + pos + terminator.size();
+}
+
+// Moves to the next start or end tag. Returns false at the end of the document or on an error.
+static bool NextTag(XmlReader* r, XmlTag* tag) {
+    while (true) {
+        const char* lt = static_cast<const char*>(memchr(r->p, '<', r->end - r->p));
+        if (lt == nullptr) {
+            r->p = r->end;
+            return false;
+        }
+        const char* next;
+        if (StartsWith(lt, r->end, "<?")) {
+            next = SkipPast(lt, r->end, "?>");
+        } else if (StartsWith(lt, r->end, "<!--")) {
+            next = SkipPast(lt, r->end, "-->");
+        } else if (StartsWith(lt, r->end, "<![CDATA[")) {
+            next = SkipPast(lt, r->end, "]]>");
+        } else if (StartsWith(lt, r->end, "<!")) {
+            next = SkipPast(lt, r->end, ">");
+        } else {
+            r->p = lt;
+            break;
+        }
+        if (next == nullptr) {
+            return Fail(r, lt, "Unterminated comment or declaration");
+        }
+        r->p = next;
+    }
+
+    const char* tagStart = r->p;
+    const char* q = tagStart + 1;
+    tag->isEnd = q < r->end && *q == '/';
+    if (tag->isEnd) {
+        q++;
+    }
+    const char* nameStart = q;
+    q = ReadName(q, r->end, &tag->nameHash);
+    if (q == nameStart) {
+        return Fail(r, tagStart, "Expected an element name");
+    }
+    tag->name = std::string_view(nameStart, q - nameStart);
+    tag->attrs = q;
+
+    // Quoted values may contain '>'
+    char quote = 0;
+    while (q < r->end) {
+        if (quote != 0) {
+            if (*q == quote) {
+                quote = 0;
+            }
+        } else if (*q == '"' || *q == '\'') {
+            quote = *q;
+        } else if (*q == '>') {
+            break;
+        }
+        q++;
+    }
+    if (q == r->end) {
+        return Fail(r, tagStart, "Unterminated tag");
+    }
+    tag->selfClosing = !tag->isEnd && q > tag->attrs && q[-1] == '/';
+    tag->attrsEnd = tag->selfClosing ? q - 1 : q;
+    r->p = q + 1;
+    return true;
+}
+
+// Reads the next attribute at `*p`. Returns false when there are none left or on an error.
+static bool NextAttribute(XmlReader* r, const char** p, const char* end, XmlAttr* attr) {
+    const char* q = *p;
+    while (q < end && IsSpace(*q)) {
+        q++;
+    }
+    if (q == end) {
+        return false;
+    }
+    const char* nameStart = q;
+    q = ReadName(q, end, &attr->nameHash);
+    if (q == nameStart) {
+        return Fail(r, nameStart, "Expected an attribute name");
+    }
+    attr->name = std::string_view(nameStart, q - nameStart);
+    while (q < end && IsSpace(*q)) {
+        q++;
+    }
+    if (q == end || *q != '=') {
+        return Fail(r, nameStart, "Expected '=' after attribute name");
+    }
+    q++;
+    while (q < end && IsSpace(*q)) {
+        q++;
+    }
+    if (q == end || (*q != '"' && *q != '\'')) {
+        return Fail(r, nameStart, "Expected a quoted attribute value");
+    }
+    const char quote = *q++;
+    const char* valueStart = q;
+    q = static_cast<const char*>(memchr(q, quote, end - q));
+    if (q == nullptr) {
+        return Fail(r, nameStart, "Unterminated attribute value");
+    }
+    attr->value = std::string_view(valueStart, q - valueStart);
+    *p = q + 1;
+    return true;
+}
+
+static std::string_view Trim(std::string_view v) {
+    while (!v.empty() && IsSpace(v.front())) {
+        v.remove_prefix(1);
+    }
+    while (!v.empty() && IsSpace(v.back())) {
+        v.remove_suffix(1);
+    }
+    return v;
+}
+
+// Same rules as tinyxml2: decimal or 0x prefixed hex. Negative values wrap, like `UnsignedAttribute`. Invalid values are 0.
+static int64_t ParseInt(std::string_view v) {
+    v = Trim(v);
+    int64_t value = 0;
+    if (v.size() > 2 && v[0] == '0' && (v[1] == 'x' || v[1] == 'X')) {
+        uint64_t hex = 0;
+        std::from_chars(v.data() + 2, v.data() + v.size(), hex, 16);
+        return (int64_t)hex;
+    }
+    if (!v.empty() && v[0] == '+') {
+        v.remove_prefix(1);
+    }
+    std::from_chars(v.data(), v.data() + v.size(), value);
+    return value;
+}
+
+static float ParseFloat(std::string_view v) {
+    v = Trim(v);
+    float value = 0.0f;
+    if (!v.empty() && v[0] == '+') {
+        v.remove_prefix(1);
+    }
+    std::from_chars(v.data(), v.data() + v.size(), value);
+    return value;
+}
+
+static bool ParseBool(std::string_view v) {
+    v = Trim(v);
+    if (!v.empty() && (v[0] == 't' || v[0] == 'T')) {
+        return true;
+    }
+    return ParseInt(v) != 0;
+}
+
+static char* PutUtf8(char* out, uint32_t c) {
+    if (c < 0x80) {
+        *out++ = (char)c;
+    } else if (c < 0x800) {
+        *out++ = (char)(0xC0 | (c >> 6));
+        *out++ = (char)(0x80 | (c & 0x3F));
+    } else if (c < 0x10000) {
+        *out++ = (char)(0xE0 | (c >> 12));
+        *out++ = (char)(0x80 | ((c >> 6) & 0x3F));
+        *out++ = (char)(0x80 | (c & 0x3F));
+    } else {
+        *out++ = (char)(0xF0 | (c >> 18));
+        *out++ = (char)(0x80 | ((c >> 12) & 0x3F));
+        *out++ = (char)(0x80 | ((c >> 6) & 0x3F));
+        *out++ = (char)(0x80 | (c & 0x3F));
+    }
+    return out;
+}
+
+// Copies an attribute value to the arena, replacing entities. Unknown entities are copied as is.
+static const char* CopyString(Arena* arena, std::string_view v) {
+    if (v.find('&') == std::string_view::npos) {
+        return arena->StrDup(v.data(), v.size());
+    }
+    // Entities never decode to more bytes than they take up
+    char* out = static_cast<char*>(arena->Alloc(v.size() + 1, 1));
+    char* o = out;
+    size_t i = 0;
+    while (i < v.size()) {
+        if (v[i] != '&') {
+            *o++ = v[i++];
+            continue;
+        }
+        size_t semi = v.find(';', i);
+        if (semi == std::string_view::npos) {
+            *o++ = v[i++];
+            continue;
+        }
+        std::string_view ent = v.substr(i + 1, semi - i - 1);
+        uint32_t c = 0;
+        bool valid = true;
+        if (ent == "lt") {
+            c = '<';
+        } else if (ent == "gt") {
+            c = '>';
+        } else if (ent == "amp") {
+            c = '&';
+        } else if (ent == "quot") {
+            c = '"';
+        } else if (ent == "apos") {
+            c = '\'';
+        } else if (ent.size() > 2 && ent[0] == '#' && (ent[1] == 'x' || ent[1] == 'X')) {
+            valid = std::from_chars(ent.data() + 2, ent.data() + ent.size(), c, 16).ec == std::errc() && c <= 0x10FFFF;
+        } else if (ent.size() > 1 && ent[0] == '#') {
+            valid = std::from_chars(ent.data() + 1, ent.data() + ent.size(), c).ec == std::errc() && c <= 0x10FFFF;
+        } else {
+            valid = false;
+        }
+        if (!valid || c == 0) {
+            *o++ = v[i++];
+            continue;
+        }
+        o = PutUtf8(o, c);
+        i = semi + 1;
+    }
+    *o = 0;
+    return out;
+}
+
+enum class SfElem : uint8_t {
+    Other,
+    SoundFont,
+    Drums,
+    Drum,
+    Instruments,
+    Instrument,
+    SfxTable,
+    Sfx,
+    Envelopes,
+    Envelope,
+    Sample,
+};
+
+typedef struct SfOpenElem {
+    std::string_view name;
+    SfElem type;
+} SfOpenElem;
+
+typedef struct SoundFontParser {
+    XmlReader r;
+    ZSoundFont* sf;
+    bool sawRoot;
+    // Number of each child read so far. Children past the parent's `Count` are ignored.
+    uint32_t drumsRead;
+    uint32_t instrumentsRead;
+    uint32_t sfxRead;
+    ZDrum* drum;
+    ZInstrument* instrument;
+    ZEnvelope* envs;
+    uint8_t* numEnvs;
+    uint32_t envCapacity;
+    SfOpenElem stack[32];
+    size_t depth;
+} SoundFontParser;
+
+static constexpr uint64_t HASH_SOUNDFONT = NameHash("SoundFont");
+static constexpr uint64_t HASH_DRUMS = NameHash("Drums");
+static constexpr uint64_t HASH_DRUM = NameHash("Drum");
+static constexpr uint64_t HASH_INSTRUMENTS = NameHash("Instruments");
+static constexpr uint64_t HASH_INSTRUMENT = NameHash("Instrument");
+static constexpr uint64_t HASH_SFX_TABLE = NameHash("SfxTable");
+static constexpr uint64_t HASH_SFX = NameHash("Sfx");
+static constexpr uint64_t HASH_ENVELOPES = NameHash("Envelopes");
+static constexpr uint64_t HASH_ENVELOPE = NameHash("Envelope");
+static constexpr uint64_t HASH_LOW_NOTES = NameHash("LowNotesSound");
+static constexpr uint64_t HASH_NORMAL_NOTES = NameHash("NormalNotesSound");
+static constexpr uint64_t HASH_HIGH_NOTES = NameHash("HighNotesSound");
+
+static constexpr uint64_t HASH_COUNT = NameHash("Count");
+static constexpr uint64_t HASH_MEDIUM = NameHash("Medium");
+static constexpr uint64_t HASH_CACHE_POLICY = NameHash("CachePolicy");
+static constexpr uint64_t HASH_VERSION = NameHash("Version");
+static constexpr uint64_t HASH_NUM = NameHash("Num");
+static constexpr uint64_t HASH_DATA1 = NameHash("Data1");
+static constexpr uint64_t HASH_DATA2 = NameHash("Data2");
+static constexpr uint64_t HASH_DATA3 = NameHash("Data3");
+static constexpr uint64_t HASH_RELEASE_RATE = NameHash("ReleaseRate");
+static constexpr uint64_t HASH_PAN = NameHash("Pan");
+static constexpr uint64_t HASH_TUNING = NameHash("Tuning");
+static constexpr uint64_t HASH_SAMPLE_REF = NameHash("SampleRef");
+static constexpr uint64_t HASH_DELAY = NameHash("Delay");
+static constexpr uint64_t HASH_ARG = NameHash("Arg");
+static constexpr uint64_t HASH_IS_VALID = NameHash("IsValid");
+static constexpr uint64_t HASH_NORMAL_RANGE_LO = NameHash("NormalRangeLo");
+static constexpr uint64_t HASH_NORMAL_RANGE_HI = NameHash("NormalRangeHi");
+
+// Reads the `Count` attribute of a list element. Every child takes at least a few bytes of XML, so a count that
+// couldn't fit in the file is an error instead of a huge allocation.
+static bool ReadCount(SoundFontParser* s, const XmlTag* tag, uint32_t* count) {
+    const char* p = tag->attrs;
+    XmlAttr attr;
+    *count = 0;
+    while (NextAttribute(&s->r, &p, tag->attrsEnd, &attr)) {
+        if (attr.nameHash == HASH_COUNT) {
+            *count = (uint32_t)ParseInt(attr.value);
+        }
+    }
+    if (s->r.error != nullptr) {
+        return false;
+    }
+    if (*count > (size_t)(s->r.end - s->r.start) / 4) {
+        return Fail(&s->r, tag->attrs, "Count is larger than the file");
+    }
+    return true;
+}
+
+static bool ReadSoundFont(SoundFontParser* s, const XmlTag* tag) {
+    ZSoundFont* sf = s->sf;
+    const char* p = tag->attrs;
+    XmlAttr attr;
+    s->sawRoot = true;
+    while (NextAttribute(&s->r, &p, tag->attrsEnd, &attr)) {
+        switch (attr.nameHash) {
+            case HASH_MEDIUM:
+                sf->medium = CopyString(&sf->arena, attr.value);
+                break;
+            case HASH_CACHE_POLICY:
+                sf->cachePolicy = CopyString(&sf->arena, attr.value);
+                break;
+            case HASH_VERSION:
+                sf->version = (uint8_t)ParseInt(attr.value);
+                break;
+            case HASH_NUM:
+                sf->index = (uint8_t)ParseInt(attr.value);
+                break;
+            case HASH_DATA1:
+                sf->data1 = (uint16_t)ParseInt(attr.value);
+                break;
+            case HASH_DATA2:
+                sf->data2 = (uint16_t)ParseInt(attr.value);
+                break;
+            case HASH_DATA3:
+                sf->data3 = (uint16_t)ParseInt(attr.value);
+                break;
+        }
+    }
+    return s->r.error == nullptr;
+}
+
+// Reads `SampleRef` and `Tuning`. Any other attribute is passed to `other`.
+template <typename F>
+static bool ReadSampleAttrs(SoundFontParser* s, const XmlTag* tag, ZSample* sample, F other) {
+    const char* p = tag->attrs;
+    XmlAttr attr;
+    while (NextAttribute(&s->r, &p, tag->attrsEnd, &attr)) {
+        const uint64_t hash = attr.nameHash;
+        if (hash == HASH_SAMPLE_REF) {
+            sample->path = CopyString(&s->sf->arena, attr.value);
+        } else if (hash == HASH_TUNING) {
+            sample->tuning = ParseFloat(attr.value);
+        } else {
+            other(hash, attr.value);
+        }
+    }
+    return s->r.error == nullptr;
+}
+
+static bool ReadDrum(SoundFontParser* s, const XmlTag* tag) {
+    s->drum = nullptr;
+    if (s->drumsRead >= s->sf->numDrums) {
+        return true;
+    }
+    ZDrum* drum = &s->sf->drums[s->drumsRead++];
+    s->drum = drum;
+    return ReadSampleAttrs(s, tag, &drum->sample, [drum](uint64_t hash, std::string_view value) {
+        switch (hash) {
+            case HASH_RELEASE_RATE:
+                drum->releaseRate = (uint8_t)ParseInt(value);
+                break;
+            case HASH_PAN:
+                drum->pan = (uint8_t)ParseInt(value);
+                break;
+        }
+    });
+}
+
+static bool ReadInstrument(SoundFontParser* s, const XmlTag* tag) {
+    s->instrument = nullptr;
+    if (s->instrumentsRead >= s->sf->numInstruments) {
+        return true;
+    }
+    ZInstrument* inst = &s->sf->instruments[s->instrumentsRead++];
+    s->instrument = inst;
+    const char* p = tag->attrs;
+    XmlAttr attr;
+    while (NextAttribute(&s->r, &p, tag->attrsEnd, &attr)) {
+        switch (attr.nameHash) {
+            case HASH_IS_VALID:
+                inst->isValid = ParseBool(attr.value);
+                break;
+            case HASH_NORMAL_RANGE_LO:
+                inst->normalRangeLo = (uint8_t)ParseInt(attr.value);
+                break;
+            case HASH_NORMAL_RANGE_HI:
+                inst->normalRangeHi = (uint8_t)ParseInt(attr.value);
+                break;
+            case HASH_RELEASE_RATE:
+                inst->releaseRate = (uint8_t)ParseInt(attr.value);
+                break;
+        }
+    }
+    return s->r.error == nullptr;
+}
+
+static bool ReadEnvelopes(SoundFontParser* s, const XmlTag* tag, ZEnvelope** envs, uint8_t* numEnvelopes) {
+    uint32_t count;
+    if (!ReadCount(s, tag, &count)) {
+        return false;
+    }
+    // The number of envelopes is stored in a byte
+    if (count > UINT8_MAX) {
+        count = UINT8_MAX;
+    }
+    *envs = s->sf->arena.AllocArray<ZEnvelope>(count);
+    *numEnvelopes = 0;
+    s->envs = *envs;
+    s->numEnvs = numEnvelopes;
+    s->envCapacity = count;
+    return true;
+}
+
+static bool ReadEnvelope(SoundFontParser* s, const XmlTag* tag) {
+    if (s->numEnvs == nullptr || *s->numEnvs >= s->envCapacity) {
+        return true;
+    }
+    ZEnvelope* env = &s->envs[(*s->numEnvs)++];
+    const char* p = tag->attrs;
+    XmlAttr attr;
+    while (NextAttribute(&s->r, &p, tag->attrsEnd, &attr)) {
+        switch (attr.nameHash) {
+            case HASH_DELAY:
+                env->delay = (int16_t)ParseInt(attr.value);
+                break;
+            case HASH_ARG:
+                env->arg = (int16_t)ParseInt(attr.value);
+                break;
+        }
+    }
+    return s->r.error == nullptr;
+}
+
+static bool ReadSfx(SoundFontParser* s, const XmlTag* tag) {
+    if (s->sfxRead >= s->sf->numSfx) {
+        return true;
+    }
+    ZSfxTbl* sfx = &s->sf->sfx[s->sfxRead++];
+    return ReadSampleAttrs(s, tag, &sfx->sample, [](uint64_t, std::string_view) {});
+}
+
+// Handles a start tag and returns what type of element it is, based on its name and the element it is in.
+static bool StartElement(SoundFontParser* s, const XmlTag* tag, SfElem parent, SfElem* type) {
+    ZSoundFont* sf = s->sf;
+    const uint64_t hash = tag->nameHash;
+    uint32_t count;
+    *type = SfElem::Other;
+
+    switch (parent) {
+        case SfElem::Other:
+            // Only the root element is looked at. Anything inside unknown elements is skipped.
+            if (s->depth == 0 && hash == HASH_SOUNDFONT && !s->sawRoot) {
+                *type = SfElem::SoundFont;
+                return ReadSoundFont(s, tag);
+            }
+            break;
+        case SfElem::SoundFont:
+            switch (hash) {
+                case HASH_DRUMS:
+                    *type = SfElem::Drums;
+                    if (!ReadCount(s, tag, &count)) {
+                        return false;
+                    }
+                    sf->numDrums = count;
+                    sf->drums = sf->arena.AllocArray<ZDrum>(count);
+                    s->drumsRead = 0;
+                    break;
+                case HASH_INSTRUMENTS:
+                    *type = SfElem::Instruments;
+                    if (!ReadCount(s, tag, &count)) {
+                        return false;
+                    }
+                    sf->numInstruments = count;
+                    sf->instruments = sf->arena.AllocArray<ZInstrument>(count);
+                    s->instrumentsRead = 0;
+                    break;
+                case HASH_SFX_TABLE:
+                    *type = SfElem::SfxTable;
+                    if (!ReadCount(s, tag, &count)) {
+                        return false;
+                    }
+                    sf->numSfx = count;
+                    sf->sfx = sf->arena.AllocArray<ZSfxTbl>(count);
+                    s->sfxRead = 0;
+                    break;
+            }
+            break;
+        case SfElem::Drums:
+            if (hash == HASH_DRUM) {
+                *type = SfElem::Drum;
+                return ReadDrum(s, tag);
+            }
+            break;
+        case SfElem::Drum:
+            if (hash == HASH_ENVELOPES && s->drum != nullptr) {
+                *type = SfElem::Envelopes;
+                return ReadEnvelopes(s, tag, &s->drum->envs, &s->drum->numEnvelopes);
+            }
+            break;
+        case SfElem::Instruments:
+            if (hash == HASH_INSTRUMENT) {
+                *type = SfElem::Instrument;
+                return ReadInstrument(s, tag);
+            }
+            break;
+        case SfElem::Instrument:
+            if (s->instrument == nullptr) {
+                break;
+            }
+            switch (hash) {
+                case HASH_ENVELOPES:
+                    *type = SfElem::Envelopes;
+                    return ReadEnvelopes(s, tag, &s->instrument->envs, &s->instrument->numEnvelopes);
+                case HASH_LOW_NOTES:
+                    *type = SfElem::Sample;
+                    return ReadSampleAttrs(s, tag, &s->instrument->lowNoteSound, [](uint64_t, std::string_view) {});
+                case HASH_NORMAL_NOTES:
+                    *type = SfElem::Sample;
+                    return ReadSampleAttrs(s, tag, &s->instrument->normalNoteSound, [](uint64_t, std::string_view) {});
+                case HASH_HIGH_NOTES:
+                    *type = SfElem::Sample;
+                    return ReadSampleAttrs(s, tag, &s->instrument->highNoteSound, [](uint64_t, std::string_view) {});
+            }
+            break;
+        case SfElem::Envelopes:
+            if (hash == HASH_ENVELOPE) {
+                *type = SfElem::Envelope;
+                return ReadEnvelope(s, tag);
+            }
+            break;
+        case SfElem::SfxTable:
+            if (hash == HASH_SFX) {
+                *type = SfElem::Sfx;
+                return ReadSfx(s, tag);
+            }
+            break;
+        default:
+            break;
+    }
+    return true;
+}
+
+static void EndElement(SoundFontParser* s, SfElem type) {
+    switch (type) {
+        case SfElem::Drum:
+            s->drum = nullptr;
+            break;
+        case SfElem::Instrument:
+            s->instrument = nullptr;
+            break;
+        case SfElem::Envelopes:
+            s->envs = nullptr;
+            s->numEnvs = nullptr;
+            s->envCapacity = 0;
+            break;
+        default:
+            break;
+    }
+}
+
+static bool ParseElements(SoundFontParser* s) {
+    XmlTag tag;
+    while (NextTag(&s->r, &tag)) {
+        if (tag.isEnd) {
+            if (s->depth == 0) {
+                return Fail(&s->r, tag.attrs, "Unexpected closing tag");
+            }
+            const SfOpenElem* open = &s->stack[--s->depth];
+            if (open->name != tag.name) {
+                return Fail(&s->r, tag.attrs, "Closing tag doesn't match the open element");
+            }
+            EndElement(s, open->type);
+            continue;
+        }
+
+        // Once inside an unknown element everything below it is unknown too
+        const SfElem parent = s->depth == 0 ? SfElem::Other : s->stack[s->depth - 1].type;
+        SfElem type = SfElem::Other;
+        if ((parent != SfElem::Other || s->depth == 0) && !StartElement(s, &tag, parent, &type)) {
+            return false;
+        }
+        if (tag.selfClosing) {
+            EndElement(s, type);
+            continue;
+        }
+        if (s->depth == std::size(s->stack)) {
+            return Fail(&s->r, tag.attrs, "Elements are nested too deeply");
+        }
+        s->stack[s->depth++] = { tag.name, type };
+    }
+    if (s->r.error != nullptr) {
+        return false;
+    }
+    if (s->depth != 0) {
+        return Fail(&s->r, s->stack[s->depth - 1].name.data(), "Element is never closed");
+    }
+    if (!s->sawRoot) {
+        return Fail(&s->r, s->r.end, "No SoundFont element");
+    }
+    return true;
+}
+
+bool ParseSoundFontXml(const char* xml, size_t size, ZSoundFont* sf, char* error, size_t errorSize) {
+    ClearSoundFont(sf);
+    // The parsed font is always smaller than its XML so this is usually the only block allocated
+    sf->arena.Reserve(size);
+
+    SoundFontParser s = {};
+    s.sf = sf;
+    s.r.start = xml;
+    s.r.p = xml;
+    s.r.end = xml + size;
+    if (StartsWith(s.r.p, s.r.end, "\xEF\xBB\xBF")) {
+        s.r.p += 3;
+    }
+
+    if (!ParseElements(&s)) {
+        int line = 1;
+        for (const char* c = s.r.start; c < s.r.errorPos; c++) {
+            line += *c == '\n';
+        }
+        if (error != nullptr && errorSize != 0) {
+            snprintf(error, errorSize, "%s on line %d", s.r.error, line);
+        }
+        ClearSoundFont(sf);
+        return false;
+    }
+    return true;
+}
+
+bool ParseSoundFont(const char* path, ZSoundFont* sf, char* error, size_t errorSize) {
+    std::error_code ec;
+    mio::mmap_source file;
+    file.map(path, ec);
+    if (ec) {
+        ClearSoundFont(sf);
+        if (error != nullptr && errorSize != 0) {
+            snprintf(error, errorSize, "Failed to open %s: %s", path, ec.message().c_str());
+        }
+        return false;
+    }
+    return ParseSoundFontXml(file.data(), file.size(), sf, error, errorSize);
+}
+
+void ClearSoundFont(ZSoundFont* sf) {
+    sf->arena.Release();
+    sf->medium = nullptr;
+    sf->cachePolicy = nullptr;
+    sf->drums = nullptr;
+    sf->instruments = nullptr;
+    sf->sfx = nullptr;
+    sf->numDrums = 0;
+    sf->numInstruments = 0;
+    sf->numSfx = 0;
+    sf->data1 = 0;
+    sf->data2 = 0;
+    sf->data3 = 0;
+    sf->version = 0;
+    sf->index = 0;
+}
@@ -0,0 +1,80 @@
+#ifndef SOUNDFONT_H
+#define SOUNDFONT_H
+
+#include <cstddef>
+#include <cstdint>
+#include "arena.h"
+
+// Not the actual order
+
+struct ZSample {
+    const char* path;
+    float tuning;
+    // `path` is an audio file on disk picked in the editor. It is imported into the archive when the font is saved.
+    bool onDisk;
+};
+
+struct ZEnvelope {
+    int16_t delay;
+    int16_t arg;
+};
+
+struct ZDrum {
+    ZSample sample;
+    ZEnvelope* envs;
+    uint8_t numEnvelopes;
+    uint8_t releaseRate;
+    uint8_t pan;
+    // variables to track modifications
+    bool modified;
+};
+
+struct ZInstrument {
+    ZSample lowNoteSound;
+    ZSample normalNoteSound;
+    ZSample highNoteSound;
+    ZEnvelope* envs;
+    uint8_t numEnvelopes;
+    bool isValid;
+    uint8_t normalRangeLo;
+    uint8_t normalRangeHi;
+    uint8_t releaseRate;
+    // variables to track modifications
+    bool modified;
+};
+
+struct ZSfxTbl {
+    ZSample sample;
+    // variables to track modifications
+    bool modified;
+};
+
+// Every array and string a soundfont points to is allocated from `arena`, so the whole font is freed with one call to
+// `ClearSoundFont`.
+struct ZSoundFont {
+    Arena arena;
+    const char* medium;
+    const char* cachePolicy;
+    ZDrum* drums;
+    ZInstrument* instruments;
+    ZSfxTbl* sfx;
+    uint32_t numDrums;
+    uint32_t numInstruments;
+    uint32_t numSfx;
+
+    uint16_t data1;
+    uint16_t data2;
+    uint16_t data3;
+    uint8_t version;
+    uint8_t index;
+};
+
+// Parses the soundfont XML at `path` into `sf`, replacing whatever was in it. The file is read in place from a memory
+// map without building a DOM. On failure `sf` is left empty and a message is written to `error`.
+bool ParseSoundFont(const char* path, ZSoundFont* sf, char* error, size_t errorSize);
+// Same as above but from XML already in memory. `xml` doesn't have to be null terminated.
+bool ParseSoundFontXml(const char* xml, size_t size, ZSoundFont* sf, char* error, size_t errorSize);
+// Frees everything allocated for `sf` and resets it to an empty font.
+void ClearSoundFont(ZSoundFont* sf);
+
+#endif
@@ -0,0 +1,1328 @@
+#include "streamed_audio.h"
+#include "xml_embed.h"
+#include "filebox.h"
+#include "CRC64.h"
+#include "memory_budget.h"
+
+#define DR_MP3_IMPLEMENTATION
+#include "dr_mp3.h"
+#define DR_WAV_IMPLEMENTATION
+#include "dr_wav.h"
+#define DR_FLAC_IMPLEMENTATION
+#include "dr_flac.h"
+
+#include <ogg/ogg.h>
+#include <vorbis/vorbisfile.h>
+#include <vorbis/vorbisenc.h>
+
+#include <tinyxml2.h>
+#include <array>
+#include <cmath>
+#include <cstring>
+#include <thread>
+#include <filesystem>
+#include <opus/opus.h>
+#include <opus/opusenc.h>
+
+#include "mio.hpp"
+#undef max
+
+enum AudioType {
+    mp3,
+    wav,
+    ogg,
+    flac,
+};
+
+constexpr static const char fontXmlBase[] = "custom/fonts/";
+constexpr static const char sampleNameBase[] = "custom/samples/";
+constexpr static const char sampleDataBase[] = "custom/sampleData/";
+constexpr static const char sampleXmlBase[] = "custom/samples/";
+constexpr static const char seqXmlBase[] = "custom/music/";
+
+// 'ID3' as a string
+#define MP3_ID3_CHECK(d) ((d[0] == 'I') && (d[1] == 'D') && (d[2] == '3'))
+// FF FB, FF F2, FF F3
+#define MP3_NON_ID3_CHECK(d) ((d[0] == 0xFF) && ((d[1] == 0xFB) || (d[1] == 0xF2) || (d[1] == 0xF3)))
+#define MP3_CHECK(d) (MP3_ID3_CHECK(d) || MP3_NON_ID3_CHECK(d))
+
+#define WAV_CHECK(d) ((d[0] == 'R') && (d[1] == 'I') && (d[2] == 'F') && (d[3] == 'F'))
+
+#define FLAC_CHECK(d) ((d[0] == 'f') && (d[1] == 'L') && (d[2] == 'a') && (d[3] == 'C'))
+
+#define OGG_CHECK(d) ((d[0] == 'O') && (d[1] == 'g') && (d[2] == 'g') && (d[3] == 'S'))
+
+constexpr static std::array<const char*, 4> audioTypeToStr = {
+    "mp3",
+    "wav",
+    "ogg",
+    "flac",
+};
+// TODO simd
+static void PcmS16ToF(float* dst, const int16_t* src, const uint64_t numFrames) {
+    for (size_t i = 0; i < numFrames; i++) {
+        dst[i] = static_cast<float>(src[i]) / 32768.0f;
+    }
+}
+
+// The record of the file the current thread is packing. Null outside of `ProcessAudioFile`.
+static thread_local PackFileRecord* sCurRecord = nullptr;
+
+// Same as `Archive::WriteFileSegments` but records how long the thread waited for the archive and how long the write took.
+static void WriteArchiveFile(Archive* a, char* path, const ArchiveDataInfo* segments, size_t numSegments) {
+    if (sCurRecord == nullptr) {
+        if (numSegments == 1) {
+            a->WriteFile(path, segments);
+        } else {
+            a->WriteFileSegments(path, segments, numSegments);
+        }
+        return;
+    }
+    StageTimer timer;
+    StartStageTimer(&timer);
+    std::unique_lock<std::mutex> lock(a->m);
+    EndStage(sCurRecord, PackStage::WriteWait, &timer);
+    if (numSegments == 1) {
+        a->WriteFileUnlocked(path, segments);
+    } else {
+        a->WriteFileSegmentsUnlocked(path, segments, numSegments);
+    }
+    EndStage(sCurRecord, PackStage::Write, &timer);
+    a->c.notify_one();
+}
+
+// Write `data` to either the archive, or if the archive is null, a file on disk
+void WriteFileData(char* path, void* data, size_t size, Archive* a) {
+    if (a == nullptr) {
+        FILE* file = fopen(path, "wb+");
+        fwrite(data, size, 1, file);
+        fclose(file);
+    }
+    else {
+        const ArchiveDataInfo info = {
+            .data = data, .size = size, .mode = DataCopy 
+        };
+        WriteArchiveFile(a, path, &info, 1);
+    }
+}
+
+static std::unique_ptr<char[]> GetSampleDataPath(const char* fileName) {
+    size_t sampleDataPathLen = sizeof(sampleDataBase) + strlen(fileName) + 1;
+    auto sampleDataPath = std::make_unique<char[]>(sampleDataPathLen);
+    snprintf(sampleDataPath.get(), sampleDataPathLen, "%s%s", sampleDataBase, fileName);
+    return sampleDataPath;
+}
+
+// If the data comes from memory, `input` is used as the source buffer.
+std::unique_ptr<char[]> CopySampleData(char* input, char* fileName, bool fromDisk, size_t size, Archive* a) {
+    auto sampleDataPath = GetSampleDataPath(fileName);
+    if (fromDisk) {
+        mio::mmap_source seqFile(input);
+        seqFile.release();
+
+        const ArchiveDataInfo info = {
+            .data = (void*)seqFile.data(), .size = seqFile.size(), .mode = MMappedFile
+        };
+        if (sCurRecord != nullptr) {
+            sCurRecord->outputSize += info.size;
+        }
+        WriteArchiveFile(a, sampleDataPath.get(), &info, 1);
+    }
+    else {
+        const ArchiveDataInfo info = {
+            .data = (void*)input, .size = size, .mode = DataCopy
+        };
+        if (sCurRecord != nullptr) {
+            sCurRecord->outputSize += info.size;
+        }
+        WriteArchiveFile(a, sampleDataPath.get(), &info, 1);
+    }
+    return sampleDataPath;
+}
+
+// Hole indices for each template. See `LoadStreamedAudioTemplates`.
+enum SampleXmlHole {
+    SampleLoopCount,
+    SampleLoopStart,
+    SampleLoopEnd,
+    SampleCustomFormat,
+    SampleSize,
+    SamplePath,
+    SampleHoleMax,
+};
+
+enum SeqXmlHole {
+    SeqFontIdx0,
+    SeqFontIdx7 = SeqFontIdx0 + 7,
+    SeqLength,
+    SeqLooped,
+    SeqStereo,
+    SeqHoleMax,
+};
+
+enum FontXmlHole {
+    FontSampleRef,
+    FontTuning,
+    FontSampleRef2,
+    FontTuning2,
+    FontHoleMax,
+};
+
+static void AddNormalNoteHoles(XmlTemplate* t, tinyxml2::XMLElement* instrumentElement) {
+    tinyxml2::XMLElement* normalNoteElement = instrumentElement->FirstChildElement("NormalNotesSound");
+    t->AddAttributeHole(normalNoteElement, "SampleRef");
+    t->AddAttributeHole(normalNoteElement, "Tuning");
+}
+
+bool LoadStreamedAudioTemplates(StreamedAudioTemplates* templates) {
+    if (!templates->sample.Load("assets/sample-base.xml", gSampleBaseXml, SAMPLE_BASE_XML_SIZE) ||
+        !templates->seq.Load("assets/seq-base.xml", gSequenceBaseXml, SEQ_BASE_XML_SIZE) ||
+        !templates->font.Load("assets/font-base.xml", gFontBaseXml, FONT_BASE_XML_SIZE) ||
+        !templates->fontMulti.Load("assets/font-base-multi.xml", gFontBaseMultiXml, FONT_BASE_MULTI_XML_SIZE)) {
+        return false;
+    }
+
+    // The holes must be added in the same order as the enums above.
+    tinyxml2::XMLElement* root = templates->sample.Root();
+    tinyxml2::XMLElement* loopElement = root->FirstChildElement("ADPCMLoop");
+    if (loopElement == nullptr) {
+        printf("sample-base.xml is missing the ADPCMLoop element\n");
+        return false;
+    }
+    templates->sample.AddAttributeHole(loopElement, "Count");
+    templates->sample.AddAttributeHole(loopElement, "Start");
+    templates->sample.AddAttributeHole(loopElement, "End");
+    templates->sample.AddAttributeHole(root, "CustomFormat");
+    templates->sample.AddAttributeHole(root, "Size");
+    templates->sample.AddAttributeHole(root, "Path");
+    templates->sample.Compile();
+
+    root = templates->seq.Root();
+    tinyxml2::XMLElement* fontIndiciesElement = root->FirstChildElement("FontIndicies");
+    if (fontIndiciesElement == nullptr) {
+        printf("seq-base.xml is missing the FontIndicies element\n");
+        return false;
+    }
+    for (size_t i = 0; i < 8; i++) {
+        tinyxml2::XMLElement* fontIdxElement = fontIndiciesElement->InsertNewChildElement("FontIndex");
+        templates->seq.AddAttributeHole(fontIdxElement, "FontIdx");
+    }
+    templates->seq.AddAttributeHole(root, "Length");
+    templates->seq.AddAttributeHole(root, "Looped");
+    templates->seq.AddAttributeHole(root, "Stereo");
+    templates->seq.Compile();
+
+    XmlTemplate* fonts[2] = { &templates->font, &templates->fontMulti };
+    for (size_t i = 0; i < 2; i++) {
+        tinyxml2::XMLElement* instrumentsElement = fonts[i]->Root()->FirstChildElement("Instruments");
+        tinyxml2::XMLElement* instrumentElement = nullptr;
+        if (instrumentsElement != nullptr) {
+            instrumentElement = instrumentsElement->FirstChildElement("Instrument");
+        }
+        // The single channel font has one instrument, the multi channel font has one per channel.
+        for (size_t j = 0; j <= i; j++) {
+            if (instrumentElement == nullptr || instrumentElement->FirstChildElement("NormalNotesSound") == nullptr) {
+                printf("Font template is missing an instrument with a NormalNotesSound\n");
+                return false;
+            }
+            AddNormalNoteHoles(fonts[i], instrumentElement);
+            instrumentElement = instrumentElement->NextSiblingElement("Instrument");
+        }
+        fonts[i]->Compile();
+    }
+
+    return true;
+}
+
+std::unique_ptr<char[]> CreateSampleXml(char* fileName, const char* audioType, uint64_t numFrames, uint64_t numChannels, SeqMetaInfo* info, uint64_t sampleRate, bool loopTimeInSamples,
+                                        const StreamedAudioTemplates* templates, XmlEmitBuffer* xmlBuf, Archive* a) {
+    const char* values[SampleHoleMax];
+    char loopStartStr[24];
+    char loopEndStr[24];
+    char sizeStr[24];
+
+    size_t sampleDataSize = sizeof(sampleDataBase) + strlen(fileName) + 1;
+    auto sampleDataPath = std::make_unique<char[]>(sampleDataSize);
+    snprintf(sampleDataPath.get(), sampleDataSize, "%s%s", sampleDataBase, fileName);
+
+    // Fill in sample XML
+    values[SampleLoopCount] = info->fanfare ? templates->sample.GetDefault(SampleLoopCount) : "-1";
+    values[SampleLoopStart] = templates->sample.GetDefault(SampleLoopStart);
+    if (info->loopStart.i != 0) {
+        uint64_t loopStartSample;
+        if (loopTimeInSamples) {
+            loopStartSample = info->loopStart.i;
+            if (info->loopStart.i > numFrames * numChannels) {
+                loopStartSample = 0;
+            }
+        } else {
+            loopStartSample = info->loopStart.f * sampleRate * numChannels;
+            if (loopStartSample > numFrames * numChannels) {
+                loopStartSample = 0;
+            }
+        }
+        tinyxml2::XMLUtil::ToStr(loopStartSample, loopStartStr, sizeof(loopStartStr));
+        values[SampleLoopStart] = loopStartStr;
+    }
+    uint64_t loopEndSample = numFrames * numChannels;
+    if (info->loopEnd.i != 0) {
+        if (loopTimeInSamples) {
+            if (info->loopEnd.i <= numFrames * numChannels) {
+                loopEndSample = info->loopEnd.i;
+            }
+        }
+        else {
+            loopEndSample = info->loopEnd.f * sampleRate * numChannels;
+            if (loopEndSample > numFrames * numChannels) {
+                loopEndSample = numFrames * numChannels;
+            }
+        }
+    }
+    tinyxml2::XMLUtil::ToStr(loopEndSample, loopEndStr, sizeof(loopEndStr));
+    values[SampleLoopEnd] = loopEndStr;
+    values[SampleCustomFormat] = audioType;
+    tinyxml2::XMLUtil::ToStr((uint64_t)(numFrames * numChannels * 2), sizeStr, sizeof(sizeStr));
+    values[SampleSize] = sizeStr;
+    values[SamplePath] = sampleDataPath.get();
+
+    size_t samplePathLen = sizeof(sampleXmlBase) + strlen(fileName) + sizeof("_SAMPLE.xml") + 1;
+    std::unique_ptr<char[]> sampleXmlPath = std::make_unique<char[]>(samplePathLen);
+    snprintf(sampleXmlPath.get(), samplePathLen, "%s%s_SAMPLE.xml", sampleXmlBase, fileName);
+
+    size_t xmlLen = xmlBuf->Emit(templates->sample, values);
+    WriteFileData(sampleXmlPath.get(), xmlBuf->Data(), xmlLen, a);
+
+    return sampleXmlPath;
+}
+
+static void CreateSequenceXml(char* fileName, char* fontPath, unsigned int length, bool isFanfare, bool stereo, const StreamedAudioTemplates* templates, XmlEmitBuffer* xmlBuf, Archive* a) {
+    const char* values[SeqHoleMax];
+    char fontIdxStrs[8][4];
+    char lengthStr[12];
+
+    uint64_t crc = CRC64(fontPath);
+    for (size_t i = 0; i < 8; i++) {
+        tinyxml2::XMLUtil::ToStr((int)((uint8_t*)&crc)[i], fontIdxStrs[i], sizeof(fontIdxStrs[i]));
+        values[SeqFontIdx0 + i] = fontIdxStrs[i];
+    }
+    tinyxml2::XMLUtil::ToStr(length, lengthStr, sizeof(lengthStr));
+    values[SeqLength] = lengthStr;
+    // By default the game will loop streamed sequences. Tell the game to NOT loop songs used as fanfares.
+    values[SeqLooped] = isFanfare ? "false" : "true";
+    values[SeqStereo] = stereo ? "true" : "false";
+
+    std::unique_ptr<char[]> seqXmlPath;
+    size_t seqPathLen = sizeof(seqXmlBase) + strlen(fileName) + sizeof("_SEQ.xml");
+    if (!isFanfare) {
+        seqXmlPath = std::make_unique<char[]>(seqPathLen);
+        snprintf(seqXmlPath.get(), seqPathLen, "%s%s_SEQ.xml", seqXmlBase, fileName);
+    } else {
+        seqPathLen += sizeof("_fanfare");
+        seqXmlPath = std::make_unique<char[]>(seqPathLen);
+        snprintf(seqXmlPath.get(), seqPathLen, "%s%s_SEQ.xml_fanfare", seqXmlBase, fileName);
+    }
+
+    size_t xmlLen = xmlBuf->Emit(templates->seq, values);
+    WriteFileData(seqXmlPath.get(), xmlBuf->Data(), xmlLen, a);
+}
+
+static std::unique_ptr<char[]> CreateFontXml(char* fileName, uint64_t sampleRate, uint64_t channels, const StreamedAudioTemplates* templates, XmlEmitBuffer* xmlBuf, Archive* a) {
+    const char* values[FontHoleMax];
+    char tuningStr[32];
+
+    size_t sampleRefPathSize = sizeof(sampleNameBase) + strlen(fileName) + sizeof("_SAMPLE.xml") + 1;
+    auto sampleRefPathXml = std::make_unique<char[]>(sampleRefPathSize);
+    snprintf(sampleRefPathXml.get(), sampleRefPathSize, "%s%s_SAMPLE.xml", sampleNameBase, fileName);
+
+    tinyxml2::XMLUtil::ToStr(((float)sampleRate / 32000.0f) * channels, tuningStr, sizeof(tuningStr));
+    values[FontSampleRef] = sampleRefPathXml.get();
+    values[FontTuning] = tuningStr;
+
+    size_t fontPathLen = sizeof(fontXmlBase) + strlen(fileName) + sizeof("_FONT.xml");
+    auto fontXmlPath = std::make_unique<char[]>(fontPathLen);
+    snprintf(fontXmlPath.get(), fontPathLen, "%s%s_FONT.xml", fontXmlBase, fileName);
+
+    size_t xmlLen = xmlBuf->Emit(templates->font, values);
+    WriteFileData(fontXmlPath.get(), xmlBuf->Data(), xmlLen, a);
+
+    return fontXmlPath;
+}
+
+static std::unique_ptr<char[]> CreateFontMultiXml(std::unique_ptr<char[]> fileNames[2], char* baseFileName, uint64_t sampleRate, const StreamedAudioTemplates* templates, XmlEmitBuffer* xmlBuf, Archive* a) {
+    const char* values[FontHoleMax];
+    char tuningStr[32];
+    std::unique_ptr<char[]> sampleRefPathXml[2];
+
+    for (size_t i = 0; i < 2; i++) {
+        size_t sampleRefPathSize = sizeof(sampleNameBase) + strlen(fileNames[i].get()) + sizeof("_SAMPLE.xml") + 1;
+        sampleRefPathXml[i] = std::make_unique<char[]>(sampleRefPathSize);
+        snprintf(sampleRefPathXml[i].get(), sampleRefPathSize, "%s%s_SAMPLE.xml", sampleNameBase, fileNames[i].get());
+    }
+
+    tinyxml2::XMLUtil::ToStr(((float)sampleRate / 32000.0f), tuningStr, sizeof(tuningStr));
+    values[FontSampleRef] = sampleRefPathXml[0].get();
+    values[FontTuning] = tuningStr;
+    values[FontSampleRef2] = sampleRefPathXml[1].get();
+    values[FontTuning2] = tuningStr;
+
+    size_t fontPathLen = sizeof(fontXmlBase) + strlen(baseFileName) + sizeof("_FONT.xml");
+    auto fontXmlPath = std::make_unique<char[]>(fontPathLen);
+    snprintf(fontXmlPath.get(), fontPathLen, "%s%s_FONT.xml", fontXmlBase, baseFileName);
+
+    size_t xmlLen = xmlBuf->Emit(templates->fontMulti, values);
+    WriteFileData(fontXmlPath.get(), xmlBuf->Data(), xmlLen, a);
+
+    return fontXmlPath;
+}
+
+struct OggFileData {
+    void* data;
+    size_t pos;
+    size_t size;
+};
+typedef enum class OggType {
+    None = -1,
+    Vorbis,
+    Opus,
+} OggType;
+
+static OggType GetOggType(OggFileData* data) {
+    ogg_sync_state oy;
+    ogg_stream_state os;
+    ogg_page og;
+    ogg_packet op;
+    OggType type;
+
+    ogg_sync_init(&oy);
+    char* buffer = ogg_sync_buffer(&oy, 4096);
+    memcpy(buffer, data->data, 4096);
+    ogg_sync_wrote(&oy, 4096);
+
+    ogg_sync_pageout(&oy, &og);
+    ogg_stream_init(&os, ogg_page_serialno(&og));
+    ogg_stream_pagein(&os, &og);
+    ogg_stream_packetout(&os, &op);
+    
+    // Can't use strcmp because op.packet isn't a null terminated string.
+    if (memcmp((char*)op.packet, "\x01vorbis", 7) == 0) {
+        type = OggType::Vorbis;
+    } else if (memcmp((char*)op.packet, "OpusHead", 8) == 0) {
+        type = OggType::Opus;
+    } else {
+        type = OggType::None;
+    }
+    ogg_stream_clear(&os);
+    ogg_sync_clear(&oy);
+    return type;
+}
+
+
+static int OpeWriteCallback(void* vData, const unsigned char* ptr, opus_int32 len) {
+    OggFileData* data = static_cast<OggFileData*>(vData);
+    size_t toRead = len;
+
+    if (toRead > data->size - data->pos) {
+        toRead = data->size - data->pos;
+    }
+
+    memcpy((char*)data->data + data->pos, ptr, toRead);
+    data->pos += toRead;
+    
+    return 0;
+}
+
+static int OpeCloseCallback(void* data) {
+    return 0;
+}
+
+static const OpusEncCallbacks opusCbs = {
+    OpeWriteCallback,
+    OpeCloseCallback,
+};
+
+
+static size_t VorbisReadCallback(void* out, size_t size, size_t elems, void* src) {
+    OggFileData* data = static_cast<OggFileData*>(src);
+    size_t toRead = size * elems;
+
+    if (toRead > data->size - data->pos) {
+        toRead = data->size - data->pos;
+    }
+
+    memcpy(out, static_cast<uint8_t*>(data->data) + data->pos, toRead);
+    data->pos += toRead;
+    
+    return toRead / size;
+}
+
+static int VorbisSeekCallback(void* src, ogg_int64_t pos, int whence) {
+    OggFileData* data = static_cast<OggFileData*>(src);
+    size_t newPos;
+    
+    switch(whence) {
+        case SEEK_SET:
+            newPos = pos;
+            break;
+        case SEEK_CUR:
+            newPos = data->pos + pos;
+            break;
+        case SEEK_END:
+            newPos = data->size + pos;
+            break;
+        default:
+            return -1;
+    }
+    if (newPos > data->size) {
+        return -1;
+    }
+    data->pos = newPos;
+    return 0;
+}
+
+static int VorbisCloseCallback([[maybe_unused]] void* src) {
+    return 0;
+}
+
+static long VorbisTellCallback(void* src) {
+    OggFileData* data = static_cast<OggFileData*>(src);
+    return data->pos;
+}
+
+static constexpr ov_callbacks cbs = {
+    VorbisReadCallback,
+    VorbisSeekCallback,
+    VorbisCloseCallback,
+    VorbisTellCallback,
+};
+
+#if 0
+typedef struct {
+    unsigned char* data;
+    size_t size;
+    size_t capacity;
+} MemoryBuffer;
+
+void init_memory_buffer(MemoryBuffer* buffer, size_t initial_size) {
+    buffer->data = (unsigned char*)malloc(initial_size);
+    buffer->capacity = initial_size;
+    buffer->size = 0;
+}
+
+void expand_memory_buffer(MemoryBuffer* buffer, size_t additional_size) {
+    buffer->capacity += additional_size;
+    buffer->data = (unsigned char*)realloc(buffer->data, buffer->capacity);
+}
+
+void write_to_buffer(MemoryBuffer* buffer, unsigned char* data, size_t data_size) {
+    while (buffer->size + data_size > buffer->capacity) {
+        expand_memory_buffer(buffer, data_size);
+    }
+    memcpy(buffer->data + buffer->size, data, data_size);
+    buffer->size += data_size;
+}
+#endif
+static constexpr size_t WAV_HEADER_SIZE = 44;
+
+typedef struct ChannelInfo {
+    void* channelData[2];
+    size_t channelSizes[2];
+    // Written before the data of each channel if `headerSize` isn't 0. Lets the samples be written without
+    // copying them after a header first.
+    uint8_t header[WAV_HEADER_SIZE];
+    size_t headerSize;
+} ChannelInfo;
+
+// Writes the data of channel `channel`, preceded by the header if there is one. The archive takes ownership of the
+// channel data.
+static void CopyChannelData(const ChannelInfo* info, size_t channel, char* fileName, Archive* a) {
+    auto sampleDataPath = GetSampleDataPath(fileName);
+    const ArchiveDataInfo segments[2] = {
+        { .data = (void*)info->header, .size = info->headerSize, .mode = DataCopy },
+        { .data = info->channelData[channel], .size = info->channelSizes[channel], .mode = DataOwned },
+    };
+    const bool hasHeader = info->headerSize != 0;
+
+    if (sCurRecord != nullptr) {
+        sCurRecord->outputSize += info->headerSize + info->channelSizes[channel];
+    }
+    WriteArchiveFile(a, sampleDataPath.get(), hasHeader ? &segments[0] : &segments[1], hasHeader ? 2 : 1);
+}
+
+static void SplitOggVorbis(ChannelInfo* info, std::unique_ptr<float[]> channels[2], uint64_t* sampleRate, uint64_t numFrames, size_t fileSize, uint32_t numChannels) {
+    for (size_t i = 0; i < numChannels; i++) {
+        OggFileData data;
+        data.data = malloc(fileSize);
+        data.size = fileSize;
+        data.pos = 0;
+        OggOpusComments* comments = ope_comments_create();
+        ope_comments_add(comments, "ENCODER", "future using libopus libopusenc");
+        
+        // TODO, hardcoded to 48KHz even if the original song isn't. Should we resample it to 48k?
+        OggOpusEnc* enc = ope_encoder_create_callbacks(&opusCbs, &data, comments, 48000, 1, 0, nullptr);
+        ope_encoder_write_float(enc, channels[i].get(), numFrames);
+        ope_encoder_drain(enc);
+        ope_encoder_destroy(enc);
+        info->channelData[i] = data.data;
+        info->channelSizes[i] = data.pos;
+    }
+    
+
+    #if 0
+    MemoryBuffer outBuffer[2];
+    // fileSize will likely always be larger than the original file but it will never need to reallocate the buffer.
+    init_memory_buffer(&outBuffer[0], fileSize);
+    init_memory_buffer(&outBuffer[1], fileSize);
+    ogg_stream_state os[2];
+    ogg_page og[2];
+    ogg_packet op[2];
+    vorbis_info outInfo[2];
+    vorbis_dsp_state vd[2];
+    vorbis_block vb[2];
+    vorbis_comment vc[2];
+    ogg_packet header[2];
+    ogg_packet header_comm[2];
+    ogg_packet header_code[2];
+    for (size_t i = 0; i < 2; i++) {
+        vorbis_info_init(&outInfo[i]);
+        vorbis_encode_init_vbr(&outInfo[i], 1, sampleRate, 0.6f);
+        vorbis_analysis_init(&vd[i], &outInfo[i]);
+        vorbis_block_init(&vd[i], &vb[i]);
+        vorbis_comment_init(&vc[i]);
+        ogg_stream_init(&os[i], 0);
+
+        vorbis_analysis_headerout(&vd[i], &vc[i], &header[i], &header_comm[i], &header_code[i]);
+        ogg_stream_packetin(&os[i], &header[i]); /* automatically placed in its own
+                                     page */
+        ogg_stream_packetin(&os[i], &header_comm[i]);
+        ogg_stream_packetin(&os[i], &header_code[i]);
+
+        while (true) {
+            int result = ogg_stream_flush(&os[i], &og[i]);
+            if (result == 0)break;
+            write_to_buffer(&outBuffer[i], og[i].header, og[i].header_len);
+            write_to_buffer(&outBuffer[i], og[i].body, og[i].body_len);
+        }
+    }
+
+    size_t pos = 0;
+    size_t read = 0;
+    do {
+        float** bufferL = vorbis_analysis_buffer(&vd[0], 1024);
+        float** bufferR = vorbis_analysis_buffer(&vd[1], 1024);
+        if (pos + 1024 > numFrames) {
+            read = numFrames - pos;
+        } else {
+            read = 1024;
+        }
+        if (read > 0) {
+            // Avoid memcpy if pcm data can be used directly
+            memcpy(bufferL[0], &channels[0].get()[pos], read * 4);
+            memcpy(bufferR[0], &channels[1].get()[pos], read * 4);
+            
+            vorbis_analysis_wrote(&vd[0], read);
+            vorbis_analysis_wrote(&vd[1], read);
+            pos += read;
+        }
+        else {
+            vorbis_analysis_wrote(&vd[0], 0); // Signal end of input
+            vorbis_analysis_wrote(&vd[1], 0); // Signal end of input
+        }
+
+        // Analysis and packet output
+        for (size_t i = 0; i < 2; i++) {
+            int eos = 0;
+            while (vorbis_analysis_blockout(&vd[i], &vb[i]) == 1) {
+                vorbis_analysis(&vb[i], NULL);
+                vorbis_bitrate_addblock(&vb[i]);
+
+                while (vorbis_bitrate_flushpacket(&vd[i], &op[i])) {
+                    ogg_stream_packetin(&os[i], &op[i]);
+                    while (!eos) {
+                        if (!ogg_stream_pageout(&os[i], &og[i])) break;
+                        write_to_buffer(&outBuffer[i], og[i].header, og[i].header_len);
+                        write_to_buffer(&outBuffer[i], og[i].body, og[i].body_len);
+                        if (ogg_page_eos(&og[i])) eos = 1;
+                    }
+                }
+            }
+        }
+    } while (read > 0);
+
+
+    // Clean up
+    for (size_t i = 0; i < 2; i++) {
+        ogg_stream_clear(&os[i]);
+        vorbis_block_clear(&vb[i]);
+        vorbis_dsp_clear(&vd[i]);
+        vorbis_comment_clear(&vc[i]);
+        vorbis_info_clear(&outInfo[i]);
+    }
+
+    info->channelData[0] = outBuffer[0].data;
+    info->channelData[1] = outBuffer[1].data;
+    info->channelSizes[0] = outBuffer[0].size;
+    info->channelSizes[1] = outBuffer[1].size;
+    #endif
+}
+
+static void DecodeOpusFile(uint32_t* numChannels, uint64_t* sampleRate, uint64_t* numSamples, OggFileData* fileData, std::unique_ptr<float[]> channels[2]) {
+    ogg_sync_state oy;
+    ogg_stream_state os;
+    ogg_page og;
+    ogg_packet op;
+
+    ogg_sync_init(&oy);
+    // Read the first page
+    char* buffer = ogg_sync_buffer(&oy, 4096);
+    VorbisReadCallback(buffer, 4096, 1, fileData);
+    // It would be best to use the number of bytes read from the callback but if it's too small the file is
+    // probably invalid anyway
+    ogg_sync_wrote(&oy, 4096); // Tell the libogg data was put into its buffer for processing
+    ogg_sync_pageout(&oy, &og);
+    ogg_stream_init(&os, ogg_page_serialno(&og));
+    ogg_stream_pagein(&os, &og);
+    ogg_stream_packetout(&os, &op);
+    *sampleRate = reinterpret_cast<uint32_t*>(op.packet)[3];
+    *numChannels = op.packet[9];
+    // We don't care about the second header and its data
+    int curHdr = 0;
+    // Consume the next header
+    while (curHdr < 1) {
+        while (curHdr < 1) {
+            int result = ogg_sync_pageout(&oy, &og);
+            if (result == 0)
+                break; // Need more data
+            if (result == 1) {
+                ogg_stream_pagein(&os, &og);
+                while (curHdr < 1) {
+                    result = ogg_stream_packetout(&os, &op);
+                    if (result == 0) // Again, needs more data. Get more from pageout, pagein
+                        break;
+                    if (result < 0) {
+                        // This is bad. Handle it at some point...
+                    }
+                    curHdr++;
+                }
+            }
+        }
+        /* no harm in not checking before adding more */
+        buffer = ogg_sync_buffer(&oy, 4096);
+        VorbisReadCallback(buffer, 4096, 1, fileData);
+        ogg_sync_wrote(&oy, 4096);
+    }
+    OpusDecoder* dec = opus_decoder_create(48000, 2, nullptr);
+    int eos = 0;
+    int read = 0;
+    std::vector<float> samples;
+    size_t pos = 0;
+    while (!eos) {
+        while (!eos) {
+            int res = ogg_sync_pageout(&oy, &og);
+            if (res == 0) // Need more data
+                break;
+            if (res < 0) {
+                // This is bad...
+            }
+            ogg_stream_pagein(&os, &og);
+            while (true) {
+                res = ogg_stream_packetout(&os, &op);
+                if (res == 0)
+                    break;
+                if (res < 0) {
+                    // You should know by now this is bad...
+                }
+                float pcm[960 * 6 * 2]; // Largest possible size
+                // Decode opus encoded samples
+                const int frameSize = opus_decode_float(dec, op.packet, op.bytes, pcm, 960 * 6, 0);
+                // There isn't a good way to know how long an opus file is, so we need to keep filling a buffer
+                // like this.
+                samples.resize(samples.size() + frameSize * 2);
+                memcpy(samples.data() + pos, pcm, frameSize * sizeof(float) * 2);
+                pos += frameSize * 2;
+            }
+            eos = ogg_page_eos(&og);
+        }
+        if (!eos) {
+            buffer = ogg_sync_buffer(&oy, 4096);
+            // Needs to read 4096 elements due to how the return works.
+            read = VorbisReadCallback(buffer, 1, 4096, fileData);
+            ogg_sync_wrote(&oy, read);
+            if (read == 0) {
+                eos = 1;
+            }
+        }
+    }
+    channels[0] = std::make_unique<float[]>(pos / 2);
+    channels[1] = std::make_unique<float[]>(pos / 2);
+    *numSamples = pos;
+    pos = 0;
+    for (size_t i = 0; i < *numSamples - 1; i += 2, pos++) {
+        channels[0].get()[pos] = samples[i];
+        channels[1].get()[pos] = samples[i + 1];
+    }
+    *numSamples /= 2;
+    opus_decoder_destroy(dec);
+
+    ogg_stream_clear(&os);
+    ogg_sync_clear(&oy);
+}
+
+// Opus files don't store their length in the header. The granule position of the last page is the number of 48KHz
+// samples in the stream, which is close enough to size the decode buffers.
+static uint64_t GetOggLastGranulePos(const uint8_t* data, size_t size) {
+    static constexpr size_t OGG_PAGE_HEADER_SIZE = 27;
+    if (size < OGG_PAGE_HEADER_SIZE) {
+        return 0;
+    }
+    for (size_t i = size - OGG_PAGE_HEADER_SIZE + 1; i-- > 0;) {
+        if (memcmp(data + i, "OggS", 4) == 0) {
+            int64_t granulePos;
+            memcpy(&granulePos, data + i + 6, sizeof(granulePos));
+            return granulePos > 0 ? (uint64_t)granulePos : 0;
+        }
+    }
+    return 0;
+}
+
+// Upper bound of what a worker allocates while converting a file: an interleaved decode buffer, planar copies in
+// both s16 and float, and an encoder output buffer the size of the input file for each channel.
+static uint64_t EstimateDecodeMemory(uint64_t numFrames, uint32_t numChannels, size_t fileSize) {
+    constexpr uint64_t bytesPerSample = sizeof(float) * 2 + sizeof(int16_t) * 2;
+    return numFrames * numChannels * bytesPerSample + (uint64_t)fileSize * numChannels;
+}
+
+// Waits until the file's decode buffers fit in the memory budget. Reading the header up to here counts as decoding.
+static void ReserveDecodeMemory(MemoryReservation* reservation, PackFileRecord* record, StageTimer* timer, uint64_t numFrames,
+                                uint32_t numChannels, size_t fileSize) {
+    EndStage(record, PackStage::Decode, timer);
+    reservation->Reserve(EstimateDecodeMemory(numFrames, numChannels, fileSize));
+    EndStage(record, PackStage::MemoryWait, timer);
+}
+
+static void PutLE16(uint8_t* out, uint16_t v) {
+    out[0] = (uint8_t)v;
+    out[1] = (uint8_t)(v >> 8);
+}
+
+static void PutLE32(uint8_t* out, uint32_t v) {
+    PutLE16(out, (uint16_t)v);
+    PutLE16(out + 2, (uint16_t)(v >> 16));
+}
+
+// Header of a mono, 16 bit PCM WAV file. The same one drwav writes.
+static void CreateWavHeader(uint8_t out[WAV_HEADER_SIZE], uint64_t numFrames, uint64_t sampleRate) {
+    const uint32_t dataSize = (uint32_t)(numFrames * sizeof(int16_t));
+
+    memcpy(out, "RIFF", 4);
+    PutLE32(out + 4, (uint32_t)(WAV_HEADER_SIZE - 8) + dataSize);
+    memcpy(out + 8, "WAVE", 4);
+    memcpy(out + 12, "fmt ", 4);
+    PutLE32(out + 16, 16);
+    PutLE16(out + 20, DR_WAVE_FORMAT_PCM);
+    PutLE16(out + 22, 1);
+    PutLE32(out + 24, (uint32_t)sampleRate);
+    PutLE32(out + 28, (uint32_t)sampleRate * sizeof(int16_t));
+    PutLE16(out + 32, sizeof(int16_t));
+    PutLE16(out + 34, 16);
+    memcpy(out + 36, "data", 4);
+    PutLE32(out + 40, dataSize);
+}
+
+// Makes each channel its own mono WAV file. The samples are written after the header as is so `l` and `r`
+// are handed to `info` and must be allocated with `malloc`.
+static void WriteWavData(int16_t* l, int16_t* r, ChannelInfo* info, uint64_t numFrames, uint64_t sampleRate) {
+    CreateWavHeader(info->header, numFrames, sampleRate);
+    info->headerSize = WAV_HEADER_SIZE;
+    info->channelData[0] = l;
+    info->channelData[1] = r;
+    info->channelSizes[0] = numFrames * sizeof(int16_t);
+    info->channelSizes[1] = numFrames * sizeof(int16_t);
+}
+
+static void ProcessAudioFile(std::vector<char*>* fileQueue, std::unordered_map<char*, SeqMetaInfo>* seqMetaMap, bool loopTimeInSamples, bool transcodeToOpus, const StreamedAudioTemplates* templates,
+                             std::atomic<size_t>* nextFile, std::atomic<unsigned int>* filesProcessed, MemoryBudget* budget, PackReport* report, Archive* a) {
+    // Reused for every XML file this thread writes.
+    XmlEmitBuffer xmlBuf;
+    // Used when the caller doesn't want a report.
+    PackFileRecord unusedRecord;
+    size_t fileIndex;
+    // Claiming the index and checking it in one step means two threads can't both take the last file
+    while ((fileIndex = nextFile->fetch_add(1, std::memory_order_relaxed)) < fileQueue->size()) {
+    filesProcessed->fetch_add(1, std::memory_order_relaxed);
+    char** inputp = &(*fileQueue)[fileIndex];
+    char* input = *inputp;
+    char* fileName = strrchr(input, PATH_SEPARATOR);
+    fileName++;
+    PackFileRecord* record = report != nullptr ? report->GetRecord(fileIndex) : nullptr;
+    if (record == nullptr) {
+        record = &unusedRecord;
+    }
+    StageTimer timer;
+    record->name = fileName;
+    record->processed = true;
+    sCurRecord = record;
+    // Released at the end of the iteration, including when the file fails.
+    MemoryReservation reservation(budget);
+    StartStageTimer(&timer);
+    size_t fileNameLen = strlen(fileName);
+
+    const size_t outFileLen = fileNameLen + sizeof("_L") + 1;
+    
+    std::unique_ptr<char[]> fileNames[2];
+
+    fileNames[0] = std::make_unique<char[]>(outFileLen);
+    snprintf(fileNames[0].get(), outFileLen, "%s_L", fileName);
+
+    fileNames[1] = std::make_unique<char[]>(outFileLen);
+    snprintf(fileNames[1].get(), outFileLen, "%s_R", fileName);
+    
+    uint8_t* dataU8;
+    uint64_t numFrames;
+    uint32_t numChannels;
+    uint64_t sampleRate;
+    int audioType;
+    // Only used for multichannel files
+    ChannelInfo infos{};
+
+
+    mio::mmap_source file(input);
+
+    void* data = (void*)file.data();
+    size_t fileSize = file.size();
+    record->inputSize = fileSize;
+
+    dataU8 = (uint8_t*)data;
+
+    // Read file header to determine which library needs to process it
+    if (MP3_CHECK(dataU8)) {
+        drmp3 mp3;
+        audioType = AudioType::mp3;
+        record->inputFormat = "mp3";
+        drmp3_init_memory(&mp3, data, fileSize, nullptr);
+        numChannels = mp3.channels;
+        sampleRate = mp3.sampleRate;
+        numFrames = drmp3_get_pcm_frame_count(&mp3);
+        EndStage(record, PackStage::Decode, &timer);
+        if (numChannels == 2 || transcodeToOpus) {
+            ReserveDecodeMemory(&reservation, record, &timer, numFrames, numChannels, fileSize);
+        }
+        if (numChannels == 2) {
+            audioType = AudioType::ogg;
+            auto sampleData = std::make_unique<float[]>(numFrames * numChannels);
+            drmp3_read_pcm_frames_f32(&mp3, numFrames, sampleData.get());
+            EndStage(record, PackStage::Decode, &timer);
+            std::unique_ptr<float[]> channels[2];
+            channels[0] = std::make_unique<float[]>(numFrames);
+            channels[1] = std::make_unique<float[]>(numFrames);
+            size_t pos = 0;
+            for (size_t i = 0; i < numFrames * numChannels - 1; i += 2, pos++) {
+                channels[0].get()[pos] = sampleData.get()[i];
+                channels[1].get()[pos] = sampleData.get()[i + 1];
+            }
+            EndStage(record, PackStage::Deinterleave, &timer);
+            SplitOggVorbis(&infos, channels, &sampleRate, numFrames, fileSize, 2);
+            EndStage(record, PackStage::Encode, &timer);
+        }
+        else if (numChannels == 1) {
+            if (transcodeToOpus) {
+                audioType = AudioType::ogg;
+                std::unique_ptr<float[]> channelDataF[2]; // `SplitOggVorbis` wants an array so we will give it one but with one element initialized.
+                channelDataF[0] = std::make_unique<float[]>(numFrames);
+                drmp3_read_pcm_frames_f32(&mp3, numFrames, channelDataF[0].get());
+                EndStage(record, PackStage::Decode, &timer);
+                SplitOggVorbis(&infos, channelDataF, &sampleRate, numFrames, fileSize, 1);
+                EndStage(record, PackStage::Encode, &timer);
+
+            }
+        }
+
+    } else if (WAV_CHECK(dataU8)) {
+        drwav wav;
+        audioType = AudioType::wav;
+        record->inputFormat = "wav";
+        drwav_init_memory(&wav, data, fileSize, nullptr);
+        numChannels = wav.channels;
+        sampleRate = wav.sampleRate;
+        numFrames = wav.totalPCMFrameCount;
+        EndStage(record, PackStage::Decode, &timer);
+        if (numChannels == 2 || transcodeToOpus) {
+            ReserveDecodeMemory(&reservation, record, &timer, numFrames, numChannels, fileSize);
+        }
+
+        if (numChannels == 2) {
+            // Split the two channels
+
+            auto sampleData = std::make_unique<int16_t[]>(numFrames * numChannels);
+            int16_t* usedSampleData;
+            if (wav.translatedFormatTag == DR_WAVE_FORMAT_PCM && wav.bitsPerSample == 16) {
+                // If the data is known to be s16 we can just read the raw data directly from the file instead of copying it into our own buffers as long as we don't write to it.
+                // This data will be copied else where at some point before freeing the file
+                usedSampleData = (int16_t*)(wav.memoryStream.data + wav.memoryStream.currentReadPos);
+            }
+            else {
+                // Otherwise let drwav convert it to s16
+                drwav_read_pcm_frames_s16(&wav, numFrames, sampleData.get());
+                usedSampleData = sampleData.get();
+            }
+            EndStage(record, PackStage::Decode, &timer);
+
+            
+            // Allocated with `malloc` so `WriteWavData` can pass them on to the archive.
+            int16_t* sampleDataL = (int16_t*)malloc(numFrames * sizeof(int16_t));
+            int16_t* sampleDataR = (int16_t*)malloc(numFrames * sizeof(int16_t));
+            size_t pos = 0;
+            for (size_t i = 0; i < numFrames * numChannels - 1; i += 2, pos++) {
+                sampleDataL[pos] = usedSampleData[i];
+                sampleDataR[pos] = usedSampleData[i + 1];
+            }
+            EndStage(record, PackStage::Deinterleave, &timer);
+            if (!transcodeToOpus) {
+                WriteWavData(sampleDataL, sampleDataR, &infos, numFrames, sampleRate);
+            } else {
+                std::unique_ptr<float[]> channelDataF[2];
+                channelDataF[0] = std::make_unique<float[]>(numFrames);
+                channelDataF[1] = std::make_unique<float[]>(numFrames);
+                PcmS16ToF(channelDataF[0].get(), sampleDataL, numFrames);
+                PcmS16ToF(channelDataF[1].get(), sampleDataR, numFrames);
+                free(sampleDataL);
+                free(sampleDataR);
+                EndStage(record, PackStage::Convert, &timer);
+                SplitOggVorbis(&infos, channelDataF, &sampleRate, numFrames, fileSize, numChannels);
+                audioType = AudioType::ogg;
+            }
+            EndStage(record, PackStage::Encode, &timer);
+        }
+        else if (numChannels == 1) {
+            if (transcodeToOpus) {
+                audioType = AudioType::ogg;
+                std::unique_ptr<float[]> channelDataF[2]; // `SplitOggVorbis` wants an array so we will give it one but with one element initialized.
+                channelDataF[0] = std::make_unique<float[]>(numFrames);
+                if (wav.translatedFormatTag == DR_WAVE_FORMAT_PCM && wav.bitsPerSample == 16) {
+                    // Small optimization to avoid multiple copies
+                    PcmS16ToF(channelDataF[0].get(), (const int16_t*)(wav.memoryStream.data + wav.memoryStream.currentReadPos), numFrames);
+                    EndStage(record, PackStage::Convert, &timer);
+                }
+                else {
+                    drwav_read_pcm_frames_f32(&wav, numFrames, channelDataF[0].get());
+                    EndStage(record, PackStage::Decode, &timer);
+                }
+                SplitOggVorbis(&infos, channelDataF, &sampleRate, numFrames, fileSize, 1);
+                EndStage(record, PackStage::Encode, &timer);
+
+            }
+        }
+    } else if (FLAC_CHECK(dataU8)) {
+        audioType = AudioType::flac;
+        record->inputFormat = "flac";
+        drflac* flac = drflac_open_memory(data, fileSize, nullptr);
+        numChannels = flac->channels;
+        sampleRate = flac->sampleRate;
+        numFrames = flac->totalPCMFrameCount;
+        EndStage(record, PackStage::Decode, &timer);
+        if (numChannels == 2 || transcodeToOpus) {
+            ReserveDecodeMemory(&reservation, record, &timer, numFrames, numChannels, fileSize);
+        }
+        if (numChannels == 2) {
+            size_t pos = 0;
+            auto sampleData = std::make_unique<int16_t[]>(numFrames * numChannels);
+            // Allocated with `malloc` so `WriteWavData` can pass them on to the archive.
+            int16_t* sampleDataL = (int16_t*)malloc(numFrames * sizeof(int16_t));
+            int16_t* sampleDataR = (int16_t*)malloc(numFrames * sizeof(int16_t));
+
+            drflac_read_pcm_frames_s16(flac, numFrames, sampleData.get());
+            EndStage(record, PackStage::Decode, &timer);
+            for (size_t i = 0; i < numFrames * numChannels - 1; i += 2, pos++) {
+                sampleDataL[pos] = sampleData.get()[i];
+                sampleDataR[pos] = sampleData.get()[i + 1];
+            }
+            EndStage(record, PackStage::Deinterleave, &timer);
+            if (!transcodeToOpus) {
+                audioType = AudioType::wav;
+                WriteWavData(sampleDataL, sampleDataR, &infos, numFrames, sampleRate);
+            } else {
+                std::unique_ptr<float[]> channelDataF[2];
+                channelDataF[0] = std::make_unique<float[]>(numFrames);
+                channelDataF[1] = std::make_unique<float[]>(numFrames);
+                PcmS16ToF(channelDataF[0].get(), sampleDataL, numFrames);
+                PcmS16ToF(channelDataF[1].get(), sampleDataR, numFrames);
+                free(sampleDataL);
+                free(sampleDataR);
+                EndStage(record, PackStage::Convert, &timer);
+                SplitOggVorbis(&infos, channelDataF, &sampleRate, numFrames, fileSize, 2);
+                audioType = AudioType::ogg;
+            }
+            EndStage(record, PackStage::Encode, &timer);
+        }
+        else if (numChannels == 1) {
+            if (transcodeToOpus) {
+                audioType = AudioType::ogg;
+                std::unique_ptr<float[]> channelDataF[2]; // `SplitOggVorbis` wants an array so we will give it one but with one element initialized.
+                auto sampleData = std::make_unique<int16_t[]>(numFrames);
+                channelDataF[0] = std::make_unique<float[]>(numFrames);
+                drflac_read_pcm_frames_s16(flac, numFrames, sampleData.get());
+                EndStage(record, PackStage::Decode, &timer);
+                PcmS16ToF(channelDataF[0].get(), sampleData.get(), numFrames);
+                EndStage(record, PackStage::Convert, &timer);
+                SplitOggVorbis(&infos, channelDataF, &sampleRate, numFrames, fileSize, 1);
+                EndStage(record, PackStage::Encode, &timer);
+                
+            }
+        }
+        drflac_close(flac);
+    }
+    else if (OGG_CHECK(dataU8)) {
+        std::unique_ptr<float[]> channels[2];
+
+        audioType = AudioType::ogg;
+        OggVorbis_File vf;
+        OggFileData fileData = {
+            .data = data,
+            .pos = 0,
+            .size = (size_t)fileSize,
+        };
+        switch (GetOggType(&fileData)) {
+            case OggType::Vorbis: {
+                long read = 0;
+                size_t pos = 0;
+                record->inputFormat = "ogg vorbis";
+                if (const int ret = ov_open_callbacks(&fileData, &vf, nullptr, 0, cbs); ret < 0) {
+                    printf("Vorbisfile failed %d\n", ret);
+                    record->failed = true;
+                    continue;
+                }
+                vorbis_info* vi = ov_info(&vf, -1);
+
+                numFrames = ov_pcm_total(&vf, -1);
+                sampleRate = vi->rate;
+                numChannels = vi->channels;
+                if (numChannels == 2) {
+                    ReserveDecodeMemory(&reservation, record, &timer, numFrames, numChannels, fileSize);
+                    channels[0] = std::make_unique<float[]>(numFrames);
+                    channels[1] = std::make_unique<float[]>(numFrames);
+
+                    do {
+                        float** pcm;
+                        int bitStream;
+                        read = ov_read_float(&vf, &pcm, 4096, &bitStream);
+                        memcpy(&channels[0].get()[pos], pcm[0], read * sizeof(float));
+                        memcpy(&channels[1].get()[pos], pcm[1], read * sizeof(float));
+                        pos += read;
+                    } while (read > 0);
+                    EndStage(record, PackStage::Decode, &timer);
+                    SplitOggVorbis(&infos, channels, &sampleRate, numFrames, fileSize, numChannels);
+                    EndStage(record, PackStage::Encode, &timer);
+                }
+                break;
+            }
+            case OggType::Opus: {
+                record->inputFormat = "ogg opus";
+                // The decoder always outputs stereo.
+                ReserveDecodeMemory(&reservation, record, &timer, GetOggLastGranulePos(dataU8, fileSize), 2, fileSize);
+                DecodeOpusFile(&numChannels, &sampleRate, &numFrames, &fileData, channels);
+                EndStage(record, PackStage::Decode, &timer);
+                SplitOggVorbis(&infos, channels, &sampleRate, numFrames, fileSize, numChannels);
+                EndStage(record, PackStage::Encode, &timer);
+                break;
+            }
+            default:
+                printf("OGG file not Vorbis or OPUS\n");
+                record->failed = true;
+                continue;
+        }
+    }
+    else {
+        record->failed = true;
+        continue;
+    }
+    record->outputFormat = audioTypeToStr[audioType];
+    record->channels = numChannels;
+    record->sampleRate = sampleRate;
+    record->numFrames = numFrames;
+
+    std::unique_ptr<char[]> fontXmlPath;
+    if (numChannels == 2) {
+        CreateSampleXml(fileNames[0].get(), audioTypeToStr[audioType], numFrames, 1, &seqMetaMap->at(fileName), sampleRate, loopTimeInSamples, templates, &xmlBuf, a);
+        CopyChannelData(&infos, 0, fileNames[0].get(), a);
+
+        CreateSampleXml(fileNames[1].get(), audioTypeToStr[audioType], numFrames, 1, &seqMetaMap->at(fileName), sampleRate, loopTimeInSamples, templates, &xmlBuf, a);
+        CopyChannelData(&infos, 1, fileNames[1].get(), a);
+        fontXmlPath = CreateFontMultiXml(fileNames, fileName, sampleRate, templates, &xmlBuf, a);
+    } else {
+        CreateSampleXml(fileName, audioTypeToStr[audioType], numFrames, numChannels, &seqMetaMap->at(fileName), sampleRate, loopTimeInSamples, templates, &xmlBuf, a);
+        CopySampleData(input, fileName, true, fileSize, a);
+        fontXmlPath = CreateFontXml(fileName, sampleRate, numChannels, templates, &xmlBuf, a);
+    }
+    // There is no good way to determine the length of the song when we go to load it so we need to store the length in seconds.
+    float lengthF = (float)numFrames / (float)sampleRate;
+    lengthF = ceilf(lengthF);
+    unsigned int length = static_cast<unsigned int>(lengthF);
+    CreateSequenceXml(fileName, fontXmlPath.get(), length, seqMetaMap->at(fileName).fanfare, numChannels == 2, templates, &xmlBuf, a);
+    // Since the function that allocates the paths allocates them 2 byte aligned, we can use the lowest bit as a signal that this file has been processed.
+    uintptr_t inputU = reinterpret_cast<uintptr_t>(*inputp);
+    inputU |= 1;
+    *inputp= (char*)inputU;
+    }
+    sCurRecord = nullptr;
+}
+
+void ClearStreamedFileQueue(std::vector<char*>* fileQueue) {
+    for (auto f : *fileQueue) {
+        // The lowest bit of the path is set to 1 if the file has been processed. We need to undo that to delete it.
+        uintptr_t origPtr = (uintptr_t)f & (UINTPTR_MAX & (~(uintptr_t)1));
+        operator delete[]((void*)origPtr, std::align_val_t(2));
+    }
+    fileQueue->clear();
+}
+
+bool IsStreamedAudioFile(char* path) {
+    char* ext = strrchr(path, '.');
+    if (ext != nullptr) {
+        char newStr[8]{};
+        for (size_t i = 0; ext[i] != 0 && i < sizeof(newStr) - 1; i++) {
+            newStr[i] = (char)tolower(ext[i]);
+        }
+        if ((strcmp(newStr, ".wav") == 0 || strcmp(newStr, ".ogg") == 0 || strcmp(newStr, ".opus") == 0 || strcmp(newStr, ".mp3") == 0) || strcmp(newStr, ".flac") == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void FillSeqMetaMap(const std::vector<char*>& fileQueue, std::unordered_map<char*, SeqMetaInfo>& seqMetaMap) {
+    seqMetaMap.clear();
+    for (const auto f : fileQueue) {
+        char* fileName = strrchr(f, PATH_SEPARATOR);
+        fileName++;
+        seqMetaMap[fileName].fanfare = false;
+        seqMetaMap[fileName].loopStart.i = 0;
+        seqMetaMap[fileName].loopEnd.i = 0;
+    }
+}
+
+bool PackStreamedAudio(std::vector<char*>* fileQueue, std::unordered_map<char*, SeqMetaInfo>* seqMetaMap, bool loopTimeInSamples, bool transcodeToOpus,
+                       std::atomic<unsigned int>* filesProcessed, uint64_t memoryBudget, PackReport* report, Archive* a) {
+    // Parse the XML templates once for the whole job instead of once per song on every thread.
+    StreamedAudioTemplates templates;
+    if (!LoadStreamedAudioTemplates(&templates)) {
+        ShowErrorBox("XML Error", "Failed to load the XML templates. Make sure the assets folder is next to the program.");
+        return false;
+    }
+
+    if (report != nullptr) {
+        report->Start(fileQueue->size());
+    }
+    MemoryBudget budget(memoryBudget);
+    std::atomic<size_t> nextFile = 0;
+    const unsigned int numThreads = std::thread::hardware_concurrency();
+    auto packFileThreads = std::make_unique<std::thread[]>(numThreads);
+    for (unsigned int i = 0; i < numThreads; i++) {
+        packFileThreads[i] = std::thread(ProcessAudioFile, fileQueue, seqMetaMap, loopTimeInSamples, transcodeToOpus, &templates, &nextFile, filesProcessed,
+                                         memoryBudget != 0 ? &budget : nullptr, report, a);
+    }
+
+    for (unsigned int i = 0; i < numThreads; i++) {
+        packFileThreads[i].join();
+    }
+    if (report != nullptr) {
+        report->Finish();
+    }
+    return true;
+}
+
+void RemoveStreamedAudioEntries(const char* fileName, Archive* a) {
+    // Stereo songs are split into a left and right sample
+    static constexpr std::array<std::pair<const char*, const char*>, 9> entries = { {
+        { sampleDataBase, "" },
+        { sampleDataBase, "_L" },
+        { sampleDataBase, "_R" },
+        { sampleXmlBase, "_SAMPLE.xml" },
+        { sampleXmlBase, "_L_SAMPLE.xml" },
+        { sampleXmlBase, "_R_SAMPLE.xml" },
+        { fontXmlBase, "_FONT.xml" },
+        { seqXmlBase, "_SEQ.xml" },
+        { seqXmlBase, "_SEQ.xml_fanfare" },
+    } };
+    std::string path;
+    for (const auto& e : entries) {
+        path = e.first;
+        path += fileName;
+        path += e.second;
+        a->RemoveFile(path.c_str());
+    }
+}
+
+bool ApplyStreamedAudioChanges(const std::vector<DirChange>& changes, char* basePath, const std::unordered_map<std::string, SeqMetaInfo>& metaByName,
+                               bool loopTimeInSamples, bool transcodeToOpus, uint64_t memoryBudget, std::set<std::string>* names, Archive* a) {
+    std::vector<char*> fileQueue;
+    std::unordered_map<char*, SeqMetaInfo> seqMetaMap;
+    const size_t baseLen = strlen(basePath);
+    const bool addSeparator = baseLen != 0 && basePath[baseLen - 1] != '/' && basePath[baseLen - 1] != PATH_SEPARATOR;
+    bool changed = false;
+    bool rescan = false;
+
+    for (const DirChange& change : changes) {
+        // Only songs at the top of the directory are packed
+        if (change.isDir || change.path.find(PATH_SEPARATOR) != std::string::npos) {
+            rescan |= change.isDir && change.path.empty();
+            continue;
+        }
+        std::string name = change.path;
+        if (!IsStreamedAudioFile(name.data())) {
+            continue;
+        }
+        // A song that changed between mono and stereo, or stopped being a fanfare, has files with different names
+        RemoveStreamedAudioEntries(name.c_str(), a);
+        changed = true;
+        if (change.type == DirChangeType::Removed) {
+            names->erase(name);
+        } else {
+            names->insert(name);
+            const size_t sizeToAlloc = baseLen + name.size() + 2;
+            char* fullPath = (char*)operator new[](sizeToAlloc, std::align_val_t(2));
+            if (addSeparator) {
+                snprintf(fullPath, sizeToAlloc, "%s%c%s", basePath, PATH_SEPARATOR, name.c_str());
+            } else {
+                snprintf(fullPath, sizeToAlloc, "%s%s", basePath, name.c_str());
+            }
+            fileQueue.push_back(fullPath);
+        }
+    }
+    if (rescan) {
+        // Changes were lost so there is no telling which songs changed
+        ClearStreamedFileQueue(&fileQueue);
+        FillFileQueue(fileQueue, basePath, IsStreamedAudioFile);
+        std::set<std::string> found;
+        for (char* path : fileQueue) {
+            found.emplace(strrchr(path, PATH_SEPARATOR) + 1);
+        }
+        for (const std::string& name : *names) {
+            if (!found.contains(name)) {
+                RemoveStreamedAudioEntries(name.c_str(), a);
+            }
+        }
+        // Songs that are still there are packed again, and may have changed between mono and stereo
+        for (const std::string& name : found) {
+            RemoveStreamedAudioEntries(name.c_str(), a);
+        }
+        *names = std::move(found);
+        changed = true;
+    }
+    if (!changed) {
+        return true;
+    }
+
+    bool ret = true;
+    if (!fileQueue.empty()) {
+        FillSeqMetaMap(fileQueue, seqMetaMap);
+        for (auto& e : seqMetaMap) {
+            const auto it = metaByName.find(e.first);
+            if (it != metaByName.end()) {
+                e.second = it->second;
+            }
+        }
+        std::atomic<unsigned int> filesProcessed = 0;
+        ret = PackStreamedAudio(&fileQueue, &seqMetaMap, loopTimeInSamples, transcodeToOpus, &filesProcessed, memoryBudget, nullptr, a);
+        ClearStreamedFileQueue(&fileQueue);
+    }
+    return a->FlushArchive() && ret;
+}
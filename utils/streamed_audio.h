@@ -0,0 +1,68 @@
+#ifndef STREAMED_AUDIO_H
+#define STREAMED_AUDIO_H
+
+#include "archive.h"
+#include "xml_template.h"
+#include "pack_report.h"
+#include "dir_watcher.h"
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+typedef union IntFloat {
+    float f;
+    uint32_t i;
+} IntFloat;
+
+typedef struct SeqMetaInfo {
+    IntFloat loopStart;
+    IntFloat loopEnd;
+    bool fanfare;
+} SeqMetaInfo;
+
+// XML templates used for every packed song. Loaded once per job and shared by all worker threads.
+typedef struct StreamedAudioTemplates {
+    XmlTemplate sample;
+    XmlTemplate seq;
+    XmlTemplate font;
+    XmlTemplate fontMulti;
+} StreamedAudioTemplates;
+
+bool LoadStreamedAudioTemplates(StreamedAudioTemplates* templates);
+
+// Returns true if `path` has the extension of an audio file that can be packed.
+bool IsStreamedAudioFile(char* path);
+// Adds a default entry for each file in `fileQueue`. The map is keyed by the pointer to the file name in the path.
+void FillSeqMetaMap(const std::vector<char*>& fileQueue, std::unordered_map<char*, SeqMetaInfo>& seqMetaMap);
+// Frees the paths in `fileQueue`, including ones that have been marked as processed.
+void ClearStreamedFileQueue(std::vector<char*>* fileQueue);
+
+// Packs every file in `fileQueue` into `a` using all hardware threads. Blocks until all files are packed.
+// `filesProcessed` is incremented as files are picked up so it can be polled from another thread.
+// Processed paths have their lowest bit set. The queue must be freed with `ClearStreamedFileQueue`.
+// Workers wait before decoding a file if their buffers would take more than `memoryBudget` bytes in total. 0 means no limit.
+// If `report` isn't null it is filled with the timings and sizes of every file.
+bool PackStreamedAudio(std::vector<char*>* fileQueue, std::unordered_map<char*, SeqMetaInfo>* seqMetaMap, bool loopTimeInSamples, bool transcodeToOpus,
+                       std::atomic<unsigned int>* filesProcessed, uint64_t memoryBudget, PackReport* report, Archive* a);
+
+// Removes every file packing `fileName` adds to `a`, for both mono and stereo songs and fanfares.
+void RemoveStreamedAudioEntries(const char* fileName, Archive* a);
+// Packs again only the songs a `DirWatcher` reported as changed in the directory at `basePath`, and removes the ones
+// that were removed. Loop points and fanfares come from `metaByName`, keyed by file name. Songs that aren't in it get the
+// defaults. `names` has the file name of every song in the archive and is kept up to date. If changes were lost every
+// song is packed again and the ones that are gone are removed. The archive is flushed if anything changed.
+bool ApplyStreamedAudioChanges(const std::vector<DirChange>& changes, char* basePath, const std::unordered_map<std::string, SeqMetaInfo>& metaByName,
+                               bool loopTimeInSamples, bool transcodeToOpus, uint64_t memoryBudget, std::set<std::string>* names, Archive* a);
+
+// Write `data` to either the archive, or if the archive is null, a file on disk
+void WriteFileData(char* path, void* data, size_t size, Archive* a);
+// If the data comes from memory, `input` is used as the source buffer.
+std::unique_ptr<char[]> CopySampleData(char* input, char* fileName, bool fromDisk, size_t size, Archive* a);
+std::unique_ptr<char[]> CreateSampleXml(char* fileName, const char* audioType, uint64_t numFrames, uint64_t numChannels, SeqMetaInfo* info, uint64_t sampleRate, bool loopTimeInSamples,
+                                        const StreamedAudioTemplates* templates, XmlEmitBuffer* xmlBuf, Archive* a);
+
+#endif
@@ -0,0 +1,169 @@
+#include "xml_template.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+// Holes are marked in the printed document with this byte followed by the index of the hole + '0'.
+// tinyxml2 doesn't escape it and it can't show up in any of the templates.
+static constexpr char HOLE_MARKER = '\x01';
+
+bool XmlTemplate::Load(const char* path, const char* fallback, size_t fallbackSize) {
+    tinyxml2::XMLError e = mDoc.LoadFile(path);
+    if (e != tinyxml2::XML_SUCCESS) {
+        printf("Failed to open %s. Falling back to the embedded version...\n", path);
+        e = mDoc.Parse(fallback, fallbackSize);
+        if (e != tinyxml2::XML_SUCCESS) {
+            printf("Failed to parse embedded XML for %s\n", path);
+            return false;
+        }
+    }
+    return mDoc.RootElement() != nullptr;
+}
+
+tinyxml2::XMLElement* XmlTemplate::Root() {
+    return mDoc.RootElement();
+}
+
+size_t XmlTemplate::AddAttributeHole(tinyxml2::XMLElement* elem, const char* name) {
+    const size_t index = mDefaults.size();
+    const char* def = elem->Attribute(name);
+
+    mDefaults.emplace_back(def != nullptr ? def : "");
+
+    const char marker[3] = { HOLE_MARKER, (char)('0' + index), 0 };
+    elem->SetAttribute(name, marker);
+    return index;
+}
+
+void XmlTemplate::Compile() {
+    tinyxml2::XMLPrinter p;
+    mDoc.RootElement()->Accept(&p);
+    mText.assign(p.CStr(), p.CStrSize() - 1);
+    mDoc.Clear();
+
+    // The holes are printed in document order which isn't always the order they were added in.
+    // Keep track of which hole follows each segment.
+    mSegments.clear();
+    mHoleOrder.clear();
+    size_t start = 0;
+    for (size_t i = 0; i < mText.size(); i++) {
+        if (mText[i] == HOLE_MARKER) {
+            mSegments.push_back({ start, i - start });
+            mHoleOrder.push_back(mText[i + 1] - '0');
+            start = i + 2;
+            i++;
+        }
+    }
+    mSegments.push_back({ start, mText.size() - start });
+}
+
+const char* XmlTemplate::GetDefault(size_t i) const {
+    return mDefaults[i].c_str();
+}
+
+size_t XmlTemplate::GetNumHoles() const {
+    return mDefaults.size();
+}
+
+static size_t EscapedLen(const char* s) {
+    size_t len = 0;
+    for (; *s != 0; s++) {
+        switch (*s) {
+            case '&':
+                len += sizeof("&amp;") - 1;
+                break;
+            case '<':
+            case '>':
+                len += sizeof("&lt;") - 1;
+                break;
+            case '"':
+            case '\'':
+                len += sizeof("&quot;") - 1;
+                break;
+            default:
+                len++;
+                break;
+        }
+    }
+    return len;
+}
+
+static char* WriteEscaped(char* out, const char* s) {
+    for (; *s != 0; s++) {
+        const char* ent;
+        switch (*s) {
+            case '&':
+                ent = "&amp;";
+                break;
+            case '<':
+                ent = "&lt;";
+                break;
+            case '>':
+                ent = "&gt;";
+                break;
+            case '"':
+                ent = "&quot;";
+                break;
+            case '\'':
+                ent = "&apos;";
+                break;
+            default:
+                *out++ = *s;
+                continue;
+        }
+        size_t entLen = strlen(ent);
+        memcpy(out, ent, entLen);
+        out += entLen;
+    }
+    return out;
+}
+
+size_t XmlTemplate::Emit(char* out, size_t outSize, const char* const* values) const {
+    size_t total = 0;
+    for (const auto& s : mSegments) {
+        total += s.size;
+    }
+    for (size_t i = 0; i < mHoleOrder.size(); i++) {
+        total += EscapedLen(values[mHoleOrder[i]]);
+    }
+
+    if (total + 1 > outSize) {
+        return total;
+    }
+
+    char* pos = out;
+    for (size_t i = 0; i < mSegments.size(); i++) {
+        memcpy(pos, mText.data() + mSegments[i].offset, mSegments[i].size);
+        pos += mSegments[i].size;
+        if (i < mHoleOrder.size()) {
+            pos = WriteEscaped(pos, values[mHoleOrder[i]]);
+        }
+    }
+    *pos = 0;
+    return total;
+}
+
+XmlEmitBuffer::XmlEmitBuffer(size_t initialSize) {
+    mData = (char*)malloc(initialSize);
+    mSize = initialSize;
+}
+
+XmlEmitBuffer::~XmlEmitBuffer() {
+    free(mData);
+}
+
+size_t XmlEmitBuffer::Emit(const XmlTemplate& t, const char* const* values) {
+    size_t len = t.Emit(mData, mSize, values);
+    if (len + 1 > mSize) {
+        // Only happens for the first document that is larger than any before it.
+        free(mData);
+        mSize = len + 1;
+        mData = (char*)malloc(mSize);
+        t.Emit(mData, mSize, values);
+    }
+    return len;
+}
+
+char* XmlEmitBuffer::Data() const {
+    return mData;
+}
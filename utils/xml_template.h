@@ -0,0 +1,62 @@
+#ifndef XML_TEMPLATE_H
+#define XML_TEMPLATE_H
+
+#include <cstddef>
+#include <string>
+#include <vector>
+#include "tinyxml2.h"
+
+// An XML document that is parsed and printed once, with "holes" left where the per-file values go.
+// Emitting a document is then only copying the pre-printed text and the values into a buffer.
+// No DOM is built and nothing is allocated per document.
+//
+// Usage:
+// Load() the template, change the DOM through Root() and mark the attributes that change per file
+// with AddAttributeHole(). Compile() then prints the document and Emit() can be called from any thread.
+class XmlTemplate {
+public:
+    // Loads the template from `path`. If the file can't be opened `fallback` is parsed instead.
+    // Returns false if neither could be parsed.
+    bool Load(const char* path, const char* fallback, size_t fallbackSize);
+    tinyxml2::XMLElement* Root();
+    // Turns attribute `name` of `elem` into a hole, adding it if it doesn't exist. Returns the index of the hole.
+    // The attribute's value from the template file is kept as the hole's default.
+    size_t AddAttributeHole(tinyxml2::XMLElement* elem, const char* name);
+    // Prints the document and splits it at the holes. The DOM is freed afterwards.
+    void Compile();
+    // Value of hole `i` in the template file. Empty if the template didn't have the attribute.
+    const char* GetDefault(size_t i) const;
+    size_t GetNumHoles() const;
+    // Writes the document to `out` with `values[i]` escaped and placed in hole `i`. The output is null terminated.
+    // Returns the length of the full document, not including the terminator. Like `snprintf`, nothing
+    // is written past `outSize` so the return value can be used to check if `out` was large enough.
+    size_t Emit(char* out, size_t outSize, const char* const* values) const;
+private:
+    struct Segment {
+        size_t offset;
+        size_t size;
+    };
+    tinyxml2::XMLDocument mDoc;
+    std::string mText;
+    // Printed text between the holes. The last segment is the text after the last hole.
+    std::vector<Segment> mSegments;
+    // Index of the hole that follows each segment.
+    std::vector<size_t> mHoleOrder;
+    std::vector<std::string> mDefaults;
+};
+
+// Growable buffer for `XmlTemplate::Emit`. Each thread should own one so it only has to be
+// allocated when the first document is emitted, or if a document is larger than any before it.
+class XmlEmitBuffer {
+public:
+    XmlEmitBuffer(size_t initialSize = 4096);
+    ~XmlEmitBuffer();
+    // Emits `t` into the buffer. Returns the length of the document.
+    size_t Emit(const XmlTemplate& t, const char* const* values);
+    char* Data() const;
+private:
+    char* mData;
+    size_t mSize;
+};
+
+#endif
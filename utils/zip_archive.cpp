@@ -1,6 +1,10 @@
 #include "zip_archive.h"
 #include "zip.h"
 #include "filebox.h"
+#include <zlib.h>
+#include <algorithm>
+#include <climits>
+#include <cstdio>
 #include <cstring>
 #include <memory>
 ZipArchive::ZipArchive() {
@@ -13,24 +17,14 @@ ZipArchive::ZipArchive(const char* path) {
 
 ZipArchive::~ZipArchive() {
     CloseArchive();
-    for (const auto d : mCopiedData) {
-        free(d);
-    }
-
-    for (const auto m : mMemoryMaps) {
-#if defined _WIN32
-        UnmapFile(m.data, 0);
-#else
-        UnmapFile(m.data, m.size);
-#endif
-    }
-
+    FreeKeptData();
     files.clear();
     
 }
 
 bool ZipArchive::OpenArchive(const char *path) {
     int error;
+    mPath = path;
     mArchive = zip_open(path, ZIP_CHECKCONS | ZIP_CREATE, &error);
     if (mArchive == nullptr) {
         zip_error_t err;
@@ -90,6 +84,8 @@ void* ZipArchive::ReadFile(const char *filePath, size_t* readBytes) {
     if (!IsArchiveOpen()) {
         return nullptr;
     }
+    // File readers can be reading on other threads
+    std::lock_guard<std::mutex> lock(m);
     size_t fileSize = GetFileSize(filePath);
     void* data = malloc(fileSize);
 
@@ -114,12 +110,258 @@ size_t ZipArchive::GetFileSize(const char *path) const {
     return stat.size;
 }
 
+// Inflate state of a deflated file at some offset. Restarting from it only needs the compressed data after `compPos`.
+typedef struct InflateCheckpoint {
+    z_stream strm;
+    uint64_t pos;
+    uint64_t compPos;
+} InflateCheckpoint;
+
+// Deflated files keep at most this many checkpoints, each about 40 KiB, spaced at least this far apart
+static constexpr size_t INFLATE_MAX_CHECKPOINTS = 128;
+static constexpr uint64_t INFLATE_MIN_CHECKPOINT_SPACING = 1024 * 1024;
+
+// Stored files are read straight from the archive at any offset. Compressed files can only be read forward.
+// Deflated files are inflated here instead of by libzip so the inflate state can be saved every so often, and reading
+// before the current position restarts from the closest checkpoint instead of from the beginning. Files compressed any
+// other way are decompressed from the beginning again.
+// libzip can't read from two threads at once so reads hold the archive's lock.
+class ZipFileReader : public ArchiveFileReader {
+    public:
+    ZipFileReader(zip_t* archive, std::mutex* lock, zip_file_t* file, zip_uint64_t index, const zip_stat_t* stat, bool inflate) {
+        mArchive = archive;
+        mLock = lock;
+        mFile = file;
+        mIndex = index;
+        mSize = stat->size;
+        mSeekable = stat->comp_method == ZIP_CM_STORE && stat->encryption_method == ZIP_EM_NONE;
+        mInflate = inflate;
+        if (!mInflate) {
+            return;
+        }
+        mCheckpointSpacing = std::max<uint64_t>(INFLATE_MIN_CHECKPOINT_SPACING, mSize / INFLATE_MAX_CHECKPOINTS + 1);
+        mInBuf = std::make_unique<uint8_t[]>(INFLATE_IN_SIZE);
+        // Raw deflate data, there is no zlib header in a zip
+        if (inflateInit2(&mStrm, -MAX_WBITS) != Z_OK || !SaveCheckpoint()) {
+            // Let libzip decompress it instead
+            inflateEnd(&mStrm);
+            mInflate = false;
+            zip_fclose(mFile);
+            mFile = zip_fopen_index(mArchive, mIndex, 0);
+        }
+    }
+
+    ~ZipFileReader() override {
+        std::lock_guard<std::mutex> lock(*mLock);
+        if (mFile != nullptr) {
+            zip_fclose(mFile);
+        }
+        if (mInflate) {
+            inflateEnd(&mStrm);
+            for (const auto& cp : mCheckpoints) {
+                inflateEnd(&cp->strm);
+            }
+        }
+    }
+
+    size_t Read(uint64_t offset, void* out, size_t size) override {
+        if (offset >= mSize) {
+            return 0;
+        }
+        size = (size_t)std::min<uint64_t>(size, mSize - offset);
+        std::lock_guard<std::mutex> lock(*mLock);
+        if (mFile == nullptr || (offset != mPos && !Seek(offset))) {
+            return 0;
+        }
+        if (mInflate) {
+            return Inflate((uint8_t*)out, size);
+        }
+        const zip_int64_t bytesRead = zip_fread(mFile, out, size);
+        if (bytesRead <= 0) {
+            return 0;
+        }
+        mPos += bytesRead;
+        return (size_t)bytesRead;
+    }
+
+    uint64_t GetSize() const override {
+        return mSize;
+    }
+
+    private:
+    static constexpr size_t INFLATE_IN_SIZE = 16384;
+
+    bool Seek(uint64_t offset) {
+        if (mSeekable) {
+            if (zip_fseek(mFile, (zip_int64_t)offset, SEEK_SET) != 0) {
+                return false;
+            }
+            mPos = offset;
+            return true;
+        }
+
+        if (mInflate) {
+            // The last checkpoint at or before `offset`. The first one is at 0.
+            const auto it = std::upper_bound(mCheckpoints.begin(), mCheckpoints.end(), offset, [](uint64_t o, const auto& cp) {
+                return o < cp->pos;
+            });
+            const InflateCheckpoint* cp = (it - 1)->get();
+            if ((offset < mPos || cp->pos > mPos) && !RestoreCheckpoint(cp)) {
+                return false;
+            }
+        } else if (offset < mPos) {
+            zip_fclose(mFile);
+            mFile = zip_fopen_index(mArchive, mIndex, 0);
+            mPos = 0;
+            if (mFile == nullptr) {
+                return false;
+            }
+        }
+        uint8_t skipBuf[16384];
+        while (mPos < offset) {
+            const size_t toSkip = (size_t)std::min<uint64_t>(sizeof(skipBuf), offset - mPos);
+            if (mInflate) {
+                if (Inflate(skipBuf, toSkip) == 0) {
+                    return false;
+                }
+                continue;
+            }
+            const zip_int64_t bytesRead = zip_fread(mFile, skipBuf, toSkip);
+            if (bytesRead <= 0) {
+                return false;
+            }
+            mPos += bytesRead;
+        }
+        return true;
+    }
+
+    // Inflates up to `size` bytes at the current position, saving a checkpoint whenever it passes the next one.
+    size_t Inflate(uint8_t* out, size_t size) {
+        size_t done = 0;
+        while (done < size) {
+            const uint64_t nextCheckpoint = mCheckpoints.back()->pos + mCheckpointSpacing;
+            if (mPos == nextCheckpoint && !SaveCheckpoint()) {
+                break;
+            }
+            if (mStrm.avail_in == 0) {
+                const zip_int64_t bytesRead = zip_fread(mFile, mInBuf.get(), INFLATE_IN_SIZE);
+                if (bytesRead <= 0) {
+                    break;
+                }
+                mStrm.next_in = mInBuf.get();
+                mStrm.avail_in = (uInt)bytesRead;
+                mCompRead += bytesRead;
+            }
+            // Stop at the next checkpoint so it is saved at exactly that offset
+            const uInt want = (uInt)std::min<uint64_t>({ size - done, mCheckpoints.back()->pos + mCheckpointSpacing - mPos, UINT_MAX });
+            mStrm.next_out = out + done;
+            mStrm.avail_out = want;
+            const int ret = inflate(&mStrm, Z_NO_FLUSH);
+            const size_t produced = want - mStrm.avail_out;
+            done += produced;
+            mPos += produced;
+            if (ret != Z_OK && ret != Z_BUF_ERROR) {
+                break;
+            }
+        }
+        return done;
+    }
+
+    bool SaveCheckpoint() {
+        auto cp = std::make_unique<InflateCheckpoint>();
+        if (inflateCopy(&cp->strm, &mStrm) != Z_OK) {
+            return false;
+        }
+        cp->pos = mPos;
+        cp->compPos = mCompRead - mStrm.avail_in;
+        mCheckpoints.push_back(std::move(cp));
+        return true;
+    }
+
+    bool RestoreCheckpoint(const InflateCheckpoint* cp) {
+        inflateEnd(&mStrm);
+        // `inflateCopy` doesn't change its source, the const is missing from zlib's signature
+        if (inflateCopy(&mStrm, (z_stream*)&cp->strm) != Z_OK) {
+            return false;
+        }
+        mStrm.next_in = nullptr;
+        mStrm.avail_in = 0;
+        mPos = cp->pos;
+        mCompRead = cp->compPos;
+        if (zip_fseek(mFile, (zip_int64_t)cp->compPos, SEEK_SET) == 0) {
+            return true;
+        }
+        // Older versions of libzip can't seek in compressed data either, but reading past it is still cheaper than
+        // inflating it
+        zip_fclose(mFile);
+        mFile = zip_fopen_index(mArchive, mIndex, ZIP_FL_COMPRESSED);
+        if (mFile == nullptr) {
+            return false;
+        }
+        for (uint64_t skipped = 0; skipped < cp->compPos;) {
+            const zip_int64_t bytesRead = zip_fread(mFile, mInBuf.get(), std::min<uint64_t>(INFLATE_IN_SIZE, cp->compPos - skipped));
+            if (bytesRead <= 0) {
+                return false;
+            }
+            skipped += bytesRead;
+        }
+        return true;
+    }
+
+    zip_t* mArchive;
+    std::mutex* mLock;
+    zip_file_t* mFile;
+    zip_uint64_t mIndex;
+    uint64_t mSize;
+    uint64_t mPos = 0;
+    bool mSeekable;
+    bool mInflate;
+    z_stream mStrm{};
+    std::unique_ptr<uint8_t[]> mInBuf;
+    // Compressed bytes read from `mFile`
+    uint64_t mCompRead = 0;
+    uint64_t mCheckpointSpacing = 0;
+    // Sorted by offset. Each is only saved the first time its offset is reached.
+    // Pointers because zlib checks that a stream hasn't moved since it was set up.
+    std::vector<std::unique_ptr<InflateCheckpoint>> mCheckpoints;
+};
+
+std::unique_ptr<ArchiveFileReader> ZipArchive::OpenFileReader(const char* filePath) {
+    if (!IsArchiveOpen()) {
+        return nullptr;
+    }
+    std::lock_guard<std::mutex> lock(m);
+    const zip_int64_t index = zip_name_locate(mArchive, filePath, 0);
+    if (index < 0) {
+        return nullptr;
+    }
+    zip_stat_t stat;
+    zip_stat_init(&stat);
+    if (zip_stat_index(mArchive, index, 0, &stat) != 0) {
+        return nullptr;
+    }
+    // Deflated data is read as is and inflated by the reader, see `ZipFileReader`
+    const bool inflate = stat.comp_method == ZIP_CM_DEFLATE && stat.encryption_method == ZIP_EM_NONE;
+    zip_file_t* file = zip_fopen_index(mArchive, index, inflate ? ZIP_FL_COMPRESSED : 0);
+    if (file == nullptr) {
+        return nullptr;
+    }
+    return std::make_unique<ZipFileReader>(mArchive, &m, file, index, &stat, inflate);
+}
+
 void ZipArchive::GenFileList() {
     size_t numFiles = GetNumFiles();
     if (numFiles != 0) {
         files.reserve(numFiles);
+        fileSizes.reserve(numFiles);
+        fileStoredSizes.reserve(numFiles);
         for (zip_uint64_t i = 0; i < numFiles; i++) {
+            zip_stat_t stat;
+            zip_stat_init(&stat);
+            zip_stat_index(mArchive, i, ZIP_FL_ENC_GUESS, &stat);
             files.push_back(zip_get_name(mArchive, i, ZIP_FL_ENC_GUESS));
+            fileSizes.push_back((stat.valid & ZIP_STAT_SIZE) ? stat.size : 0);
+            fileStoredSizes.push_back((stat.valid & ZIP_STAT_COMP_SIZE) ? stat.comp_size : 0);
         }
     }
 }
@@ -140,6 +382,9 @@ void ZipArchive::CreateArchiveFromList(std::vector<char*>& list, char* pathBase)
 }
 
 void ZipArchive::RegisterProgressCallback(zip_progress_callback cb, void* callingClass) {
+    // Kept so the callback can be registered again when the archive is reopened by `FlushArchive`
+    mProgressCb = cb;
+    mProgressData = callingClass;
     zip_register_progress_callback_with_state(mArchive, 0.01, cb, nullptr, callingClass);
 }
 
@@ -155,10 +400,8 @@ void ZipArchive::WriteFile(char* path, const ArchiveDataInfo* data) {
     c.notify_one();
 }
 
-void ZipArchive::WriteFileUnlocked(char* path, const ArchiveDataInfo* data) {
-    zip_error_t err;
-    zip_source_t* source;
-
+// Returns a pointer to the data of `data` that stays valid until the archive is closed.
+void* ZipArchive::KeepData(const ArchiveDataInfo* data) {
     switch (data->mode) {
     case DataCopy: {
         // libzip requires the data given used to create the source data
@@ -168,21 +411,172 @@ void ZipArchive::WriteFileUnlocked(char* path, const ArchiveDataInfo* data) {
         void* copy = malloc(data->size);
 
         memcpy(copy, data->data, data->size);
-        source = zip_source_buffer_create(copy, data->size, 0, &err);
         mCopiedData.push_back(copy);
-        break;
+        return copy;
+    }
+    case DataOwned: {
+        // Same as above, but the caller gave up the buffer so there is no need to copy it.
+        mCopiedData.push_back(data->data);
+        return data->data;
     }
     case MMappedFile: {
         // To avoid copying file data we can create a memory map of a file to add.
         // We still must maintain a pointer to this data but it avoids copies.
         // We will also unmap these in the destructor.
-        source = zip_source_buffer_create(data->data, data->size, 0, &err);
-        
         mMemoryMaps.push_back(CREATE_MAPPED_INFO(data->data, data->size));
-        break;
+        return data->data;
+    }
+    }
+    return nullptr;
+}
+
+// Only safe once libzip no longer references the data, after the archive is closed.
+void ZipArchive::FreeKeptData() {
+    for (const auto d : mCopiedData) {
+        free(d);
     }
+    mCopiedData.clear();
+
+    for (const auto m : mMemoryMaps) {
+#if defined _WIN32
+        UnmapFile(m.data, 0);
+#else
+        UnmapFile(m.data, m.size);
+#endif
     }
+    mMemoryMaps.clear();
+}
 
+void ZipArchive::AddStoredFile(char* path, zip_source_t* source) {
     zip_int64_t rv = zip_file_add(mArchive, path, source, ZIP_FL_OVERWRITE | ZIP_FL_ENC_UTF_8);
+    if (rv < 0) {
+        zip_source_free(source);
+        return;
+    }
     zip_set_file_compression(mArchive, rv, ZIP_CM_STORE, 0);
-}
\ No newline at end of file
+}
+
+void ZipArchive::WriteFileUnlocked(char* path, const ArchiveDataInfo* data) {
+    zip_error_t err;
+    zip_source_t* source = zip_source_buffer_create(KeepData(data), data->size, 0, &err);
+
+    AddStoredFile(path, source);
+}
+
+// A source that reads several buffers back to back. libzip owns it once it is added and deletes it with
+// `ZIP_SOURCE_FREE`. The buffers themselves are kept by the archive until it is destroyed.
+typedef struct ZipSegmentSource {
+    std::vector<std::pair<const char*, size_t>> segments;
+    zip_uint64_t size;
+    size_t curSegment;
+    size_t curOffset;
+    zip_error_t error;
+} ZipSegmentSource;
+
+static zip_int64_t ZipSegmentSourceCallback(void* userdata, void* data, zip_uint64_t len, zip_source_cmd_t cmd) {
+    ZipSegmentSource* src = static_cast<ZipSegmentSource*>(userdata);
+
+    switch (cmd) {
+        case ZIP_SOURCE_OPEN:
+            src->curSegment = 0;
+            src->curOffset = 0;
+            return 0;
+        case ZIP_SOURCE_READ: {
+            zip_uint64_t read = 0;
+            while (read < len && src->curSegment < src->segments.size()) {
+                const auto& seg = src->segments[src->curSegment];
+                const size_t toRead = std::min<zip_uint64_t>(len - read, seg.second - src->curOffset);
+                memcpy((char*)data + read, seg.first + src->curOffset, toRead);
+                read += toRead;
+                src->curOffset += toRead;
+                if (src->curOffset == seg.second) {
+                    src->curSegment++;
+                    src->curOffset = 0;
+                }
+            }
+            return (zip_int64_t)read;
+        }
+        case ZIP_SOURCE_CLOSE:
+            return 0;
+        case ZIP_SOURCE_STAT: {
+            zip_stat_t* st = ZIP_SOURCE_GET_ARGS(zip_stat_t, data, len, &src->error);
+            if (st == nullptr) {
+                return -1;
+            }
+            zip_stat_init(st);
+            st->size = src->size;
+            st->valid |= ZIP_STAT_SIZE;
+            return sizeof(*st);
+        }
+        case ZIP_SOURCE_ERROR:
+            return zip_error_to_data(&src->error, data, len);
+        case ZIP_SOURCE_FREE:
+            zip_error_fini(&src->error);
+            delete src;
+            return 0;
+        case ZIP_SOURCE_SUPPORTS:
+            return zip_source_make_command_bitmap(ZIP_SOURCE_OPEN, ZIP_SOURCE_READ, ZIP_SOURCE_CLOSE, ZIP_SOURCE_STAT, ZIP_SOURCE_ERROR,
+                                                  ZIP_SOURCE_FREE, -1);
+        default:
+            zip_error_set(&src->error, ZIP_ER_OPNOTSUPP, 0);
+            return -1;
+    }
+}
+
+void ZipArchive::WriteFileSegments(char* path, const ArchiveDataInfo* segments, size_t numSegments) {
+    std::lock_guard<std::mutex> lock(m);
+    WriteFileSegmentsUnlocked(path, segments, numSegments);
+    c.notify_one();
+}
+
+void ZipArchive::WriteFileSegmentsUnlocked(char* path, const ArchiveDataInfo* segments, size_t numSegments) {
+    zip_error_t err;
+    ZipSegmentSource* src = new ZipSegmentSource;
+
+    src->size = 0;
+    src->curSegment = 0;
+    src->curOffset = 0;
+    zip_error_init(&src->error);
+    src->segments.reserve(numSegments);
+    for (size_t i = 0; i < numSegments; i++) {
+        src->segments.push_back({ (const char*)KeepData(&segments[i]), segments[i].size });
+        src->size += segments[i].size;
+    }
+
+    zip_source_t* source = zip_source_function_create(ZipSegmentSourceCallback, src, &err);
+    if (source == nullptr) {
+        zip_error_fini(&src->error);
+        delete src;
+        return;
+    }
+    AddStoredFile(path, source);
+}
+
+bool ZipArchive::RemoveFile(const char* path) {
+    std::lock_guard<std::mutex> lock(m);
+    const zip_int64_t index = zip_name_locate(mArchive, path, 0);
+    return index >= 0 && zip_delete(mArchive, (zip_uint64_t)index) == 0;
+}
+
+bool ZipArchive::FlushArchive() {
+    std::lock_guard<std::mutex> lock(m);
+    if (!IsArchiveOpen()) {
+        return false;
+    }
+    // If writing fails the archive stays open with its changes so they can be written by a later flush or close.
+    if (zip_close(mArchive) != 0) {
+        return false;
+    }
+    mArchive = nullptr;
+    FreeKeptData();
+
+    const std::string path = mPath;
+    OpenArchive(path.c_str());
+    if (!IsArchiveOpen()) {
+        return false;
+    }
+    if (mProgressCb != nullptr) {
+        zip_register_progress_callback_with_state(mArchive, 0.01, mProgressCb, nullptr, mProgressData);
+    }
+    return true;
+}
@@ -5,6 +5,7 @@
 #include "stdlib.h"
 #include "zip.h"
 #include "mio.hpp"
+#include <string>
 
 typedef struct MappedFileInfo {
     void* data;
@@ -33,16 +34,28 @@ public:
     //void ReadFile(const char* filePath, void** outBuffer) override;
 
     size_t GetFileSize(const char* path) const override;
+    std::unique_ptr<ArchiveFileReader> OpenFileReader(const char* filePath) override;
     void GenFileList() override;
     void CreateArchiveFromList(std::vector<char*>& list, char* basePath) override;
     void RegisterProgressCallback(zip_progress_callback cb, void* callingClass);
 
     void WriteFile(char* path, const ArchiveDataInfo* data) override;
     void WriteFileUnlocked(char* path, const ArchiveDataInfo* data) override;
+    void WriteFileSegments(char* path, const ArchiveDataInfo* segments, size_t numSegments) override;
+    void WriteFileSegmentsUnlocked(char* path, const ArchiveDataInfo* segments, size_t numSegments) override;
+    bool RemoveFile(const char* path) override;
+    // libzip only writes the archive when it is closed so this closes it and opens it again.
+    bool FlushArchive() override;
 private:
+    void* KeepData(const ArchiveDataInfo* data);
+    void FreeKeptData();
+    void AddStoredFile(char* path, zip_source_t* source);
     std::vector<void*> mCopiedData;
     std::vector<MappedFileInfo> mMemoryMaps;
     zip_t* mArchive = nullptr;
+    std::string mPath;
+    zip_progress_callback mProgressCb = nullptr;
+    void* mProgressData = nullptr;
 
 };
 
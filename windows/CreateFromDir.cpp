@@ -3,10 +3,10 @@
 #include "imgui_internal.h"
 #include "WindowMgr.h"
 #include "filebox.h"
-#include "zip_archive.h"
-#include "mpq_archive.h"
+#include "archive.h"
+#include "VirtualTable.h"
 #include <string.h>
-#include <filesystem>
+#include <chrono>
 
 CreateFromDirWindow::CreateFromDirWindow()
 {
@@ -14,11 +14,22 @@ CreateFromDirWindow::CreateFromDirWindow()
 
 CreateFromDirWindow::~CreateFromDirWindow()
 {
+    mScanner.Cancel();
+    mWatcher.Stop();
+    if (mAddFileThread.joinable()) {
+        mAddFileThread.join();
+    }
     ClearPathBuff();
     ClearSaveBuff();
+    ClearFileQueue();
+}
+
+void CreateFromDirWindow::ClearFileQueue()
+{
     for (auto p : mFileQueue) {
-        delete p;
+        delete[] p;
     }
+    mFileQueue.clear();
 }
 
 void CreateFromDirWindow::ClearPathBuff()
@@ -37,33 +48,46 @@ void CreateFromDirWindow::ClearSaveBuff()
     }
 }
 
-static void CallBack(zip_t* archive, double progress, void* data) {
-    CreateFromDirWindow* thisx = (CreateFromDirWindow*)data;
-    thisx->mProgress = progress;
-}
-
 static void AddFilesWorker(CreateFromDirWindow* thisx) {
     thisx->mThreadIsDone = false;
     thisx->mThreadStarted = true;
 
-    Archive* a;
-    switch (thisx->mRadioState) {
-        case 0: {
-            a = new MpqArchive(thisx->mSavePath);
-            break;
-        }
-        case 1: {
-            a = new ZipArchive(thisx->mSavePath);
-            ZipArchive* za = (ZipArchive*)a;
-            za->RegisterProgressCallback(CallBack, thisx);
-            break;
+    const std::vector<std::string> ignorePatterns = thisx->GetIgnorePatterns();
+    std::set<std::string> names;
+    const bool watch = thisx->mWatcher.IsWatching();
+    if (watch) {
+        names = GetDirPackNames(thisx->mFileQueue, thisx->mPathBuff);
+    }
+
+    // Write only archives write each file as soon as it is read so the read ahead is all that is kept in memory
+    const ArchiveType type = thisx->mRadioState == 0 ? ArchiveType::OTR : ArchiveType::O2R;
+    std::unique_ptr<Archive> a = CreateWriteOnlyArchiveOfType(type, thisx->mSavePath);
+    if (a != nullptr && a->IsArchiveOpen()) {
+        PackDirectory(&thisx->mFileQueue, thisx->mPathBuff, a.get(), DIR_PACK_READ_AHEAD, DIR_PACK_MAX_OPEN_FILES,
+                      &thisx->mPackProgress);
+        if (watch) {
+            thisx->mNumUpdates = 0;
+            thisx->mNumFailedUpdates = a->FlushArchive() ? 0 : 1;
+            thisx->mWatching = true;
+            std::vector<DirChange> changes;
+            while (thisx->mWatcher.WaitForChanges(&changes)) {
+                const auto start = std::chrono::steady_clock::now();
+                const bool updated = ApplyDirChanges(changes, thisx->mPathBuff, ignorePatterns, a.get(), &names, &thisx->mPackProgress);
+                const auto time = std::chrono::steady_clock::now() - start;
+                if (updated) {
+                    thisx->mLastUpdateMs = (unsigned int)std::chrono::duration_cast<std::chrono::milliseconds>(time).count();
+                    thisx->mNumUpdates++;
+                } else {
+                    thisx->mNumFailedUpdates++;
+                }
+                changes.clear();
+            }
+            thisx->mWatching = false;
         }
+        a->CloseArchive();
     }
+    thisx->mWatcher.Stop();
 
-    a->CreateArchiveFromList(thisx->mFileQueue, thisx->mPathBuff);
-    a->CloseArchive();
-    delete a;
-    
     thisx->mThreadIsDone = true;
     thisx->mThreadStarted = false;
 }
@@ -104,6 +128,13 @@ void CreateFromDirWindow::DrawWindow()
         ImGui::SameLine();
         ImGui::Text("Path to Pack: %s", mPathBuff);
     }
+    ImGui::SetNextItemWidth(ImGui::CalcTextSize("0").x * 40.0f);
+    ImGui::InputTextWithHint("Ignore", "*.tmp;.git", mIgnoreBuf, sizeof(mIgnoreBuf));
+    ImGui::SetItemTooltip("Files and directories to leave out, separated by ';'. Use * and ? for globs.\nPatterns with a separator are matched against the path from the selected directory.");
+    // Scan again with the new patterns
+    if (ImGui::IsItemDeactivatedAfterEdit() && mPathBuff != nullptr && mPathBuff[0] != 0) {
+        FillFileQueue();
+    }
     if (ImGui::Button("Set Save Path")) {
         GetSaveFilePath(&mSavePath);
     }
@@ -114,17 +145,60 @@ void CreateFromDirWindow::DrawWindow()
     }
 
 
-    if (!mFileQueue.empty() && mPathBuff != nullptr && mSavePath != nullptr) {
+    if (!mFileQueue.empty() && !mScanning && mPathBuff != nullptr && mSavePath != nullptr) {
         if (ImGui::Button("Pack Archive")) {
+            if (mAddFileThread.joinable()) {
+                mAddFileThread.join();
+            }
+            // Started before packing so files that change while packing aren't missed
+            if (mWatch && !mWatcher.Start(mPathBuff, GetIgnorePatterns())) {
+                ShowErrorBox("Error", "Failed to watch the directory for changes. The files will only be packed once.");
+            }
+            mThreadStarted = true;
             mAddFileThread = std::thread(AddFilesWorker, this);
-            mAddFileThread.detach();
+        }
+        if (DIR_WATCH_SUPPORTED) {
+            ImGui::SameLine();
+            ImGui::Checkbox("Watch for changes", &mWatch);
+            ImGui::SetItemTooltip("Keep running after packing and update only the files that change in the directory.");
         }
     }
 
     ImGui::EndDisabled();
-    
-    if (mThreadStarted) {
-        ImGui::Text("Packing archive. Progress: %.0f %%", mProgress * 100.0);
+
+    if (mWatching) {
+        ImGui::Text("Watching %s for changes. Updated %u times, the last took %u ms.", mPathBuff, mNumUpdates.load(), mLastUpdateMs.load());
+        if (mNumFailedUpdates != 0) {
+            ImGui::Text("%u updates failed. %s may be missing files that changed.", mNumFailedUpdates.load(), mSavePath);
+        }
+        if (ImGui::Button("Stop Watching")) {
+            mWatcher.Stop();
+        }
+    } else if (mThreadStarted) {
+        double fraction;
+        double secondsLeft;
+        GetDirPackEstimate(&mPackProgress, &fraction, &secondsLeft);
+        ImGui::Text("Packing archive. Progress: %.0f %% (%.1f MiB)", fraction * 100.0,
+                    mPackProgress.bytesWritten.load() / (1024.0 * 1024.0));
+        if (secondsLeft >= 0.0) {
+            ImGui::SameLine();
+            ImGui::Text("About %.0f seconds left", secondsLeft);
+        }
+        ImGui::ProgressBar((float)fraction);
+    } else if (mThreadIsDone && mPackProgress.numFailed != 0) {
+        ImGui::Text("%u files couldn't be read and were skipped", mPackProgress.numFailed.load());
+    }
+
+    if (mScanning) {
+        // Check before taking the files so the last batch isn't missed
+        const bool done = mScanner.IsDone();
+        mScanner.TakeFiles(&mFileQueue);
+        mScanning = !done;
+    }
+    if (mScanning) {
+        ImGui::Text("Finding files... %zu found", mScanner.GetNumFound());
+    } else if (mScanner.GetNumErrors() != 0) {
+        ImGui::Text("%zu directories couldn't be read. Their files were skipped.", mScanner.GetNumErrors());
     }
 
     DrawPendingFilesList();
@@ -135,127 +209,55 @@ void CreateFromDirWindow::DrawWindow()
 }
 
 void CreateFromDirWindow::DrawPendingFilesList() {
-    if (mFileQueue.empty()) {
+    // The packer empties the queue when it is done
+    if (mFileQueue.empty() || mThreadStarted) {
         return;
     }
 
-    const ImVec2 cursorPos = ImGui::GetCursorPos();
-    const ImVec2 windowSize = ImGui::GetWindowSize();
-    const ImVec2 childWindowSize = { windowSize.x - cursorPos.x, windowSize.y - cursorPos.y };
-
-    ImGui::BeginChild("File List", childWindowSize, 0, 0);
     ImGui::TextUnformatted("Files to Pack:");
-    const float windowHeight = ImGui::GetWindowHeight();
-    const float textHeight = ImGui::GetTextLineHeight();
-
-    for (const auto s:  mFileQueue) {
-        const float scroll = ImGui::GetScrollY();
-        const float cursorPosY = ImGui::GetCursorPosY();
+    static constexpr VirtualTableColumn columns[] = { { nullptr, 0.0f } };
 
-        // Only draw elements that are on screen. This gives around 20x performance improvement.
-        if ((cursorPosY < scroll) || (cursorPosY > (scroll + windowHeight))) {
-            ImGui::NewLine();
-            continue;
-        }
-        char* fileName = strrchr(s, PATH_SEPARATOR);
-        fileName++;
-        ImGui::Text("%s", fileName);
-    }
-    ImGui::EndChild();
+    DrawVirtualTable("File List", columns, 1, mFileQueue.size(), ImGuiTableFlags_ScrollY, {}, [this](size_t i) {
+        const char* fileName = strrchr(mFileQueue[i], PATH_SEPARATOR);
+        fileName = fileName != nullptr ? fileName + 1 : mFileQueue[i];
+        ImGui::TextUnformatted(fileName);
+    });
 }
 
-static void FillFileQueueImpl(std::vector<char*>& files, char* startPath, int);
-
 void CreateFromDirWindow::FillFileQueue()
 {
-    FillFileQueueImpl(mFileQueue, mPathBuff, 0);
+    mScanner.Cancel();
+    ClearFileQueue();
+    mScanning = false;
+    if (mPathBuff == nullptr || mPathBuff[0] == 0) {
+        return;
+    }
+    mScanner.Start(mPathBuff, GetIgnorePatterns());
+    mScanning = true;
 }
 
-static void FillFileQueueImpl(std::vector<char*>& files, char* startPath, int newPathLen) {
-    std::filesystem::recursive_directory_iterator it(startPath);
-    for (const auto& i : it) {
-        if (!i.is_directory()) {
-            files.push_back(strdup(i.path().string().c_str()));
+std::vector<std::string> CreateFromDirWindow::GetIgnorePatterns() const
+{
+    std::vector<std::string> ignorePatterns;
+    const char* start = mIgnoreBuf;
+    while (*start != 0) {
+        const char* end = strchr(start, ';');
+        if (end == nullptr) {
+            end = start + strlen(start);
         }
-    }
-#if 0 // vv This doesn't work... I give up for now...
-#if defined (_WIN32)
-    WIN32_FIND_DATAA ffd;
-    char buffer[MAX_PATH];
-    strncpy_s(buffer, startPath, MAX_PATH);
-    PathAppendA(buffer, "*");
-
-    HANDLE h = FindFirstFileA(buffer, &ffd);
-
-    do {
-        // Skip '.' and '..'
-        if (ffd.cFileName[0] == '.' && ffd.cFileName[1] == 0 || (ffd.cFileName[1] == '.' && ffd.cFileName[2] == 0)) {
-            continue;
-        } else if (ffd.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) {
-            char innerPath[MAX_PATH];
-            strncpy_s(innerPath, startPath, MAX_PATH);
-            PathAppendA(innerPath, ffd.cFileName);
-            FillFileQueueImpl(files, innerPath);
-        } else {
-            size_t len = strlen(ffd.cFileName);
-            // Start path is used because FindNextFile chokes on the path if it has a '*' in it which `buffer` does
-            size_t len2 = strlen(startPath);
-
-            char* str = new char[len + len2 + 2]; // Don't change. Prevents overflows
-            memset(str, 0, len + len2 + 1);
-            PathAppendA(str, startPath);
-            PathAppendA(str, ffd.cFileName);
-            files.push_back((str));
+        // Spaces around the separators aren't part of the patterns
+        const char* first = start;
+        const char* last = end;
+        while (first < last && *first == ' ') {
+            first++;
         }
-    } while (FindNextFileA(h, &ffd) != 0);
-    FindClose(h);
-#elif defined(__linux__) || defined(__APPLE__)
-    //I give up...
-    size_t basePathLen = strlen(startPath);
-    char buffer[PATH_MAX];
-    strncpy(buffer, startPath, PATH_MAX);
-    strncat(buffer, "/", PATH_MAX - 1);
-    DIR* d = opendir(startPath);
-
-    struct dirent* dir;
-
-    if (d != nullptr) {
-        while((dir = readdir(d)) != nullptr) {
-            if ((dir->d_name[0] == '.' && dir->d_name[1] == 0) || (dir->d_name[0] == '.' && dir->d_name[1] == '.')) {
-                    continue;
-            } 
-            char innerPath[PATH_MAX];
-            struct stat path;
-            strncpy(innerPath, buffer, PATH_MAX);
-            strncat(innerPath, dir->d_name, PATH_MAX);
-            int ret = stat(innerPath, &path);
-            if (S_ISDIR(path.st_mode)) {
-                    //char innerPath[PATH_MAX];
-                    size_t len = strlen(innerPath);
-                    size_t len2 = strlen(dir->d_name);
-                    //strncpy(innerPath, buffer, PATH_MAX);
-                    //innerPath[len] = '/';
-                    //strncat(innerPath, dir->d_name, PATH_MAX - (len + len2));
-                    //innerPath[len+len2 + 1] = '/';
-                    //innerPath[len+len2 + 2] = 0;
-                    FillFileQueueImpl(files, innerPath, len2);
-                
-            } else {
-                size_t len = strlen(innerPath);
-                char* path = new char[len + 2];
-                strncpy(path, innerPath, PATH_MAX);
-                //strncat(path, dir->d_name, PATH_MAX - (len + len2));
-                files.push_back(path);
-                // Clear out the last file name but leave the folder path.
-                // We could make another buffer and copy everything but the file
-                // But we can't afford the stack space.
-                innerPath[len + 1] = 0;
-            }
+        while (last > first && last[-1] == ' ') {
+            last--;
         }
+        if (first != last) {
+            ignorePatterns.emplace_back(first, last);
+        }
+        start = *end != 0 ? end + 1 : end;
     }
-    // Same as above but this time clear out everything before the base path
-    //buffer[basePathLen - newPathLen] = 0;
-    closedir(d);
-#endif
-#endif
-}
\ No newline at end of file
+    return ignorePatterns;
+}
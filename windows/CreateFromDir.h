@@ -2,6 +2,10 @@
 #define CREATE_FROM_DIR_H
 
 #include "WindowBase.h"
+#include "dir_scanner.h"
+#include "dir_packer.h"
+#include "dir_watcher.h"
+#include <atomic>
 #include <vector>
 #include <memory>
 #include <thread>
@@ -12,19 +16,34 @@ public:
     ~CreateFromDirWindow();
     void DrawWindow() override;
     void FillFileQueue();
+    std::vector<std::string> GetIgnorePatterns() const;
 
     std::vector<char*> mFileQueue;
     std::thread mAddFileThread;
     char* mPathBuff = nullptr;
     char* mSavePath = nullptr;
-    double mProgress = 0.0;
+    // Fills `mFileQueue` in the background after a directory is selected
+    DirScanner mScanner;
+    // Patterns of files and directories to skip, separated by ';'
+    char mIgnoreBuf[256] = {};
+    DirPackProgress mPackProgress = {};
+    // Keeps the archive up to date after it is packed when `mWatch` is set
+    DirWatcher mWatcher;
+    std::atomic<bool> mWatching = false;
+    std::atomic<unsigned int> mNumUpdates = 0;
+    // Batches of changes that couldn't be read or written to the archive
+    std::atomic<unsigned int> mNumFailedUpdates = 0;
+    std::atomic<unsigned int> mLastUpdateMs = 0;
+    bool mWatch = false;
     bool mThreadIsDone = false;
     bool mThreadStarted = false;
+    bool mScanning = false;
     int mRadioState = 0;
 private:
     void DrawPendingFilesList();
     void ClearPathBuff();
     void ClearSaveBuff();
+    void ClearFileQueue();
 };
 
 #endif
@@ -4,12 +4,8 @@
 #include "WindowBase.h"
 #include <vector>
 #include <cstdint>
+#include "sequenced_audio.h"
 
-typedef enum CheckState : uint8_t {
-    Unchecked,
-    Good,
-    Bad,
-} CheckState;
 class CustomSequencedAudioWindow : public WindowBase {
 public:
     CustomSequencedAudioWindow();
@@ -32,8 +28,6 @@ private:
     int mRadioState = 2;
     bool mThreadStarted = false;
     bool mThreadIsDone = false;
-    bool mMMRSThreadStarted = false;
-    bool mMMRSThreadIsDone = false;
     bool mPackAsArchive = false;
     CheckState pairCheckState = CheckState::Unchecked;
 };
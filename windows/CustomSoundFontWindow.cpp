@@ -7,12 +7,15 @@
 #include "imgui_internal.h"
 #include "filebox.h"
 #include "mio.hpp"
+#include "tinyxml2.h"
 #include "zip_archive.h"
 #include "mpq_archive.h"
-#include "CustomStreamedAudio.h"
+#include "streamed_audio.h"
 #include "dr_mp3.h"
 #include "dr_wav.h"
 #include "dr_flac.h"
+#include "archive.h"
+#include "VirtualTable.h"
 
 // 'ID3' as a string
 #define MP3_ID3_CHECK(d) ((d[0] == 'I') && (d[1] == 'D') && (d[2] == '3'))
@@ -26,28 +29,18 @@
 
 #define OGG_CHECK(d) ((d[0] == 'O') && (d[1] == 'g') && (d[2] == 'g') && (d[3] == 'S'))
 
-static void DrawSample(const char* type, ZSample* sample, bool* modified);
-
-#define TAG_SIZE(n) (sizeof(n) + sizeof(void*)*2)
-
-// strup but using `new` for compatibility with the file box API
-static const char* StrDupNew(const char* orig) {
-    if (orig == nullptr) {
-        return nullptr;
-    }
-    size_t len = strlen(orig);
-    const char* newStr = new char[len + 1];
-    memset(const_cast<char*>(newStr), 0, len);
-    strcpy(const_cast<char*>(newStr), orig);
-    return newStr;
-}
+static void DrawSample(const char* type, ZSample* sample, Arena* arena, bool* modified);
 
 CustomSoundFontWindow::CustomSoundFontWindow() {
 }
 
 CustomSoundFontWindow::~CustomSoundFontWindow() {
+    if (mSaveThread.joinable()) {
+        mSaveThread.join();
+    }
+    delete[] mSavePath;
     ClearPathBuff();
-    ClearSoundFont();
+    ClearSoundFont(&mSoundFont);
 }
 
 void CustomSoundFontWindow::ClearPathBuff() {
@@ -72,19 +65,21 @@ void CustomSoundFontWindow::DrawWindow() {
     ImGui::SeparatorEx(ImGuiSeparatorFlags_Horizontal, 3.0f);
 
 
+    // The soundfont is read by the save thread so it can't be changed until the save is done
+    const bool saving = mSaving;
+    ImGui::BeginDisabled(saving);
     if (ImGui::Button("Select Soundfont XML")) {
         sfParsed = false;
         ClearPathBuff();
-        GetOpenFilePath(&mPathBuff, FileBoxType::Max);
-        mDoc.LoadFile(mPathBuff);
-        if (!mDoc.Error()) {
-            ParseSoundFont();
-            sfParsed = true;
+        mParseError[0] = 0;
+        if (GetOpenFilePath(&mPathBuff, FileBoxType::Max)) {
+            sfParsed = ParseSoundFont(mPathBuff, &mSoundFont, mParseError, sizeof(mParseError));
         }
     }
 
-    if (mDoc.Error()) {
-        ImGui::Text("XML Error tinyxml returned: %s", mDoc.ErrorStr());
+    if (mParseError[0] != 0) {
+        ImGui::Text("XML Error: %s", mParseError);
+        ImGui::EndDisabled();
         goto end;
     }
 
@@ -98,6 +93,18 @@ void CustomSoundFontWindow::DrawWindow() {
         ImGui::SetItemTooltip("Only save instruments, drums, and SFX that are modified.\nRecommended for compatability with other packs.");
         ImGui::SameLine();
         ImGui::Checkbox("##patchonly", &mExportPatchOnly);
+        ImGui::EndDisabled();
+        if (saving) {
+            ImGui::SameLine();
+            ImGui::Text("Saving. Imported %u of %zu samples", mSamplesImported.load(), mImports.size());
+        } else if (mSaveError != nullptr) {
+            ImGui::SameLine();
+            ImGui::Text("Save failed: %s", mSaveError.load());
+        } else if (mSamplesFailed != 0) {
+            ImGui::SameLine();
+            ImGui::Text("%u samples could not be imported and were left out", mSamplesFailed.load());
+        }
+        ImGui::BeginDisabled(saving);
 
         char* sfStr = strrchr(mPathBuff, PATH_SEPARATOR);
         if (sfStr == nullptr) {
@@ -118,137 +125,11 @@ void CustomSoundFontWindow::DrawWindow() {
             DrawSfxTbl(mSfLocked);
         }
     }
+    ImGui::EndDisabled();
 end:
     ImGui::End();
 }
 
-void CustomSoundFontWindow::ParseSoundFont() {
-    tinyxml2::XMLElement *root = mDoc.FirstChildElement("SoundFont");
-    mSoundFont.medium = StrDupNew(root->Attribute("Medium"));
-    mSoundFont.cachePolicy = StrDupNew(root->Attribute("CachePolicy"));
-    mSoundFont.version = root->UnsignedAttribute("Version");
-    mSoundFont.index = root->UnsignedAttribute("Num");
-    mSoundFont.data1 = root->UnsignedAttribute("Data1");
-    mSoundFont.data2 = root->UnsignedAttribute("Data2");
-    mSoundFont.data3 = root->UnsignedAttribute("Data3");
-
-    tinyxml2::XMLElement *child = root->FirstChildElement();
-    while (child != nullptr) {
-        const char *elemName = child->Name();
-        if (strcmp(elemName, "Drums") == 0) {
-            ParseDrums(child);
-        } else if (strcmp(elemName, "Instruments") == 0) {
-            ParseInstruments(child);
-        } else if (strcmp(elemName, "SfxTable") == 0) {
-            ParseSfxTbl(child);
-        }
-        child = child->NextSiblingElement();
-    }
-}
-
-uint8_t CustomSoundFontWindow::ParseEnvelopes(tinyxml2::XMLElement* envsELem, ZEnvelope** envs) {
-    unsigned int numEnvelopes = envsELem->UnsignedAttribute("Count");
-    *envs = new ZEnvelope[numEnvelopes];
-    tinyxml2::XMLElement* envelope = envsELem->FirstChildElement("Envelope");
-    unsigned int i = 0;
-    while (envelope != nullptr) {
-        (*envs)[i].delay = envelope->UnsignedAttribute("Delay");
-        (*envs)[i].arg = envelope->UnsignedAttribute("Arg");
-        envelope = envelope->NextSiblingElement("Envelope");
-        i++;
-    }
-    return i;
-}
-
-void CustomSoundFontWindow::ParseDrums(tinyxml2::XMLElement* drumsElem) {
-    mSoundFont.numDrums = drumsElem->UnsignedAttribute("Count");
-    mSoundFont.drums = new ZDrum[mSoundFont.numDrums];
-    tinyxml2::XMLElement* drum = drumsElem->FirstChildElement("Drum");
-    unsigned int i = 0;
-    while (drum != nullptr) {
-        mSoundFont.drums[i].releaseRate = drum->UnsignedAttribute("ReleaseRate");
-        mSoundFont.drums[i].pan = drum->UnsignedAttribute("Pan");
-        mSoundFont.drums[i].sample.tuning = drum->FloatAttribute("Tuning");
-        mSoundFont.drums[i].sample.path = StrDupNew(drum->Attribute("SampleRef"));
-        tinyxml2::XMLElement* envs = drum->FirstChildElement("Envelopes");
-        mSoundFont.drums[i].numEnvelopes = ParseEnvelopes(envs, &mSoundFont.drums[i].envs);
-        drum = drum->NextSiblingElement("Drum");
-        i++;
-    }
-    // return true;
-}
-
-void CustomSoundFontWindow::ParseInstruments(tinyxml2::XMLElement* instrumentsElem) {
-    mSoundFont.numInstruments = instrumentsElem->UnsignedAttribute("Count");
-    mSoundFont.instruments = new ZInstrument[mSoundFont.numInstruments];
-    tinyxml2::XMLElement* instrument = instrumentsElem->FirstChildElement("Instrument");
-    unsigned int i = 0;
-    while (instrument != nullptr) {
-        mSoundFont.instruments[i].isValid = instrument->BoolAttribute("IsValid");
-        mSoundFont.instruments[i].normalRangeLo = instrument->UnsignedAttribute("NormalRangeLo");
-        mSoundFont.instruments[i].normalRangeHi = instrument->UnsignedAttribute("NormalRangeHi");
-        mSoundFont.instruments[i].releaseRate = instrument->UnsignedAttribute("ReleaseRate");
-
-        tinyxml2::XMLElement* instChild = instrument->FirstChildElement();
-        while (instChild != nullptr) {
-            if (strcmp(instChild->Name(), "Envelopes") == 0) {
-                mSoundFont.instruments[i].numEnvelopes = ParseEnvelopes(instChild, &mSoundFont.instruments[i].envs);
-            } else if (strcmp(instChild->Name(), "LowNotesSound") == 0) {
-                mSoundFont.instruments[i].lowNoteSound.path = StrDupNew(instChild->Attribute("SampleRef"));
-                mSoundFont.instruments[i].lowNoteSound.tuning = instChild->FloatAttribute("Tuning");
-            } else if (strcmp(instChild->Name(), "NormalNotesSound") == 0) {
-                mSoundFont.instruments[i].normalNoteSound.path = StrDupNew(instChild->Attribute("SampleRef"));
-                mSoundFont.instruments[i].normalNoteSound.tuning = instChild->FloatAttribute("Tuning");
-            } else if (strcmp(instChild->Name(), "HighNotesSound") == 0) {
-                mSoundFont.instruments[i].highNoteSound.path = StrDupNew(instChild->Attribute("SampleRef"));
-                mSoundFont.instruments[i].highNoteSound.tuning = instChild->FloatAttribute("Tuning");
-            }
-            instChild = instChild->NextSiblingElement();
-        }
-        instrument = instrument->NextSiblingElement("Instrument");
-        i++;
-    }
-}
-
-void CustomSoundFontWindow::ParseSfxTbl(tinyxml2::XMLElement *sfxTblElem) {
-    mSoundFont.numSfx = sfxTblElem->UnsignedAttribute("Count");
-    mSoundFont.sfx = new ZSfxTbl[mSoundFont.numSfx];
-    tinyxml2::XMLElement* sfxElem = sfxTblElem->FirstChildElement("Sfx");
-    unsigned int i = 0;
-    while (sfxElem != nullptr) {
-        mSoundFont.sfx[i].sample.path = StrDupNew(sfxElem->Attribute("SampleRef"));
-        mSoundFont.sfx[i].sample.tuning = sfxElem->FloatAttribute("Tuning");
-        sfxElem = sfxElem->NextSiblingElement("Sfx");
-        i++;
-    }
-}
-
-void CustomSoundFontWindow::ClearSoundFont() {
-    for (unsigned int i = 0; i < mSoundFont.numDrums; i++) {
-        delete[] mSoundFont.drums[i].envs;
-        if (mSoundFont.drums[i].sample.path != nullptr) {
-            delete[] mSoundFont.drums[i].sample.path;
-        }
-    }
-    mSoundFont.numDrums = 0;
-    if (mSoundFont.drums != nullptr) {
-        delete[] mSoundFont.drums;
-        mSoundFont.drums = nullptr;
-    }
-
-    for (unsigned int i = 0; i < mSoundFont.numInstruments; i++) {
-        delete[] mSoundFont.instruments[i].envs;
-    }
-    mSoundFont.numInstruments = 0;
-    if (mSoundFont.instruments != nullptr) {
-        delete[] mSoundFont.instruments;
-        mSoundFont.instruments = nullptr;
-    }
-    delete[] mSoundFont.sfx;
-    delete[] mSoundFont.medium;
-    delete[] mSoundFont.cachePolicy;
-}
-
 void CustomSoundFontWindow::DrawHeader(bool locked) const{
     ImGui::BeginDisabled(locked);
     ImGui::TextUnformatted("Version");
@@ -273,144 +154,135 @@ void CustomSoundFontWindow::DrawHeader(bool locked) const{
     ImGui::EndDisabled();
 }
 
-void CustomSoundFontWindow::DrawDrums(bool locked) const {
+void CustomSoundFontWindow::DrawDrums(bool locked) {
     ImGui::BeginDisabled(locked);
-    char drumTreeTag[sizeof("Drums()") + 9];
-    sprintf(drumTreeTag, "Drums(%u)", mSoundFont.numDrums);
-    if (ImGui::TreeNode(drumTreeTag)) {
-
+    if (ImGui::TreeNode("Drums", "Drums(%u)", mSoundFont.numDrums)) {
+        // Rows can have their envelopes expanded so they aren't all the same height and can't be clipped by `DrawVirtualTable`.
         for (unsigned int i = 0; i < mSoundFont.numDrums; i++) {
+            ZDrum* drum = &mSoundFont.drums[i];
             bool modified = false;
-            char envTreeTag[sizeof("Envelopes()") + 3];
-
-            DrawSample("Drum", &mSoundFont.drums[i].sample, &modified);
-            sprintf(envTreeTag, "Envelopes(%u)", mSoundFont.drums[i].numEnvelopes);
-            if (ImGui::TreeNodeEx(mSoundFont.drums[i].envs, ImGuiTreeNodeFlags_None, "%s", envTreeTag)) {
-                for (unsigned int j = 0; j < mSoundFont.drums[i].numEnvelopes; j++) {
-                    char envTag[TAG_SIZE("##")];
-                    sprintf(envTag, "Delay##%p", (&mSoundFont.drums[i].envs[j]));
-                    if (ImGui::InputScalarN(envTag, ImGuiDataType_S16, &mSoundFont.drums[i].envs[j].delay, 1)) {
+
+            ImGui::PushID((int)i);
+            DrawSample("Drum", &drum->sample, &mSoundFont.arena, &modified);
+            if (ImGui::TreeNode("Envelopes", "Envelopes(%u)", drum->numEnvelopes)) {
+                for (unsigned int j = 0; j < drum->numEnvelopes; j++) {
+                    ImGui::PushID((int)j);
+                    if (ImGui::InputScalar("Delay", ImGuiDataType_S16, &drum->envs[j].delay)) {
                         modified = true;
                     }
                     ImGui::SameLine();
-                    sprintf(envTag, "Arg##%p", (&mSoundFont.drums[i].envs[j]) + 1);
-                    if (ImGui::InputScalarN(envTag, ImGuiDataType_S16, &mSoundFont.drums[i].envs[j].arg, 1)) {
+                    if (ImGui::InputScalar("Arg", ImGuiDataType_S16, &drum->envs[j].arg)) {
                         modified = true;
                     }
+                    ImGui::PopID();
                 }
                 ImGui::TreePop();
             }
+            ImGui::PopID();
             if (modified) {
-                mSoundFont.drums[i].modified = true;
+                drum->modified = true;
             }
-
         }
         ImGui::TreePop();
     }
     ImGui::EndDisabled();
 }
 
-void CustomSoundFontWindow::DrawInstruments(bool locked) const {
-    char instTreeTag[sizeof("Instruments()") + 9];
+void CustomSoundFontWindow::DrawInstruments(bool locked) {
+    static constexpr VirtualTableColumn columns[] = { { nullptr, 0.0f } };
 
-    sprintf(instTreeTag, "Instruments(%u)", mSoundFont.numInstruments);
-    if (ImGui::TreeNode(instTreeTag)) {
-        for (unsigned int i = 0; i < mSoundFont.numInstruments; i++) {
+    if (ImGui::TreeNode("Instruments", "Instruments(%u)", mSoundFont.numInstruments)) {
+        DrawVirtualTable("Instrument List", columns, IM_ARRAYSIZE(columns), mSoundFont.numInstruments, 0, {}, [this](size_t i) {
+            ZInstrument* inst = &mSoundFont.instruments[i];
             bool modified = false;
-            char checkboxTag[TAG_SIZE("##")];
-            char rangeLoTag[TAG_SIZE("##")];
-            char rangeHiTag[TAG_SIZE("##")];
-            char releaseRateTag[TAG_SIZE("##")];
-
-            sprintf(checkboxTag, "##%p", &mSoundFont.instruments[i].isValid);
-            sprintf(rangeLoTag, "##%p", &mSoundFont.instruments[i].normalRangeLo);
-            sprintf(rangeHiTag, "##%p", &mSoundFont.instruments[i].normalRangeHi);
-            sprintf(releaseRateTag, "##%p", &mSoundFont.instruments[i].releaseRate);
+
             ImGui::TextUnformatted("Valid ");
             ImGui::SameLine();
-            ImGui::Checkbox(checkboxTag, &mSoundFont.instruments[i].isValid);
+            ImGui::Checkbox("##valid", &inst->isValid);
             ImGui::SameLine();
             ImGui::TextUnformatted("  Range Low ");
             ImGui::SameLine();
-            if (ImGui::InputScalarN(rangeLoTag, ImGuiDataType_U8, &mSoundFont.instruments[i].normalRangeLo, 1)) {
+            if (ImGui::InputScalar("##rangeLo", ImGuiDataType_U8, &inst->normalRangeLo)) {
                 modified = true;
             }
             ImGui::SameLine();
             ImGui::TextUnformatted("  Range Hi ");
             ImGui::SameLine();
-            if (ImGui::InputScalarN(rangeHiTag, ImGuiDataType_U8, &mSoundFont.instruments[i].normalRangeHi, 1)) {
+            if (ImGui::InputScalar("##rangeHi", ImGuiDataType_U8, &inst->normalRangeHi)) {
                 modified = true;
             }
             ImGui::SameLine();
             ImGui::TextUnformatted("  Release Rate ");
             ImGui::SameLine();
-            if (ImGui::InputScalarN(releaseRateTag, ImGuiDataType_U8, &mSoundFont.instruments[i].releaseRate, 1)) {
+            if (ImGui::InputScalar("##releaseRate", ImGuiDataType_U8, &inst->releaseRate)) {
                 modified = true;
             }
-            DrawSample("Low Note Sound", &mSoundFont.instruments[i].lowNoteSound, &modified);
-            DrawSample("Normal Note Sound", &mSoundFont.instruments[i].normalNoteSound, &modified);
-            DrawSample("High Note Sound", &mSoundFont.instruments[i].highNoteSound, &modified);
+            DrawSample("Low Note Sound", &inst->lowNoteSound, &mSoundFont.arena, &modified);
+            DrawSample("Normal Note Sound", &inst->normalNoteSound, &mSoundFont.arena, &modified);
+            DrawSample("High Note Sound", &inst->highNoteSound, &mSoundFont.arena, &modified);
             if (modified) {
-                mSoundFont.instruments[i].modified = true;
+                inst->modified = true;
             }
-        }
-
+        });
         ImGui::TreePop();
     }
 }
 
-void CustomSoundFontWindow::DrawSfxTbl(bool locked) const {
-    char sfxTreeTag[sizeof("Sfx()") + 3];
-    sprintf(sfxTreeTag, "Sfx(%u)", mSoundFont.numSfx);
-    if (ImGui::TreeNode(sfxTreeTag)) {
-        for (unsigned int i = 0; i < mSoundFont.numSfx; i++) {
+void CustomSoundFontWindow::DrawSfxTbl(bool locked) {
+    static constexpr VirtualTableColumn columns[] = { { nullptr, 0.0f } };
+
+    if (ImGui::TreeNode("Sfx", "Sfx(%u)", mSoundFont.numSfx)) {
+        DrawVirtualTable("Sfx List", columns, IM_ARRAYSIZE(columns), mSoundFont.numSfx, 0, {}, [this](size_t i) {
             bool modified = false;
-            DrawSample("Sfx", &mSoundFont.sfx[i].sample, &modified);
+            DrawSample("Sfx", &mSoundFont.sfx[i].sample, &mSoundFont.arena, &modified);
             if (modified) {
                 mSoundFont.sfx[i].modified = true;
             }
-        }
+        });
         ImGui::TreePop();
     }
 }
 
-static void DrawSample(const char* type, ZSample* sample, bool* modified) {
-    char sampleButtonTag[TAG_SIZE(ICON_FA_PENCIL"##")];
-    sprintf(sampleButtonTag, "%s##%p", ICON_FA_PENCIL, &sample->path);
+static void DrawSample(const char* type, ZSample* sample, Arena* arena, bool* modified) {
+    // Samples are identified by their address so several can be drawn under the same ID
+    ImGui::PushID(sample);
     ImGui::Indent();
+    bool openNewSample;
     if (sample->path != nullptr && sample->path[0] != 0) {
-        char tuningTag[TAG_SIZE("##")];
-
         //ImGui::Text("%s %s  ",type, sample->path);
-        const char* sampleStart = strrchr(sample->path, PATH_SEPARATOR) + 1;
-        const char* sampleEnd = strrchr(sample->path, '_');
-        ImGui::Text("%s", type);
+        const char* sampleStart = strrchr(sample->path, PATH_SEPARATOR);
+        sampleStart = sampleStart != nullptr ? sampleStart + 1 : sample->path;
+        const char* sampleEnd = strrchr(sampleStart, '_');
+        ImGui::TextUnformatted(type);
         ImGui::SameLine();
         ImGui::TextEx(sampleStart, sampleEnd);
-        sprintf(tuningTag, "##%p", &sample->path);
 
         ImGui::SameLine();
-        if (ImGui::Button(sampleButtonTag)) {
-            goto openNewSample;
-        }
+        openNewSample = ImGui::Button(ICON_FA_PENCIL "##edit");
         ImGui::SameLine();
         ImGui::TextUnformatted("Tuning");
         ImGui::SameLine();
-        if (ImGui::InputScalarN(tuningTag, ImGuiDataType_Float, &sample->tuning, 1)) {
+        if (ImGui::InputScalar("##tuning", ImGuiDataType_Float, &sample->tuning)) {
             *modified = true;
         }
     } else {
         ImGui::Text("%s Empty", type);
         ImGui::SameLine();
-        if (ImGui::Button(sampleButtonTag)) {
-            openNewSample:
-            if (GetOpenFilePath(const_cast<char**>(&sample->path), FileBoxType::Max)) {
-                *modified = true;
-                // At this point `path` contains a path to a location on disk, it will be converted and added to the archive when saved.
-            }
+        openNewSample = ImGui::Button(ICON_FA_PENCIL "##edit");
+    }
+    if (openNewSample) {
+        char* newPath = nullptr;
+        if (GetOpenFilePath(&newPath, FileBoxType::Max)) {
+            // The old path stays in the arena until the soundfont is cleared
+            sample->path = arena->StrDup(newPath);
+            sample->onDisk = true;
+            *modified = true;
+            // At this point `path` contains a path to a location on disk, it will be converted and added to the archive when saved.
         }
+        delete[] newPath;
     }
     ImGui::Unindent();
+    ImGui::PopID();
 }
 
 static void WriteEnvData(ZEnvelope* zEnvs, unsigned int numEnvelopes, tinyxml2::XMLElement* envDoc) {
@@ -425,9 +297,6 @@ static void WriteEnvData(ZEnvelope* zEnvs, unsigned int numEnvelopes, tinyxml2::
     envDoc->InsertEndChild(envs);
 }
 
-extern std::unique_ptr<char[]> CopySampleData(char* input, char* fileName, bool fromDisk, size_t size, Archive* a);
-extern std::unique_ptr<char[]> CreateSampleXml(char* fileName, const char* audioType, uint64_t numFrames, uint64_t numChannels, SeqMetaInfo* info, uint64_t sampleRate, bool loopTimeInSamples, Archive* a);
-
 enum AudioType {
     mp3,
     wav,
@@ -447,82 +316,199 @@ constexpr static char sampleNameBase[] = "custom/samples/";
 constexpr static char sampleDataBase[] = "custom/sampleData/";
 constexpr static char sampleXmlBase[] = "custom/samples/";
 
-static void SaveSample(ZSample* sample, tinyxml2::XMLElement* elem, Archive* a) {
-    if (sample->path != nullptr) {
-        if (sample->path[0] == '/') {
-            AudioType type;
-            std::unique_ptr<char[]> samplePath;
-            std::unique_ptr<char[]> sampleXmlPath;
-            const char* fileName = strrchr(sample->path, '/');
-            fileName++;
-            uint32_t numChannels;
-            uint64_t sampleRate;
-            uint64_t numFrames;
-            SeqMetaInfo info;
-            mio::mmap_source file(sample->path);
-            if (WAV_CHECK(file.data())) {
-                drwav wav;
-                drwav_init_memory(&wav, file.data(), file.size(), nullptr);
-                numChannels = wav.channels;
-                sampleRate = wav.sampleRate;
-                numFrames = wav.totalPCMFrameCount;
-                type = AudioType::wav;
-
-                if (!(wav.translatedFormatTag == DR_WAVE_FORMAT_PCM && wav.bitsPerSample == 16)) {
-                    // Uh oh
-                    return;
-                }
-            } else if (MP3_CHECK(file.data())) {
-                drmp3 mp3;
-                drmp3_init_memory(&mp3, file.data(), file.size(), nullptr);
-                numChannels = mp3.channels;
-                sampleRate = mp3.sampleRate;
-                numFrames = drmp3_get_pcm_frame_count(&mp3);
-                type = AudioType::mp3;
-            } else if (FLAC_CHECK(file.data())) {
-                drflac* flac = drflac_open_memory(file.data(), file.size(), nullptr);
-                numChannels = flac->channels;
-                sampleRate = flac->sampleRate;
-                numFrames = flac->totalPCMFrameCount;
-                type = AudioType::flac;
-            } else if (OGG_CHECK(file.data())) {
+// Probes the audio file picked for a sample and writes its sample XML and data to `a`. `out->xmlPath` is left null if
+// the file can't be used.
+static void ImportSample(ImportedSample* out, const StreamedAudioTemplates* templates, XmlEmitBuffer* xmlBuf, Archive* a) {
+    const char* fileName = strrchr(out->path, PATH_SEPARATOR);
+    fileName = fileName != nullptr ? fileName + 1 : out->path;
+    AudioType type;
+    uint32_t numChannels;
+    uint64_t sampleRate;
+    uint64_t numFrames;
+    SeqMetaInfo info;
+    std::error_code ec;
+    mio::mmap_source file;
+    file.map(out->path, ec);
+    if (ec || file.size() < 4) {
+        return;
+    }
+    if (WAV_CHECK(file.data())) {
+        drwav wav;
+        if (!drwav_init_memory(&wav, file.data(), file.size(), nullptr)) {
+            return;
+        }
+        numChannels = wav.channels;
+        sampleRate = wav.sampleRate;
+        numFrames = wav.totalPCMFrameCount;
+        type = AudioType::wav;
+        const bool isPcm16 = wav.translatedFormatTag == DR_WAVE_FORMAT_PCM && wav.bitsPerSample == 16;
+        drwav_uninit(&wav);
+        if (!isPcm16) {
+            return;
+        }
+    } else if (MP3_CHECK(file.data())) {
+        drmp3 mp3;
+        if (!drmp3_init_memory(&mp3, file.data(), file.size(), nullptr)) {
+            return;
+        }
+        numChannels = mp3.channels;
+        sampleRate = mp3.sampleRate;
+        numFrames = drmp3_get_pcm_frame_count(&mp3);
+        type = AudioType::mp3;
+        drmp3_uninit(&mp3);
+    } else if (FLAC_CHECK(file.data())) {
+        drflac* flac = drflac_open_memory(file.data(), file.size(), nullptr);
+        if (flac == nullptr) {
+            return;
+        }
+        numChannels = flac->channels;
+        sampleRate = flac->sampleRate;
+        numFrames = flac->totalPCMFrameCount;
+        type = AudioType::flac;
+        drflac_close(flac);
+    } else {
+        // OGG samples aren't supported yet
+        return;
+    }
+    const size_t fileSize = file.size();
+    file.unmap();
 
-            }
-            info.fanfare = true;
-            info.loopEnd.i = numFrames;
-            info.loopStart.i = 0;
-
-            sampleXmlPath = CreateSampleXml(const_cast<char*>(fileName), audioTypeToStr[type], numFrames, numChannels, &info, sampleRate, true, a);
-            CopySampleData(const_cast<char*>(sample->path), const_cast<char*>(fileName), true, file.size(), a);
-            elem->SetAttribute("SampleRef", sampleXmlPath.get());
-            elem->SetAttribute("Tuning", ((float)sampleRate * (float)numChannels) / 32000.0f);
+    info.fanfare = true;
+    info.loopEnd.i = numFrames;
+    info.loopStart.i = 0;
+
+    out->xmlPath = CreateSampleXml(const_cast<char*>(fileName), audioTypeToStr[type], numFrames, numChannels, &info, sampleRate, true, templates, xmlBuf, a);
+    CopySampleData(const_cast<char*>(out->path), const_cast<char*>(fileName), true, fileSize, a);
+    out->tuning = ((float)sampleRate * (float)numChannels) / 32000.0f;
+}
+
+static void ImportSamplesWorker(std::vector<ImportedSample>* imports, std::atomic<size_t>* nextImport, std::atomic<unsigned int>* samplesImported,
+                                const StreamedAudioTemplates* templates, Archive* a) {
+    XmlEmitBuffer xmlBuf;
+    size_t i;
+    while ((i = nextImport->fetch_add(1)) < imports->size()) {
+        ImportSample(&(*imports)[i], templates, &xmlBuf, a);
+        samplesImported->fetch_add(1);
+    }
+}
+
+void CustomSoundFontWindow::SaveSample(const ZSample* sample, tinyxml2::XMLElement* elem) {
+    if (sample->onDisk) {
+        const ImportedSample* imported = &mImports[mImportIndices.at(sample->path)];
+        if (imported->xmlPath == nullptr) {
+            // The file couldn't be imported. Leave the sample out.
             return;
         }
+        elem->SetAttribute("SampleRef", imported->xmlPath.get());
+        elem->SetAttribute("Tuning", imported->tuning);
+        return;
     }
     elem->SetAttribute("SampleRef", sample->path);
     elem->SetAttribute("Tuning", sample->tuning);
 }
 
-static void WriteInstrument(ZSample* zSample, tinyxml2::XMLElement* instrument, const char* name, Archive* a) {
+void CustomSoundFontWindow::WriteInstrument(const ZSample* zSample, tinyxml2::XMLElement* instrument, const char* name) {
     tinyxml2::XMLElement* inst = instrument->InsertNewChildElement(name);
     if (zSample->path != nullptr) {
-        SaveSample(zSample, inst, a);
+        SaveSample(zSample, inst);
     }
     instrument->InsertEndChild(inst);
 }
 
+void CustomSoundFontWindow::AddImport(const ZSample* sample) {
+    if (sample->path == nullptr || !sample->onDisk) {
+        return;
+    }
+    // The same file can be picked for more than one sample. Only import it once.
+    if (mImportIndices.try_emplace(sample->path, mImports.size()).second) {
+        mImports.push_back({ .path = sample->path, .xmlPath = nullptr, .tuning = 0.0f });
+    }
+}
+
 void CustomSoundFontWindow::Save() {
     char* outBuffer = nullptr;
-    ZipArchive a;
-
     GetSaveFilePath(&outBuffer);
-    a.OpenArchive(outBuffer);
-    char* sfStr = strrchr(mPathBuff, PATH_SEPARATOR);
-    sfStr++;
+    // The dialog returns an empty path on Linux and macOS if it was cancelled.
+    if (outBuffer == nullptr || outBuffer[0] == 0) {
+        delete[] outBuffer;
+        return;
+    }
+    if (mSaveThread.joinable()) {
+        mSaveThread.join();
+    }
+    delete[] mSavePath;
+    mSavePath = outBuffer;
+
+    // Find the files that need to be imported before starting so the worker only reads the soundfont. The editor is
+    // disabled until the save is done.
+    mImports.clear();
+    mImportIndices.clear();
+    for (unsigned int i = 0; i < mSoundFont.numDrums; i++) {
+        if (!mExportPatchOnly || mSoundFont.drums[i].modified) {
+            AddImport(&mSoundFont.drums[i].sample);
+        }
+    }
+    for (unsigned int i = 0; i < mSoundFont.numInstruments; i++) {
+        if (!mExportPatchOnly || mSoundFont.instruments[i].modified) {
+            AddImport(&mSoundFont.instruments[i].lowNoteSound);
+            AddImport(&mSoundFont.instruments[i].normalNoteSound);
+            AddImport(&mSoundFont.instruments[i].highNoteSound);
+        }
+    }
+    for (unsigned int i = 0; i < mSoundFont.numSfx; i++) {
+        if (!mExportPatchOnly || mSoundFont.sfx[i].modified) {
+            AddImport(&mSoundFont.sfx[i].sample);
+        }
+    }
+
+    mSamplesImported = 0;
+    mSamplesFailed = 0;
+    mSaveError = nullptr;
+    mSaving = true;
+    mSaveThread = std::thread(&CustomSoundFontWindow::SaveWorker, this);
+}
+
+void CustomSoundFontWindow::SaveWorker() {
+    ArchiveType archiveType = GetArchiveTypeFromExt(mSavePath);
+    if (archiveType == ArchiveType::Unchecked) {
+        archiveType = ArchiveType::O2R;
+    }
+    // A patch is usually saved into an existing mod
+    std::unique_ptr<Archive> a = OpenOrCreateArchiveOfType(archiveType, mSavePath);
+    if (a == nullptr || !a->IsArchiveOpen()) {
+        mSaveError = "Failed to open the archive";
+        mSaving = false;
+        return;
+    }
+
+    StreamedAudioTemplates templates;
+    if (!LoadStreamedAudioTemplates(&templates)) {
+        mSaveError = "Failed to load the XML templates. Make sure the assets folder is next to the program.";
+        a->CloseArchive();
+        mSaving = false;
+        return;
+    }
+
+    std::atomic<size_t> nextImport = 0;
+    const unsigned int numThreads = std::min<size_t>(std::max(1u, std::thread::hardware_concurrency()), mImports.size());
+    auto importThreads = std::make_unique<std::thread[]>(numThreads);
+    for (unsigned int i = 0; i < numThreads; i++) {
+        importThreads[i] = std::thread(ImportSamplesWorker, &mImports, &nextImport, &mSamplesImported, &templates, a.get());
+    }
+    for (unsigned int i = 0; i < numThreads; i++) {
+        importThreads[i].join();
+    }
+    for (const auto& imported : mImports) {
+        if (imported.xmlPath == nullptr) {
+            mSamplesFailed++;
+        }
+    }
+
+    const char* sfStr = strrchr(mPathBuff, PATH_SEPARATOR);
+    sfStr = sfStr != nullptr ? sfStr + 1 : mPathBuff;
 
     tinyxml2::XMLDocument outDoc;
     tinyxml2::XMLElement* root = outDoc.NewElement("SoundFont");
-
     root->SetAttribute("Version", 0);
     root->SetAttribute("Num", mSoundFont.index);
     root->SetAttribute("Medium", mSoundFont.medium);
@@ -540,7 +526,7 @@ void CustomSoundFontWindow::Save() {
             drum->SetAttribute("ReleaseRate", mSoundFont.drums[i].releaseRate);
             drum->SetAttribute("Pan", mSoundFont.drums[i].pan);
             drum->SetAttribute("Loaded", 0);
-            SaveSample(&mSoundFont.drums[i].sample, drum, &a);
+            SaveSample(&mSoundFont.drums[i].sample, drum);
             WriteEnvData(mSoundFont.drums[i].envs, mSoundFont.drums[i].numEnvelopes, drum);
             if (mExportPatchOnly && mSoundFont.drums[i].modified) { // If we aren't exporting only the changes, it doesn't matter which entry is being modified
                 drum->SetAttribute("Patches", i);
@@ -564,9 +550,9 @@ void CustomSoundFontWindow::Save() {
                 instrument->SetAttribute("Patches", i);
             }
             WriteEnvData(mSoundFont.instruments[i].envs, mSoundFont.instruments[i].numEnvelopes, instrument);
-            WriteInstrument(&mSoundFont.instruments[i].lowNoteSound, instrument, "LowNotesSound", &a);
-            WriteInstrument(&mSoundFont.instruments[i].normalNoteSound, instrument, "NormalNotesSound", &a);
-            WriteInstrument(&mSoundFont.instruments[i].highNoteSound, instrument, "HighNotesSound", &a);
+            WriteInstrument(&mSoundFont.instruments[i].lowNoteSound, instrument, "LowNotesSound");
+            WriteInstrument(&mSoundFont.instruments[i].normalNoteSound, instrument, "NormalNotesSound");
+            WriteInstrument(&mSoundFont.instruments[i].highNoteSound, instrument, "HighNotesSound");
             instruments->InsertEndChild(instrument);
         }
     }
@@ -578,7 +564,7 @@ void CustomSoundFontWindow::Save() {
         if (!mExportPatchOnly || mSoundFont.sfx[i].modified) {
             tinyxml2::XMLElement* inst = sfxTbl->InsertNewChildElement("Sfx");
             if (mSoundFont.sfx[i].sample.path != nullptr) {
-                SaveSample(&mSoundFont.sfx[i].sample, inst, &a);
+                SaveSample(&mSoundFont.sfx[i].sample, inst);
                 //inst->SetAttribute("SampleRef", mSoundFont.sfx[i].sample.path);
                 //inst->SetAttribute("Tuning", mSoundFont.sfx[i].sample.tuning);
                 if (mExportPatchOnly && mSoundFont.sfx[i].modified) {
@@ -597,7 +583,7 @@ void CustomSoundFontWindow::Save() {
     };
     auto outSfPath = std::make_unique<char[]>(sizeof(fontXmlBase) + strlen(sfStr) + sizeof("_PATCH") + 1);
     sprintf(outSfPath.get(), "%s%s_PATCH", fontXmlBase, sfStr);
-    a.WriteFile(outSfPath.get(), &info);
-    a.CloseArchive();
-    delete[] outBuffer;
+    a->WriteFile(outSfPath.get(), &info);
+    a->CloseArchive();
+    mSaving = false;
 }
\ No newline at end of file
@@ -1,70 +1,24 @@
 #ifndef CUSTOMSOUNDFONTWINDOW_H
 #define CUSTOMSOUNDFONTWINDOW_H
 
+#include <atomic>
 #include <memory>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
 
 #include "WindowBase.h"
+#include "soundfont.h"
 #include "tinyxml2.h"
 
-// Not the actual order
-
-struct ZSample {
+// A file picked in the editor that is added to the archive when the soundfont is saved
+typedef struct ImportedSample {
     const char* path;
+    // Path of the sample XML in the archive. Null if the file couldn't be imported.
+    std::unique_ptr<char[]> xmlPath;
     float tuning;
-};
-
-struct ZEnvelope {
-    int16_t delay;
-    int16_t arg;
-};
-
-struct ZDrum {
-    ZSample sample;
-    ZEnvelope* envs;
-    uint8_t numEnvelopes;
-    uint8_t releaseRate;
-    uint8_t pan;
-    // variables to track modifications
-    bool modified = false;;
-};
-
-struct ZInstrument {
-    ZSample lowNoteSound;
-    ZSample normalNoteSound;
-    ZSample highNoteSound;
-    ZEnvelope* envs;
-    uint8_t numEnvelopes;
-    bool isValid;
-    uint8_t normalRangeLo;
-    uint8_t normalRangeHi;
-    uint8_t releaseRate;
-    // variables to track modifications
-    bool modified = false;;
-};
-
-struct ZSfxTbl {
-    ZSample sample;
-    // variables to track modifications
-    bool modified = false;;
-};
-
-struct ZSoundFont {
-    const char* medium;
-    const char* cachePolicy;
-    ZDrum* drums;
-    ZInstrument* instruments;
-    ZSfxTbl* sfx;
-    uint32_t numDrums;
-    uint32_t numInstruments;
-    uint32_t numSfx;
-
-    uint16_t data1;
-    uint16_t data2;
-    uint16_t data3;
-    uint8_t version;
-    uint8_t index;
-};
-
+} ImportedSample;
 
 class CustomSoundFontWindow : public WindowBase {
 public:
@@ -73,22 +27,29 @@ public:
     void DrawWindow() override;
 private:
     void ClearPathBuff();
-    void ParseSoundFont();
-    void ClearSoundFont();
-    uint8_t ParseEnvelopes(tinyxml2::XMLElement* envsELem, ZEnvelope** envs);
-    void ParseDrums(tinyxml2::XMLElement* drumsElem);
-    void ParseInstruments(tinyxml2::XMLElement* instrumentsElem);
-    void ParseSfxTbl(tinyxml2::XMLElement* sfxTblElem);
     void DrawHeader(bool locked) const;
-    void DrawDrums(bool locked) const;
-    void DrawInstruments(bool locked) const;
-    void DrawSfxTbl(bool locked) const;
+    void DrawDrums(bool locked);
+    void DrawInstruments(bool locked);
+    void DrawSfxTbl(bool locked);
     void Save();
+    void SaveWorker();
+    void AddImport(const ZSample* sample);
+    void SaveSample(const ZSample* sample, tinyxml2::XMLElement* elem);
+    void WriteInstrument(const ZSample* zSample, tinyxml2::XMLElement* instrument, const char* name);
     //void DrawSample(char* type);
     char* mPathBuff = nullptr;
     char* mSavePath = nullptr;
-    tinyxml2::XMLDocument mDoc;
     ZSoundFont mSoundFont {};
+    char mParseError[256] {};
+    std::thread mSaveThread;
+    std::vector<ImportedSample> mImports;
+    // Index into `mImports` of each imported path
+    std::unordered_map<std::string, size_t> mImportIndices;
+    std::atomic<unsigned int> mSamplesImported = 0;
+    std::atomic<unsigned int> mSamplesFailed = 0;
+    std::atomic<bool> mSaving = false;
+    // Set by the save thread if the archive couldn't be written. Shown once the save is done.
+    std::atomic<const char*> mSaveError = nullptr;
     bool sfParsed = false;
     bool mSfLocked = false;
     bool mExportPatchOnly = true;
@@ -3,19 +3,17 @@
 
 #include "WindowBase.h"
 #include "threadSafeQueue.h"
+#include "streamed_audio.h"
+#include "memory_budget.h"
+#include "VirtualTable.h"
+#include "WaveformView.h"
+#include "peak_pyramid.h"
+#include "dir_watcher.h"
+#include <atomic>
+#include <thread>
+#include <string>
 #include <unordered_map>
 
-typedef union IntFloat {
-    float f;
-    uint32_t i;
-} IntFloat;
-
-typedef struct SeqMetaInfo {
-    IntFloat loopStart;
-    IntFloat loopEnd;
-    bool fanfare;
-} SeqMetaInfo;
-
 class CustomStreamedAudioWindow : public WindowBase {
 public:
     CustomStreamedAudioWindow() = default;
@@ -25,23 +23,55 @@ public:
     char* GetSavePath() const;
     bool GetLoopTimeType() const;
     bool GetTranscode() const;
+    uint64_t GetMemoryBudget() const;
+    PackReport* GetReport();
+    // Packs the songs that change in the selected directory until watching is stopped. Returns right away if watching
+    // wasn't started.
+    void WatchForChanges(Archive* a);
 private:
     void DrawPendingFilesList();
+    void DrawLoopEditor();
+    void SelectFile(size_t i);
+    void ClearWaveform();
+    void DrawReport();
+    void ExportReport(bool json);
     void ClearPathBuff();
     void ClearSaveBuff();
     void ClearFanfareMap();
     void FillFanfareMap();
     std::vector<char*> mFileQueue;
     std::unordered_map<char*, SeqMetaInfo> mSeqMetaMap;
+    PackReport mReport;
+    TextWidthCache mNameWidths;
+    // Waveform of the selected file, built on `mWaveformThread`. Only read once `mWaveformDone` is set.
+    PeakPyramid mWaveform;
+    WaveformView mWaveformView = {};
+    std::thread mWaveformThread;
+    std::atomic<bool> mWaveformCancel = false;
+    std::atomic<bool> mWaveformDone = false;
+    size_t mSelectedFile = SIZE_MAX;
+    std::thread mPackThread;
+    // Keeps the archive up to date after it is packed when `mWatch` is set
+    DirWatcher mWatcher;
+    // Loop points and fanfares by file name. `mSeqMetaMap` is keyed by pointers into the queue, which is freed once
+    // the songs are packed.
+    std::unordered_map<std::string, SeqMetaInfo> mMetaByName;
+    std::atomic<bool> mWatching = false;
+    std::atomic<unsigned int> mNumUpdates = 0;
+    // Batches of changes that couldn't be packed or written to the archive
+    std::atomic<unsigned int> mNumFailedUpdates = 0;
+    std::atomic<unsigned int> mLastUpdateMs = 0;
     char* mPathBuff = nullptr;
     char* mSavePath = nullptr;
     unsigned int fileCount = 0;
+    uint64_t mMemoryBudgetMiB = GetDefaultMemoryBudget() / (1024 * 1024);
     int mRadioState = 2;
     bool mThreadStarted = false;
     bool mThreadIsDone = false;
     bool mPackAsArchive = true;
     bool mLoopIsISamples = false;
     bool mTranscodeToOpus = true;
+    bool mWatch = false;
 };
 
 #endif
@@ -5,18 +5,16 @@
 #include "WindowMgr.h"
 #include "zip.h"
 #include "stdlib.h"
+#include <cstring>
 #include "imgui_memory_editor.h"
 #include "images.h"
 #include "zip_archive.h"
 #include "mpq_archive.h"
 #include "font.h"
-#if defined (_WIN32)
-#define WIN32_LEAN_AND_MEAN
-#include <Windows.h>
-#elif defined(__linux__) || defined(__APPLE__)
-#include <fcntl.h>
-#include <unistd.h>
-#endif
+#include "VirtualTable.h"
+#include "audio_preview.h"
+
+#include <algorithm>
 
 ExploreWindow::ExploreWindow() {
     // ImGui::InputText can't handle a null buffer being passed in.
@@ -27,6 +25,8 @@ ExploreWindow::ExploreWindow() {
 }
 
 ExploreWindow::~ExploreWindow() {
+    // The preview may be reading from the archive
+    StopAudioPreview();
     delete[] mPathBuff;
     mPathBuff = nullptr;
     
@@ -56,6 +56,20 @@ void ExploreWindow::DrawWindow() {
             mFileChangedSinceValidation = false;
             mFailedToOpenArchive = false;
             mFileValidated = ValidateInputFile();
+            // The tree points to the archive's file names
+            mFileTreeView.Reset(nullptr);
+            mFileTree.Clear();
+            mSearchIndex.Clear();
+            mSearchResults.clear();
+            mStats.Clear();
+            mDirRows.order.clear();
+            mExtRows.order.clear();
+            mTreemapLayout = {};
+            mTreemapNode = PathTree::ROOT;
+            // The viewer and the preview read from the archive as they go
+            viewWindow = nullptr;
+            StopAudioPreview();
+            mSearchPending = mSearchBuf[0] != 0;
             if (mArchive != nullptr && mArchive->IsArchiveOpen()) {
                 mArchive->CloseArchive();
                 mArchive = nullptr;
@@ -68,6 +82,10 @@ void ExploreWindow::DrawWindow() {
 
         if (!mFailedToOpenArchive && mArchive->files.empty()) {
             mArchive->GenFileList();
+            mFileTree.Build(mArchive->files, mArchive->fileSizes);
+            mFileTreeView.Reset(&mFileTree);
+            mSearchIndex.BuildAsync(&mArchive->files);
+            mStats.BuildAsync(&mArchive->files, &mArchive->fileSizes, &mArchive->fileStoredSizes);
         }
     }
     if (mArchive != nullptr) {
@@ -90,125 +108,344 @@ void ExploreWindow::DrawWindow() {
     ImGui::End();
 }
 
+static void FormatFileSize(char* out, size_t outSize, uint64_t size) {
+    if (size < 1024) {
+        snprintf(out, outSize, "%llu B", (unsigned long long)size);
+    } else if (size < 1024 * 1024) {
+        snprintf(out, outSize, "%.1f KiB", size / 1024.0);
+    } else {
+        snprintf(out, outSize, "%.1f MiB", size / (1024.0 * 1024.0));
+    }
+}
+
+// Audio written by the streamed and sequenced audio packers
+static bool IsSampleDataPath(const char* path) {
+    static constexpr char sampleDataBase[] = "custom/sampleData/";
+    return strncmp(path, sampleDataBase, sizeof(sampleDataBase) - 1) == 0;
+}
+
+void ExploreWindow::DrawFileButtons(const char* path) {
+    if (ImGui::SmallButton(ICON_FA_CODE "##view")) {
+        viewWindow = std::make_unique<FileViewerWindow>(mArchive.get(), path);
+    }
+    ImGui::SameLine();
+    if (ImGui::SmallButton(ICON_FA_DOWNLOAD "##save")) {
+        char* outPath = nullptr;
+        GetSaveFilePath(&outPath);
+        SaveFile(outPath, path);
+    }
+    ImGui::SameLine();
+    if (IsSampleDataPath(path)) {
+        const bool playing = IsAudioPreviewPlaying(mArchive.get(), path);
+        if (ImGui::SmallButton(playing ? ICON_FA_STOP "##play" : ICON_FA_PLAY "##play")) {
+            if (playing) {
+                StopAudioPreview();
+            } else {
+                StartAudioPreview(mArchive.get(), path);
+            }
+        }
+        ImGui::SameLine();
+    }
+}
+
+void ExploreWindow::DrawSearchResults() {
+    const VirtualTableColumn columns[] = {
+        { "Path", 0.0f },
+        { "Size", ImGui::CalcTextSize("0000.0 MiB").x },
+    };
+    DrawVirtualTable("Search Results", columns, IM_ARRAYSIZE(columns), mSearchResults.size(), ImGuiTableFlags_ScrollY, {}, [this](size_t i) {
+        const uint32_t fileIndex = mSearchResults[i];
+        char sizeStr[16];
+
+        DrawFileButtons(mArchive->files[fileIndex]);
+        ImGui::TextUnformatted(mArchive->files[fileIndex]);
+        ImGui::TableNextColumn();
+        FormatFileSize(sizeStr, sizeof(sizeStr), fileIndex < mArchive->fileSizes.size() ? mArchive->fileSizes[fileIndex] : 0);
+        ImGui::TextUnformatted(sizeStr);
+    });
+}
+
 void ExploreWindow::DrawFileList() {
-    const ImVec2 cursorPos = ImGui::GetCursorPos();
-    const ImVec2 windowSize = ImGui::GetWindowSize();
-    const ImVec2 childWindowSize = {windowSize.x - cursorPos.x, windowSize.y -cursorPos.y};
-    
-    ImGui::BeginChild("File List", childWindowSize, 0, 0);
-    ImGui::SetWindowFontScale(0.7f);
-    const float windowHeight = ImGui::GetWindowHeight();
-    unsigned int i = 0;
-    const float textHeight = ImGui::GetTextLineHeight();
-    for (const auto s : mArchive->files) {
-        const float scroll = ImGui::GetScrollY();
-        const float cursorPosY = ImGui::GetCursorPosY();
-        char btnId[12];
-        int width;
-        int height;
-
-        // Only draw elements that are on screen. This gives around 20x performance improvement.
-        if ((cursorPosY < scroll) || (cursorPosY >(scroll + windowHeight))) {
-            ImGui::NewLine();
-            i++;
-            continue;
-        }
-
-        snprintf(btnId, 12, "I%u", i);
-
-        ImGui::PushStyleVar(ImGuiStyleVar_FramePadding, ImVec2(0, 0));
-        ImGui::PushStyleVar(ImGuiStyleVar_ItemSpacing, ImVec2(3.0f, 3.0f));
-        ImGui::PushID(btnId);
-        
-        if (ImGui::Button(ICON_FA_CODE, ImVec2(26, 26))) {
-            viewWindow = std::make_unique<FileViewerWindow>(mArchive.get(), s);
-        }
-        ImGui::PopID();
+    if (ImGui::InputTextWithHint("##search", "Search. Use * and ? for globs", mSearchBuf, sizeof(mSearchBuf))) {
+        mSearchPending = true;
+    }
+    if (mSearchPending && mSearchIndex.IsReady()) {
+        mSearchIndex.Search(mSearchBuf, &mSearchResults);
+        mSearchPending = false;
+    }
+    const bool searching = mSearchBuf[0] != 0;
+    if (searching) {
         ImGui::SameLine();
-        btnId[0] = 'E';
-        ImGui::PushID(btnId);
-        if (ImGui::Button(ICON_FA_DOWNLOAD, ImVec2(26, 26))) {
-            char* outPath = nullptr;
-            GetSaveFilePath(&outPath);
-            SaveFile(outPath, s);
+        if (mSearchPending) {
+            ImGui::TextUnformatted("Indexing...");
+        } else {
+            ImGui::Text("%zu matches", mSearchResults.size());
         }
-        ImGui::PopID();
+    }
+    ImGui::SameLine();
+    ImGui::Checkbox(ICON_FA_PIE_CHART " Statistics", &mShowStats);
+    DrawAudioPreviewStatus();
 
-        ImGui::SameLine();
-        ImGui::Text("%s", s);
-        ImGui::PopStyleVar(2);
-        i++;
+    if (mShowStats) {
+        DrawStats();
+        return;
     }
+
+    ImGui::BeginChild("File List", {}, 0, 0);
+    ImGui::SetWindowFontScale(0.7f);
+    ImGui::PushStyleVar(ImGuiStyleVar_FramePadding, ImVec2(0, 0));
+    ImGui::PushStyleVar(ImGuiStyleVar_ItemSpacing, ImVec2(3.0f, 3.0f));
+    if (searching) {
+        DrawSearchResults();
+    } else {
+        DrawFileTree();
+    }
+    ImGui::PopStyleVar(2);
     ImGui::EndChild();
 }
 
-bool ExploreWindow::OpenArchive() {
-    switch (mArchiveType) {
-        case ArchiveType::O2R: {
-            mArchive = std::make_unique<ZipArchive>(mPathBuff);
-            break;
+void ExploreWindow::DrawFileTree() {
+    const std::vector<PathTreeRow>& rows = mFileTreeView.GetRows();
+    size_t toggledRow = SIZE_MAX;
+    const VirtualTableColumn columns[] = {
+        { "Name", 0.0f },
+        { "Files", ImGui::CalcTextSize("0000000").x },
+        { "Size", ImGui::CalcTextSize("0000.0 MiB").x },
+    };
+    DrawVirtualTable("Files", columns, IM_ARRAYSIZE(columns), rows.size(), ImGuiTableFlags_ScrollY, {}, [&](size_t i) {
+        const PathTreeRow& row = rows[i];
+        const PathTreeNode& node = mFileTree.GetNode(row.node);
+        const float indent = row.depth * ImGui::GetStyle().IndentSpacing;
+        char sizeStr[16];
+
+        if (indent > 0.0f) {
+            ImGui::Indent(indent);
         }
-        case ArchiveType::OTR: {
-            mArchive = std::make_unique<MpqArchive>(mPathBuff);
-            break;
+        const bool isDir = mFileTree.IsDir(row.node);
+        if (isDir) {
+            const bool expanded = mFileTreeView.IsExpanded(row.node);
+            ImGui::SetNextItemOpen(expanded);
+            ImGui::TreeNodeEx("##dir", ImGuiTreeNodeFlags_NoTreePushOnOpen | ImGuiTreeNodeFlags_SpanAvailWidth, "%s %.*s",
+                              expanded ? ICON_FA_FOLDER_OPEN : ICON_FA_FOLDER, (int)node.nameLen, node.name);
+            // Rows can't be added or removed while the table is being drawn
+            if (ImGui::IsItemToggledOpen()) {
+                toggledRow = i;
+            }
+        } else {
+            DrawFileButtons(mArchive->files[node.fileIndex]);
+            ImGui::TextUnformatted(node.name, node.name + node.nameLen);
+        }
+        if (indent > 0.0f) {
+            ImGui::Unindent(indent);
         }
+        ImGui::TableNextColumn();
+        if (isDir) {
+            ImGui::Text("%u", node.numFiles);
+        }
+        ImGui::TableNextColumn();
+        FormatFileSize(sizeStr, sizeof(sizeStr), node.size);
+        ImGui::TextUnformatted(sizeStr);
+    });
+
+    if (toggledRow != SIZE_MAX) {
+        mFileTreeView.Toggle(toggledRow);
     }
-    return !mArchive->IsArchiveOpen();
 }
 
-bool ExploreWindow::ValidateInputFile() {
-    bool rv;
-    uint32_t header = 0;
-#if defined(_WIN32)
-    HANDLE inFile = CreateFileA(mPathBuff, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+void ExploreWindow::DrawStats() {
+    // Nothing to count if the archive failed to open
+    if (mFileTree.IsEmpty()) {
+        return;
+    }
+    if (!mStats.IsReady()) {
+        ImGui::TextUnformatted("Counting...");
+        return;
+    }
+    const ArchiveStatGroup& total = mStats.GetTotal();
+    char sizeStr[16];
+    char storedStr[16];
+    FormatFileSize(sizeStr, sizeof(sizeStr), total.size);
+    FormatFileSize(storedStr, sizeof(storedStr), total.storedSize);
+    ImGui::Text("%llu files, %s, %s in the archive (%.1f%%)", (unsigned long long)total.numFiles, sizeStr, storedStr,
+                GetStoredPercent(&total));
 
-    if (!ReadFile(inFile, &header, 4, nullptr, nullptr)) {
-        CloseHandle(inFile);
-        return false;
+    if (ImGui::BeginTabBar("Stats")) {
+        if (ImGui::BeginTabItem("Treemap")) {
+            DrawStatsTreemap();
+            ImGui::EndTabItem();
+        }
+        if (ImGui::BeginTabItem("Directories")) {
+            DrawStatGroups("Directories", mStats.GetDirectories(), &mDirRows);
+            ImGui::EndTabItem();
+        }
+        if (ImGui::BeginTabItem("Extensions")) {
+            DrawStatGroups("Extensions", mStats.GetExtensions(), &mExtRows);
+            ImGui::EndTabItem();
+        }
+        if (ImGui::BeginTabItem("Largest Files")) {
+            DrawLargestFiles();
+            ImGui::EndTabItem();
+        }
+        ImGui::EndTabBar();
     }
+}
 
-    CloseHandle(inFile);
-#elif defined(__linux__) || defined(__APPLE__)
-    int fd;
-    fd = open(mPathBuff, O_RDONLY);
-    if (read(fd, &header, 4) != 4) {
-        return false;
+void ExploreWindow::DrawStatsTreemap() {
+    ImGui::BeginDisabled(mTreemapNode == PathTree::ROOT);
+    if (ImGui::Button(ICON_FA_LEVEL_UP " Up")) {
+        mTreemapNode = mFileTree.GetNode(mTreemapNode).parent;
     }
-    close(fd);
-    
-#endif
-    if (((char*)&header)[0] == 'P' && ((char*)&header)[1] == 'K' && ((char*)&header)[2] == 3 && ((char*)&header)[3] == 4) {
-        rv = true;
-        mArchiveType = ArchiveType::O2R;
-    } else if (((char*)&header)[0] == 'M' && ((char*)&header)[1] == 'P' && ((char*)&header)[2] == 'Q' && ((char*)&header)[3] == 0x1A) {
-        rv = true;
-        mArchiveType = ArchiveType::OTR;
+    ImGui::EndDisabled();
+    ImGui::SameLine();
+    // Paths in the tree aren't null terminated, so the path of the directory is found from its ancestors
+    std::vector<uint32_t> ancestors;
+    for (uint32_t n = mTreemapNode; n != PathTree::ROOT; n = mFileTree.GetNode(n).parent) {
+        ancestors.push_back(n);
     }
-    else {
-        rv = false;
+    ImGui::TextUnformatted("/");
+    for (auto it = ancestors.rbegin(); it != ancestors.rend(); it++) {
+        const PathTreeNode& node = mFileTree.GetNode(*it);
+        ImGui::SameLine(0.0f, 0.0f);
+        ImGui::Text("%.*s/", (int)node.nameLen, node.name);
+    }
+    ImGui::SameLine();
+    ImGui::TextDisabled("Uncompressed sizes. Click a directory to open it.");
+
+    const uint32_t clicked = DrawTreemap("##treemap", &mFileTree, mTreemapNode, &mTreemapLayout, ImGui::GetContentRegionAvail());
+    if (clicked != PATH_TREE_NONE) {
+        mTreemapNode = clicked;
     }
-    return rv;
 }
 
-void ExploreWindow::SaveFile(char* outPath, const char* archiveFilePath) {
-    size_t uncompressedSize;
-    void* data = mArchive->ReadFile(outPath, &uncompressedSize);
+enum StatColumn {
+    StatColumnName,
+    StatColumnFiles,
+    StatColumnSize,
+    StatColumnStored,
+    StatColumnPercent,
+};
 
-    FILE* outFile = fopen(outPath, "wb+");
+static void SortStatRows(std::vector<uint32_t>* order, const std::vector<ArchiveStatGroup>& groups, int column, bool descending) {
+    // Key of `g` in `column`. Names are already sorted, so their index is their key.
+    auto key = [&](uint32_t g) -> double {
+        switch (column) {
+            case StatColumnFiles:
+                return (double)groups[g].numFiles;
+            case StatColumnSize:
+                return (double)groups[g].size;
+            case StatColumnStored:
+                return (double)groups[g].storedSize;
+            case StatColumnPercent:
+                return GetStoredPercent(&groups[g]);
+            default:
+                return (double)g;
+        }
+    };
+    std::stable_sort(order->begin(), order->end(), [&](uint32_t a, uint32_t b) {
+        return descending ? key(a) > key(b) : key(a) < key(b);
+    });
+}
 
-    fwrite(data, uncompressedSize, 1, outFile);
-    fclose(outFile);
-    free(data);
+void ExploreWindow::DrawStatGroups(const char* id, const std::vector<ArchiveStatGroup>& groups, StatRows* rows) {
+    if (rows->order.size() != groups.size()) {
+        rows->order.resize(groups.size());
+        for (uint32_t i = 0; i < groups.size(); i++) {
+            rows->order[i] = i;
+        }
+        SortStatRows(&rows->order, groups, rows->sortColumn, rows->descending);
+    }
+    const float sizeWidth = ImGui::CalcTextSize("0000.0 MiB").x;
+    const VirtualTableColumn columns[] = {
+        { "Name", 0.0f, 0 },
+        { "Files", ImGui::CalcTextSize("00000000").x, ImGuiTableColumnFlags_PreferSortDescending },
+        { "Size", sizeWidth, ImGuiTableColumnFlags_PreferSortDescending },
+        { "Stored", sizeWidth, ImGuiTableColumnFlags_PreferSortDescending | ImGuiTableColumnFlags_DefaultSort },
+        { "Stored %", ImGui::CalcTextSize("Stored %").x, ImGuiTableColumnFlags_PreferSortDescending },
+    };
+    const ImGuiTableFlags flags = ImGuiTableFlags_ScrollY | ImGuiTableFlags_Sortable | ImGuiTableFlags_RowBg;
+    DrawVirtualTable(id, columns, IM_ARRAYSIZE(columns), rows->order.size(), flags, {}, [&](size_t i) {
+        const ArchiveStatGroup& g = groups[rows->order[i]];
+        char sizeStr[16];
 
+        ImGui::TextUnformatted(g.name.c_str());
+        ImGui::TableNextColumn();
+        ImGui::Text("%llu", (unsigned long long)g.numFiles);
+        ImGui::TableNextColumn();
+        FormatFileSize(sizeStr, sizeof(sizeStr), g.size);
+        ImGui::TextUnformatted(sizeStr);
+        ImGui::TableNextColumn();
+        FormatFileSize(sizeStr, sizeof(sizeStr), g.storedSize);
+        ImGui::TextUnformatted(sizeStr);
+        ImGui::TableNextColumn();
+        ImGui::Text("%.1f%%", GetStoredPercent(&g));
+    }, [&](const ImGuiTableSortSpecs* specs) {
+        if (specs->SpecsCount == 0) {
+            return;
+        }
+        rows->sortColumn = specs->Specs[0].ColumnIndex;
+        rows->descending = specs->Specs[0].SortDirection == ImGuiSortDirection_Descending;
+        SortStatRows(&rows->order, groups, rows->sortColumn, rows->descending);
+    });
+}
+
+void ExploreWindow::DrawLargestFiles() {
+    const std::vector<uint32_t>& largest = mStats.GetLargestFiles();
+    const float sizeWidth = ImGui::CalcTextSize("0000.0 MiB").x;
+    const VirtualTableColumn columns[] = {
+        { "Path", 0.0f, 0 },
+        { "Size", sizeWidth, 0 },
+        { "Stored", sizeWidth, 0 },
+        { "Stored %", ImGui::CalcTextSize("Stored %").x, 0 },
+    };
+    DrawVirtualTable("Largest Files", columns, IM_ARRAYSIZE(columns), largest.size(), ImGuiTableFlags_ScrollY | ImGuiTableFlags_RowBg, {}, [&](size_t i) {
+        const uint32_t fileIndex = largest[i];
+        const uint64_t size = fileIndex < mArchive->fileSizes.size() ? mArchive->fileSizes[fileIndex] : 0;
+        const uint64_t storedSize = fileIndex < mArchive->fileStoredSizes.size() ? mArchive->fileStoredSizes[fileIndex] : 0;
+        const ArchiveStatGroup file = { {}, 1, size, storedSize };
+        char sizeStr[16];
+
+        ImGui::TextUnformatted(mArchive->files[fileIndex]);
+        ImGui::TableNextColumn();
+        FormatFileSize(sizeStr, sizeof(sizeStr), size);
+        ImGui::TextUnformatted(sizeStr);
+        ImGui::TableNextColumn();
+        FormatFileSize(sizeStr, sizeof(sizeStr), storedSize);
+        ImGui::TextUnformatted(sizeStr);
+        ImGui::TableNextColumn();
+        ImGui::Text("%.1f%%", GetStoredPercent(&file));
+    });
+}
+
+bool ExploreWindow::OpenArchive() {
+    mArchive = CreateArchiveOfType(mArchiveType, mPathBuff);
+    return mArchive == nullptr || !mArchive->IsArchiveOpen();
+}
+
+bool ExploreWindow::ValidateInputFile() {
+    mArchiveType = GetArchiveTypeFromFile(mPathBuff);
+    return mArchiveType != ArchiveType::Unchecked;
+}
+
+void ExploreWindow::SaveFile(char* outPath, const char* archiveFilePath) {
+    ExtractArchiveFile(mArchive.get(), archiveFilePath, outPath);
+}
+
+// The editor is given the `PagedFile` in place of the file's data so it can be read a page at a time
+static ImU8 ReadPagedFileByte(const ImU8* data, size_t off) {
+    return ((PagedFile*)data)->ReadByte(off);
 }
 
 FileViewerWindow::FileViewerWindow(Archive* archive, const char* path) {
-    mData = archive->ReadFile(path, &mSize);
+    std::unique_ptr<ArchiveFileReader> reader = archive->OpenFileReader(path);
+    if (reader != nullptr) {
+        mFile = std::make_unique<PagedFile>(std::move(reader));
+    }
     mEditor = std::make_unique<MemoryEditor>();
+    mEditor->ReadOnly = true;
+    mEditor->ReadFn = ReadPagedFileByte;
 }
 
 FileViewerWindow::~FileViewerWindow() {
-    free(mData);
 }
 
 void FileViewerWindow::DrawWindow() {
@@ -216,7 +453,11 @@ void FileViewerWindow::DrawWindow() {
     ImGui::Begin("Memory Editor",&mIsOpen);
     
     ImGui::SetWindowFocus();
-    mEditor->DrawContents(mData, mSize);
+    if (mFile != nullptr) {
+        mEditor->DrawContents(mFile.get(), mFile->GetSize());
+    } else {
+        ImGui::TextUnformatted("Failed to open file");
+    }
     ImGui::End();
     ImGui::PopFont();
 }
@@ -7,12 +7,11 @@
 #include "zip.h"
 #include "StormLib.h"
 #include "archive.h"
-
-enum class ArchiveType : uint8_t {
-    Unchecked,
-    O2R,
-    OTR,
-};
+#include "path_tree.h"
+#include "path_search.h"
+#include "paged_file.h"
+#include "archive_stats.h"
+#include "Treemap.h"
 
 class FileViewerWindow;
 
@@ -26,11 +25,40 @@ private:
     bool OpenArchive();
     void SaveFile(char* path, const char* archiveFilePath);
     void DrawFileList();
+    void DrawFileTree();
+    void DrawSearchResults();
+    void DrawFileButtons(const char* path);
+    void DrawStats();
+    void DrawStatsTreemap();
+    void DrawLargestFiles();
+
+    // Stat groups in the order they are shown in one of the stats tables
+    typedef struct StatRows {
+        std::vector<uint32_t> order;
+        int sortColumn;
+        bool descending;
+    } StatRows;
+    void DrawStatGroups(const char* id, const std::vector<ArchiveStatGroup>& groups, StatRows* rows);
 
     std::vector<const char*> mArchiveFiles;
+    PathTree mFileTree;
+    PathTreeView mFileTreeView;
     std::unique_ptr<char[]> mArchiveErrStr;
     char* mPathBuff;
     std::unique_ptr<Archive> mArchive;
+    // Declared after `mArchive` so indexing is stopped before the archive's paths are freed
+    PathSearchIndex mSearchIndex;
+    std::vector<uint32_t> mSearchResults;
+    char mSearchBuf[256] = {};
+    // The query changed while the index was still being built
+    bool mSearchPending = false;
+    // Also declared after `mArchive` for the same reason
+    ArchiveStats mStats;
+    StatRows mDirRows = {};
+    StatRows mExtRows = {};
+    TreemapLayout mTreemapLayout = {};
+    uint32_t mTreemapNode = PathTree::ROOT;
+    bool mShowStats = false;
     //union {
     //    zip_t* zipArchive = nullptr;
     //    HANDLE mpqArchive;
@@ -52,8 +80,8 @@ public:
     void DrawWindow();
     bool mIsOpen = true;
 private:
-    void* mData;
-    size_t mSize;
+    // Null if the file couldn't be opened
+    std::unique_ptr<PagedFile> mFile;
     std::unique_ptr<MemoryEditor> mEditor;
 
 };
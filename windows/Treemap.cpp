@@ -0,0 +1,170 @@
+#include "Treemap.h"
+
+#include <algorithm>
+
+// Rectangles smaller than this aren't drawn, there are usually lots of them and they can't be told apart anyway
+static constexpr float MIN_DRAWN_SIZE = 2.0f;
+static constexpr ImU32 DIR_COLOR = IM_COL32(70, 100, 150, 255);
+static constexpr ImU32 BORDER_COLOR = IM_COL32(20, 20, 24, 255);
+static constexpr ImU32 HOVER_COLOR = IM_COL32(255, 255, 255, 200);
+
+// Worst aspect ratio of a row of rectangles with a total area of `sum` laid along a side of length `side`
+static float GetWorstRatio(float sum, float minArea, float maxArea, float side) {
+    const float side2 = side * side;
+    const float sum2 = sum * sum;
+    return std::max(side2 * maxArea / sum2, sum2 / (side2 * minArea));
+}
+
+// Squarified treemap. Rows of the largest remaining items are laid along the shorter side of the space that is left,
+// and a row stops taking items once the next one would make its worst aspect ratio worse.
+static void LayoutTreemap(const PathTree* tree, uint32_t node, ImVec2 size, std::vector<TreemapRect>* out) {
+    out->clear();
+    const PathTreeNode& parent = tree->GetNode(node);
+    const uint32_t* children = tree->GetChildren(node);
+    std::vector<uint32_t> items;
+    items.reserve(parent.numChildren);
+    for (uint32_t i = 0; i < parent.numChildren; i++) {
+        if (tree->GetNode(children[i]).size != 0) {
+            items.push_back(children[i]);
+        }
+    }
+    if (items.empty() || parent.size == 0) {
+        return;
+    }
+    std::sort(items.begin(), items.end(), [tree](uint32_t a, uint32_t b) {
+        return tree->GetNode(a).size > tree->GetNode(b).size;
+    });
+
+    const double areaPerByte = (double)size.x * size.y / parent.size;
+    auto areaOf = [&](uint32_t n) {
+        return (float)(tree->GetNode(n).size * areaPerByte);
+    };
+    ImVec2 pos = { 0.0f, 0.0f };
+    ImVec2 left = size;
+    size_t i = 0;
+    while (i < items.size() && left.x > 0.0f && left.y > 0.0f) {
+        const float side = std::min(left.x, left.y);
+        size_t end = i + 1;
+        float sum = areaOf(items[i]);
+        // Sorted largest first, so the first item is the largest in the row and the last is the smallest
+        const float maxArea = sum;
+        float worst = GetWorstRatio(sum, sum, maxArea, side);
+        while (end < items.size()) {
+            const float area = areaOf(items[end]);
+            const float next = GetWorstRatio(sum + area, area, maxArea, side);
+            if (next > worst) {
+                break;
+            }
+            worst = next;
+            sum += area;
+            end++;
+        }
+
+        const float thickness = sum / side;
+        float offset = 0.0f;
+        for (size_t j = i; j < end; j++) {
+            const float length = areaOf(items[j]) / thickness;
+            TreemapRect r;
+            if (left.x >= left.y) {
+                r.min = { pos.x, pos.y + offset };
+                r.max = { pos.x + thickness, pos.y + offset + length };
+            } else {
+                r.min = { pos.x + offset, pos.y };
+                r.max = { pos.x + offset + length, pos.y + thickness };
+            }
+            r.node = items[j];
+            out->push_back(r);
+            offset += length;
+        }
+        if (left.x >= left.y) {
+            pos.x += thickness;
+            left.x -= thickness;
+        } else {
+            pos.y += thickness;
+            left.y -= thickness;
+        }
+        i = end;
+    }
+}
+
+// Files get a color from their extension so the same kind of file looks the same everywhere
+static ImU32 GetFileColor(const PathTreeNode& node) {
+    const char* end = node.name + node.nameLen;
+    const char* ext = end;
+    while (ext > node.name && ext[-1] != '.') {
+        ext--;
+    }
+    if (ext == node.name) {
+        ext = end;
+    }
+    uint32_t hash = 2166136261u;
+    for (const char* c = ext; c < end; c++) {
+        hash = (hash ^ (uint8_t)*c) * 16777619u;
+    }
+    float r;
+    float g;
+    float b;
+    ImGui::ColorConvertHSVtoRGB((hash % 360) / 360.0f, 0.45f, 0.75f, r, g, b);
+    return ImGui::ColorConvertFloat4ToU32({ r, g, b, 1.0f });
+}
+
+uint32_t DrawTreemap(const char* id, const PathTree* tree, uint32_t node, TreemapLayout* layout, ImVec2 size) {
+    size.x = std::max(size.x, 1.0f);
+    size.y = std::max(size.y, 1.0f);
+    if (layout->tree != tree || layout->node != node || layout->size.x != size.x || layout->size.y != size.y) {
+        layout->tree = tree;
+        layout->node = node;
+        layout->size = size;
+        LayoutTreemap(tree, node, size, &layout->rects);
+    }
+
+    ImGui::InvisibleButton(id, size);
+    const bool clicked = ImGui::IsItemClicked(ImGuiMouseButton_Left);
+    const bool hovered = ImGui::IsItemHovered();
+    const ImVec2 origin = ImGui::GetItemRectMin();
+    const ImVec2 mouse = ImGui::GetIO().MousePos;
+    ImDrawList* drawList = ImGui::GetWindowDrawList();
+    const float lineHeight = ImGui::GetTextLineHeight();
+    const TreemapRect* hoveredRect = nullptr;
+
+    drawList->PushClipRect(origin, { origin.x + size.x, origin.y + size.y }, true);
+    for (const TreemapRect& r : layout->rects) {
+        const ImVec2 min = { origin.x + r.min.x, origin.y + r.min.y };
+        const ImVec2 max = { origin.x + r.max.x, origin.y + r.max.y };
+        if (hovered && mouse.x >= min.x && mouse.x < max.x && mouse.y >= min.y && mouse.y < max.y) {
+            hoveredRect = &r;
+        }
+        if (max.x - min.x < MIN_DRAWN_SIZE || max.y - min.y < MIN_DRAWN_SIZE) {
+            continue;
+        }
+        const PathTreeNode& child = tree->GetNode(r.node);
+        drawList->AddRectFilled(min, max, tree->IsDir(r.node) ? DIR_COLOR : GetFileColor(child));
+        drawList->AddRect(min, max, BORDER_COLOR);
+        if (max.y - min.y > lineHeight && max.x - min.x > lineHeight * 2.0f) {
+            const ImVec4 clip = { min.x, min.y, max.x - 2.0f, max.y };
+            drawList->AddText(nullptr, 0.0f, { min.x + 3.0f, min.y + 1.0f }, IM_COL32_WHITE, child.name, child.name + child.nameLen,
+                              0.0f, &clip);
+        }
+    }
+    drawList->PopClipRect();
+
+    uint32_t clickedDir = PATH_TREE_NONE;
+    if (hoveredRect != nullptr) {
+        const PathTreeNode& child = tree->GetNode(hoveredRect->node);
+        drawList->AddRect({ origin.x + hoveredRect->min.x, origin.y + hoveredRect->min.y },
+                          { origin.x + hoveredRect->max.x, origin.y + hoveredRect->max.y }, HOVER_COLOR, 0.0f, 0, 2.0f);
+        if (ImGui::BeginTooltip()) {
+            ImGui::Text("%.*s", (int)child.nameLen, child.name);
+            ImGui::Text("%.2f MiB, %.1f%% of this directory", child.size / (1024.0 * 1024.0),
+                        100.0 * child.size / tree->GetNode(node).size);
+            if (tree->IsDir(hoveredRect->node)) {
+                ImGui::Text("%u files. Click to open.", child.numFiles);
+            }
+            ImGui::EndTooltip();
+        }
+        if (clicked && tree->IsDir(hoveredRect->node)) {
+            clickedDir = hoveredRect->node;
+        }
+    }
+    return clickedDir;
+}
@@ -0,0 +1,27 @@
+#ifndef TREEMAP_H
+#define TREEMAP_H
+
+#include <cstdint>
+#include <vector>
+#include "imgui.h"
+#include "path_tree.h"
+
+typedef struct TreemapRect {
+    ImVec2 min;
+    ImVec2 max;
+    uint32_t node;
+} TreemapRect;
+
+// Rectangles of the last directory drawn by `DrawTreemap`. Only recomputed when the directory or the size changes.
+typedef struct TreemapLayout {
+    const PathTree* tree;
+    uint32_t node;
+    ImVec2 size;
+    std::vector<TreemapRect> rects;
+} TreemapLayout;
+
+// Draws the children of `node` as rectangles with areas proportional to their sizes, laid out so they are as close to
+// square as they can be. Returns the directory that was clicked, or `PATH_TREE_NONE`.
+uint32_t DrawTreemap(const char* id, const PathTree* tree, uint32_t node, TreemapLayout* layout, ImVec2 size);
+
+#endif
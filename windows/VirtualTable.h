@@ -0,0 +1,108 @@
+#ifndef VIRTUAL_TABLE_H
+#define VIRTUAL_TABLE_H
+
+#include <cstddef>
+#include "imgui.h"
+
+// Helpers for drawing long lists. Only the rows that are on screen are submitted to ImGui so the cost of a frame
+// depends on the size of the window, not on the number of rows.
+
+typedef struct VirtualTableColumn {
+    // Header text. If no column has a label the header row isn't drawn.
+    const char* label;
+    // 0 stretches the column to fill the remaining space
+    float width;
+    // Added to the flags the column is set up with, like `ImGuiTableColumnFlags_PreferSortDescending`
+    ImGuiTableColumnFlags flags;
+} VirtualTableColumn;
+
+// Widest label of a list, measured once per row instead of every frame. Rows are measured in batches so adding a huge
+// list doesn't stall a single frame, the width just grows over the next few frames.
+class TextWidthCache {
+public:
+    // Measures rows that haven't been measured yet. `getText(i)` returns the label of row `i`.
+    // Rows are only ever appended. Call `Clear` if they are removed or reordered.
+    template <typename F>
+    float Update(size_t numRows, F getText) {
+        const float fontSize = ImGui::GetFontSize();
+        if (fontSize != mFontSize || numRows < mNumMeasured) {
+            Clear();
+            mFontSize = fontSize;
+        }
+        const size_t end = numRows - mNumMeasured > BATCH_SIZE ? mNumMeasured + BATCH_SIZE : numRows;
+        for (size_t i = mNumMeasured; i < end; i++) {
+            const float width = ImGui::CalcTextSize(getText(i)).x;
+            if (width > mMaxWidth) {
+                mMaxWidth = width;
+            }
+        }
+        mNumMeasured = end;
+        return mMaxWidth;
+    }
+
+    void Clear() {
+        mNumMeasured = 0;
+        mMaxWidth = 0.0f;
+    }
+
+    float GetMaxWidth() const {
+        return mMaxWidth;
+    }
+private:
+    static constexpr size_t BATCH_SIZE = 4096;
+    size_t mNumMeasured = 0;
+    float mMaxWidth = 0.0f;
+    float mFontSize = 0.0f;
+};
+
+// Draws `numRows` rows in a table using `ImGuiListClipper`. `drawRow(row)` is called for each visible row with the
+// first column already selected and the row index pushed as the ID, so widgets in a row can use constant labels like
+// "##start". Every row must be the same height.
+// Pass `ImGuiTableFlags_ScrollY` and a size to have the table scroll on its own with the header row frozen, otherwise
+// it is clipped against the window it is drawn in.
+// With `ImGuiTableFlags_Sortable`, `sortRows(specs)` is called before any rows are drawn whenever the sort order
+// changes, including the first frame. It has to reorder the rows itself.
+template <typename F, typename S>
+void DrawVirtualTable(const char* id, const VirtualTableColumn* columns, int numColumns, size_t numRows, ImGuiTableFlags flags,
+                      ImVec2 size, F drawRow, S sortRows) {
+    if (!ImGui::BeginTable(id, numColumns, flags, size)) {
+        return;
+    }
+    bool hasHeaders = false;
+    for (int i = 0; i < numColumns; i++) {
+        const ImGuiTableColumnFlags columnFlags =
+            columns[i].flags | (columns[i].width > 0.0f ? ImGuiTableColumnFlags_WidthFixed : ImGuiTableColumnFlags_WidthStretch);
+        ImGui::TableSetupColumn(columns[i].label, columnFlags, columns[i].width);
+        hasHeaders |= columns[i].label != nullptr;
+    }
+    if (hasHeaders) {
+        ImGui::TableSetupScrollFreeze(0, 1);
+        ImGui::TableHeadersRow();
+    }
+    ImGuiTableSortSpecs* sortSpecs = ImGui::TableGetSortSpecs();
+    if (sortSpecs != nullptr && sortSpecs->SpecsDirty) {
+        sortRows((const ImGuiTableSortSpecs*)sortSpecs);
+        sortSpecs->SpecsDirty = false;
+    }
+
+    ImGuiListClipper clipper;
+    clipper.Begin((int)numRows);
+    while (clipper.Step()) {
+        for (int row = clipper.DisplayStart; row < clipper.DisplayEnd; row++) {
+            ImGui::TableNextRow();
+            ImGui::TableSetColumnIndex(0);
+            ImGui::PushID(row);
+            drawRow((size_t)row);
+            ImGui::PopID();
+        }
+    }
+    ImGui::EndTable();
+}
+
+template <typename F>
+void DrawVirtualTable(const char* id, const VirtualTableColumn* columns, int numColumns, size_t numRows, ImGuiTableFlags flags,
+                      ImVec2 size, F drawRow) {
+    DrawVirtualTable(id, columns, numColumns, numRows, flags, size, drawRow, [](const ImGuiTableSortSpecs*) {});
+}
+
+#endif
@@ -0,0 +1,126 @@
+#include "WaveformView.h"
+#include "peak_pyramid.h"
+
+#include <algorithm>
+#include <cmath>
+
+// How close to a marker, in pixels, a click has to be to grab it
+static constexpr float GRAB_DISTANCE = 6.0f;
+// How far, in pixels, a dragged marker looks for a zero crossing
+static constexpr float SNAP_DISTANCE = 5.0f;
+static constexpr double ZOOM_STEP = 0.8;
+
+static constexpr ImU32 BACKGROUND_COLOR = IM_COL32(20, 20, 24, 255);
+static constexpr ImU32 LOOP_COLOR = IM_COL32(60, 90, 140, 80);
+static constexpr ImU32 WAVE_COLOR = IM_COL32(110, 180, 255, 255);
+static constexpr ImU32 AXIS_COLOR = IM_COL32(80, 80, 90, 255);
+static constexpr ImU32 START_COLOR = IM_COL32(80, 220, 100, 255);
+static constexpr ImU32 END_COLOR = IM_COL32(230, 80, 80, 255);
+
+static void ClampView(WaveformView* view, double numFrames, float width) {
+    const double maxFramesPerPixel = std::max(1.0, numFrames / width);
+    view->framesPerPixel = std::clamp(view->framesPerPixel, 1.0, maxFramesPerPixel);
+    view->startFrame = std::clamp(view->startFrame, 0.0, std::max(0.0, numFrames - width * view->framesPerPixel));
+}
+
+static void DrawMarker(ImDrawList* drawList, float x, float top, float bottom, ImU32 color) {
+    drawList->AddLine({ x, top }, { x, bottom }, color, 2.0f);
+    drawList->AddTriangleFilled({ x - 5.0f, top }, { x + 5.0f, top }, { x, top + 7.0f }, color);
+}
+
+bool DrawWaveform(const char* id, const PeakPyramid* peaks, WaveformView* view, uint64_t* loopStart, uint64_t* loopEnd,
+                  ImVec2 size) {
+    ImGui::InvisibleButton(id, size, ImGuiButtonFlags_MouseButtonLeft | ImGuiButtonFlags_MouseButtonRight);
+    const ImVec2 min = ImGui::GetItemRectMin();
+    const ImVec2 max = ImGui::GetItemRectMax();
+    const float width = max.x - min.x;
+    const uint64_t numFrames = peaks->GetNumFrames();
+    if (width <= 0.0f || numFrames == 0) {
+        return false;
+    }
+    const ImGuiIO& io = ImGui::GetIO();
+
+    if (view->framesPerPixel <= 0.0) {
+        view->framesPerPixel = (double)numFrames / width;
+        view->startFrame = 0.0;
+    }
+    if (ImGui::IsItemHovered() && io.MouseWheel != 0.0f) {
+        // Keep the frame under the cursor where it is
+        const double mouseX = io.MousePos.x - min.x;
+        const double mouseFrame = view->startFrame + mouseX * view->framesPerPixel;
+        view->framesPerPixel *= std::pow(ZOOM_STEP, io.MouseWheel);
+        ClampView(view, (double)numFrames, width);
+        view->startFrame = mouseFrame - mouseX * view->framesPerPixel;
+    }
+    if (ImGui::IsItemActive() && ImGui::IsMouseDragging(ImGuiMouseButton_Right, 0.0f)) {
+        view->startFrame -= io.MouseDelta.x * view->framesPerPixel;
+    }
+    ClampView(view, (double)numFrames, width);
+
+    auto frameToX = [&](uint64_t frame) {
+        return min.x + (float)(((double)frame - view->startFrame) / view->framesPerPixel);
+    };
+    auto mouseToFrame = [&]() {
+        const double frame = view->startFrame + (io.MousePos.x - min.x) * view->framesPerPixel;
+        return (uint64_t)std::clamp(frame, 0.0, (double)numFrames);
+    };
+
+    const float startX = frameToX(*loopStart);
+    const float endX = frameToX(*loopEnd);
+    const bool nearStart = std::fabs(io.MousePos.x - startX) <= GRAB_DISTANCE;
+    const bool nearEnd = std::fabs(io.MousePos.x - endX) <= GRAB_DISTANCE;
+    if (ImGui::IsItemActivated() && ImGui::IsMouseClicked(ImGuiMouseButton_Left)) {
+        if (nearStart || nearEnd) {
+            // Prefer the closer one when both are in reach
+            view->dragging = (nearStart && (!nearEnd || std::fabs(io.MousePos.x - startX) < std::fabs(io.MousePos.x - endX))) ? 1 : 2;
+        }
+    }
+    if (!ImGui::IsItemActive()) {
+        view->dragging = 0;
+    }
+    if (ImGui::IsItemHovered() && (nearStart || nearEnd || view->dragging != 0)) {
+        ImGui::SetMouseCursor(ImGuiMouseCursor_ResizeEW);
+    }
+
+    bool changed = false;
+    if (view->dragging != 0) {
+        uint64_t frame = mouseToFrame();
+        if (!io.KeyAlt) {
+            frame = peaks->FindZeroCrossing(frame, (uint64_t)(SNAP_DISTANCE * view->framesPerPixel));
+        }
+        uint64_t* point = view->dragging == 1 ? loopStart : loopEnd;
+        if (view->dragging == 1) {
+            frame = std::min(frame, *loopEnd > 0 ? *loopEnd - 1 : 0);
+        } else {
+            frame = std::clamp<uint64_t>(frame, *loopStart + 1, numFrames);
+        }
+        changed = *point != frame;
+        *point = frame;
+    }
+
+    ImDrawList* drawList = ImGui::GetWindowDrawList();
+    const float midY = (min.y + max.y) * 0.5f;
+    const float halfHeight = (max.y - min.y) * 0.5f;
+    drawList->PushClipRect(min, max, true);
+    drawList->AddRectFilled(min, max, BACKGROUND_COLOR);
+    drawList->AddRectFilled({ frameToX(*loopStart), min.y }, { frameToX(*loopEnd), max.y }, LOOP_COLOR);
+    drawList->AddLine({ min.x, midY }, { max.x, midY }, AXIS_COLOR);
+    for (float x = 0.0f; x < width; x += 1.0f) {
+        const double first = view->startFrame + x * view->framesPerPixel;
+        const uint64_t start = (uint64_t)first;
+        const uint64_t end = (uint64_t)(first + view->framesPerPixel);
+        if (start >= numFrames) {
+            break;
+        }
+        float lo;
+        float hi;
+        peaks->GetRange(start, end, &lo, &hi);
+        // At least a pixel tall so silence still shows up
+        drawList->AddLine({ min.x + x + 0.5f, midY - hi * halfHeight }, { min.x + x + 0.5f, midY - lo * halfHeight + 1.0f }, WAVE_COLOR);
+    }
+    DrawMarker(drawList, frameToX(*loopStart), min.y, max.y, START_COLOR);
+    DrawMarker(drawList, frameToX(*loopEnd), min.y, max.y, END_COLOR);
+    drawList->PopClipRect();
+
+    return changed;
+}
@@ -0,0 +1,25 @@
+#ifndef WAVEFORM_VIEW_H
+#define WAVEFORM_VIEW_H
+
+#include <cstdint>
+#include "imgui.h"
+
+class PeakPyramid;
+
+// Zoom and scroll position of a waveform. Zero initialize it to show the whole file.
+typedef struct WaveformView {
+    double startFrame;
+    // 0 until the first draw, which fits the whole file in the view
+    double framesPerPixel;
+    // Loop marker being dragged. 0 for none, 1 for the start, 2 for the end.
+    int dragging;
+} WaveformView;
+
+// Draws `peaks` with the loop between `loopStart` and `loopEnd` highlighted. The mouse wheel zooms around the cursor,
+// dragging with the right button scrolls and the loop markers can be dragged with the left button. Markers snap to the
+// nearest zero crossing unless Alt is held. Every pixel reads a few pairs from the pyramid so the cost only depends on
+// `size`. Returns true if a loop point was moved.
+bool DrawWaveform(const char* id, const PeakPyramid* peaks, WaveformView* view, uint64_t* loopStart, uint64_t* loopEnd,
+                  ImVec2 size);
+
+#endif